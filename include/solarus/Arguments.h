@@ -18,6 +18,7 @@
 #define SOLARUS_ARGUMENTS_H
 
 #include "solarus/Common.h"
+#include <cstddef>
 #include <string>
 #include <vector>
 
@@ -41,6 +42,7 @@ class SOLARUS_API Arguments {
     const std::vector<std::string>& get_arguments() const;
     bool has_argument(const std::string& option) const;
     std::string get_argument_value(const std::string& key) const;
+    size_t get_argument_size(const std::string& key, size_t default_value) const;
 
     void add_argument(const std::string& argument);
     void add_argument(const std::string& key, const std::string& value);
@@ -37,6 +37,7 @@ class KeysEffect;
 class LuaContext;
 class MainLoop;
 class Map;
+class MapCache;
 class Savegame;
 
 /**
@@ -50,6 +51,7 @@ class SOLARUS_API Game {
 
     // creation
     Game(MainLoop& main_loop, const std::shared_ptr<Savegame>& savegame);
+    ~Game();
 
     // no copy operations
     Game(const Game& game) = delete;
@@ -75,6 +77,7 @@ class SOLARUS_API Game {
     bool notify_input(const InputEvent& event);
     void update();
     void draw(const SurfacePtr& dst_surface);
+    void notify_idle(uint32_t deadline);
 
     // game controls
     void notify_command_pressed(GameCommand command);
@@ -87,6 +90,7 @@ class SOLARUS_API Game {
     // map
     bool has_current_map() const;
     Map& get_current_map();
+    MapCache& get_map_cache();
     void set_current_map(const std::string& map_id, const std::string& destination_name,
         Transition::Style transition_style);
 
@@ -145,6 +149,8 @@ class SOLARUS_API Game {
                                 * (represented on the HUD by the action icon, the objects icons, etc.) */
 
     // map
+    std::unique_ptr<MapCache>
+        map_cache;             /**< recently visited and prefetched maps */
     std::shared_ptr<Map>
         current_map;           /**< the map currently displayed */
     std::shared_ptr<Map>
@@ -42,6 +42,7 @@ class SOLARUS_API MainLoop {
 
     void run();
     void step();
+    void draw();
 
     void set_exiting();
     bool is_exiting();
@@ -57,7 +58,6 @@ class SOLARUS_API MainLoop {
     void load_quest_properties();
     void check_input();
     void notify_input(const InputEvent& event);
-    void draw();
     void update();
 
     std::unique_ptr<LuaContext>
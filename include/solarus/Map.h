@@ -29,6 +29,7 @@
 #include "solarus/Transition.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace Solarus {
 
@@ -36,6 +37,7 @@ class Destination;
 class Detector;
 class InputEvent;
 class LuaContext;
+class MapEntity;
 class MapEntities;
 class MapLoader;
 class Tileset;
@@ -163,6 +165,7 @@ class SOLARUS_API Map: public ExportableToLua {
     bool is_suspended() const;
     void check_suspended();
     void draw();
+    void notify_idle(uint32_t deadline);
     void draw_sprite(Sprite& sprite, const Point& xy);
     void draw_sprite(Sprite& sprite, int x, int y);
     void draw_sprite(Sprite& sprite, int x, int y,
@@ -189,9 +192,10 @@ class SOLARUS_API Map: public ExportableToLua {
     int height8;                  /**< Map height in 8x8 squares (height8 = get_height() / 8). */
 
     std::string tileset_id;       /**< Id of the current tileset. */
-    std::unique_ptr<Tileset>
+    std::shared_ptr<Tileset>
         tileset;                  /**< Tileset of the map: every tile of this map
-                                   * is extracted from this tileset. */
+                                   * is extracted from this tileset.
+                                   * Other maps may share it. */
 
     std::string music_id;         /**< Id of the current music of the map:
                                    * can be a valid music, Music::none or Music::unchanged. */
@@ -228,6 +232,12 @@ class SOLARUS_API Map: public ExportableToLua {
 
     std::unique_ptr<MapEntities>
         entities;                 /**< The entities on the map. */
+    mutable std::vector<MapEntity*>
+        obstacle_candidates;      /**< Buffer reused by obstacle queries to avoid allocations. */
+    std::vector<Detector*>
+        detector_candidates;      /**< Buffer reused by detector queries to avoid allocations. */
+    std::vector<MapEntity*>
+        detected_candidates;      /**< Buffer reused by queries from a detector to avoid allocations. */
     bool suspended;               /**< Whether the game is suspended. */
 };
 
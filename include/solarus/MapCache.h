@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_MAP_CACHE_H
+#define SOLARUS_MAP_CACHE_H
+
+#include "solarus/Common.h"
+#include "solarus/lowlevel/Debug.h"
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SDL_Surface;
+
+namespace Solarus {
+
+class MapData;
+class Tileset;
+class TilesetData;
+
+/**
+ * \brief Keeps the data of recently visited maps and their tilesets.
+ *
+ * Maps reachable through the teletransporters of the current map are
+ * also parsed in advance by a background thread, so that changing maps
+ * only has to create the entities.
+ * The background thread also parses the tilesets of these maps and
+ * decodes their images.
+ * The main thread reads the files (the quest files API is not
+ * thread-safe) and creates the tilesets from the results.
+ * Only a few tilesets are kept: the least recently used ones are freed
+ * when no map uses them anymore.
+ */
+class MapCache {
+
+  public:
+
+    MapCache();
+    ~MapCache();
+
+    MapCache(const MapCache& other) = delete;
+    MapCache& operator=(const MapCache& other) = delete;
+
+    std::shared_ptr<const MapData> get_map_data(const std::string& map_id);
+    void add_map(const std::string& map_id, const std::shared_ptr<const MapData>& data);
+    std::shared_ptr<Tileset> get_tileset(const std::string& tileset_id);
+    void notify_tileset_modified(const Tileset& tileset);
+
+    void prefetch_destinations(const std::string& map_id, const MapData& data);
+    void update();
+
+    int get_num_hits() const;
+    int get_num_misses() const;
+
+  private:
+
+    /**
+     * \brief A map file read by the main thread, to be parsed by the worker.
+     */
+    struct MapToParse {
+      std::string map_id;                         /**< Id of the map. */
+      std::string buffer;                         /**< Content of its data file. */
+      std::string compiled_buffer;                /**< Content of its compiled data file, if any. */
+      std::shared_ptr<MapData> data;              /**< Parsed data, or nullptr on error. */
+    };
+
+    /**
+     * \brief A tileset read by the main thread, to be parsed by the worker.
+     */
+    struct TilesetToParse {
+      std::string tileset_id;                     /**< Id of the tileset. */
+      std::string buffer;                         /**< Content of its data file. */
+      std::string tiles_image_buffer;             /**< Content of its tiles image,
+                                                   * empty if it is already decoded. */
+      std::string entities_image_buffer;          /**< Content of its entities image,
+                                                   * empty if it is already decoded. */
+      std::shared_ptr<TilesetData> data;          /**< Parsed data, or nullptr on error. */
+      std::shared_ptr<SDL_Surface> tiles_image;   /**< Decoded tiles image, if any. */
+      std::shared_ptr<SDL_Surface> entities_image;  /**< Decoded entities image, if any. */
+      std::vector<Debug::DeferredMessage>
+          messages;                               /**< Errors and warnings of the worker. */
+    };
+
+    void touch_map(const std::string& map_id);
+    void install_parsed_maps();
+    void wait_for_map(const std::string& map_id);
+    void touch_tileset(const std::string& tileset_id);
+    void add_tileset(const std::string& tileset_id, const std::shared_ptr<Tileset>& tileset);
+    void prefetch_tileset(const std::string& tileset_id);
+    void install_parsed_tilesets();
+    void wait_for_tileset(const std::string& tileset_id);
+    void start_worker();
+    void run_worker();
+
+    static constexpr size_t max_maps = 16;        /**< Number of maps kept. */
+    static constexpr size_t max_tilesets = 4;     /**< Number of tilesets kept,
+                                                   * unless more are used by maps. */
+
+    std::map<std::string, std::shared_ptr<const MapData>>
+        maps;                                     /**< Parsed maps by id. */
+    std::list<std::string> recent_maps;           /**< Ids of cached maps, most recent first. */
+    std::map<std::string, std::shared_ptr<Tileset>>
+        tilesets;                                 /**< Loaded tilesets by id. */
+    std::list<std::string> recent_tilesets;       /**< Ids of cached tilesets, most recent first. */
+    std::deque<std::string> maps_to_read;         /**< Maps to prefetch, not read yet. */
+    std::set<std::string> maps_prefetching;       /**< Maps queued or being parsed. */
+    std::vector<std::string> destination_maps;    /**< Prefetched maps whose tileset
+                                                   * is not prefetched yet. */
+    std::set<std::string> destination_tilesets;   /**< Tilesets prefetched for the
+                                                   * destinations of the current map. */
+    std::set<std::string> tilesets_prefetching;   /**< Tilesets queued or being parsed. */
+    int num_hits;                                 /**< Maps and tilesets found in the cache. */
+    int num_misses;                               /**< Maps and tilesets loaded on demand. */
+
+    std::thread worker;                           /**< Thread that parses the prefetched maps. */
+    std::mutex mutex;                             /**< Protects the fields below. */
+    std::condition_variable maps_changed;         /**< Signals new work or new results. */
+    std::deque<MapToParse> maps_to_parse;         /**< Maps waiting for the worker. */
+    std::deque<MapToParse> parsed_maps;           /**< Results of the worker. */
+    std::string parsing_map_id;                   /**< Map being parsed by the worker, if any. */
+    std::deque<TilesetToParse> tilesets_to_parse; /**< Tilesets waiting for the worker. */
+    std::deque<TilesetToParse> parsed_tilesets;   /**< Results of the worker. */
+    std::string parsing_tileset_id;               /**< Tileset being parsed by the worker, if any. */
+    bool stopping;                                /**< Asks the worker to stop. */
+
+};
+
+}
+
+#endif
+
@@ -181,6 +181,8 @@ class SOLARUS_API MapData : public LuaData {
 
     virtual bool import_from_lua(lua_State* l) override;
     virtual bool export_to_lua(std::ostream& out) const override;
+    virtual bool import_from_binary(BinaryReader& reader) override;
+    virtual bool export_to_binary(BinaryWriter& writer) const override;
 
     static constexpr int NO_FLOOR = -9999;  /**< Represents a non-existent floor (nil in Lua data files). */
 
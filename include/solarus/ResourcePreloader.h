@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_RESOURCE_PRELOADER_H
+#define SOLARUS_RESOURCE_PRELOADER_H
+
+#include "solarus/Common.h"
+
+namespace Solarus {
+
+class Arguments;
+
+/**
+ * \brief Loads the resources of the quest in advance, in the background.
+ *
+ * Resource files are read by the main thread, a few of them at each cycle,
+ * and decoded in parallel by worker threads: map and sprite data files,
+ * images of tilesets and sprites, and sounds.
+ * The results are then installed by the main thread: sprite animation sets
+ * are created with their textures, sounds get their OpenAL buffer and
+ * images are stored in the image cache until a surface needs them.
+ *
+ * Dependencies are discovered along the way: a map brings its tileset
+ * images, a sprite brings its source images.
+ * The preloading stops early when the decoded images and sounds exceed
+ * a memory budget (option -preload-size).
+ */
+namespace ResourcePreloader {
+
+void SOLARUS_API initialize(const Arguments& args);
+void SOLARUS_API start();
+void SOLARUS_API quit();
+void SOLARUS_API update();
+
+bool SOLARUS_API is_started();
+bool SOLARUS_API is_finished();
+int SOLARUS_API get_num_loaded();
+int SOLARUS_API get_num_total();
+
+}
+
+}
+
+#endif
+
@@ -29,6 +29,7 @@ class LuaContext;
 class Size;
 class SpriteAnimation;
 class SpriteAnimationSet;
+class SpriteData;
 class Tileset;
 
 /**
@@ -51,6 +52,7 @@ class Sprite: public Drawable {
     // initialization
     static void initialize();
     static void quit();
+    static void preload_animation_set(const std::string& id, const SpriteData& data);
 
     // creation and destruction
     Sprite(const std::string& id);
@@ -28,6 +28,7 @@ namespace Solarus {
 
 class SpriteAnimation;
 class SpriteAnimationData;
+class SpriteData;
 class Tileset;
 
 /**
@@ -43,6 +44,7 @@ class SpriteAnimationSet {
   public:
 
     SpriteAnimationSet(const std::string& id);
+    SpriteAnimationSet(const std::string& id, const SpriteData& data);
 
     void set_tileset(Tileset& tileset);
 
@@ -58,6 +60,7 @@ class SpriteAnimationSet {
   private:
 
     void load();
+    void load(const SpriteData& data);
 
     void add_animation(const std::string& animation_name,
         const SpriteAnimationData& animation_data);
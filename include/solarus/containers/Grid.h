@@ -19,9 +19,12 @@
 
 #include "solarus/Common.h"
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Point.h"
 #include "solarus/lowlevel/Rectangle.h"
 #include "solarus/lowlevel/Size.h"
-#include <set>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
 #include <vector>
 
 namespace Solarus {
@@ -29,7 +32,23 @@ namespace Solarus {
 /**
  * \brief A collection of objects spatially located in a grid.
  *
- * In the current implementation, objects cannot move or be resized.
+ * Each object is stored in all cells its bounding box overlaps.
+ * Objects can be added, moved, resized and removed at any time:
+ * the grid remembers the cells of each object so that these operations
+ * only touch the cells involved.
+ *
+ * Parts of objects or of query rectangles that are outside the grid are
+ * considered to be in the nearest border cells.
+ * This means that objects outside the grid are still found by queries.
+ *
+ * Each object has an order number: by default, the order in which objects
+ * were added to the grid, or an order given by the caller.
+ * Cells are kept sorted by this order, and queries return objects in this
+ * order too, whatever the cells they come from.
+ *
+ * T must be a pointer-like type that can be hashed with std::hash.
+ * The functions that do not take a rectangle use
+ * element->get_bounding_box().
  */
 template <typename T>
 class Grid {
@@ -43,9 +62,17 @@ class Grid {
     size_t get_num_rows() const;
     size_t get_num_columns() const;
     size_t get_num_cells() const;
+    size_t get_num_elements() const;
+    size_t get_cell_index(const Point& xy) const;
 
     void clear();
-    void add(const T& element);
+    bool has_element(const T& element) const;
+    bool add(const T& element);
+    bool add(const T& element, const Rectangle& bounding_box);
+    bool add(const T& element, const Rectangle& bounding_box, uint32_t order);
+    bool move(const T& element);
+    bool move(const T& element, const Rectangle& bounding_box);
+    bool remove(const T& element);
 
     const std::vector<T>& get_elements(size_t cell_index) const;
     void get_elements(const Rectangle& where,
@@ -53,11 +80,70 @@ class Grid {
 
   private:
 
+    /**
+     * \brief A range of cells, in cell units (last row and column included).
+     */
+    struct CellRange {
+      size_t row1;
+      size_t row2;
+      size_t column1;
+      size_t column2;
+
+      bool operator==(const CellRange& other) const {
+        return row1 == other.row1 && row2 == other.row2 &&
+            column1 == other.column1 && column2 == other.column2;
+      }
+    };
+
+    /**
+     * \brief Bookkeeping of an element stored in the grid.
+     */
+    struct Slot {
+      T element;                            /**< The element or an empty value if the slot is free. */
+      CellRange cells;                      /**< Cells where the element is stored. */
+      uint32_t order;                       /**< Rank of the element in cells and query results. */
+      mutable uint32_t query_stamp;         /**< Last query that returned this element. */
+    };
+
+    /**
+     * \brief Content of a cell.
+     *
+     * Both vectors are parallel: slots[i] is the slot of elements[i].
+     * They are sorted by the order of the slots.
+     */
+    struct Cell {
+      std::vector<T> elements;
+      std::vector<size_t> slots;
+    };
+
+    /**
+     * \brief Next element to return from a cell during a query.
+     */
+    struct CellCursor {
+      size_t cell_index;                    /**< Index of the cell. */
+      size_t position;                      /**< Position of the next element in this cell. */
+    };
+
+    CellRange get_cell_range(const Rectangle& where) const;
+    void add_to_cells(size_t slot_index);
+    void remove_from_cells(size_t slot_index);
+
     const Size grid_size;
     const Size cell_size;
     size_t num_rows;
     size_t num_columns;
-    std::vector<std::vector<T>> elements;     /**< Two-dimensional array of cells. */
+    std::vector<Cell> cells;                  /**< Two-dimensional array of cells. */
+    std::vector<Slot> slots;                  /**< Bookkeeping of each element stored. */
+    std::vector<size_t> free_slots;           /**< Indexes of unused slots in the slots vector. */
+    std::unordered_map<T, size_t>
+        slot_indexes;                         /**< Slot of each element stored. */
+    uint32_t next_order;                      /**< Order of the next element added
+                                               * without an explicit order. */
+    mutable uint32_t query_stamp;             /**< Incremented at each rectangle query
+                                               * to detect elements already returned. */
+    mutable std::vector<CellCursor>
+        cursors;                              /**< Cells being merged by a rectangle query,
+                                               * kept to avoid allocations. */
 
 };
 
@@ -72,7 +158,9 @@ Grid<T>::Grid(const Size& grid_size, const Size& cell_size):
     grid_size(grid_size),
     cell_size(cell_size),
     num_rows(0),
-    num_columns(0) {
+    num_columns(0),
+    next_order(0),
+    query_stamp(0) {
 
   Debug::check_assertion(grid_size.width > 0 && grid_size.height > 0,
       "Invalid grid size");
@@ -88,7 +176,7 @@ Grid<T>::Grid(const Size& grid_size, const Size& cell_size):
   if (grid_size.width % cell_size.width != 0) {
     ++num_columns;
   }
-  elements.resize(num_rows * num_columns);
+  cells.resize(num_rows * num_columns);
 }
 
 /**
@@ -133,7 +221,34 @@ size_t Grid<T>::get_num_columns() const {
  */
 template <typename T>
 size_t Grid<T>::get_num_cells() const {
-  return elements.size();
+  return cells.size();
+}
+
+/**
+ * \brief Returns the number of elements in the grid.
+ *
+ * Elements that are in several cells are counted once.
+ *
+ * \return The number of elements.
+ */
+template <typename T>
+size_t Grid<T>::get_num_elements() const {
+  return slot_indexes.size();
+}
+
+/**
+ * \brief Returns the index of the cell that contains a point.
+ *
+ * Points outside the grid are considered to be in the nearest border cell.
+ *
+ * \param xy A point in grid coordinates.
+ * \return The index of the cell containing this point.
+ */
+template <typename T>
+size_t Grid<T>::get_cell_index(const Point& xy) const {
+
+  const CellRange& range = get_cell_range(Rectangle(xy, Size(1, 1)));
+  return range.row1 * num_columns + range.column1;
 }
 
 /**
@@ -147,51 +262,84 @@ const std::vector<T>& Grid<T>::get_elements(size_t cell_index) const {
   Debug::check_assertion(cell_index < get_num_cells(),
       "Invalid index");
 
-  return elements[cell_index];
+  return cells[cell_index].elements;
 }
 
 /**
- * \brief Returns all elements in the specified rectangle.
+ * \brief Returns all elements in the cells overlapped by a rectangle.
  *
  * Elements that are in several cells are returned only once.
+ * The elements returned may not overlap the rectangle themselves:
+ * only their cells do.
+ * They are returned sorted by their order, without sorting anything:
+ * the cells, already sorted, are merged.
+ *
+ * This function does not allocate memory other than by growing the
+ * output vector and a buffer reused by all queries.
  *
  * \param where The area to get.
- * \param[out] elements The vector to fill.
+ * \param[out] elements The vector to fill. Elements are appended to it.
  */
 template <typename T>
 void Grid<T>::get_elements(
     const Rectangle& where,
     std::vector<T>& elements) const {
 
-  const size_t row1 = where.get_y() / num_rows;
-  const size_t row2 = where.get_y() + where.get_height() / num_rows;
-  const size_t column1 = where.get_x() / num_columns;
-  const size_t column2 = where.get_x() + where.get_width() / num_columns;
-
-  if (row1 > row2 || column1 > column2) {
-    // No cell.
+  const CellRange& range = get_cell_range(where);
+  if (range.row1 == range.row2 && range.column1 == range.column2) {
+    // A single cell: nothing to merge.
+    const Cell& cell = cells[range.row1 * num_columns + range.column1];
+    elements.insert(elements.end(), cell.elements.begin(), cell.elements.end());
     return;
   }
 
-  std::set<T> elements_added;
-  for (size_t i = row1; i <= row2; ++i) {
-    if (i >= num_rows) {
-      continue;
+  ++query_stamp;
+  if (query_stamp == 0) {
+    // The counter has wrapped around: forget all previous stamps.
+    for (const Slot& slot: slots) {
+      slot.query_stamp = 0;
     }
+    query_stamp = 1;
+  }
 
-    for (size_t j = column1; j <= column2; ++j) {
-      if (j >= num_columns) {
-        continue;
+  cursors.clear();
+  for (size_t i = range.row1; i <= range.row2; ++i) {
+    for (size_t j = range.column1; j <= range.column2; ++j) {
+      const size_t cell_index = i * num_columns + j;
+      if (!cells[cell_index].elements.empty()) {
+        cursors.push_back({ cell_index, 0 });
       }
+    }
+  }
 
-      const std::vector<T>& in_cell = this->elements[i * num_columns + j];
-      for (const T& element: in_cell) {
-        if (elements_added.find(element) == elements_added.end()) {
-          elements_added.insert(element);
-          elements.push_back(element);
-        }
+  // Only a few cells are overlapped in practice: a linear search
+  // of the smallest order is enough.
+  while (!cursors.empty()) {
+
+    size_t best = 0;
+    uint32_t best_order = 0;
+    for (size_t k = 0; k < cursors.size(); ++k) {
+      const CellCursor& cursor = cursors[k];
+      const uint32_t order = slots[cells[cursor.cell_index].slots[cursor.position]].order;
+      if (k == 0 || order < best_order) {
+        best = k;
+        best_order = order;
       }
     }
+
+    CellCursor& cursor = cursors[best];
+    const Cell& cell = cells[cursor.cell_index];
+    const Slot& slot = slots[cell.slots[cursor.position]];
+    if (slot.query_stamp != query_stamp) {
+      slot.query_stamp = query_stamp;
+      elements.push_back(cell.elements[cursor.position]);
+    }
+
+    ++cursor.position;
+    if (cursor.position == cell.elements.size()) {
+      cursor = cursors.back();
+      cursors.pop_back();
+    }
   }
 }
 
@@ -201,43 +349,233 @@ void Grid<T>::get_elements(
 template <typename T>
 void Grid<T>::clear() {
 
-  elements.clear();
-  elements.resize(num_rows * num_columns);
+  cells.clear();
+  cells.resize(num_rows * num_columns);
+  slots.clear();
+  free_slots.clear();
+  slot_indexes.clear();
+  next_order = 0;
+}
+
+/**
+ * \brief Returns whether an element is in the grid.
+ * \param element The element to check.
+ * \return \c true if this element was added and not removed since.
+ */
+template <typename T>
+bool Grid<T>::has_element(const T& element) const {
+  return slot_indexes.find(element) != slot_indexes.end();
 }
 
 /**
  * \brief Adds an element in the grid.
  *
- * The element will be added to all cells it overlaps.
+ * The element will be added to all cells its bounding box overlaps.
+ *
+ * \param element The element to add.
+ * \return \c false if the element was already in the grid.
+ */
+template <typename T>
+bool Grid<T>::add(const T& element) {
+  return add(element, element->get_bounding_box());
+}
+
+/**
+ * \brief Adds an element in the grid with the specified bounding box.
+ *
+ * The element will be added to all cells the rectangle overlaps.
+ * It comes after all elements added before.
  *
  * \param element The element to add.
+ * \param bounding_box Where to put the element.
+ * \return \c false if the element was already in the grid.
  */
 template <typename T>
-void Grid<T>::add(const T& element) {
+bool Grid<T>::add(const T& element, const Rectangle& bounding_box) {
 
-  const Rectangle& position = element->get_bounding_box();
+  if (has_element(element)) {
+    return false;
+  }
+  return add(element, bounding_box, next_order++);
+}
 
-  const size_t row1 = position.get_y() / cell_size.height;
-  const size_t row2 = (position.get_y() + position.get_height()) / cell_size.height;
-  const size_t column1 = position.get_x() / cell_size.width;
-  const size_t column2 = (position.get_x() + position.get_width()) / cell_size.width;
+/**
+ * \brief Adds an element in the grid with the specified bounding box
+ * and order.
+ *
+ * The element will be added to all cells the rectangle overlaps.
+ * Elements with a lower order come first in cells and query results.
+ * Elements with the same order come in the order they were put in cells.
+ *
+ * \param element The element to add.
+ * \param bounding_box Where to put the element.
+ * \param order Rank of the element.
+ * \return \c false if the element was already in the grid.
+ */
+template <typename T>
+bool Grid<T>::add(const T& element, const Rectangle& bounding_box, uint32_t order) {
 
-  if (row1 > row2 || column1 > column2) {
-    // No cell.
-    return;
+  if (has_element(element)) {
+    return false;
   }
 
-  for (size_t i = row1; i <= row2; ++i) {
-    if (i >= num_rows) {
-      continue;
-    }
+  size_t slot_index = 0;
+  if (!free_slots.empty()) {
+    slot_index = free_slots.back();
+    free_slots.pop_back();
+  }
+  else {
+    slot_index = slots.size();
+    slots.emplace_back();
+  }
+
+  Slot& slot = slots[slot_index];
+  slot.element = element;
+  slot.cells = get_cell_range(bounding_box);
+  slot.order = order;
+  slot.query_stamp = 0;
+  slot_indexes[element] = slot_index;
+
+  add_to_cells(slot_index);
+  return true;
+}
+
+/**
+ * \brief Updates the cells of an element whose bounding box has changed.
+ * \param element The element to move.
+ * \return \c false if the element is not in the grid.
+ */
+template <typename T>
+bool Grid<T>::move(const T& element) {
+  return move(element, element->get_bounding_box());
+}
+
+/**
+ * \brief Updates the cells of an element with a new bounding box.
+ *
+ * Nothing is done if the element stays in the same cells, which is the
+ * most common case.
+ *
+ * \param element The element to move.
+ * \param bounding_box The new position and size of the element.
+ * \return \c false if the element is not in the grid.
+ */
+template <typename T>
+bool Grid<T>::move(const T& element, const Rectangle& bounding_box) {
+
+  const auto it = slot_indexes.find(element);
+  if (it == slot_indexes.end()) {
+    return false;
+  }
+
+  const size_t slot_index = it->second;
+  const CellRange& new_cells = get_cell_range(bounding_box);
+  if (new_cells == slots[slot_index].cells) {
+    return true;
+  }
+
+  remove_from_cells(slot_index);
+  slots[slot_index].cells = new_cells;
+  add_to_cells(slot_index);
+  return true;
+}
+
+/**
+ * \brief Removes an element from the grid.
+ * \param element The element to remove.
+ * \return \c false if the element was not in the grid.
+ */
+template <typename T>
+bool Grid<T>::remove(const T& element) {
 
-    for (size_t j = column1; j <= column2; ++j) {
-      if (j >= num_columns) {
-        continue;
+  const auto it = slot_indexes.find(element);
+  if (it == slot_indexes.end()) {
+    return false;
+  }
+
+  const size_t slot_index = it->second;
+  remove_from_cells(slot_index);
+  slot_indexes.erase(it);
+  slots[slot_index].element = T();
+  free_slots.push_back(slot_index);
+  return true;
+}
+
+/**
+ * \brief Returns the cells overlapped by a rectangle.
+ *
+ * Parts of the rectangle outside the grid are clamped to the border cells.
+ * Flat rectangles are considered to have a size of 1 pixel.
+ *
+ * \param where A rectangle in grid coordinates.
+ * \return The range of cells.
+ */
+template <typename T>
+typename Grid<T>::CellRange Grid<T>::get_cell_range(const Rectangle& where) const {
+
+  const int x1 = where.get_x();
+  const int y1 = where.get_y();
+  const int x2 = x1 + std::max(where.get_width(), 1) - 1;
+  const int y2 = y1 + std::max(where.get_height(), 1) - 1;
+  const int last_column = (int) num_columns - 1;
+  const int last_row = (int) num_rows - 1;
+
+  // Integer division rounds negative coordinates toward zero,
+  // which is fine since they are clamped to the first cell anyway.
+  CellRange range;
+  range.column1 = (size_t) std::min(std::max(x1 / cell_size.width, 0), last_column);
+  range.column2 = (size_t) std::min(std::max(x2 / cell_size.width, 0), last_column);
+  range.row1 = (size_t) std::min(std::max(y1 / cell_size.height, 0), last_row);
+  range.row2 = (size_t) std::min(std::max(y2 / cell_size.height, 0), last_row);
+  return range;
+}
+
+/**
+ * \brief Puts the element of a slot in all cells of its range.
+ *
+ * The element is inserted at the place of its order in each cell.
+ * This is usually the end of the cell.
+ *
+ * \param slot_index Index of the slot.
+ */
+template <typename T>
+void Grid<T>::add_to_cells(size_t slot_index) {
+
+  const Slot& slot = slots[slot_index];
+  const CellRange& range = slot.cells;
+  for (size_t i = range.row1; i <= range.row2; ++i) {
+    for (size_t j = range.column1; j <= range.column2; ++j) {
+      Cell& cell = cells[i * num_columns + j];
+      size_t position = cell.slots.size();
+      while (position > 0 && slots[cell.slots[position - 1]].order > slot.order) {
+        --position;
       }
+      cell.elements.insert(cell.elements.begin() + position, slot.element);
+      cell.slots.insert(cell.slots.begin() + position, slot_index);
+    }
+  }
+}
 
-      elements[i * num_columns + j].push_back(element);
+/**
+ * \brief Removes the element of a slot from all cells of its range.
+ *
+ * The order of other elements in these cells is preserved.
+ *
+ * \param slot_index Index of the slot.
+ */
+template <typename T>
+void Grid<T>::remove_from_cells(size_t slot_index) {
+
+  const CellRange& range = slots[slot_index].cells;
+  for (size_t i = range.row1; i <= range.row2; ++i) {
+    for (size_t j = range.column1; j <= range.column2; ++j) {
+      Cell& cell = cells[i * num_columns + j];
+      const auto it = std::find(cell.slots.begin(), cell.slots.end(), slot_index);
+      if (it != cell.slots.end()) {
+        const auto index = it - cell.slots.begin();
+        cell.slots.erase(it);
+        cell.elements.erase(cell.elements.begin() + index);
+      }
     }
   }
 }
@@ -245,4 +583,3 @@ void Grid<T>::add(const T& element) {
 }
 
 #endif
-
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_RING_BUFFER_H
+#define SOLARUS_RING_BUFFER_H
+
+#include "solarus/Common.h"
+#include "solarus/lowlevel/Debug.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace Solarus {
+
+/**
+ * \brief A fixed-size queue of values shared by two threads without locks.
+ *
+ * Exactly one thread (the producer) writes values and exactly one other
+ * thread (the consumer) reads them.
+ * The storage is allocated once by the constructor.
+ *
+ * T must be trivially copyable.
+ */
+template <typename T>
+class RingBuffer {
+
+  public:
+
+    explicit RingBuffer(size_t capacity);
+
+    size_t get_capacity() const;
+    size_t get_num_readable() const;
+    size_t get_num_writable() const;
+
+    size_t write(const T* values, size_t count);
+    size_t read(T* values, size_t count);
+    void clear();
+
+  private:
+
+    std::vector<T> values;                  /**< Storage, its size is a power of 2. */
+    size_t mask;                            /**< Size of the storage minus 1. */
+    std::atomic<size_t> read_position;      /**< Number of values read since the
+                                             * beginning (only changed by the
+                                             * consumer). */
+    std::atomic<size_t> write_position;     /**< Number of values written since the
+                                             * beginning (only changed by the
+                                             * producer). */
+
+};
+
+/**
+ * \brief Creates an empty ring buffer.
+ * \param capacity Minimum number of values the buffer can hold.
+ * It is rounded up to a power of 2.
+ */
+template <typename T>
+RingBuffer<T>::RingBuffer(size_t capacity):
+  values(),
+  mask(0),
+  read_position(0),
+  write_position(0) {
+
+  Debug::check_assertion(capacity > 0, "Invalid ring buffer capacity");
+
+  size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  values.resize(size);
+  mask = size - 1;
+}
+
+/**
+ * \brief Returns the number of values the buffer can hold.
+ * \return The capacity.
+ */
+template <typename T>
+size_t RingBuffer<T>::get_capacity() const {
+  return values.size();
+}
+
+/**
+ * \brief Returns the number of values that can be read now.
+ *
+ * From the consumer thread, this is a lower bound: the producer may add
+ * values at any time.
+ *
+ * \return The number of readable values.
+ */
+template <typename T>
+size_t RingBuffer<T>::get_num_readable() const {
+  return write_position.load(std::memory_order_acquire) -
+      read_position.load(std::memory_order_acquire);
+}
+
+/**
+ * \brief Returns the number of values that can be written now.
+ *
+ * From the producer thread, this is a lower bound: the consumer may read
+ * values at any time.
+ *
+ * \return The number of writable values.
+ */
+template <typename T>
+size_t RingBuffer<T>::get_num_writable() const {
+  return values.size() - get_num_readable();
+}
+
+/**
+ * \brief Appends values to the buffer.
+ *
+ * Must only be called by the producer thread.
+ *
+ * \param values The values to write.
+ * \param count Number of values to write.
+ * \return Number of values actually written: less than \c count if the
+ * buffer is full.
+ */
+template <typename T>
+size_t RingBuffer<T>::write(const T* values, size_t count) {
+
+  const size_t position = write_position.load(std::memory_order_relaxed);
+  const size_t free_space = this->values.size() -
+      (position - read_position.load(std::memory_order_acquire));
+  count = std::min(count, free_space);
+
+  const size_t start = position & mask;
+  const size_t first_part = std::min(count, this->values.size() - start);
+  std::copy(values, values + first_part, &this->values[start]);
+  std::copy(values + first_part, values + count, &this->values[0]);
+
+  write_position.store(position + count, std::memory_order_release);
+  return count;
+}
+
+/**
+ * \brief Removes values from the buffer.
+ *
+ * Must only be called by the consumer thread.
+ *
+ * \param values Destination of the values read.
+ * \param count Maximum number of values to read.
+ * \return Number of values actually read: less than \c count if there are
+ * not enough values in the buffer.
+ */
+template <typename T>
+size_t RingBuffer<T>::read(T* values, size_t count) {
+
+  const size_t position = read_position.load(std::memory_order_relaxed);
+  const size_t available = write_position.load(std::memory_order_acquire) - position;
+  count = std::min(count, available);
+
+  const size_t start = position & mask;
+  const size_t first_part = std::min(count, this->values.size() - start);
+  std::copy(&this->values[start], &this->values[start] + first_part, values);
+  std::copy(&this->values[0], &this->values[0] + (count - first_part), values + first_part);
+
+  read_position.store(position + count, std::memory_order_release);
+  return count;
+}
+
+/**
+ * \brief Removes all values.
+ *
+ * Must only be called when no other thread uses the buffer.
+ */
+template <typename T>
+void RingBuffer<T>::clear() {
+
+  read_position.store(0, std::memory_order_relaxed);
+  write_position.store(0, std::memory_order_relaxed);
+}
+
+}
+
+#endif
+
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_ANIMATED_REGIONS_H
+#define SOLARUS_ANIMATED_REGIONS_H
+
+#include "solarus/Common.h"
+#include "solarus/containers/Grid.h"
+#include "solarus/entities/Layer.h"
+#include "solarus/entities/TilePtr.h"
+#include "solarus/lowlevel/SurfacePtr.h"
+#include <vector>
+
+namespace Solarus {
+
+class Map;
+
+/**
+ * \brief Manages the tiles that are in animated regions.
+ *
+ * These are the tiles rejected by NonAnimatedRegions: animated tiles
+ * and static tiles overlapping them.
+ * When all of them only cycle through the frames of the tileset,
+ * each cell of the map is pre-rendered lazily once per animation frame,
+ * so that drawing it costs one blit instead of one blit per tile.
+ * Otherwise (parallax or scrolling patterns), tiles are drawn one by one.
+ */
+class AnimatedRegions {
+
+  public:
+
+    AnimatedRegions(Map& map, Layer layer);
+
+    void build(const std::vector<TilePtr>& tiles);
+    void notify_tileset_changed();
+    void draw_on_map();
+
+  private:
+
+    static constexpr int num_frame_states = 9;  /**< Combinations of the frames of both sequences. */
+
+    bool update_cell_sequences();
+    int get_frame_state(int cell_index) const;
+    void build_frame(int cell_index, int frame_state);
+
+    Map& map;                               /**< The map. */
+    Layer layer;                            /**< Layer of the map managed by this object. */
+    std::vector<TilePtr>
+        tiles;                              /**< All tiles in animated regions of this layer,
+                                             * in drawing order. */
+    bool frames_cached;                     /**< Whether cells are pre-rendered for each frame.
+                                             * If false, tiles are drawn individually. */
+
+    Grid<TilePtr>
+        animated_tiles;                     /**< The same tiles, stored in a grid to know
+                                             * which ones to pre-render in each cell. */
+    std::vector<int>
+        cell_sequences;                     /**< For each cell, bit i is set if it has a tile
+                                             * animated with sequence i. */
+    std::vector<std::vector<SurfacePtr>>
+        frame_surfaces;                     /**< For each cell, its pre-rendered surface for each
+                                             * frame state or nullptr before it is drawn. */
+    std::vector<int>
+        cells_with_frames;                  /**< Indexes of the cells that have frames built.
+                                             * Frames are freed when their cell is not visible anymore. */
+
+};
+
+}
+
+#endif
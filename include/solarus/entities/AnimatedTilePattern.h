@@ -48,6 +48,9 @@ class AnimatedTilePattern: public TilePattern {
     static void initialize();
     static void update();
     static void quit();
+    static int get_current_frame(AnimationSequence sequence);
+
+    AnimationSequence get_sequence() const;
 
     virtual void draw(
         const SurfacePtr& dst_surface,
@@ -55,6 +58,7 @@ class AnimatedTilePattern: public TilePattern {
         Tileset& tileset,
         const Point& viewport
     ) override;
+    virtual bool is_animated_by_frames() const override;
     virtual bool is_drawn_at_its_position() const override;
 
   private:
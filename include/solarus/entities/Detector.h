@@ -43,6 +43,7 @@ class Detector: public MapEntity {
     virtual void notify_being_removed() override;
 
     // properties
+    int get_collision_modes() const;
     virtual bool has_layer_independent_collisions() const override;
     void set_layer_independent_collisions(bool independent);
 
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_GROUND_BITS_H
+#define SOLARUS_GROUND_BITS_H
+
+#include "solarus/Common.h"
+#include "solarus/entities/Ground.h"
+#include <cstdint>
+#include <vector>
+
+namespace Solarus {
+
+class Rectangle;
+
+/**
+ * \brief Precomputed obstacle bits of the static ground of a layer.
+ *
+ * For each pixel of the map, a bit indicates whether the tiles make it a
+ * wall for every entity (walls and the wall half of diagonal walls).
+ * For each 8x8 square, another bit indicates whether its ground is an
+ * obstacle only for some entities (water, holes, ladders, etc.).
+ *
+ * This makes the terrain part of collision tests a few word-wide
+ * operations per row instead of a ground lookup per point.
+ * Dynamic entities that change the ground are not taken into account.
+ */
+class GroundBits {
+
+  public:
+
+    GroundBits(int width8, int height8);
+
+    void set_ground(int x8, int y8, Ground ground);
+
+    bool has_wall_on_border(const Rectangle& box) const;
+    bool has_entity_dependent_ground_on_border(const Rectangle& box) const;
+
+    static bool is_entity_dependent(Ground ground);
+
+  private:
+
+    static uint32_t get_wall_mask(Ground ground, int y_in_square);
+    static bool test_row(const uint32_t* row, int x1, int x2);
+    static bool test_bit(const uint32_t* row, int x);
+
+    int width8;                          /**< Number of 8x8 squares on a row. */
+    int height8;                         /**< Number of 8x8 squares on a column. */
+    int nb_integers_per_row;             /**< Number of uint32_t necessary to store
+                                          * the bits of a row of pixels. */
+    int nb_integers_per_row8;            /**< Number of uint32_t necessary to store
+                                          * the bits of a row of 8x8 squares. */
+    std::vector<uint32_t> wall_bits;     /**< One bit per pixel, row by row:
+                                          * the bit of x is (1 << (x & 31)) in
+                                          * the integer x >> 5 of its row. */
+    std::vector<uint32_t>
+        entity_dependent_bits;           /**< One bit per 8x8 square, organized
+                                          * like wall_bits. */
+
+};
+
+}
+
+#endif
+
@@ -18,28 +18,36 @@
 #define SOLARUS_MAP_ENTITIES_H
 
 #include "solarus/Common.h"
+#include "solarus/containers/Grid.h"
 #include "solarus/entities/EntityType.h"
 #include "solarus/entities/Ground.h"
+#include "solarus/entities/GroundBits.h"
 #include "solarus/entities/Layer.h"
 #include "solarus/entities/MapEntityPtr.h"
 #include "solarus/entities/TilePtr.h"
+#include "solarus/lowlevel/Rectangle.h"
 #include "solarus/Transition.h"
+#include <cstdint>
 #include <list>
 #include <map>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace Solarus {
 
+class AnimatedRegions;
 class Boomerang;
 class CrystalBlock;
 class Destination;
+class FlowField;
 class Detector;
 class Hero;
 class Map;
 class NonAnimatedRegions;
-class Rectangle;
+class PathFindingTerrain;
 class Separator;
 class Stairs;
 
@@ -57,24 +65,53 @@ class SOLARUS_API MapEntities {
 
     // creation and destruction
     MapEntities(Game& game, Map& map);
+    ~MapEntities();
 
     // entities
     Hero& get_hero();
     Ground get_tile_ground(Layer layer, int x, int y) const;
-    const std::list<MapEntityPtr>& get_entities();
-    const std::list<MapEntity*>& get_obstacle_entities(Layer layer);
-    const std::list<MapEntity*>& get_ground_observers(Layer layer);
-    const std::list<MapEntity*>& get_ground_modifiers(Layer layer);
-    const std::list<Detector*>& get_detectors();
-    const std::list<Stairs*>& get_stairs(Layer layer);
-    const std::list<CrystalBlock*>& get_crystal_blocks(Layer layer);
-    const std::list<const Separator*>& get_separators() const;
+    const GroundBits& get_tile_ground_bits(Layer layer) const;
+    PathFindingTerrain& get_path_finding_terrain(Layer layer);
+    FlowField* get_flow_field(const MapEntity& target);
+    const std::vector<MapEntityPtr>& get_entities();
+    const std::vector<MapEntity*>& get_obstacle_entities(Layer layer);
+    void get_obstacle_entities(
+        Layer layer,
+        const Rectangle& where,
+        std::vector<MapEntity*>& obstacles
+    ) const;
+    const std::vector<MapEntity*>& get_ground_observers(Layer layer);
+    const std::vector<MapEntity*>& get_ground_modifiers(Layer layer);
+    const MapEntity* get_ground_modifier(Layer layer, const Point& xy) const;
+    bool overlaps_ground_modifiers(Layer layer, const Rectangle& where) const;
+    const std::vector<Detector*>& get_detectors();
+    void get_detectors(
+        const MapEntity& entity,
+        std::vector<Detector*>& detectors
+    ) const;
+    void get_entities(
+        const Detector& detector,
+        std::vector<MapEntity*>& entities
+    ) const;
+    void get_entities_in_rectangle(
+        const Rectangle& where,
+        std::vector<MapEntity*>& entities
+    ) const;
+    void get_entities_in_radius(
+        const Point& center,
+        int radius,
+        std::vector<MapEntity*>& entities
+    ) const;
+    const std::vector<Stairs*>& get_stairs(Layer layer);
+    const std::vector<CrystalBlock*>& get_crystal_blocks(Layer layer);
+    const std::vector<const Separator*>& get_separators() const;
     Destination* get_default_destination();
 
     MapEntity* get_entity(const std::string& name);
     MapEntity* find_entity(const std::string& name);
-    std::list<MapEntity*> get_entities_with_prefix(const std::string& prefix);
-    std::list<MapEntity*> get_entities_with_prefix(EntityType type, const std::string& prefix);
+    std::vector<MapEntity*> get_entities_with_prefix(const std::string& prefix);
+    std::vector<MapEntity*> get_entities_with_prefix(EntityType type, const std::string& prefix);
+    int get_num_entities_with_prefix(const std::string& prefix) const;
     bool has_entity_with_prefix(const std::string& prefix) const;
 
     // handle entities
@@ -85,10 +122,18 @@ class SOLARUS_API MapEntities {
     void bring_to_front(MapEntity& entity);
     void bring_to_back(MapEntity& entity);
     static bool compare_y(MapEntity* first, MapEntity* second);
+    static void sort_y_order(std::vector<MapEntity*>& entities);
     void set_entity_drawn_in_y_order(MapEntity& entity, bool drawn_in_y_order);
     void set_entity_layer(MapEntity& entity, Layer layer);
     void notify_entity_ground_observer_changed(MapEntity& entity);
     void notify_entity_ground_modifier_changed(MapEntity& entity);
+    void notify_entity_bounding_box_changed(MapEntity& entity);
+    void notify_detector_collision_modes_changed(Detector& detector);
+
+    // statistics
+    uint32_t get_num_obstacle_queries() const;
+    uint32_t get_num_obstacle_candidates() const;
+    void reset_obstacle_query_stats();
 
     // specific to some entity types
     bool overlaps_raised_blocks(Layer layer, const Rectangle& rectangle);
@@ -106,16 +151,40 @@ class SOLARUS_API MapEntities {
     void set_suspended(bool suspended);
     void update();
     void draw();
+    void prefetch_tiles(uint32_t deadline);
 
   private:
 
     friend class MapLoader;            /**< the map loader initializes the private fields of MapEntities */
 
+    using NamedEntityRange = std::pair<
+        std::map<std::string, MapEntity*>::const_iterator,
+        std::map<std::string, MapEntity*>::const_iterator
+    >;
+
+    NamedEntityRange get_named_entities_with_prefix(const std::string& prefix) const;
+    static bool is_found_by_prefix(const MapEntity& entity);
+    void get_entity_candidates(
+        const Rectangle& where,
+        std::vector<MapEntity*>& candidates
+    ) const;
+
     void add_tile(const TilePtr& tile);
     void set_tile_ground(Layer layer, int x8, int y8, Ground ground);
     void remove_marked_entities();
     void notify_entity_removed(MapEntity* entity);
     void update_crystal_blocks();
+    void sort_entities_drawn_y_order(Layer layer);
+    void initialize_grids();
+    void update_obstacle_grid(MapEntity& entity);
+    void remove_from_obstacle_grid(MapEntity& entity);
+    void update_detection_grids(MapEntity& entity);
+    void remove_from_detection_grids(MapEntity& entity);
+    static Rectangle get_detection_box(const MapEntity& entity);
+    uint32_t get_insertion_rank(const MapEntity& entity) const;
+    void sort_by_insertion_rank(std::vector<MapEntity*>& entities) const;
+    void add_ground_modifier(MapEntity& entity, Layer layer);
+    void remove_ground_modifier(MapEntity& entity, Layer layer);
 
     // map
     Game& game;                                     /**< the game running this map */
@@ -128,48 +197,86 @@ class SOLARUS_API MapEntities {
                                                      * (tiles_grid_size = map_width8 * map_height8) */
     std::vector<Ground> tiles_ground[LAYER_NB];     /**< array of size tiles_grid_size representing the ground property
                                                      * of each 8x8 square. */
+    std::unique_ptr<GroundBits>
+        tiles_ground_bits[LAYER_NB];                /**< wall pixels and entity-dependent squares
+                                                     * of tiles_ground, for fast collision tests */
+    std::unique_ptr<PathFindingTerrain>
+        path_finding_terrain[LAYER_NB];             /**< static passability of path finding transitions,
+                                                     * created when a path is first computed */
+    std::vector<std::unique_ptr<FlowField>>
+        flow_fields;                                /**< distance maps toward the entities chased
+                                                     * by flow field path finding movements */
     std::unique_ptr<NonAnimatedRegions>
         non_animated_regions[LAYER_NB];             /**< All non-animated tiles are managed here for performance. */
-    std::vector<TilePtr>
-        tiles_in_animated_regions[LAYER_NB];        /**< animated tiles and tiles overlapping them */
+    std::unique_ptr<AnimatedRegions>
+        animated_regions[LAYER_NB];                 /**< animated tiles and tiles overlapping them,
+                                                     * pre-rendered per animation frame */
 
     // dynamic entities
     Hero& hero;                                     /**< the hero (stored in Game because it is kept when changing maps) */
 
     std::map<std::string, MapEntity*>
       named_entities;                               /**< entities identified by a name */
-    std::list<MapEntityPtr> all_entities;           /**< all map entities except the tiles and the hero;
+    std::vector<MapEntityPtr> all_entities;         /**< all map entities except the tiles and the hero;
                                                      * this vector is used to delete the entities
                                                      * when the map is unloaded */
-    std::list<MapEntity*> entities_to_remove;       /**< list of entities that need to be removed right now */
+    std::vector<MapEntity*> entities_to_remove;     /**< list of entities that need to be removed right now */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       entities_drawn_first[LAYER_NB];               /**< all map entities that are drawn in the normal order */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       entities_drawn_y_order[LAYER_NB];             /**< all map entities that are drawn in the order
-                                                     * defined by their y position, including the hero */
+                                                     * defined by their y position, including the hero;
+                                                     * kept sorted from one cycle to the next */
 
-    std::list<Detector*> detectors;                 /**< all entities able to detect other entities
-                                                     * on this map.
-                                                     * TODO store them by layer like obstacle_entities
-                                                     * but take care of has_layer_independent_collisions() */
-    std::list<MapEntity*>
+    std::vector<Detector*> detectors;               /**< all entities able to detect other entities
+                                                     * on this map */
+    std::vector<MapEntity*>
       ground_observers[LAYER_NB];                   /**< all dynamic entities sensible to the ground
                                                      * below them */
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       ground_modifiers[LAYER_NB];                   /**< all dynamic entities that may change the ground of
                                                      * the map where they are placed */
+    std::unique_ptr<Grid<MapEntity*>>
+      ground_modifier_grid[LAYER_NB];               /**< Ground modifiers of each layer bucketed by the
+                                                     * cells their bounding box overlaps. */
+    std::unordered_map<const MapEntity*, uint32_t>
+      ground_modifier_ranks;                        /**< Position of each ground modifier in its
+                                                     * ground_modifiers list: when several of them
+                                                     * overlap, the last one added wins. */
+    uint32_t next_ground_modifier_rank;             /**< Rank to give to the next ground modifier. */
     Destination* default_destination;               /**< the default destination of this map */
 
-    std::list<MapEntity*>
+    std::vector<MapEntity*>
       obstacle_entities[LAYER_NB];                  /**< all entities that might be obstacle for other
                                                      * entities on this map, including the hero */
 
-    std::list<Stairs*> stairs[LAYER_NB];            /**< all stairs of the map */
-    std::list<CrystalBlock*>
+    std::unique_ptr<Grid<MapEntity*>>
+      obstacle_grid[LAYER_NB];                      /**< Obstacle entities of each layer bucketed by the
+                                                     * cells their bounding box overlaps, so that collision
+                                                     * tests only look at entities near the tested box. */
+    mutable uint32_t num_obstacle_queries;          /**< Number of obstacle queries since the last reset. */
+    mutable uint32_t num_obstacle_candidates;       /**< Number of obstacle entities returned by these queries. */
+
+    std::unique_ptr<Grid<MapEntity*>>
+      entity_grid;                                  /**< All entities except tiles, including the hero,
+                                                     * bucketed by their detection box (see
+                                                     * get_detection_box()), whatever their layer. */
+    std::unique_ptr<Grid<Detector*>>
+      detector_grid;                                /**< Detectors bucketed by their bounding box,
+                                                     * whatever their layer. Detectors with a custom
+                                                     * collision test are in all cells. */
+    std::unordered_map<const MapEntity*, uint32_t>
+      insertion_ranks;                              /**< Order in which each entity other than tiles
+                                                     * and the hero was added: their order in the
+                                                     * entity and detector grids. */
+    uint32_t next_insertion_rank;                   /**< Rank to give to the next entity added. */
+
+    std::vector<Stairs*> stairs[LAYER_NB];          /**< all stairs of the map */
+    std::vector<CrystalBlock*>
       crystal_blocks[LAYER_NB];                     /**< all crystal blocks of the map */
-    std::list<const Separator*> separators;         /**< all separators of the map */
+    std::vector<const Separator*> separators;       /**< all separators of the map */
 
     Boomerang* boomerang;                           /**< the boomerang if present on the map, nullptr otherwise */
 
@@ -346,6 +346,7 @@ class SOLARUS_API MapEntity: public ExportableToLua {
   private:
 
     void finish_initialization();
+    void notify_bounding_box_changed();
     void clear_old_movements();
     void clear_old_sprites();
 
@@ -21,11 +21,14 @@
 #include "solarus/containers/Grid.h"
 #include "solarus/entities/Layer.h"
 #include "solarus/entities/TilePtr.h"
+#include "solarus/lowlevel/Point.h"
 #include "solarus/lowlevel/SurfacePtr.h"
+#include <cstdint>
 #include <vector>
 
 namespace Solarus {
 
+class Arguments;
 class Map;
 
 /**
@@ -35,22 +38,46 @@ class Map;
  * tile. The tiles in such rectangles of the map can be pre-drawn once for all
  * on an intermediate surface for performance. Furthermore, this intermediate
  * surface is drawn lazily when the camera moves.
+ *
+ * The intermediate surfaces of all maps share a memory budget: the least
+ * recently drawn cells are freed when it is exceeded.
+ * Cells the camera is moving toward can also be built in advance, during
+ * the idle time of the main loop.
  */
 class NonAnimatedRegions {
 
   public:
 
+    static void initialize(const Arguments& args);
+    static void quit();
+
+    static size_t get_cells_size();
+    static size_t get_peak_cells_size();
+    static int get_num_cells_built();
+    static int get_num_cells_prefetched();
+    static int get_num_cells_evicted();
+    static uint64_t get_cells_build_time();
+
     NonAnimatedRegions(Map& map, Layer layer);
+    ~NonAnimatedRegions();
+
+    NonAnimatedRegions(const NonAnimatedRegions& other) = delete;
+    NonAnimatedRegions& operator=(const NonAnimatedRegions& other) = delete;
 
     void add_tile(const TilePtr& tile);
     void build(std::vector<TilePtr>& rejected_tiles);
     void notify_tileset_changed();
     void draw_on_map();
+    void prefetch_cells(uint32_t deadline);
 
   private:
 
+    static bool free_cells(size_t size_needed, uint64_t min_age);
+
     bool overlaps_animated_tile(Tile& tile) const;
+    size_t get_cell_surface_size() const;
     void build_cell(int cell_index);
+    void release_cell(int cell_index);
 
     Map& map;                               /**< The map. */
     Layer layer;                            /**< Layer of the map managed by this object. */
@@ -67,7 +94,12 @@ class NonAnimatedRegions {
     std::vector<SurfacePtr>
         optimized_tiles_surfaces;           /**< All non-animated tiles are drawn here once for all
                                              * for performance. Each cell of the grid has a surface
-                                             * or nullptr before it is drawn. */
+                                             * or nullptr before it is drawn or after it is freed. */
+    std::vector<uint64_t>
+        cells_last_use;                     /**< For each cell, date of its last drawing
+                                             * (in number of layers drawn). */
+    Point previous_camera_xy;               /**< Camera position at the previous drawing. */
+    Point camera_motion;                    /**< Camera movement since the previous drawing. */
 
 };
 
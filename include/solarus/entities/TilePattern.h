@@ -72,6 +72,7 @@ class TilePattern {
         const Point& viewport
     ) = 0;
     virtual bool is_animated() const;
+    virtual bool is_animated_by_frames() const;
     virtual bool is_drawn_at_its_position() const;
 
   protected:
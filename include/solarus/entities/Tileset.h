@@ -30,6 +30,7 @@ namespace Solarus {
 
 class TilePattern;
 class TilePatternData;
+class TilesetData;
 
 /**
  * \brief A set of tile patterns that are used to compose a map.
@@ -43,9 +44,10 @@ class Tileset {
     Tileset(const std::string& id);
 
     void load();
+    void load(const TilesetData& data);
     void unload();
 
-    const std::string& get_id();
+    const std::string& get_id() const;
     Color& get_background_color();
     bool is_loaded();
     const SurfacePtr& get_tiles_image();
@@ -55,6 +57,7 @@ class Tileset {
 
   private:
 
+    void load_images();
     void add_tile_pattern(
         const std::string& id,
         const TilePatternData& pattern_data
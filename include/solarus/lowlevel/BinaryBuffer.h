@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_BINARY_BUFFER_H
+#define SOLARUS_BINARY_BUFFER_H
+
+#include "solarus/Common.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Solarus {
+
+/**
+ * \brief Appends binary values to a memory buffer.
+ *
+ * Integers are written in little-endian order, whatever the platform.
+ */
+class BinaryWriter {
+
+  public:
+
+    explicit BinaryWriter(std::string& buffer);
+
+    void write_uint8(uint8_t value);
+    void write_uint32(uint32_t value);
+    void write_int32(int32_t value);
+    void write_uint64(uint64_t value);
+    void write_bytes(const char* bytes, size_t size);
+
+  private:
+
+    std::string& buffer;            /**< The buffer to append to. */
+
+};
+
+/**
+ * \brief Reads binary values written by BinaryWriter from a memory area.
+ *
+ * The memory area is not copied: it must outlive the reader.
+ * Reading past the end fails and leaves the value unchanged.
+ */
+class BinaryReader {
+
+  public:
+
+    BinaryReader(const char* data, size_t size);
+
+    size_t get_position() const;
+    size_t get_num_remaining() const;
+
+    bool read_uint8(uint8_t& value);
+    bool read_uint32(uint32_t& value);
+    bool read_int32(int32_t& value);
+    bool read_uint64(uint64_t& value);
+    bool read_bytes(size_t size, const char*& bytes);
+
+  private:
+
+    const char* data;               /**< The memory area to read. */
+    size_t size;                    /**< Size of the memory area in bytes. */
+    size_t position;                /**< Position of the next byte to read. */
+
+};
+
+}
+
+#endif
+
@@ -19,6 +19,7 @@
 
 #include "solarus/Common.h"
 #include <string>
+#include <vector>
 
 #ifndef NDEBUG
 #define SOLARUS_ASSERT(condition, message) Debug::check_assertion(condition, message)
@@ -35,6 +36,14 @@ class CommandLine;
  */
 namespace Debug {
 
+/**
+ * \brief An error or a warning kept to be printed later.
+ */
+struct DeferredMessage {
+  bool error;              /**< \c true for an error, \c false for a warning. */
+  std::string message;     /**< The text of the message. */
+};
+
 void SOLARUS_API set_die_on_error(bool die);
 void SOLARUS_API set_show_popup_on_die(bool show);
 void SOLARUS_API set_abort_on_die(bool abort);
@@ -45,6 +54,9 @@ void SOLARUS_API check_assertion(bool assertion, const char* error_message);
 void SOLARUS_API check_assertion(bool assertion, const std::string& error_message);
 void SOLARUS_API die(const std::string& error_message);
 
+void SOLARUS_API set_deferred_messages(std::vector<DeferredMessage>* messages);
+void SOLARUS_API print_deferred_messages(const std::vector<DeferredMessage>& messages);
+
 }
 
 }
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_IMAGE_CACHE_H
+#define SOLARUS_IMAGE_CACHE_H
+
+#include "solarus/Common.h"
+#include <memory>
+#include <string>
+
+struct SDL_Surface;
+
+namespace Solarus {
+
+class Arguments;
+
+/**
+ * \brief Keeps the images loaded from files decoded in memory.
+ *
+ * Images are stored in the video pixel format and shared by all surfaces
+ * created from the same file: a surface only copies the pixels when it
+ * modifies them (see Surface).
+ * Images no longer used by any surface are kept until the cache exceeds
+ * its memory budget (option -image-cache-size), and then freed oldest
+ * first.
+ *
+ * With the command-line option -image-cache=yes, decoded pixels are also
+ * saved in the quest write directory, which avoids decoding PNG files
+ * again at the next execution.
+ */
+class ImageCache {
+
+  public:
+
+    static void initialize(const Arguments& args);
+    static void quit();
+
+    static std::shared_ptr<SDL_Surface> get_image(
+        const std::string& file_name, bool language_specific);
+    static bool has_image(const std::string& file_name);
+    static void add_image(const std::string& file_name, SDL_Surface* image);
+    static void add_image(
+        const std::string& file_name, const std::shared_ptr<SDL_Surface>& image);
+    static std::shared_ptr<SDL_Surface> decode_image(const std::string& buffer);
+
+    static int get_num_hits();
+    static int get_num_misses();
+
+};
+
+}
+
+#endif
+
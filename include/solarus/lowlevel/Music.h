@@ -18,11 +18,14 @@
 #define SOLARUS_MUSIC_H
 
 #include "solarus/Common.h"
+#include "solarus/containers/RingBuffer.h"
 #include "solarus/lowlevel/ItDecoder.h"
 #include "solarus/lowlevel/Sound.h"
 #include "solarus/lua/ScopedLuaRef.h"
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace Solarus {
@@ -37,6 +40,10 @@ namespace Solarus {
  * initialized, by calling Sound::initialize().
  * Sound and Music are the only classes that depends on audio libraries.
  *
+ * OGG musics are decoded by a separate thread, so that the codec cost does
+ * not slow down the main loop. The main thread only moves decoded data into
+ * OpenAL buffers.
+ *
  * TODO move the non-static parts to an internal private class.
  * TODO make a subclass for each format?
  */
@@ -87,6 +94,8 @@ class Music {
     static void stop_playing();
     static const std::string& get_current_music_id();
 
+    ~Music();
+
   private:
 
     Music();
@@ -104,6 +113,12 @@ class Music {
 
     void decode_it(ALuint destination_buffer, ALsizei nb_samples);
     void decode_ogg(ALuint destination_buffer, ALsizei nb_samples);
+    long read_ogg(ALshort* destination, long nb_values);
+    bool fill_buffer_from_decoded_data(ALuint destination_buffer);
+
+    void start_decoding_thread();
+    void stop_decoding_thread();
+    void run_decoding_thread();
 
     bool update_playing();
 
@@ -116,10 +131,22 @@ class Music {
     // OGG specific
     OggVorbis_File ogg_file;                     /**< the file used by the vorbisfile lib */
     Sound::SoundFromMemory ogg_mem;              /**< the encoded music loaded in memory, passed to the vorbisfile lib as user data */
+    ALenum ogg_format;                           /**< OpenAL format of the decoded data */
+    ALsizei ogg_sample_rate;                     /**< sample rate of the decoded data */
+    int ogg_num_channels;                        /**< number of channels of the decoded data */
+    std::unique_ptr<RingBuffer<ALshort>>
+        decoded_data;                            /**< PCM data produced by the decoding thread and
+                                                  * consumed by update_playing() */
+    std::thread decoding_thread;                 /**< thread that decodes the music into decoded_data */
+    std::atomic<bool> decoding_stopped;          /**< asks the decoding thread to stop */
+    std::atomic<bool> decoding_finished;         /**< whether the decoding thread reached the end of the file */
+    std::atomic<long> decoding_error;            /**< vorbisfile error that stopped the decoding thread, or 0 */
 
     static constexpr int nb_buffers = 8;
     ALuint buffers[nb_buffers];                  /**< multiple buffers used to stream the music */
     ALuint source;                               /**< the OpenAL source streaming the buffers */
+    std::vector<ALuint> free_buffers;            /**< buffers played and waiting for decoded data */
+    std::vector<ALshort> pcm_chunk;              /**< decoded data of one buffer, allocated once */
 
 
     static std::unique_ptr<ItDecoder>
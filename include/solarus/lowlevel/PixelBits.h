@@ -32,7 +32,9 @@ class Surface;
  *
  * This class stores efficiently the location of the non-transparent pixels of a surface.
  * For each pixel of the image, a bit indicates whether this pixel is transparent.
- * This class perform fast pixel-perfect collision checks.
+ * Bits of all rows are stored in a single array of 64-bit words,
+ * together with the range of opaque pixels of each row,
+ * so that collision checks skip transparent parts and test 64 pixels at once.
  */
 class PixelBits {
 
@@ -45,17 +47,28 @@ class PixelBits {
 
   private:
 
+    /**
+     * \brief Range of opaque pixels of a row.
+     */
+    struct OpaqueSpan {
+      int begin;             /**< x of the first opaque pixel, or width if there is none */
+      int end;               /**< x after the last opaque pixel, or 0 if there is none */
+    };
+
+    uint64_t get_bits(int row, int x) const;
     void print() const;
-    void print_mask(uint32_t mask) const;
 
     int width;               /**< width of the image in pixels */
     int height;              /**< height of the image in pixels */
-    int nb_integers_per_row; /**< number of uint32_t necessary to store
-                              * the bits of a row of the image */
+    int nb_words_per_row;    /**< number of uint64_t storing a row: enough for
+                              * the bits of the row plus a zero word, so that
+                              * 64 bits can be read from any pixel of the row */
 
-    std::vector<std::vector<uint32_t>>
-        bits;                /**< A two-dimensional array representing the
-                              * transparency bit of each pixel in the image. */
+    std::vector<uint64_t>
+        bits;                /**< The transparency bit of each pixel, row after row:
+                              * bit x % 64 of word x / 64 is set if pixel x is opaque. */
+    std::vector<OpaqueSpan>
+        opaque_spans;        /**< The range of opaque pixels of each row. */
 
 };
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_PROFILER_H
+#define SOLARUS_PROFILER_H
+
+#include "solarus/Common.h"
+#include <cstdint>
+#include <string>
+
+namespace Solarus {
+
+/**
+ * \brief Measures the time spent in the main phases of a simulation step.
+ *
+ * Phases can be nested: the time of a nested phase is not counted in the
+ * enclosing one, so that the times of all phases add up to the total time.
+ * Measures are only taken when the profiler is enabled.
+ */
+namespace Profiler {
+
+/**
+ * \brief The phases that can be measured.
+ */
+enum class Phase {
+  LUA_UPDATE,      /**< Lua timers, menus, movements and on_update() callbacks. */
+  ENTITY_UPDATE,   /**< Update of map entities. */
+  COLLISION,       /**< Collision tests with obstacles and detectors. */
+  DRAW,            /**< Drawing of the game and of Lua menus. */
+  RENDER           /**< Rendering of the quest surface on the screen. */
+};
+
+constexpr int num_phases = 5;
+
+void SOLARUS_API set_enabled(bool enabled);
+bool SOLARUS_API is_enabled();
+void SOLARUS_API reset();
+
+uint64_t SOLARUS_API get_time(Phase phase);
+const std::string& SOLARUS_API get_phase_name(Phase phase);
+
+void SOLARUS_API begin_phase(Phase phase);
+void SOLARUS_API end_phase();
+
+/**
+ * \brief Measures a phase during the lifetime of this object.
+ */
+class ScopedPhase {
+
+  public:
+
+    /**
+     * \brief Starts measuring a phase if the profiler is enabled.
+     * \param phase The phase to measure.
+     */
+    explicit ScopedPhase(Phase phase):
+      active(is_enabled()) {
+
+      if (active) {
+        begin_phase(phase);
+      }
+    }
+
+    /**
+     * \brief Stops measuring the phase.
+     */
+    ~ScopedPhase() {
+
+      if (active) {
+        end_phase();
+      }
+    }
+
+    ScopedPhase(const ScopedPhase& other) = delete;
+    ScopedPhase& operator=(const ScopedPhase& other) = delete;
+
+  private:
+
+    bool active;    /**< Whether the profiler was enabled at the beginning. */
+
+};
+
+}
+
+}
+
+#endif
+
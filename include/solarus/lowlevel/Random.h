@@ -28,6 +28,7 @@ namespace Random {
 
 void initialize();
 void quit();
+void set_seed(unsigned int seed);
 
 int get_number(unsigned int x);
 int get_number(int x, int y);
@@ -18,6 +18,7 @@
 #define SOLARUS_SOUND_H
 
 #include "solarus/Common.h"
+#include <cstdint>
 #include <string>
 #include <list>
 #include <map>
@@ -42,6 +43,15 @@ class Sound {
 
   public:
 
+    /**
+     * \brief Decoded content of a sound file.
+     */
+    struct PcmData {
+      ALenum format;            /**< AL_FORMAT_MONO16 or AL_FORMAT_STEREO16 */
+      ALsizei sample_rate;      /**< number of samples per second */
+      std::string samples;      /**< the 16-bit samples */
+    };
+
     // libvorbisfile
 
     /**
@@ -63,6 +73,13 @@ class Sound {
     bool start();
 
     static void load_all();
+    static std::string get_file_name(const std::string& sound_id);
+    static bool decode_pcm(
+        const std::string& encoded_data,
+        PcmData& pcm,
+        std::string& error_message
+    );
+    static void load_decoded(const std::string& sound_id, const PcmData& pcm);
     static bool exists(const std::string& sound_id);
     static void play(const std::string& sound_id);
 
@@ -74,11 +91,26 @@ class Sound {
     static int get_volume();
     static void set_volume(int volume);
 
+    static int get_num_cache_hits();
+    static int get_num_cache_misses();
+
   private:
 
+    /**
+     * \brief Entry of the decoded sound cache file.
+     */
+    struct CachedSound {
+      uint64_t source_hash;     /**< hash of the encoded file that was decoded */
+      PcmData pcm;              /**< the decoded data */
+    };
+
     ALuint decode_file(const std::string &file_name);
+    static ALuint create_buffer(const PcmData& pcm, const std::string& file_name);
     bool update_playing();
 
+    static void read_pcm_cache(std::map<std::string, CachedSound>& cache);
+    static void write_pcm_cache(const std::map<std::string, CachedSound>& cache);
+
     static ALCdevice* device;
     static ALCcontext* context;
 
@@ -90,6 +122,10 @@ class Sound {
 
     static bool initialized;                     /**< indicates that the audio system is initialized */
     static bool sounds_preloaded;                /**< true if load_all() was called */
+    static bool pcm_cache_enabled;               /**< whether load_all() keeps decoded sounds
+                                                  * in a file of the quest write directory */
+    static int num_cache_hits;                   /**< sounds found in the decoded sound cache */
+    static int num_cache_misses;                 /**< sounds decoded by load_all() */
     static float volume;                         /**< the volume of sound effects (0.0 to 1.0) */
 
 };
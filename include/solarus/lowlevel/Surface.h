@@ -20,6 +20,7 @@
 #include "solarus/Common.h"
 #include "solarus/lowlevel/PixelBits.h"
 #include "solarus/lowlevel/SurfacePtr.h"
+#include "solarus/lowlevel/TextureAtlas.h"
 #include "solarus/Drawable.h"
 #include <SDL.h>
 #include <SDL_image.h>
@@ -61,6 +62,7 @@ class Surface: public Drawable {
 
     Surface(int width, int height);
     explicit Surface(SDL_Surface* internal_surface);
+    explicit Surface(const std::shared_ptr<SDL_Surface>& shared_internal_surface);
 
     // Surfaces should only created with std::make_shared.
     // This is what create() functions do, so you should call them rather than
@@ -90,6 +92,8 @@ class Surface: public Drawable {
     void apply_pixel_filter(const PixelFilter& pixel_filter, Surface& dst_surface);
 
     void render(SDL_Renderer* renderer);
+    static int get_num_render_commands();
+    static int get_num_render_copies();
 
     virtual const std::string& get_lua_type_name() const override;
 
@@ -112,6 +116,7 @@ class Surface: public Drawable {
 
     class SubSurfaceNode;
     using SubSurfaceNodePtr = std::shared_ptr<Surface::SubSurfaceNode>;
+    using SubSurfaceList = std::vector<SubSurfaceNodePtr>;
 
     struct SDL_Surface_Deleter {
         void operator()(SDL_Surface* sdl_surface) {
@@ -131,33 +136,44 @@ class Surface: public Drawable {
     bool is_pixel_transparent(int index) const;
     uint32_t get_color_value(const Color& color) const;
 
-    static SDL_Surface* get_surface_from_file(
+    static std::shared_ptr<SDL_Surface> get_surface_from_file(
         const std::string& file_name,
         ImageDirectory base_directory);
 
     void create_software_surface();
+    void detach_software_surface();
     void convert_software_surface();
     void create_texture_from_surface();
+    void update_texture_from_surface();
     void add_subsurface(const SurfacePtr& src_surface, const Rectangle& region, const Point& dst_position);
     void clear_subsurfaces();
-    void render(
-        SDL_Renderer* renderer,
+    void add_render_commands(
         const Rectangle& src_rect,
         const Rectangle& dst_rect,
         const Rectangle& clip_rect,
         uint8_t opacity,
-        const std::vector<SubSurfaceNodePtr>& subsurfaces
+        const SubSurfaceList* subsurfaces,
+        size_t num_subsurfaces
     );
 
-    std::vector<SubSurfaceNodePtr>
-        subsurfaces;                      /**< Source Subsurfaces not in the tree yet */
+    std::shared_ptr<SubSurfaceList>
+        subsurfaces;                      /**< Source Subsurfaces not in the tree yet (possibly nullptr).
+                                           * Nodes drawing this surface share this list and only
+                                           * use the part that existed when they were created. */
 
     bool software_destination;            /**< indicates that this surface is modified on software side
                                            * (and therefore immediately) when used as a destination */
-    SDL_Surface_UniquePtr
+    std::shared_ptr<SDL_Surface>
         internal_surface;                 /**< the SDL_Surface encapsulated, if any. */
+    bool internal_surface_shared;         /**< indicates that internal_surface belongs to the
+                                           * image cache and must be copied before being modified. */
     SDL_Texture_UniquePtr
         internal_texture;                 /**< the SDL_Texture encapsulated, if any. */
+    TextureAtlas::RegionPtr
+        atlas_region;                     /**< the part of a texture atlas used instead of
+                                           * internal_texture, if any. */
+    bool atlas_allowed;                   /**< indicates that the texture may be packed into
+                                           * the texture atlas (images loaded from files). */
     std::unique_ptr<Color>
         internal_color;                   /**< the background color to use, if any. */
     bool is_rendered;                     /**< indicates if the current surface has been rendered. Set to false when drawing a surface on this one. */
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_TEXTURE_ATLAS_H
+#define SOLARUS_TEXTURE_ATLAS_H
+
+#include "solarus/Common.h"
+#include "solarus/lowlevel/Rectangle.h"
+#include <memory>
+
+struct SDL_Surface;
+struct SDL_Texture;
+
+namespace Solarus {
+
+/**
+ * \brief Packs the images loaded from files into a few large textures.
+ *
+ * Sprite sheets, tilesets and bitmap fonts are small compared to what the
+ * GPU accepts. Storing them in shared pages means that successive drawings
+ * of different images often use the same texture, which avoids state
+ * changes and allows the renderer to batch them.
+ *
+ * Images that do not fit in a page keep their own texture.
+ * A page is destroyed when it contains no image anymore.
+ */
+class TextureAtlas {
+
+  public:
+
+    class Page;
+
+    /**
+     * \brief An image stored in a page of the atlas.
+     *
+     * The space is released when the region is destroyed.
+     */
+    class Region {
+
+      public:
+
+        Region(const std::shared_ptr<Page>& page, const Rectangle& rectangle);
+        ~Region();
+
+        Region(const Region& other) = delete;
+        Region& operator=(const Region& other) = delete;
+
+        SDL_Texture* get_texture() const;
+        Point get_position() const;
+
+        void update(SDL_Surface& surface);
+
+      private:
+
+        std::shared_ptr<Page> page;    /**< The page that contains this image. */
+        Rectangle rectangle;           /**< Position and size of the image in the page. */
+
+    };
+
+    using RegionPtr = std::unique_ptr<Region>;
+
+    static RegionPtr add_image(SDL_Surface& surface);
+    static void quit();
+
+    static int get_num_pages();
+    static int get_memory_size();
+    static double get_fill_ratio();
+
+};
+
+}
+
+#endif
+
@@ -18,6 +18,7 @@
 #define SOLARUS_EXPORTABLE_TO_LUA_H
 
 #include "solarus/Common.h"
+#include "solarus/lua/LuaEvent.h"
 #include <memory>
 #include <string>
 
@@ -41,6 +42,8 @@ class ExportableToLua:
     void set_known_to_lua(bool known_to_lua);
     bool is_with_lua_table() const;
     void set_with_lua_table(bool with_lua_table);
+    bool has_lua_callback(LuaEvent event) const;
+    void set_lua_callback(LuaEvent event, bool defined);
 
     /**
      * \brief Returns the name identifying this type in Lua.
@@ -54,9 +57,32 @@ class ExportableToLua:
                                   * at least once. */
     bool with_lua_table;         /**< Whether a Lua table was created to make
                                   * this userdata indexable like a table. */
+    LuaEventSet lua_callbacks;   /**< Events defined in the Lua table of this
+                                  * userdata (not in its metatable). */
 
 };
 
+/**
+ * \brief Returns whether the Lua table of this userdata defines a callback.
+ *
+ * Callbacks defined in the metatable of the type are not taken into account.
+ *
+ * \param event The event to test.
+ * \return \c true if the userdata has a non-nil field with this name.
+ */
+inline bool ExportableToLua::has_lua_callback(LuaEvent event) const {
+  return lua_callbacks.test(static_cast<int>(event));
+}
+
+/**
+ * \brief Sets whether the Lua table of this userdata defines a callback.
+ * \param event The event.
+ * \param defined \c true if the userdata has a non-nil field with this name.
+ */
+inline void ExportableToLua::set_lua_callback(LuaEvent event, bool defined) {
+  lua_callbacks.set(static_cast<int>(event), defined);
+}
+
 }
 
 #endif
@@ -28,6 +28,7 @@
 #include "solarus/lowlevel/InputEvent.h"
 #include "solarus/lowlevel/SurfacePtr.h"
 #include "solarus/lua/ExportableToLuaPtr.h"
+#include "solarus/lua/LuaEvent.h"
 #include "solarus/lua/ScopedLuaRef.h"
 #include "solarus/Ability.h"
 #include "solarus/SpritePtr.h"
@@ -37,6 +38,9 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 struct lua_State;
 struct luaL_Reg;
@@ -186,6 +190,10 @@ class LuaContext {
         const ExportableToLua& userdata,
         const std::string& key
     ) const;
+    bool userdata_has_field(
+        const ExportableToLua& userdata,
+        LuaEvent event
+    ) const;
 
     // Timers.
     void add_timer(
@@ -430,6 +438,8 @@ class LuaContext {
       main_api_get_angle,     // TODO remove?
       main_api_get_metatable,
       main_api_get_os,
+      main_api_preload_resources,
+      main_api_get_preload_progress,
 
       // Audio API.
       audio_api_get_sound_volume,
@@ -609,6 +619,8 @@ class LuaContext {
       path_finding_movement_api_set_target,
       path_finding_movement_api_get_speed,
       path_finding_movement_api_set_speed,
+      path_finding_movement_api_is_flow_field_enabled,
+      path_finding_movement_api_set_flow_field_enabled,
       circle_movement_api_set_center,
       circle_movement_api_get_radius,
       circle_movement_api_set_radius,
@@ -759,6 +771,7 @@ class LuaContext {
       map_api_get_entities,
       map_api_get_entities_count,
       map_api_has_entities,
+      map_api_get_entities_in_rectangle,
       map_api_get_hero,
       map_api_set_entities_enabled,
       map_api_remove_entities,
@@ -783,6 +796,7 @@ class LuaContext {
       entity_api_get_bounding_box,
       entity_api_overlaps,
       entity_api_get_distance,
+      entity_api_get_nearby_entities,
       entity_api_get_angle,
       entity_api_get_direction4_to,
       entity_api_get_direction8_to,
@@ -943,7 +957,8 @@ class LuaContext {
       // available to all userdata types
       userdata_meta_gc,
       userdata_meta_newindex_as_table,
-      userdata_meta_index_as_table;
+      userdata_meta_index_as_table,
+      type_metatable_meta_newindex;
 
   private:
 
@@ -967,10 +982,43 @@ class LuaContext {
      * \brief Data associated to any Lua timer.
      */
     struct LuaTimerData {
+      TimerPtr timer;             /**< The timer. */
       ScopedLuaRef callback_ref;  /**< Lua ref of the function to call after the timer. */
       const void* context;        /**< Lua table or userdata the timer is attached to. */
+      uint64_t schedule_id;       /**< Identifies the valid entry of this timer in
+                                   * the schedule, or 0 if it is not scheduled. */
     };
 
+    /**
+     * \brief Entry of the schedule of timers.
+     *
+     * Entries are never removed from the middle of the schedule: when a timer
+     * is rescheduled, its previous entry is just invalidated.
+     */
+    struct ScheduledTimer {
+      uint32_t date;              /**< When the timer should be updated. */
+      uint64_t schedule_id;       /**< Order of scheduling, to break ties. */
+      const Timer* timer;         /**< The timer to update. */
+
+      /**
+       * \brief Returns whether this entry comes after another one.
+       *
+       * This is the comparison of a min-heap: the first entry is the soonest.
+       *
+       * \param other Another entry.
+       * \return \c true if this entry should be handled after the other one.
+       */
+      bool operator>(const ScheduledTimer& other) const {
+        return date > other.date ||
+            (date == other.date && schedule_id > other.schedule_id);
+      }
+    };
+
+    // Scheduling timers.
+    void cancel_timer(LuaTimerData& timer_data);
+    void schedule_timer(const Timer& timer);
+    void rebuild_timer_schedule();
+
     // Executing Lua code.
     bool userdata_has_metafield(
         const ExportableToLua& userdata, const char* key) const;
@@ -1027,6 +1075,8 @@ class LuaContext {
     static void push_game(lua_State* l, Savegame& game);
     static void push_map(lua_State* l, Map& map);
     static void push_entity(lua_State* l, MapEntity& entity);
+    static void push_entity_iterator(lua_State* l, const std::vector<MapEntity*>& entities);
+    static void filter_entities(lua_State* l, int index, std::vector<MapEntity*>& entities);
     static void push_hero(lua_State* l, Hero& hero);
     static void push_npc(lua_State* l, Npc& npc);
     static void push_teletransporter(lua_State* l, Teletransporter& teletransporter);
@@ -1214,6 +1264,7 @@ class LuaContext {
       l_panic,
       l_loader,
       l_get_map_entity_or_global,
+      l_entity_iterator_next,
       l_camera_do_callback,
       l_camera_restore,
       l_treasure_dialog_finished,
@@ -1251,9 +1302,19 @@ class LuaContext {
 
     std::list<LuaMenuData> menus;   /**< The menus currently running in their context.
                                      * Invalid ones are to be removed at the next cycle. */
-    std::map<TimerPtr, LuaTimerData>
+    std::unordered_map<const Timer*, LuaTimerData>
         timers;                     /**< The timers currently running, with
                                      * their context and callback. */
+    std::vector<ScheduledTimer>
+        timer_schedule;             /**< Min-heap of the next update dates of
+                                     * timers that are not suspended. */
+    uint64_t next_timer_schedule_id;
+                                    /**< Id of the next entry of the schedule. */
+    std::unordered_map<const void*, std::vector<TimerPtr>>
+        context_timers;             /**< Timers attached to each context. */
+    std::unordered_set<int>
+        timer_callback_refs;        /**< Lua refs of the callbacks of timers,
+                                     * to detect duplicates in debug mode. */
     std::list<TimerPtr>
         timers_to_remove;           /**< Timers to be removed at the next cycle. */
 
@@ -1268,6 +1329,13 @@ class LuaContext {
                                      * userdata with our __newindex. This is
                                      * only for performance, to avoid Lua
                                      * lookups for callbacks like on_update. */
+    LuaEventSet
+        metatable_callbacks;        /**< Events that may be defined in the
+                                     * metatable of at least one type. */
+    std::map<std::string, LuaEventSet>
+        type_metatable_callbacks;   /**< Events that may be defined in the
+                                     * metatable of each type. Setting them
+                                     * to nil is not detected. */
 
     static const std::map<EntityType, lua_CFunction>
         entity_creation_functions;  /**< Creation function of each entity type. */
@@ -25,6 +25,9 @@ struct lua_State;
 
 namespace Solarus {
 
+class BinaryReader;
+class BinaryWriter;
+
 /**
  * \brief Abstract class for data the can be loaded and optionally saved as Lua.
  */
@@ -37,6 +40,8 @@ class SOLARUS_API LuaData {
 
     virtual bool import_from_lua(lua_State* l) = 0;
     virtual bool export_to_lua(std::ostream& out) const;  // Optional.
+    virtual bool import_from_binary(BinaryReader& reader);  // Optional.
+    virtual bool export_to_binary(BinaryWriter& writer) const;  // Optional.
 
     bool import_from_buffer(const std::string& buffer);
     bool import_from_file(const std::string& file_name);
@@ -48,6 +53,21 @@ class SOLARUS_API LuaData {
     bool export_to_buffer(std::string& buffer) const;
     bool export_to_file(const std::string& file_name) const;
 
+    bool import_from_compiled_buffer(
+        const std::string& buffer,
+        const std::string& compiled_buffer
+    );
+    bool export_to_compiled_buffer(
+        const std::string& buffer,
+        std::string& compiled_buffer
+    ) const;
+
+    static std::string get_compiled_file_name(const std::string& file_name);
+    static std::string read_compiled_quest_file(
+        const std::string& quest_file_name,
+        bool language_specific = false
+    );
+
 };
 
 }
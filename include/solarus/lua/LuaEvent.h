@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_LUA_EVENT_H
+#define SOLARUS_LUA_EVENT_H
+
+#include "solarus/Common.h"
+#include <bitset>
+#include <string>
+
+namespace Solarus {
+
+/**
+ * \brief The callbacks that the engine calls on Lua objects.
+ *
+ * Event names are interned to these small integers so that knowing whether
+ * an object defines a callback is a bit test instead of a Lua lookup.
+ */
+enum class LuaEvent {
+  ON_ABILITY_USED,
+  ON_ACTIVATED,
+  ON_ACTIVATED_REPEAT,
+  ON_ACTIVATING,
+  ON_AMOUNT_CHANGED,
+  ON_ANIMATION_CHANGED,
+  ON_ANIMATION_FINISHED,
+  ON_ATTACKING_HERO,
+  ON_BOUGHT,
+  ON_BUYING,
+  ON_CAMERA_BACK,
+  ON_CHANGED,
+  ON_CLOSED,
+  ON_COLLISION_ENEMY,
+  ON_COLLISION_EXPLOSION,
+  ON_COLLISION_FIRE,
+  ON_COMMAND_PRESSED,
+  ON_COMMAND_RELEASED,
+  ON_CREATED,
+  ON_CUSTOM_ATTACK_RECEIVED,
+  ON_CUT,
+  ON_DEAD,
+  ON_DIALOG_FINISHED,
+  ON_DIALOG_STARTED,
+  ON_DIRECTION_CHANGED,
+  ON_DISABLED,
+  ON_DRAW,
+  ON_DYING,
+  ON_EMPTY,
+  ON_ENABLED,
+  ON_EXPLODED,
+  ON_FINISHED,
+  ON_FRAME_CHANGED,
+  ON_GAME_OVER_FINISHED,
+  ON_GAME_OVER_STARTED,
+  ON_GROUND_BELOW_CHANGED,
+  ON_HURT,
+  ON_HURT_BY_SWORD,
+  ON_IMMOBILIZED,
+  ON_INACTIVATED,
+  ON_INTERACTION,
+  ON_INTERACTION_ITEM,
+  ON_LEFT,
+  ON_LIFTING,
+  ON_LOOKED,
+  ON_MAP_CHANGED,
+  ON_MOVED,
+  ON_MOVEMENT_CHANGED,
+  ON_MOVEMENT_FINISHED,
+  ON_MOVING,
+  ON_NPC_COLLISION_FIRE,
+  ON_NPC_INTERACTION,
+  ON_NPC_INTERACTION_ITEM,
+  ON_OBSTACLE_REACHED,
+  ON_OBTAINED,
+  ON_OBTAINED_TREASURE,
+  ON_OBTAINING,
+  ON_OBTAINING_TREASURE,
+  ON_OPENED,
+  ON_OPENING_TRANSITION_FINISHED,
+  ON_PAUSED,
+  ON_PICKABLE_CREATED,
+  ON_POSITION_CHANGED,
+  ON_POST_DRAW,
+  ON_PRE_DRAW,
+  ON_REGENERATING,
+  ON_REMOVED,
+  ON_RESTARTED,
+  ON_STARTED,
+  ON_STATE_CHANGED,
+  ON_SUSPENDED,
+  ON_TAKING_DAMAGE,
+  ON_UNPAUSED,
+  ON_UPDATE,
+  ON_USING,
+  ON_VARIANT_CHANGED
+};
+
+constexpr int num_lua_events = static_cast<int>(LuaEvent::ON_VARIANT_CHANGED) + 1;
+
+/**
+ * \brief A set of Lua events, for example the callbacks defined on an object.
+ */
+using LuaEventSet = std::bitset<num_lua_events>;
+
+const std::string& get_lua_event_name(LuaEvent event);
+bool get_lua_event_by_name(const std::string& name, LuaEvent& event);
+
+}
+
+#endif
+
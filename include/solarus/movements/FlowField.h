@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_FLOW_FIELD_H
+#define SOLARUS_FLOW_FIELD_H
+
+#include "solarus/Common.h"
+#include "solarus/entities/Layer.h"
+#include "solarus/lowlevel/Point.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Solarus {
+
+class Map;
+class MapEntity;
+
+/**
+ * \brief Distance map toward an entity, shared by all entities chasing it.
+ *
+ * This is a Dijkstra search from the 8*8 square of the target entity, with
+ * the same 16*16 nodes and transitions as PathFinding.
+ * Only the tiles are taken into account: ground that is an obstacle for
+ * some entities only (water, holes, etc.) is considered as blocking, and
+ * dynamic obstacles are checked by each entity when it takes a step.
+ *
+ * The field is rebuilt when the target changes of square or of layer, or
+ * when the tiles change. Then, each entity chasing the target finds its
+ * next steps by following decreasing distances, which is cheap.
+ */
+class SOLARUS_API FlowField {
+
+  public:
+
+    static constexpr int max_distance = 240;  /**< Nodes farther than this from
+                                               * the target are not reached. */
+
+    FlowField(Map& map, const MapEntity& target);
+
+    const MapEntity& get_target() const;
+    void update();
+    std::string compute_path(MapEntity& source, int max_steps) const;
+
+  private:
+
+    /**
+     * \brief Entry of the Dijkstra priority queue.
+     */
+    struct OpenNode {
+      int distance;      /**< distance of the node when the entry was added */
+      int index;         /**< index of the node */
+
+      bool operator<(const OpenNode& other) const;
+    };
+
+    void rebuild();
+    int get_distance(int x8, int y8) const;
+    bool is_step_valid(MapEntity& source, const Point& location, int direction) const;
+
+    Map& map;                           /**< the map */
+    const MapEntity& target;            /**< the entity to reach */
+    int width8;                         /**< number of 8x8 squares on a row of the map */
+    int height8;                        /**< number of 8x8 squares on a column of the map */
+
+    Layer layer;                        /**< layer of the target when the field was built */
+    Point target_node;                  /**< node of the target when the field was built */
+    uint32_t terrain_version;           /**< version of the terrain when the field was built */
+    bool built;                         /**< whether the field was built at least once */
+
+    std::vector<int> distances;         /**< distance of each node to the target
+                                         * (indexed by 8x8 square), -1 if not reached */
+    std::vector<int> reached_nodes;     /**< nodes whose distance is set, to reset them
+                                         * without clearing the whole map */
+    std::vector<OpenNode> open_list;    /**< heap of the Dijkstra search */
+
+};
+
+}
+
+#endif
+
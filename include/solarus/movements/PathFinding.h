@@ -19,15 +19,16 @@
 
 #include "solarus/Common.h"
 #include "solarus/lowlevel/Point.h"
-#include <list>
-#include <map>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace Solarus {
 
 class Map;
 class MapEntity;
-class Rectangle;
+class PathFindingTerrain;
 
 /**
  * \brief Implementation of the A* algorithm to compute a path.
@@ -35,6 +36,10 @@ class Rectangle;
  * In the current implementation, the computed path always corresponds to a
  * shape of 16*16. If the entity to move is bigger, some obstacles may prevent
  * it from following the computed path.
+ *
+ * Nodes are stored in flat arrays indexed by their 8*8 square on the map,
+ * and the open list is a binary heap.
+ * These arrays are reused from one search to the next.
  */
 class SOLARUS_API PathFinding {
 
@@ -50,44 +55,59 @@ class SOLARUS_API PathFinding {
   private:
 
     /**
-     * \brief Represents a node in the path to compute.
+     * \brief State of a node in the path to compute.
      *
      * A node is the location of a 16*16 square of the map.
      * The algorithm tries to find the best sequence of nodes leading to the target.
      */
-    class Node {
-
-     public:
-
-      Point location;     /**< location of this node on the map */
-      int index;          /**< index of this node's square on the map (depends on the location) */
+    struct Node {
+      uint32_t generation;  /**< search that last touched this node:
+                             * the node is unvisited if this is not the
+                             * current one */
+      int previous_cost;    /**< cost of the best path that leads to this node */
+      int parent_index;     /**< index of the square containing the best node leading to this node */
+      char direction;       /**< direction from the parent node to this node ('0' to '7') */
+      bool closed;          /**< whether the best path to this node is known */
+    };
 
-      // total_cost = previous_cost + heuristic
-      int previous_cost;  /**< cost of the best path that leads to this node */
-      int heuristic;      /**< estimation of the remaining cost to the target */
-      int total_cost;     /**< total cost of this node */
+    /**
+     * \brief Entry of the open list.
+     *
+     * When a better path to an open node is found, a new entry is added and
+     * the previous one becomes outdated: it will be skipped when popped.
+     */
+    struct OpenNode {
+      int total_cost;       /**< previous cost + heuristic when the entry was added */
+      uint32_t order;       /**< insertion order, to prefer the last added nodes */
+      int index;            /**< index of the node */
 
-      int parent_index;   /**< index of the square containing the best node leading to this node */
-      char direction;     /**< direction from the parent node to this node (0 to 7) */
+      bool operator<(const OpenNode& other) const;
+    };
 
-      bool operator<(const Node& other) const;
+    /**
+     * \brief Arrays used during a search, reused by later searches.
+     */
+    struct SearchData {
+      std::vector<Node> nodes;            /**< all nodes of the map */
+      std::vector<OpenNode> open_list;    /**< heap of the open nodes */
+      uint32_t generation = 0;            /**< current search */
     };
 
-    int get_square_index(const Point& location) const;
-    bool is_node_transition_valid(const Node& node, int direction) const;
-    void add_index_sorted(Node* node);
-    std::string rebuild_path(const Node* final_node);
+    bool is_node_transition_valid(const Point& location, int direction) const;
+    std::string rebuild_path(const SearchData& data, int final_index) const;
 
-    static const Point neighbours_locations[];
-    static const Rectangle transition_collision_boxes[];
+    static std::unique_ptr<SearchData> acquire_search_data();
+    static void release_search_data(std::unique_ptr<SearchData> data);
 
     Map& map;                          /**< the map */
     MapEntity& source_entity;          /**< the entity to move */
     MapEntity& target_entity;          /**< the target point */
+    PathFindingTerrain& terrain;       /**< static passability on the layer of the source */
 
-    std::map<int, Node> closed_list;   /**< the closed list, indexed by the node locations on the map */
-    std::map<int, Node> open_list;     /**< the open list, indexed by the node locations on the map */
-    std::list<int> open_list_indices;  /**< indices of the open list elements, sorted by priority */
+    static std::vector<std::unique_ptr<SearchData>>
+        free_search_data;              /**< search data not used by any search at the moment
+                                        * (is_obstacle_for() may run Lua code that
+                                        * computes another path during a search) */
 
 };
 
@@ -32,6 +32,11 @@ namespace Solarus {
  * The entity tries to find a path and to avoid the obstacles on the way.
  * To this end, the PathFinding class (i.e. an implementation of the A* algorithm) is used.
  * If the target entity is too far or not reachable, the movement is a random walk.
+ *
+ * Optionally, the movement can follow a flow field toward the target instead:
+ * the field is computed once per map for all entities chasing the same
+ * target, which scales better for crowds of enemies.
+ * A* is still used where the field does not lead to the target.
  */
 class SOLARUS_API PathFindingMovement: public PathMovement {
 
@@ -40,6 +45,8 @@ class SOLARUS_API PathFindingMovement: public PathMovement {
     PathFindingMovement(int speed);
 
     void set_target(const MapEntityPtr& target);
+    bool is_flow_field_enabled() const;
+    void set_flow_field_enabled(bool flow_field_enabled);
     virtual bool is_finished() const override;
 
     virtual const std::string& get_lua_type_name() const override;
@@ -53,6 +60,7 @@ class SOLARUS_API PathFindingMovement: public PathMovement {
 
     MapEntityPtr target;               /**< the entity targeted by this movement (usually the hero) */
     uint32_t next_recomputation_date;
+    bool flow_field_enabled;           /**< whether to follow the flow field toward the target */
 
 };
 
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_PATH_FINDING_TERRAIN_H
+#define SOLARUS_PATH_FINDING_TERRAIN_H
+
+#include "solarus/Common.h"
+#include "solarus/lowlevel/Point.h"
+#include "solarus/lowlevel/Rectangle.h"
+#include <cstdint>
+#include <vector>
+
+namespace Solarus {
+
+class GroundBits;
+
+/**
+ * \brief Static passability of the path finding transitions of a layer.
+ *
+ * Path finding nodes are 16*16 squares aligned on the 8*8 grid of the map.
+ * From each node, a transition to each of the 8 neighbour nodes is possible
+ * if the transition box of that direction does not collide with obstacles.
+ *
+ * This class caches the part of this test that only depends on the tiles:
+ * the borders of the map and the static walls.
+ * Each node is computed the first time it is requested.
+ * Only dynamic obstacles then need to be checked live.
+ */
+class PathFindingTerrain {
+
+  public:
+
+    /**
+     * \brief What the tiles say about a transition.
+     */
+    enum class Transition {
+      BLOCKED,         /**< Blocked by the map border or by static walls. */
+      FREE,            /**< No tile obstacle: only entities need to be checked. */
+      GROUND_DEPENDENT /**< The tiles have grounds that are obstacles only for
+                        * some entities: a full collision test is needed. */
+    };
+
+    PathFindingTerrain(const GroundBits& ground_bits, int width8, int height8);
+
+    Transition get_transition(int x8, int y8, int direction);
+    void notify_ground_changed(int x8, int y8);
+    uint32_t get_version() const;
+
+    static const Point neighbour_offsets[];
+    static const Rectangle transition_boxes[];
+
+  private:
+
+    uint32_t compute_node(int x8, int y8) const;
+
+    const GroundBits& ground_bits;   /**< Wall bits of the tiles of the layer. */
+    int width8;                      /**< Number of 8x8 squares on a row. */
+    int height8;                     /**< Number of 8x8 squares on a column. */
+    std::vector<uint32_t> nodes;     /**< For each node (indexed by its 8x8
+                                      * square): 0 if not computed yet,
+                                      * otherwise COMPUTED_BIT, the blocked
+                                      * directions in bits 0 to 7 and the
+                                      * ground-dependent ones in bits 8 to 15. */
+    uint32_t version;                /**< Incremented when the ground changes. */
+
+    static constexpr uint32_t COMPUTED_BIT = 1 << 16;
+
+};
+
+}
+
+#endif
+
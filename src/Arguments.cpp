@@ -15,7 +15,11 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/Arguments.h"
+#include "solarus/lowlevel/Debug.h"
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <limits>
 
 namespace Solarus {
 
@@ -87,6 +91,37 @@ std::string Arguments::get_argument_value(const std::string& key) const {
   return "";
 }
 
+/**
+ * \brief If there is an argument of the form \c key=value, returns the value
+ * as a non-negative size.
+ *
+ * A warning is printed if the value is not a valid decimal number.
+ *
+ * \param key The key to look for.
+ * \param default_value The value to return if no such argument was passed
+ * or if its value is invalid.
+ * \return The value that was passed for this key, or the default value.
+ */
+size_t Arguments::get_argument_size(const std::string& key, size_t default_value) const {
+
+  const std::string& value = get_argument_value(key);
+  if (value.empty()) {
+    return default_value;
+  }
+
+  char* end = nullptr;
+  errno = 0;
+  const unsigned long long size = std::strtoull(value.c_str(), &end, 10);
+  if (value[0] == '-' ||
+      *end != '\0' ||
+      errno == ERANGE ||
+      size > std::numeric_limits<size_t>::max()) {
+    Debug::warning(std::string("Invalid value for option ") + key + ": '" + value + "'");
+    return default_value;
+  }
+  return static_cast<size_t>(size);
+}
+
 /**
  * \brief Adds an argument.
  * \param argument The string to add.
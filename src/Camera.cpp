@@ -365,7 +365,7 @@ Rectangle Camera::apply_separators(const Rectangle& area) {
   int adjusted_x = x;  // Updated coordinates after applying separators.
   int adjusted_y = y;
   std::list<const Separator*> applied_separators;
-  const std::list<const Separator*>& separators =
+  const std::vector<const Separator*>& separators =
       map.get_entities().get_separators();
   for (const Separator* separator: separators) {
 
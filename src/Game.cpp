@@ -31,6 +31,7 @@
 #include "solarus/KeysEffect.h"
 #include "solarus/MainLoop.h"
 #include "solarus/Map.h"
+#include "solarus/MapCache.h"
 #include "solarus/CurrentQuest.h"
 #include "solarus/Savegame.h"
 #include "solarus/Treasure.h"
@@ -54,6 +55,7 @@ Game::Game(MainLoop& main_loop, const std::shared_ptr<Savegame>& savegame):
   started(false),
   restarting(false),
   keys_effect(),
+  map_cache(new MapCache()),
   current_map(nullptr),
   next_map(nullptr),
   previous_map_surface(nullptr),
@@ -108,6 +110,13 @@ Game::Game(MainLoop& main_loop, const std::shared_ptr<Savegame>& savegame):
   set_current_map(starting_map_id, starting_destination_name, Transition::Style::FADE);
 }
 
+/**
+ * \brief Destroys the game.
+ */
+Game::~Game() {
+
+}
+
 /**
  * \brief Starts this game.
  *
@@ -347,6 +356,7 @@ void Game::update() {
 
   // update the transitions between maps
   update_transitions();
+  map_cache->update();
 
   if (restarting || !started) {
     return;
@@ -363,6 +373,24 @@ void Game::update() {
   update_keys_effect();
 }
 
+/**
+ * \brief Uses the remaining time of the current frame to prepare the
+ * next ones.
+ *
+ * This function is called by the main loop when it has time left before
+ * the next cycle.
+ *
+ * \param deadline Real time when the main loop needs to continue.
+ */
+void Game::notify_idle(uint32_t deadline) {
+
+  if (current_map == nullptr || !current_map->is_started()) {
+    return;
+  }
+
+  current_map->notify_idle(deadline);
+}
+
 /**
  * \brief Handles the transitions.
  *
@@ -564,6 +592,14 @@ Map& Game::get_current_map() {
   return *current_map;
 }
 
+/**
+ * \brief Returns the cache of maps of this game.
+ * \return The map cache.
+ */
+MapCache& Game::get_map_cache() {
+  return *map_cache;
+}
+
 /**
  * \brief Changes the current map.
  *
@@ -14,11 +14,13 @@
  * You should have received a copy of the GNU General Public License along
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
+#include "solarus/entities/NonAnimatedRegions.h"
 #include "solarus/entities/TilePattern.h"
 #include "solarus/lowlevel/Color.h"
 #include "solarus/lowlevel/Debug.h"
 #include "solarus/lowlevel/Music.h"
 #include "solarus/lowlevel/Output.h"
+#include "solarus/lowlevel/Profiler.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Surface.h"
 #include "solarus/lowlevel/System.h"
@@ -28,6 +30,7 @@
 #include "solarus/Game.h"
 #include "solarus/QuestProperties.h"
 #include "solarus/MainLoop.h"
+#include "solarus/ResourcePreloader.h"
 #include "solarus/Savegame.h"
 #include "solarus/Settings.h"
 #include <lua.hpp>
@@ -104,6 +107,8 @@ MainLoop::MainLoop(const Arguments& args):
   // Read the quest resource list from data.
   CurrentQuest::initialize();
   TilePattern::initialize();
+  NonAnimatedRegions::initialize(args);
+  ResourcePreloader::initialize(args);
 
   // Create the quest surface.
   root_surface = Surface::create(
@@ -136,6 +141,8 @@ MainLoop::~MainLoop() {
   root_surface = nullptr;
 
   lua_context->exit();
+  ResourcePreloader::quit();
+  NonAnimatedRegions::quit();
   TilePattern::quit();
   CurrentQuest::quit();
   System::quit();
@@ -264,8 +271,15 @@ void MainLoop::run() {
       draw();
     }
 
-    // 4. Sleep if we have time, to save CPU and GPU cycles.
+    // 4. If we have time, prepare the next frames,
+    // and then sleep to save CPU and GPU cycles.
     last_frame_duration = (System::get_real_time() - time_dropped) - last_frame_date;
+    if (last_frame_duration < System::timestep && game != nullptr) {
+      game->notify_idle(
+          System::get_real_time() + System::timestep - last_frame_duration
+      );
+      last_frame_duration = (System::get_real_time() - time_dropped) - last_frame_date;
+    }
     if (last_frame_duration < System::timestep) {
       System::sleep(System::timestep - last_frame_duration);
     }
@@ -332,8 +346,12 @@ void MainLoop::update() {
   if (game != nullptr) {
     game->update();
   }
-  lua_context->update();
+  {
+    Profiler::ScopedPhase phase(Profiler::Phase::LUA_UPDATE);
+    lua_context->update();
+  }
   System::update();
+  ResourcePreloader::update();
 
   // go to another game?
   if (next_game != game.get()) {
@@ -355,15 +373,20 @@ void MainLoop::update() {
  * \brief Redraws the current screen.
  *
  * This function is called repeatedly by the main loop.
+ * Like step(), you can call it yourself if you don't use run().
  */
 void MainLoop::draw() {
 
+  Profiler::ScopedPhase phase(Profiler::Phase::DRAW);
+
   root_surface->clear();
 
   if (game != nullptr) {
     game->draw(root_surface);
   }
   lua_context->main_on_draw(root_surface);
+
+  Profiler::ScopedPhase render_phase(Profiler::Phase::RENDER);
   Video::render(root_surface);
 }
 
@@ -18,9 +18,11 @@
 #include "solarus/entities/Destination.h"
 #include "solarus/entities/Detector.h"
 #include "solarus/entities/Ground.h"
+#include "solarus/entities/GroundBits.h"
 #include "solarus/entities/Hero.h"
 #include "solarus/entities/MapEntities.h"
 #include "solarus/lowlevel/Music.h"
+#include "solarus/lowlevel/Profiler.h"
 #include "solarus/entities/NonAnimatedRegions.h"
 #include "solarus/entities/TilePattern.h"
 #include "solarus/entities/Tileset.h"
@@ -30,6 +32,7 @@
 #include "solarus/lua/LuaContext.h"
 #include "solarus/Game.h"
 #include "solarus/Map.h"
+#include "solarus/MapCache.h"
 #include "solarus/MapLoader.h"
 #include "solarus/Savegame.h"
 #include "solarus/Sprite.h"
@@ -105,6 +108,7 @@ const std::string& Map::get_tileset_id() const {
  */
 void Map::set_tileset(const std::string& tileset_id) {
 
+  get_game().get_map_cache().notify_tileset_modified(*tileset);
   tileset->set_images(tileset_id);
   get_entities().notify_tileset_changed();
   this->tileset_id = tileset_id;
@@ -514,8 +518,14 @@ void Map::update() {
 
   // update the elements
   TilePattern::update();
-  entities->update();
-  get_lua_context().map_on_update(*this);
+  {
+    Profiler::ScopedPhase phase(Profiler::Phase::ENTITY_UPDATE);
+    entities->update();
+  }
+  {
+    Profiler::ScopedPhase phase(Profiler::Phase::LUA_UPDATE);
+    get_lua_context().map_on_update(*this);
+  }
   camera->update();  // update the camera after the entities since this might
                      // be the last update() call for this map */
 }
@@ -563,6 +573,17 @@ void Map::draw() {
   }
 }
 
+/**
+ * \brief Uses the idle time of the main loop to prepare the next frames.
+ * \param deadline Real time when the main loop needs to continue.
+ */
+void Map::notify_idle(uint32_t deadline) {
+
+  if (is_loaded()) {
+    entities->prefetch_tiles(deadline);
+  }
+}
+
 /**
  * \brief Builds or rebuilds the surface corresponding to the background of
  * the tileset.
@@ -888,19 +909,27 @@ bool Map::test_collision_with_entities(
     const Rectangle& collision_box,
     MapEntity& entity_to_check) const {
 
-  const std::list<MapEntity*>& obstacle_entities =
-      entities->get_obstacle_entities(layer);
+  // Candidates are appended to a buffer shared by all queries.
+  // is_obstacle_for() may run Lua code that makes nested queries, so we only
+  // use our own part of the buffer and index it rather than iterating it.
+  const size_t first = obstacle_candidates.size();
+  entities->get_obstacle_entities(layer, collision_box, obstacle_candidates);
+  const size_t last = obstacle_candidates.size();
 
-  for (MapEntity* entity: obstacle_entities) {
+  bool collision = false;
+  for (size_t i = first; i < last && !collision; ++i) {
 
+    MapEntity* entity = obstacle_candidates[i];
     if (entity->overlaps(collision_box)
         && entity->is_obstacle_for(entity_to_check, collision_box)
         && entity->is_enabled()
-        && entity != &entity_to_check)
-      return true;
+        && entity != &entity_to_check) {
+      collision = true;
+    }
   }
+  obstacle_candidates.resize(first);
 
-  return false;
+  return collision;
 }
 
 /**
@@ -917,6 +946,8 @@ bool Map::test_collision_with_obstacles(
     const Rectangle& collision_box,
     MapEntity& entity_to_check) const {
 
+  Profiler::ScopedPhase phase(Profiler::Phase::COLLISION);
+
   // This function is called very often.
   // For performance reasons, we only check the border of the of the collision box.
 
@@ -927,6 +958,30 @@ bool Map::test_collision_with_obstacles(
   const int y1 = collision_box.get_y();
   const int y2 = y1 + collision_box.get_height() - 1;
 
+  if (collision_box.get_width() > 0
+      && collision_box.get_height() > 0
+      && collision_box.get_width() % 8 == 0
+      && collision_box.get_height() % 8 == 0) {
+
+    // Fast path: outside the map, this is an obstacle.
+    if (test_collision_with_border(x1, y1) || test_collision_with_border(x2, y2)) {
+      return true;
+    }
+
+    // If the border only has static walls and traversable grounds,
+    // the precomputed wall bits of the tiles give the same result as
+    // the point by point checks below.
+    const GroundBits& ground_bits = entities->get_tile_ground_bits(layer);
+    if (!ground_bits.has_entity_dependent_ground_on_border(collision_box)
+        && !entities->overlaps_ground_modifiers(layer, collision_box)) {
+
+      if (ground_bits.has_wall_on_border(collision_box)) {
+        return true;
+      }
+      return test_collision_with_entities(layer, collision_box, entity_to_check);
+    }
+  }
+
   // First, only check the terrain of both extremities of each 8-pixel
   // segment of the border.
   // This is enough for all terrains (except diagonal ones, see below)
@@ -991,6 +1046,8 @@ bool Map::test_collision_with_obstacles(
     int y,
     MapEntity& entity_to_check) const {
 
+  Profiler::ScopedPhase phase(Profiler::Phase::COLLISION);
+
   bool collision;
   bool is_diagonal_wall;
 
@@ -1073,21 +1130,10 @@ Ground Map::get_ground(Layer layer, int x, int y) const {
   }
 
   // See if a dynamic entity changes the ground.
-  // TODO store ground modifiers in a quad tree for performance.
-
-  const std::list<MapEntity*>& ground_modifiers =
-      entities->get_ground_modifiers(layer);
-  std::list<MapEntity*>::const_reverse_iterator it;
-  const std::list<MapEntity*>::const_reverse_iterator rend =
-      ground_modifiers.rend();
-  for (it = ground_modifiers.rbegin(); it != rend; ++it) {
-    const MapEntity& ground_modifier = *(*it);
-    if (ground_modifier.overlaps(x, y)
-        && ground_modifier.get_modified_ground() != Ground::EMPTY
-        && ground_modifier.is_enabled()
-        && !ground_modifier.is_being_removed()) {
-      return ground_modifier.get_modified_ground();
-    }
+  const MapEntity* ground_modifier =
+      entities->get_ground_modifier(layer, Point(x, y));
+  if (ground_modifier != nullptr) {
+    return ground_modifier->get_modified_ground();
   }
 
   // Otherwise, return the ground defined by static tiles (this is very fast).
@@ -1125,15 +1171,23 @@ void Map::check_collision_with_detectors(MapEntity& entity) {
     return;
   }
 
-  // Check this entity with each detector.
-  const std::list<Detector*>& detectors = entities->get_detectors();
-  for (Detector* detector: detectors) {
+  Profiler::ScopedPhase phase(Profiler::Phase::COLLISION);
+
+  // Check this entity with each detector close enough.
+  // Collision callbacks may check other collisions recursively:
+  // each call only works on the part of the buffer it has appended.
+  const size_t first = detector_candidates.size();
+  entities->get_detectors(entity, detector_candidates);
+  const size_t last = detector_candidates.size();
+  for (size_t i = first; i < last; ++i) {
 
+    Detector* detector = detector_candidates[i];
     if (detector->is_enabled()
         && !detector->is_being_removed()) {
       detector->check_collision(entity);
     }
   }
+  detector_candidates.resize(first);
 }
 
 /**
@@ -1151,18 +1205,26 @@ void Map::check_collision_from_detector(Detector& detector) {
     return;
   }
 
+  Profiler::ScopedPhase phase(Profiler::Phase::COLLISION);
+
   // First check the hero.
-  detector.check_collision(get_entities().get_hero());
+  Hero& hero = get_entities().get_hero();
+  detector.check_collision(hero);
 
-  // Check each entity with this detector.
-  const std::list<MapEntityPtr>& all_entities = entities->get_entities();
-  for (const MapEntityPtr& entity: all_entities) {
+  // Check each entity close enough to this detector.
+  const size_t first = detected_candidates.size();
+  entities->get_entities(detector, detected_candidates);
+  const size_t last = detected_candidates.size();
+  for (size_t i = first; i < last; ++i) {
 
-    if (entity->is_enabled()
+    MapEntity* entity = detected_candidates[i];
+    if (entity != &hero
+        && entity->is_enabled()
         && !entity->is_being_removed()) {
       detector.check_collision(*entity);
     }
   }
+  detected_candidates.resize(first);
 }
 
 /**
@@ -1183,10 +1245,14 @@ void Map::check_collision_with_detectors(MapEntity& entity, Sprite& sprite) {
     return;
   }
 
+  Profiler::ScopedPhase phase(Profiler::Phase::COLLISION);
+
   // Check each detector.
-  const std::list<Detector*>& detectors = entities->get_detectors();
-  for (Detector* detector: detectors) {
+  // Iterate by index: collision callbacks may create detectors.
+  const std::vector<Detector*>& detectors = entities->get_detectors();
+  for (size_t i = 0; i < detectors.size(); ++i) {
 
+    Detector* detector = detectors[i];
     if (!detector->is_being_removed()
         && detector->is_enabled()) {
       detector->check_collision(entity, sprite);
@@ -0,0 +1,575 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/EntityType.h"
+#include "solarus/entities/TilePattern.h"
+#include "solarus/entities/Tileset.h"
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/ImageCache.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/CurrentQuest.h"
+#include "solarus/EntityData.h"
+#include "solarus/MapCache.h"
+#include "solarus/MapData.h"
+#include <algorithm>
+
+namespace Solarus {
+
+constexpr size_t MapCache::max_maps;
+constexpr size_t MapCache::max_tilesets;
+
+/**
+ * \brief Creates an empty map cache.
+ */
+MapCache::MapCache():
+  num_hits(0),
+  num_misses(0),
+  stopping(false) {
+
+}
+
+/**
+ * \brief Destroys the map cache and stops its thread.
+ */
+MapCache::~MapCache() {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  maps_changed.notify_all();
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+/**
+ * \brief Returns the data of a map, parsing it if it is not in the cache.
+ *
+ * If the map is being prefetched, waits for the background thread.
+ *
+ * \param map_id Id of the map.
+ * \return The map data, or nullptr if the map file could not be loaded.
+ */
+std::shared_ptr<const MapData> MapCache::get_map_data(const std::string& map_id) {
+
+  if (maps_prefetching.find(map_id) != maps_prefetching.end()) {
+    const auto it = std::find(maps_to_read.begin(), maps_to_read.end(), map_id);
+    if (it != maps_to_read.end()) {
+      // Not read yet: load it right now instead.
+      maps_to_read.erase(it);
+      maps_prefetching.erase(map_id);
+    }
+    else {
+      wait_for_map(map_id);
+    }
+  }
+  install_parsed_maps();
+
+  const auto it = maps.find(map_id);
+  if (it != maps.end()) {
+    ++num_hits;
+    touch_map(map_id);
+    return it->second;
+  }
+
+  ++num_misses;
+  const std::shared_ptr<MapData>& data = std::make_shared<MapData>();
+  const std::string& file_name = std::string("maps/") + map_id + ".dat";
+  if (!data->import_from_quest_file(file_name)) {
+    return nullptr;
+  }
+  add_map(map_id, data);
+  return data;
+}
+
+/**
+ * \brief Returns a tileset, loading it if it is not in the cache.
+ *
+ * The tileset is shared by all maps that use it.
+ * If the tileset is being prefetched, waits for the background thread.
+ *
+ * \param tileset_id Id of the tileset.
+ * \return The loaded tileset.
+ */
+std::shared_ptr<Tileset> MapCache::get_tileset(const std::string& tileset_id) {
+
+  if (tilesets_prefetching.find(tileset_id) != tilesets_prefetching.end()) {
+    wait_for_tileset(tileset_id);
+  }
+  install_parsed_tilesets();
+
+  const auto it = tilesets.find(tileset_id);
+  if (it != tilesets.end()) {
+    ++num_hits;
+    touch_tileset(tileset_id);
+    return it->second;
+  }
+
+  ++num_misses;
+  const std::shared_ptr<Tileset>& tileset = std::make_shared<Tileset>(tileset_id);
+  tileset->load();
+  add_tileset(tileset_id, tileset);
+  return tileset;
+}
+
+/**
+ * \brief Notifies the cache that a map changed the images of its tileset.
+ *
+ * The modified tileset is no longer given to other maps.
+ *
+ * \param tileset The tileset modified.
+ */
+void MapCache::notify_tileset_modified(const Tileset& tileset) {
+
+  const auto it = tilesets.find(tileset.get_id());
+  if (it != tilesets.end() && it->second.get() == &tileset) {
+    tilesets.erase(it);
+    recent_tilesets.remove(tileset.get_id());
+  }
+}
+
+/**
+ * \brief Schedules the prefetching of the maps reachable from a map through
+ * teletransporters.
+ *
+ * The maps and then their tilesets are read and parsed later,
+ * by update() and the worker thread.
+ *
+ * \param map_id Id of the map.
+ * \param data The data of this map.
+ */
+void MapCache::prefetch_destinations(const std::string& map_id, const MapData& data) {
+
+  destination_maps.clear();
+  destination_tilesets.clear();
+  for (int layer = 0; layer < LAYER_NB; ++layer) {
+    const int num_entities = data.get_num_entities(Layer(layer));
+    for (int i = 0; i < num_entities; ++i) {
+      const EntityData& entity_data = data.get_entity({ Layer(layer), i });
+      if (entity_data.get_type() != EntityType::TELETRANSPORTER) {
+        continue;
+      }
+
+      const std::string& destination_map_id = entity_data.get_string("destination_map");
+      if (destination_map_id == map_id ||
+          !CurrentQuest::resource_exists(ResourceType::MAP, destination_map_id)) {
+        continue;
+      }
+
+      if (std::find(destination_maps.begin(), destination_maps.end(), destination_map_id) ==
+          destination_maps.end()) {
+        destination_maps.push_back(destination_map_id);
+      }
+      if (maps.find(destination_map_id) != maps.end()) {
+        continue;
+      }
+
+      if (maps_prefetching.insert(destination_map_id).second) {
+        maps_to_read.push_back(destination_map_id);
+      }
+    }
+  }
+}
+
+/**
+ * \brief Makes some progress in the prefetching.
+ *
+ * This function is called at each cycle of the game. It reads at most one
+ * map file or the files of one tileset for the worker thread,
+ * and creates the tilesets parsed by the worker.
+ */
+void MapCache::update() {
+
+  install_parsed_maps();
+  install_parsed_tilesets();
+
+  if (!maps_to_read.empty()) {
+    const std::string map_id = maps_to_read.front();
+    maps_to_read.pop_front();
+
+    const std::string& file_name = std::string("maps/") + map_id + ".dat";
+    if (!QuestFiles::data_file_exists(file_name)) {
+      maps_prefetching.erase(map_id);
+    }
+    else {
+      MapToParse map_to_parse;
+      map_to_parse.map_id = map_id;
+      map_to_parse.buffer = QuestFiles::data_file_read(file_name);
+      map_to_parse.compiled_buffer = LuaData::read_compiled_quest_file(file_name);
+
+      start_worker();
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        maps_to_parse.push_back(std::move(map_to_parse));
+      }
+      maps_changed.notify_all();
+    }
+    return;
+  }
+
+  // Prefetch the tileset of a destination map, keeping room for the
+  // tileset of the current map.
+  for (auto it = destination_maps.begin(); it != destination_maps.end();) {
+    const auto map_it = maps.find(*it);
+    if (map_it == maps.end()) {
+      if (maps_prefetching.find(*it) == maps_prefetching.end()) {
+        // The map could not be parsed.
+        it = destination_maps.erase(it);
+      }
+      else {
+        ++it;
+      }
+      continue;
+    }
+
+    const std::string tileset_id = map_it->second->get_tileset_id();
+    it = destination_maps.erase(it);
+    if (destination_tilesets.find(tileset_id) != destination_tilesets.end()) {
+      continue;
+    }
+    if (destination_tilesets.size() + 1 >= max_tilesets) {
+      // Prefetching more would evict the ones just prefetched.
+      destination_maps.clear();
+      return;
+    }
+
+    destination_tilesets.insert(tileset_id);
+    if (tilesets.find(tileset_id) != tilesets.end()) {
+      touch_tileset(tileset_id);
+    }
+    else if (tilesets_prefetching.find(tileset_id) == tilesets_prefetching.end()) {
+      prefetch_tileset(tileset_id);
+      return;
+    }
+  }
+}
+
+/**
+ * \brief Returns how many times a map or a tileset was found in the cache.
+ * \return The number of cache hits.
+ */
+int MapCache::get_num_hits() const {
+  return num_hits;
+}
+
+/**
+ * \brief Returns how many times a map or a tileset had to be loaded on
+ * demand.
+ * \return The number of cache misses.
+ */
+int MapCache::get_num_misses() const {
+  return num_misses;
+}
+
+/**
+ * \brief Marks a cached map as the most recently used one.
+ * \param map_id Id of a map in the cache.
+ */
+void MapCache::touch_map(const std::string& map_id) {
+
+  const auto it = std::find(recent_maps.begin(), recent_maps.end(), map_id);
+  if (it != recent_maps.begin()) {
+    recent_maps.splice(recent_maps.begin(), recent_maps, it);
+  }
+}
+
+/**
+ * \brief Adds a map to the cache.
+ *
+ * The least recently used maps are removed if there are too many.
+ * This can also provide a map that does not exist in the quest files,
+ * like a map generated by a program.
+ *
+ * \param map_id Id of the map.
+ * \param data Its parsed data.
+ */
+void MapCache::add_map(
+    const std::string& map_id,
+    const std::shared_ptr<const MapData>& data) {
+
+  if (maps.find(map_id) != maps.end()) {
+    recent_maps.remove(map_id);
+  }
+  maps[map_id] = data;
+  recent_maps.push_front(map_id);
+
+  while (recent_maps.size() > max_maps) {
+    maps.erase(recent_maps.back());
+    recent_maps.pop_back();
+  }
+}
+
+/**
+ * \brief Adds to the cache the maps parsed by the worker thread.
+ */
+void MapCache::install_parsed_maps() {
+
+  std::deque<MapToParse> results;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    results.swap(parsed_maps);
+  }
+
+  for (MapToParse& result: results) {
+    maps_prefetching.erase(result.map_id);
+    if (result.data != nullptr) {
+      // Errors are reported again if the map is really loaded.
+      add_map(result.map_id, result.data);
+    }
+  }
+}
+
+/**
+ * \brief Waits until the worker thread has parsed a map.
+ * \param map_id Id of a map given to the worker thread.
+ */
+void MapCache::wait_for_map(const std::string& map_id) {
+
+  std::unique_lock<std::mutex> lock(mutex);
+  maps_changed.wait(lock, [&] {
+    return parsing_map_id != map_id &&
+        std::none_of(maps_to_parse.begin(), maps_to_parse.end(),
+            [&](const MapToParse& map_to_parse) {
+      return map_to_parse.map_id == map_id;
+    });
+  });
+}
+
+/**
+ * \brief Marks a cached tileset as the most recently used one.
+ * \param tileset_id Id of a tileset in the cache.
+ */
+void MapCache::touch_tileset(const std::string& tileset_id) {
+
+  const auto it = std::find(recent_tilesets.begin(), recent_tilesets.end(), tileset_id);
+  if (it != recent_tilesets.begin()) {
+    recent_tilesets.splice(recent_tilesets.begin(), recent_tilesets, it);
+  }
+}
+
+/**
+ * \brief Adds a loaded tileset to the cache.
+ *
+ * The least recently used tilesets are removed if there are too many,
+ * unless a map still uses them.
+ *
+ * \param tileset_id Id of the tileset.
+ * \param tileset The tileset.
+ */
+void MapCache::add_tileset(
+    const std::string& tileset_id,
+    const std::shared_ptr<Tileset>& tileset) {
+
+  if (tilesets.find(tileset_id) != tilesets.end()) {
+    recent_tilesets.remove(tileset_id);
+  }
+  tilesets[tileset_id] = tileset;
+  recent_tilesets.push_front(tileset_id);
+
+  auto it = recent_tilesets.end();
+  while (tilesets.size() > max_tilesets && it != recent_tilesets.begin()) {
+    --it;
+    const auto tileset_it = tilesets.find(*it);
+    if (tileset_it->second.use_count() == 1) {
+      // No map uses it.
+      tilesets.erase(tileset_it);
+      it = recent_tilesets.erase(it);
+    }
+  }
+}
+
+/**
+ * \brief Reads the files of a tileset and gives them to the worker thread.
+ *
+ * Images already in the image cache are not read again.
+ *
+ * \param tileset_id Id of the tileset.
+ */
+void MapCache::prefetch_tileset(const std::string& tileset_id) {
+
+  const std::string& file_name = std::string("tilesets/") + tileset_id + ".dat";
+  if (!QuestFiles::data_file_exists(file_name)) {
+    // The error will be reported if the tileset is really loaded.
+    return;
+  }
+
+  TilesetToParse tileset_to_parse;
+  tileset_to_parse.tileset_id = tileset_id;
+  tileset_to_parse.buffer = QuestFiles::data_file_read(file_name);
+
+  const std::string& tiles_image_file_name =
+      std::string("tilesets/") + tileset_id + ".tiles.png";
+  if (!ImageCache::has_image(tiles_image_file_name) &&
+      QuestFiles::data_file_exists(tiles_image_file_name)) {
+    tileset_to_parse.tiles_image_buffer = QuestFiles::data_file_read(tiles_image_file_name);
+  }
+  const std::string& entities_image_file_name =
+      std::string("tilesets/") + tileset_id + ".entities.png";
+  if (!ImageCache::has_image(entities_image_file_name) &&
+      QuestFiles::data_file_exists(entities_image_file_name)) {
+    tileset_to_parse.entities_image_buffer = QuestFiles::data_file_read(entities_image_file_name);
+  }
+
+  tilesets_prefetching.insert(tileset_id);
+  start_worker();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tilesets_to_parse.push_back(std::move(tileset_to_parse));
+  }
+  maps_changed.notify_all();
+}
+
+/**
+ * \brief Creates the tilesets parsed by the worker thread and adds them
+ * to the cache.
+ *
+ * Their decoded images go to the image cache: only the textures are
+ * created here.
+ */
+void MapCache::install_parsed_tilesets() {
+
+  std::deque<TilesetToParse> results;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    results.swap(parsed_tilesets);
+  }
+
+  for (TilesetToParse& result: results) {
+    const std::string& tileset_id = result.tileset_id;
+    tilesets_prefetching.erase(tileset_id);
+    if (result.data == nullptr || tilesets.find(tileset_id) != tilesets.end()) {
+      // Errors are reported again if the tileset is really loaded.
+      continue;
+    }
+
+    Debug::print_deferred_messages(result.messages);
+    if (result.tiles_image != nullptr) {
+      ImageCache::add_image(
+          std::string("tilesets/") + tileset_id + ".tiles.png", result.tiles_image);
+    }
+    if (result.entities_image != nullptr) {
+      ImageCache::add_image(
+          std::string("tilesets/") + tileset_id + ".entities.png", result.entities_image);
+    }
+
+    const std::shared_ptr<Tileset>& tileset = std::make_shared<Tileset>(tileset_id);
+    tileset->load(*result.data);
+    add_tileset(tileset_id, tileset);
+  }
+}
+
+/**
+ * \brief Waits until the worker thread has parsed a tileset.
+ * \param tileset_id Id of a tileset given to the worker thread.
+ */
+void MapCache::wait_for_tileset(const std::string& tileset_id) {
+
+  std::unique_lock<std::mutex> lock(mutex);
+  maps_changed.wait(lock, [&] {
+    return parsing_tileset_id != tileset_id &&
+        std::none_of(tilesets_to_parse.begin(), tilesets_to_parse.end(),
+            [&](const TilesetToParse& tileset_to_parse) {
+      return tileset_to_parse.tileset_id == tileset_id;
+    });
+  });
+}
+
+/**
+ * \brief Creates the worker thread if it is not running yet.
+ */
+void MapCache::start_worker() {
+
+  if (!worker.joinable()) {
+    worker = std::thread([this] { run_worker(); });
+  }
+}
+
+/**
+ * \brief Function executed by the worker thread.
+ *
+ * Maps are parsed before tilesets, because tilesets to prefetch are only
+ * known once their maps are parsed.
+ * Errors are not printed by this thread: they are kept with the results.
+ */
+void MapCache::run_worker() {
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    maps_changed.wait(lock, [this] {
+      return stopping || !maps_to_parse.empty() || !tilesets_to_parse.empty();
+    });
+    if (stopping) {
+      return;
+    }
+
+    if (maps_to_parse.empty()) {
+      TilesetToParse tileset_to_parse = std::move(tilesets_to_parse.front());
+      tilesets_to_parse.pop_front();
+      parsing_tileset_id = tileset_to_parse.tileset_id;
+      lock.unlock();
+
+      Debug::set_deferred_messages(&tileset_to_parse.messages);
+      const std::shared_ptr<TilesetData>& data = std::make_shared<TilesetData>();
+      if (data->import_from_buffer(tileset_to_parse.buffer)) {
+        tileset_to_parse.data = data;
+      }
+      if (!tileset_to_parse.tiles_image_buffer.empty()) {
+        tileset_to_parse.tiles_image =
+            ImageCache::decode_image(tileset_to_parse.tiles_image_buffer);
+      }
+      if (!tileset_to_parse.entities_image_buffer.empty()) {
+        tileset_to_parse.entities_image =
+            ImageCache::decode_image(tileset_to_parse.entities_image_buffer);
+      }
+      Debug::set_deferred_messages(nullptr);
+      tileset_to_parse.buffer.clear();
+      tileset_to_parse.tiles_image_buffer.clear();
+      tileset_to_parse.entities_image_buffer.clear();
+
+      lock.lock();
+      parsing_tileset_id.clear();
+      parsed_tilesets.push_back(std::move(tileset_to_parse));
+      maps_changed.notify_all();
+      continue;
+    }
+
+    MapToParse map_to_parse = std::move(maps_to_parse.front());
+    maps_to_parse.pop_front();
+    parsing_map_id = map_to_parse.map_id;
+    lock.unlock();
+
+    // Errors are reported again if the map is really loaded.
+    std::vector<Debug::DeferredMessage> messages;
+    Debug::set_deferred_messages(&messages);
+    const std::shared_ptr<MapData>& data = std::make_shared<MapData>();
+    if (data->import_from_compiled_buffer(map_to_parse.buffer, map_to_parse.compiled_buffer) ||
+        data->import_from_buffer(map_to_parse.buffer)) {
+      map_to_parse.data = data;
+    }
+    Debug::set_deferred_messages(nullptr);
+    map_to_parse.buffer.clear();
+    map_to_parse.compiled_buffer.clear();
+
+    lock.lock();
+    parsing_map_id.clear();
+    parsed_maps.push_back(std::move(map_to_parse));
+    maps_changed.notify_all();
+  }
+}
+
+}
+
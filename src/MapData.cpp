@@ -15,10 +15,12 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/entities/EntityTypeInfo.h"
+#include "solarus/lowlevel/BinaryBuffer.h"
 #include "solarus/lowlevel/Debug.h"
 #include "solarus/lua/LuaTools.h"
 #include "solarus/MapData.h"
 #include <ostream>
+#include <vector>
 
 namespace Solarus {
 
@@ -743,6 +745,94 @@ int l_properties(lua_State* l) {
   });
 }
 
+/**
+ * \brief Strings of a compiled map file.
+ *
+ * Each distinct string is stored once, records refer to it by index.
+ */
+class StringTable {
+
+  public:
+
+    /**
+     * \brief Returns the index of a string, adding it if necessary.
+     * \param value A string.
+     * \return Its index in the table.
+     */
+    uint32_t get_index(const std::string& value) {
+
+      const auto it = indexes.find(value);
+      if (it != indexes.end()) {
+        return it->second;
+      }
+      const uint32_t index = static_cast<uint32_t>(strings.size());
+      indexes.emplace(value, index);
+      strings.push_back(value);
+      return index;
+    }
+
+    /**
+     * \brief Writes the table.
+     * \param writer Where to write.
+     */
+    void write(BinaryWriter& writer) const {
+
+      writer.write_uint32(static_cast<uint32_t>(strings.size()));
+      for (const std::string& value : strings) {
+        writer.write_uint32(static_cast<uint32_t>(value.size()));
+        writer.write_bytes(value.data(), value.size());
+      }
+    }
+
+    /**
+     * \brief Reads a table.
+     * \param reader Where to read.
+     * \return \c false if the data is not valid.
+     */
+    bool read(BinaryReader& reader) {
+
+      uint32_t num_strings = 0;
+      if (!reader.read_uint32(num_strings) ||
+          num_strings > reader.get_num_remaining() / 4) {
+        return false;
+      }
+      strings.reserve(num_strings);
+      for (uint32_t i = 0; i < num_strings; ++i) {
+        uint32_t size = 0;
+        const char* bytes = nullptr;
+        if (!reader.read_uint32(size) ||
+            !reader.read_bytes(size, bytes)) {
+          return false;
+        }
+        strings.emplace_back(bytes, size);
+      }
+      return true;
+    }
+
+    /**
+     * \brief Reads a string index and returns the corresponding string.
+     * \param reader Where to read.
+     * \param value The string.
+     * \return \c false if the data is not valid.
+     */
+    bool read_string(BinaryReader& reader, const std::string*& value) const {
+
+      uint32_t index = 0;
+      if (!reader.read_uint32(index) ||
+          index >= strings.size()) {
+        return false;
+      }
+      value = &strings[index];
+      return true;
+    }
+
+  private:
+
+    std::map<std::string, uint32_t> indexes;   /**< Index of each string. */
+    std::vector<std::string> strings;          /**< The strings by index. */
+
+};
+
 }  // Anonymous namespace
 
 /**
@@ -795,5 +885,202 @@ bool MapData::export_to_lua(std::ostream& out) const {
   return true;
 }
 
+/**
+ * \copydoc LuaData::import_from_binary
+ *
+ * The binary part of a compiled map file is:
+ * - the string table,
+ * - the properties: x, y, width, height, floor, then the world, tileset
+ *   and music strings,
+ * - the number of entities, then one record per entity: type string,
+ *   layer, x, y, name string and number of fields,
+ *   followed by one record per field: key string, value type and value
+ *   (a string index for strings).
+ *
+ * All values are 32-bit integers.
+ */
+bool MapData::import_from_binary(BinaryReader& reader) {
+
+  StringTable strings;
+  if (!strings.read(reader)) {
+    return false;
+  }
+
+  // Properties.
+  int32_t x = 0, y = 0, width = 0, height = 0, floor = 0;
+  const std::string* world = nullptr;
+  const std::string* tileset_id = nullptr;
+  const std::string* music_id = nullptr;
+  if (!reader.read_int32(x) ||
+      !reader.read_int32(y) ||
+      !reader.read_int32(width) ||
+      !reader.read_int32(height) ||
+      !reader.read_int32(floor) ||
+      !strings.read_string(reader, world) ||
+      !strings.read_string(reader, tileset_id) ||
+      !strings.read_string(reader, music_id)) {
+    return false;
+  }
+
+  MapData data;
+  data.set_location({ x, y });
+  data.set_size({ width, height });
+  data.set_world(*world);
+  data.set_floor(floor);
+  data.set_tileset_id(*tileset_id);
+  data.set_music_id(*music_id);
+
+  // Entities.
+  std::map<std::string, EntityType> types_by_name;
+  for (const auto& kvp : EntityTypeInfo::get_entity_type_names()) {
+    types_by_name.emplace(kvp.second, kvp.first);
+  }
+
+  uint32_t num_entities = 0;
+  if (!reader.read_uint32(num_entities)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_entities; ++i) {
+
+    const std::string* type_name = nullptr;
+    uint32_t layer = 0;
+    int32_t entity_x = 0, entity_y = 0;
+    const std::string* name = nullptr;
+    uint32_t num_fields = 0;
+    if (!strings.read_string(reader, type_name) ||
+        !reader.read_uint32(layer) ||
+        !reader.read_int32(entity_x) ||
+        !reader.read_int32(entity_y) ||
+        !strings.read_string(reader, name) ||
+        !reader.read_uint32(num_fields)) {
+      return false;
+    }
+
+    const auto it = types_by_name.find(*type_name);
+    if (it == types_by_name.end() || layer >= LAYER_NB) {
+      return false;
+    }
+
+    EntityData entity(it->second);
+    entity.set_name(*name);
+    entity.set_layer(static_cast<Layer>(layer));
+    entity.set_xy({ entity_x, entity_y });
+
+    for (uint32_t j = 0; j < num_fields; ++j) {
+      const std::string* key = nullptr;
+      uint32_t value_type = 0;
+      if (!strings.read_string(reader, key) ||
+          !reader.read_uint32(value_type)) {
+        return false;
+      }
+
+      switch (static_cast<EntityData::EntityFieldType>(value_type)) {
+
+      case EntityData::EntityFieldType::STRING:
+      {
+        const std::string* value = nullptr;
+        if (!strings.read_string(reader, value) ||
+            !entity.is_string(*key)) {
+          return false;
+        }
+        entity.set_string(*key, *value);
+        break;
+      }
+
+      case EntityData::EntityFieldType::INTEGER:
+      {
+        int32_t value = 0;
+        if (!reader.read_int32(value) ||
+            !entity.is_integer(*key)) {
+          return false;
+        }
+        entity.set_integer(*key, value);
+        break;
+      }
+
+      case EntityData::EntityFieldType::BOOLEAN:
+      {
+        int32_t value = 0;
+        if (!reader.read_int32(value) ||
+            !entity.is_boolean(*key)) {
+          return false;
+        }
+        entity.set_boolean(*key, value != 0);
+        break;
+      }
+
+      default:
+        return false;
+      }
+    }
+
+    if (!data.add_entity(entity).is_valid()) {
+      return false;
+    }
+  }
+
+  *this = std::move(data);
+  return true;
+}
+
+/**
+ * \copydoc LuaData::export_to_binary
+ */
+bool MapData::export_to_binary(BinaryWriter& writer) const {
+
+  // Records are written first to fill the string table.
+  StringTable strings;
+  std::string records;
+  BinaryWriter records_writer(records);
+
+  records_writer.write_int32(get_location().x);
+  records_writer.write_int32(get_location().y);
+  records_writer.write_int32(get_size().width);
+  records_writer.write_int32(get_size().height);
+  records_writer.write_int32(get_floor());
+  records_writer.write_uint32(strings.get_index(get_world()));
+  records_writer.write_uint32(strings.get_index(get_tileset_id()));
+  records_writer.write_uint32(strings.get_index(get_music_id()));
+
+  records_writer.write_uint32(static_cast<uint32_t>(get_num_entities()));
+  for (const EntityList& layer_entities : entities) {
+    for (const EntityData& entity_data : layer_entities.entities) {
+
+      const std::map<std::string, EntityData::FieldValue>& fields =
+          entity_data.get_fields();
+      records_writer.write_uint32(strings.get_index(entity_data.get_type_name()));
+      records_writer.write_uint32(static_cast<uint32_t>(entity_data.get_layer()));
+      records_writer.write_int32(entity_data.get_xy().x);
+      records_writer.write_int32(entity_data.get_xy().y);
+      records_writer.write_uint32(strings.get_index(entity_data.get_name()));
+      records_writer.write_uint32(static_cast<uint32_t>(fields.size()));
+
+      for (const auto& kvp : fields) {
+        const EntityData::FieldValue& value = kvp.second;
+        records_writer.write_uint32(strings.get_index(kvp.first));
+        records_writer.write_uint32(static_cast<uint32_t>(value.value_type));
+        switch (value.value_type) {
+
+        case EntityData::EntityFieldType::STRING:
+          records_writer.write_uint32(strings.get_index(value.string_value));
+          break;
+
+        case EntityData::EntityFieldType::INTEGER:
+        case EntityData::EntityFieldType::BOOLEAN:
+          records_writer.write_int32(value.int_value);
+          break;
+
+        case EntityData::EntityFieldType::NIL:
+          return false;
+        }
+      }
+    }
+  }
+
+  strings.write(writer);
+  writer.write_bytes(records.data(), records.size());
+  return true;
+}
+
 }  // namespace Solarus
 
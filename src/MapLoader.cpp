@@ -14,8 +14,10 @@
  * You should have received a copy of the GNU General Public License along
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
+#include "solarus/entities/AnimatedRegions.h"
 #include "solarus/entities/EntityType.h"
 #include "solarus/entities/EntityTypeInfo.h"
+#include "solarus/entities/GroundBits.h"
 #include "solarus/entities/Layer.h"
 #include "solarus/entities/MapEntities.h"
 #include "solarus/entities/MapEntity.h"
@@ -28,6 +30,7 @@
 #include "solarus/lowlevel/Surface.h"
 #include "solarus/lua/LuaContext.h"
 #include "solarus/lua/LuaTools.h"
+#include "solarus/MapCache.h"
 #include "solarus/MapLoader.h"
 #include "solarus/Map.h"
 #include "solarus/Game.h"
@@ -51,14 +54,15 @@ MapLoader::MapLoader() {
  */
 void MapLoader::load_map(Game& game, Map& map) {
 
-  // Read the map data file.
-  MapData data;
-  const std::string& file_name = std::string("maps/") + map.get_id() + ".dat";
-  bool success = data.import_from_quest_file(file_name);
+  // Get the map data file, maybe already parsed.
+  MapCache& map_cache = game.get_map_cache();
+  const std::shared_ptr<const MapData>& data_ptr = map_cache.get_map_data(map.get_id());
 
-  if (!success) {
+  if (data_ptr == nullptr) {
+    const std::string& file_name = std::string("maps/") + map.get_id() + ".dat";
     Debug::die("Failed to load map data file '" + file_name + "'");
   }
+  const MapData& data = *data_ptr;
 
   // Initialize the map from the data just read.
   // TODO make a method in Map instead of changing directly the fields.
@@ -71,8 +75,7 @@ void MapLoader::load_map(Game& game, Map& map) {
   map.set_world(data.get_world());
   map.set_floor(data.get_floor());
   map.tileset_id = data.get_tileset_id();
-  map.tileset = std::unique_ptr<Tileset>(new Tileset(data.get_tileset_id()));
-  map.tileset->load();
+  map.tileset = map_cache.get_tileset(data.get_tileset_id());
 
   MapEntities& entities = map.get_entities();
   entities.map_width8 = map.width8;
@@ -84,11 +87,18 @@ void MapLoader::load_map(Game& game, Map& map) {
     for (int i = 0; i < entities.tiles_grid_size; ++i) {
       entities.tiles_ground[layer].push_back(initial_ground);
     }
+    entities.tiles_ground_bits[layer] = std::unique_ptr<GroundBits>(
+        new GroundBits(map.width8, map.height8)
+    );
 
     entities.non_animated_regions[layer] = std::unique_ptr<NonAnimatedRegions>(
         new NonAnimatedRegions(map, Layer(layer))
     );
+    entities.animated_regions[layer] = std::unique_ptr<AnimatedRegions>(
+        new AnimatedRegions(map, Layer(layer))
+    );
   }
+  entities.initialize_grids();
   entities.boomerang = nullptr;
   map.camera = std::unique_ptr<Camera>(new Camera(map));
 
@@ -107,6 +117,9 @@ void MapLoader::load_map(Game& game, Map& map) {
       }
     }
   }
+
+  // Prepare the maps that can be reached from here.
+  map_cache.prefetch_destinations(map.get_id(), data);
 }
 
 }
@@ -0,0 +1,667 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/ImageCache.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lowlevel/Sound.h"
+#include "solarus/lowlevel/System.h"
+#include "solarus/lowlevel/Video.h"
+#include "solarus/Arguments.h"
+#include "solarus/CurrentQuest.h"
+#include "solarus/MapData.h"
+#include "solarus/ResourcePreloader.h"
+#include "solarus/Sprite.h"
+#include "solarus/SpriteData.h"
+#include <SDL.h>
+#include <SDL_image.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace Solarus {
+
+namespace ResourcePreloader {
+
+namespace {
+
+/**
+ * \brief Kinds of files handled by the preloader.
+ */
+enum class JobType {
+  MAP,       /**< A map data file, only parsed to know its tileset. */
+  SPRITE,    /**< A sprite data file. */
+  IMAGE,     /**< A PNG image of a tileset or a sprite. */
+  SOUND      /**< An Ogg Vorbis sound. */
+};
+
+struct SDL_Surface_Deleter {
+  void operator()(SDL_Surface* sdl_surface) {
+    SDL_FreeSurface(sdl_surface);
+  }
+};
+using SDL_Surface_UniquePtr = std::unique_ptr<SDL_Surface, SDL_Surface_Deleter>;
+
+/**
+ * \brief A file to preload.
+ *
+ * The main thread reads the file, a worker thread decodes it and the main
+ * thread finally installs the result.
+ */
+struct Job {
+  JobType type;                              /**< Kind of file. */
+  std::string id;                            /**< Resource id, or file name for images. */
+  std::string file_name;                     /**< File to read, relative to the data directory. */
+  std::string encoded_data;                  /**< Content of the file. */
+  std::string compiled_data;                 /**< Content of the compiled data file, if any. */
+  bool success;                              /**< Whether the file could be decoded. */
+  std::string error_message;                 /**< Why the file could not be decoded. */
+  std::vector<Debug::DeferredMessage>
+      messages;                              /**< Errors and warnings of the worker thread. */
+  std::string tileset_id;                    /**< Tileset of a map. */
+  std::unique_ptr<SpriteData> sprite_data;   /**< Content of a sprite data file. */
+  SDL_Surface_UniquePtr image;               /**< Image decoded in the video pixel format. */
+  Sound::PcmData pcm;                        /**< Decoded sound. */
+};
+using JobPtr = std::unique_ptr<Job>;
+
+/**
+ * \brief A sprite whose animation set waits for its source images.
+ */
+struct PendingSprite {
+  std::string id;                            /**< Id of the animation set. */
+  std::unique_ptr<SpriteData> data;          /**< Its parsed data file. */
+  std::set<std::string> missing_images;      /**< Images not decoded yet. */
+  bool failed;                               /**< Whether one of its images is broken. */
+};
+
+// Maximum time spent by the main thread in update(), in milliseconds.
+const uint32_t max_update_duration = 4;
+
+// Default memory budget of the decoded images and sounds, in bytes.
+const size_t default_max_preloaded_size = 8 * 1024 * 1024;
+
+// State only accessed by the main thread.
+size_t max_preloaded_size = default_max_preloaded_size;
+size_t preloaded_size = 0;
+bool budget_reached = false;
+bool started = false;
+bool finished = false;
+int num_loaded = 0;
+int num_total = 0;
+int num_maps_remaining = 0;
+size_t num_jobs_decoding = 0;
+size_t max_jobs_decoding = 0;
+std::deque<JobPtr> jobs_to_read;
+std::set<std::string> known_tilesets;
+std::set<std::string> known_images;
+std::set<std::string> failed_images;
+std::set<std::string> decoded_images;
+std::list<PendingSprite> pending_sprites;
+
+// State shared with the worker threads.
+std::vector<std::thread> workers;
+std::mutex mutex;
+std::condition_variable jobs_available;
+std::deque<JobPtr> jobs_to_decode;
+std::deque<JobPtr> decoded_jobs;
+bool stopping = false;
+
+/**
+ * \brief Adds a file to preload.
+ * \param type Kind of file.
+ * \param id Resource id, or file name for images.
+ * \param file_name File to read, relative to the data directory.
+ * \param urgent \c true to load it before the files already planned.
+ */
+void add_job(
+    JobType type,
+    const std::string& id,
+    const std::string& file_name,
+    bool urgent) {
+
+  JobPtr job = JobPtr(new Job());
+  job->type = type;
+  job->id = id;
+  job->file_name = file_name;
+  job->success = false;
+
+  if (urgent) {
+    jobs_to_read.push_front(std::move(job));
+  }
+  else {
+    jobs_to_read.push_back(std::move(job));
+  }
+  ++num_total;
+}
+
+/**
+ * \brief Adds an image to preload unless it is already planned.
+ * \param file_name Image file, relative to the data directory.
+ * \param urgent \c true to load it before the files already planned.
+ */
+void add_image(const std::string& file_name, bool urgent) {
+
+  if (!known_images.insert(file_name).second) {
+    return;
+  }
+
+  if (ImageCache::has_image(file_name)) {
+    // Already decoded by a surface.
+    decoded_images.insert(file_name);
+    return;
+  }
+  add_job(JobType::IMAGE, file_name, file_name, urgent);
+}
+
+/**
+ * \brief Adds the images of a tileset to preload unless they are already
+ * planned.
+ * \param tileset_id Id of a tileset.
+ * \param urgent \c true to load them before the files already planned.
+ */
+void add_tileset(const std::string& tileset_id, bool urgent) {
+
+  if (known_tilesets.insert(tileset_id).second) {
+    add_image(std::string("tilesets/") + tileset_id + ".entities.png", urgent);
+    add_image(std::string("tilesets/") + tileset_id + ".tiles.png", urgent);
+  }
+}
+
+/**
+ * \brief Adds the tilesets that no map has brought.
+ */
+void add_remaining_tilesets() {
+
+  for (const auto& kvp: CurrentQuest::get_resources(ResourceType::TILESET)) {
+    add_tileset(kvp.first, false);
+  }
+}
+
+/**
+ * \brief Decodes the file of a job.
+ *
+ * This function is called by worker threads:
+ * it does not use the quest files, the renderer or OpenAL,
+ * and errors of parsers are stored in the job to be printed by the main
+ * thread.
+ *
+ * \param job The job to process.
+ */
+void decode(Job& job) {
+
+  Debug::set_deferred_messages(&job.messages);
+
+  switch (job.type) {
+
+  case JobType::MAP:
+  {
+    MapData data;
+    job.success = data.import_from_compiled_buffer(job.encoded_data, job.compiled_data) ||
+        data.import_from_buffer(job.encoded_data);
+    job.compiled_data.clear();
+    if (job.success) {
+      job.tileset_id = data.get_tileset_id();
+    }
+    break;
+  }
+
+  case JobType::SPRITE:
+    job.sprite_data = std::unique_ptr<SpriteData>(new SpriteData());
+    job.success = job.sprite_data->import_from_buffer(job.encoded_data);
+    break;
+
+  case JobType::IMAGE:
+  {
+    SDL_RWops* rw = SDL_RWFromMem(
+        const_cast<char*>(job.encoded_data.data()),
+        (int) job.encoded_data.size()
+    );
+    job.image = SDL_Surface_UniquePtr(IMG_Load_RW(rw, 0));
+    SDL_RWclose(rw);
+
+    if (job.image == nullptr) {
+      job.error_message = std::string("Cannot load image '") + job.file_name + "'";
+      break;
+    }
+
+    // Also do the pixel format conversion here rather than in the main thread.
+    SDL_PixelFormat* pixel_format = Video::get_pixel_format();
+    if (job.image->format->format != pixel_format->format) {
+      job.image = SDL_Surface_UniquePtr(
+          SDL_ConvertSurface(job.image.get(), pixel_format, 0)
+      );
+    }
+    job.success = job.image != nullptr;
+    if (!job.success) {
+      job.error_message = std::string("Failed to convert image '") + job.file_name + "'";
+    }
+    break;
+  }
+
+  case JobType::SOUND:
+    job.success = Sound::decode_pcm(job.encoded_data, job.pcm, job.error_message);
+    break;
+  }
+
+  job.encoded_data.clear();
+  job.encoded_data.shrink_to_fit();
+
+  Debug::set_deferred_messages(nullptr);
+}
+
+/**
+ * \brief Function executed by the worker threads.
+ */
+void run_worker() {
+
+  while (true) {
+    JobPtr job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      jobs_available.wait(lock, [] {
+        return stopping || !jobs_to_decode.empty();
+      });
+      if (stopping) {
+        return;
+      }
+      job = std::move(jobs_to_decode.front());
+      jobs_to_decode.pop_front();
+    }
+
+    decode(*job);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    decoded_jobs.push_back(std::move(job));
+  }
+}
+
+/**
+ * \brief Stops and joins the worker threads.
+ *
+ * Jobs not decoded yet are dropped.
+ */
+void stop_workers() {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  jobs_available.notify_all();
+  for (std::thread& worker: workers) {
+    worker.join();
+  }
+  workers.clear();
+
+  stopping = false;
+  jobs_to_decode.clear();
+  decoded_jobs.clear();
+  num_jobs_decoding = 0;
+}
+
+/**
+ * \brief Creates the animation set of a sprite whose images are all decoded.
+ * \param sprite The sprite.
+ */
+void install_sprite(const PendingSprite& sprite) {
+
+  if (sprite.failed) {
+    // Let the sprite fail normally if it is ever used.
+    return;
+  }
+  Sprite::preload_animation_set(sprite.id, *sprite.data);
+}
+
+/**
+ * \brief Installs the result of a decoded job.
+ * \param job The job.
+ */
+void finish_job(Job& job) {
+
+  ++num_loaded;
+  Debug::print_deferred_messages(job.messages);
+
+  switch (job.type) {
+
+  case JobType::MAP:
+    // Errors of the parser were printed above.
+    if (job.success && !job.tileset_id.empty()) {
+      add_tileset(job.tileset_id, true);
+    }
+    --num_maps_remaining;
+    if (num_maps_remaining == 0) {
+      add_remaining_tilesets();
+    }
+    break;
+
+  case JobType::SPRITE:
+  {
+    if (!job.success) {
+      break;
+    }
+
+    PendingSprite sprite;
+    sprite.id = job.id;
+    sprite.failed = false;
+    for (const auto& kvp: job.sprite_data->get_animations()) {
+      const SpriteAnimationData& animation = kvp.second;
+      if (animation.src_image_is_tileset()) {
+        continue;
+      }
+      const std::string file_name = std::string("sprites/") + animation.get_src_image();
+      if (failed_images.find(file_name) != failed_images.end()) {
+        sprite.failed = true;
+      }
+      else if (decoded_images.find(file_name) == decoded_images.end()) {
+        sprite.missing_images.insert(file_name);
+      }
+    }
+    sprite.data = std::move(job.sprite_data);
+
+    if (budget_reached && !sprite.missing_images.empty()) {
+      // Its images would not be preloaded anymore:
+      // the sprite will be loaded normally if it is ever used.
+      break;
+    }
+    for (const std::string& file_name: sprite.missing_images) {
+      add_image(file_name, true);
+    }
+
+    if (sprite.missing_images.empty()) {
+      install_sprite(sprite);
+    }
+    else {
+      pending_sprites.push_back(std::move(sprite));
+    }
+    break;
+  }
+
+  case JobType::IMAGE:
+    if (job.success) {
+      preloaded_size += static_cast<size_t>(job.image->pitch) * job.image->h;
+      ImageCache::add_image(job.id, job.image.release());
+      decoded_images.insert(job.id);
+    }
+    else {
+      failed_images.insert(job.id);
+      Debug::error(job.error_message);
+    }
+
+    for (auto it = pending_sprites.begin(); it != pending_sprites.end();) {
+      PendingSprite& sprite = *it;
+      if (sprite.missing_images.erase(job.id) == 0) {
+        ++it;
+        continue;
+      }
+      sprite.failed = sprite.failed || !job.success;
+      if (sprite.missing_images.empty()) {
+        install_sprite(sprite);
+        it = pending_sprites.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+    break;
+
+  case JobType::SOUND:
+    if (job.success) {
+      preloaded_size += job.pcm.samples.size();
+      Sound::load_decoded(job.id, job.pcm);
+    }
+    else {
+      std::string message = job.error_message;
+      if (message.empty()) {
+        message = std::string("Cannot decode sound file '") + job.file_name + "'";
+      }
+      Debug::error(message);
+    }
+    break;
+  }
+}
+
+/**
+ * \brief Gives up the files not read yet because the memory budget is
+ * reached.
+ *
+ * Sprites still waiting for images are not created, and neither are
+ * sprites decoded later that need images not decoded yet:
+ * they will be loaded normally if they are ever used.
+ */
+void drop_remaining_jobs() {
+
+  for (const JobPtr& job: jobs_to_read) {
+    if (job->type == JobType::IMAGE) {
+      // No longer planned.
+      known_images.erase(job->id);
+    }
+  }
+  num_total -= static_cast<int>(jobs_to_read.size());
+  jobs_to_read.clear();
+  pending_sprites.clear();
+  budget_reached = true;
+}
+
+/**
+ * \brief Reads the file of the next planned job and gives it to the
+ * worker threads.
+ */
+void read_next_job() {
+
+  JobPtr job = std::move(jobs_to_read.front());
+  jobs_to_read.pop_front();
+
+  // The quest files API is not thread-safe: read the file here.
+  if (!QuestFiles::data_file_exists(job->file_name)) {
+    job->error_message = std::string("Cannot find file '") + job->file_name + "'";
+    finish_job(*job);
+    return;
+  }
+  job->encoded_data = QuestFiles::data_file_read(job->file_name);
+  if (job->type == JobType::MAP) {
+    job->compiled_data = LuaData::read_compiled_quest_file(job->file_name);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs_to_decode.push_back(std::move(job));
+  }
+  ++num_jobs_decoding;
+  jobs_available.notify_one();
+}
+
+}  // Anonymous namespace.
+
+/**
+ * \brief Initializes the resource preloader.
+ *
+ * Options recognized:
+ *   -preload-size=<bytes>
+ *
+ * This is the memory budget of the images and sounds decoded in advance.
+ * When it is reached, the remaining resources are not preloaded.
+ * Preloaded images also count in the budget of the image cache
+ * (-image-cache-size) until they are used.
+ *
+ * \param args Command-line arguments.
+ */
+void initialize(const Arguments& args) {
+
+  max_preloaded_size = args.get_argument_size("-preload-size", default_max_preloaded_size);
+}
+
+/**
+ * \brief Starts preloading all resources of the quest.
+ *
+ * Does nothing if the preloading is already started.
+ * The work is then done progressively by update().
+ */
+void start() {
+
+  if (started) {
+    return;
+  }
+  started = true;
+  finished = false;
+
+  // Maps come first because they tell which tilesets are needed first.
+  for (const auto& kvp: CurrentQuest::get_resources(ResourceType::MAP)) {
+    add_job(JobType::MAP, kvp.first, std::string("maps/") + kvp.first + ".dat", false);
+    ++num_maps_remaining;
+  }
+  if (num_maps_remaining == 0) {
+    add_remaining_tilesets();
+  }
+
+  for (const auto& kvp: CurrentQuest::get_resources(ResourceType::SPRITE)) {
+    add_job(JobType::SPRITE, kvp.first, std::string("sprites/") + kvp.first + ".dat", false);
+  }
+
+  if (Sound::is_initialized()) {
+    for (const auto& kvp: CurrentQuest::get_resources(ResourceType::SOUND)) {
+      add_job(JobType::SOUND, kvp.first, Sound::get_file_name(kvp.first), false);
+    }
+  }
+
+  // The main thread keeps running the game meanwhile.
+  const unsigned num_workers = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+  max_jobs_decoding = num_workers * 2;
+  for (unsigned i = 0; i < num_workers; ++i) {
+    workers.emplace_back(run_worker);
+  }
+}
+
+/**
+ * \brief Stops preloading.
+ *
+ * Resources already installed stay loaded.
+ */
+void quit() {
+
+  stop_workers();
+
+  max_preloaded_size = default_max_preloaded_size;
+  preloaded_size = 0;
+  budget_reached = false;
+  started = false;
+  finished = false;
+  num_loaded = 0;
+  num_total = 0;
+  num_maps_remaining = 0;
+  jobs_to_read.clear();
+  known_tilesets.clear();
+  known_images.clear();
+  failed_images.clear();
+  decoded_images.clear();
+  pending_sprites.clear();
+}
+
+/**
+ * \brief Makes some progress in the preloading.
+ *
+ * This function is called at each cycle by the main loop.
+ * It installs the resources decoded since the previous call and gives new
+ * files to the worker threads, for a few milliseconds at most.
+ */
+void update() {
+
+  if (!started || finished) {
+    return;
+  }
+
+  const uint32_t start_time = System::get_real_time();
+  do {
+    JobPtr job;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!decoded_jobs.empty()) {
+        job = std::move(decoded_jobs.front());
+        decoded_jobs.pop_front();
+      }
+    }
+
+    if (job != nullptr) {
+      --num_jobs_decoding;
+      finish_job(*job);
+    }
+    else if (!jobs_to_read.empty() && num_jobs_decoding < max_jobs_decoding) {
+      read_next_job();
+    }
+    else {
+      // Waiting for the workers.
+      break;
+    }
+  } while (System::get_real_time() - start_time < max_update_duration);
+
+  if (preloaded_size >= max_preloaded_size && !jobs_to_read.empty()) {
+    drop_remaining_jobs();
+  }
+
+  if (jobs_to_read.empty() && num_jobs_decoding == 0) {
+    Debug::check_assertion(pending_sprites.empty(),
+        "Sprites still waiting for images");
+    stop_workers();
+    finished = true;
+  }
+}
+
+/**
+ * \brief Returns whether the preloading was started.
+ * \return \c true if start() was called.
+ */
+bool is_started() {
+  return started;
+}
+
+/**
+ * \brief Returns whether all resources are preloaded.
+ * \return \c true if the preloading is finished.
+ */
+bool is_finished() {
+  return finished;
+}
+
+/**
+ * \brief Returns the number of files already preloaded.
+ * \return The number of files processed.
+ */
+int get_num_loaded() {
+  return num_loaded;
+}
+
+/**
+ * \brief Returns the number of files to preload.
+ *
+ * This number increases while the preloading discovers dependencies,
+ * like the images of sprites.
+ *
+ * \return The number of files known so far.
+ */
+int get_num_total() {
+  return num_total;
+}
+
+}
+
+}
+
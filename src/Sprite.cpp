@@ -53,6 +53,22 @@ void Sprite::quit() {
   all_animation_sets.clear();
 }
 
+/**
+ * \brief Creates an animation set in advance from its parsed data file.
+ *
+ * Does nothing if this animation set is already loaded.
+ *
+ * \param id Id of the animation set.
+ * \param data The content of its sprite data file.
+ */
+void Sprite::preload_animation_set(const std::string& id, const SpriteData& data) {
+
+  if (all_animation_sets.find(id) != all_animation_sets.end()) {
+    return;
+  }
+  all_animation_sets[id] = new SpriteAnimationSet(id, data);
+}
+
 /**
  * \brief Returns the sprite animation set corresponding to the specified id.
  *
@@ -39,24 +39,45 @@ SpriteAnimationSet::SpriteAnimationSet(const std::string& id):
   load();
 }
 
+/**
+ * \brief Creates an animation set from data already parsed.
+ * \param id Id of the sprite animation set.
+ * \param data The content of its sprite data file.
+ */
+SpriteAnimationSet::SpriteAnimationSet(
+    const std::string& id,
+    const SpriteData& data):
+  id(id) {
+
+  load(data);
+}
+
 /**
  * \brief Attempts to load this animation set from its file.
  */
 void SpriteAnimationSet::load() {
 
-  Debug::check_assertion(animations.empty(),
-      "Animation set already loaded");
-
   // Load the sprite data file.
   std::string file_name = std::string("sprites/") + id + ".dat";
   SpriteData data;
   bool success = data.import_from_quest_file(file_name);
   if (success) {
-    // Get the imported data.
-    default_animation_name = data.get_default_animation_name();
-    for (const auto& kvp : data.get_animations()) {
-      add_animation(kvp.first, kvp.second);
-    }
+    load(data);
+  }
+}
+
+/**
+ * \brief Loads this animation set from data already parsed.
+ * \param data The content of the sprite data file.
+ */
+void SpriteAnimationSet::load(const SpriteData& data) {
+
+  Debug::check_assertion(animations.empty(),
+      "Animation set already loaded");
+
+  default_animation_name = data.get_default_animation_name();
+  for (const auto& kvp : data.get_animations()) {
+    add_animation(kvp.first, kvp.second);
   }
 }
 
@@ -149,6 +149,22 @@ void Timer::set_expiration_date(uint32_t expiration_date) {
   this->finished = System::now() >= this->expiration_date;
 }
 
+/**
+ * \brief Returns the next date when update() has something to do.
+ *
+ * Calling update() before this date is not necessary unless the timer is
+ * modified in the meantime.
+ *
+ * \return The expiration date, or the date of the next clock sound if sooner.
+ */
+uint32_t Timer::get_next_update_date() const {
+
+  if (is_with_sound() && next_sound_date < expiration_date) {
+    return next_sound_date;
+  }
+  return expiration_date;
+}
+
 /**
  * \brief Updates the timer.
  */
@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/AnimatedRegions.h"
+#include "solarus/entities/AnimatedTilePattern.h"
+#include "solarus/entities/Tile.h"
+#include "solarus/lowlevel/Surface.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/Map.h"
+
+namespace Solarus {
+
+/**
+ * \brief Constructor.
+ * \param map The map. Its size must be known.
+ * \param layer The layer to represent.
+ */
+AnimatedRegions::AnimatedRegions(Map& map, Layer layer):
+  map(map),
+  layer(layer),
+  frames_cached(false),
+  animated_tiles(map.get_size(), Size(64, 64)) {
+
+}
+
+/**
+ * \brief Sets the tiles of animated regions of this layer.
+ * \param tiles The tiles rejected by NonAnimatedRegions::build(): animated
+ * tiles and static tiles overlapping them, in drawing order.
+ */
+void AnimatedRegions::build(const std::vector<TilePtr>& tiles) {
+
+  Debug::check_assertion(frame_surfaces.empty(),
+      "Animated regions are already built");
+
+  this->tiles = tiles;
+
+  cell_sequences.resize(animated_tiles.get_num_cells(), 0);
+  frame_surfaces.resize(animated_tiles.get_num_cells());
+
+  for (const TilePtr& tile: tiles) {
+    Debug::check_assertion(tile->get_layer() == layer,
+        "Wrong layer for animated tile");
+
+    // The grid keeps the insertion order in each cell,
+    // so tiles are pre-rendered in their drawing order.
+    animated_tiles.add(tile);
+  }
+
+  frames_cached = update_cell_sequences();
+}
+
+/**
+ * \brief Computes the animation sequences used by each cell.
+ * \return \c false if a tile is animated in another way than by cycling
+ * through frames (for example with parallax or scrolling): then the cells
+ * cannot be pre-rendered.
+ */
+bool AnimatedRegions::update_cell_sequences() {
+
+  for (size_t i = 0; i < animated_tiles.get_num_cells(); ++i) {
+    int sequences = 0;
+    for (const TilePtr& tile: animated_tiles.get_elements(i)) {
+      TilePattern& pattern = tile->get_tile_pattern();
+      if (!pattern.is_animated()) {
+        continue;
+      }
+      if (!pattern.is_animated_by_frames()) {
+        return false;
+      }
+      // Only AnimatedTilePattern is animated by frames.
+      const AnimatedTilePattern& animated_pattern =
+          static_cast<const AnimatedTilePattern&>(pattern);
+      sequences |= 1 << animated_pattern.get_sequence();
+    }
+    cell_sequences[i] = sequences;
+  }
+  return true;
+}
+
+/**
+ * \brief Clears previous drawings because the tileset has changed.
+ */
+void AnimatedRegions::notify_tileset_changed() {
+
+  for (int cell_index: cells_with_frames) {
+    frame_surfaces[cell_index].clear();
+  }
+  cells_with_frames.clear();
+
+  // Tile patterns may have changed.
+  frames_cached = update_cell_sequences();
+
+  // Everything will be redrawn when necessary.
+}
+
+/**
+ * \brief Returns which pre-rendered frame of a cell corresponds to the
+ * current animation frames.
+ *
+ * Sequences not used in the cell are considered at their first frame,
+ * to avoid pre-rendering identical surfaces.
+ *
+ * \param cell_index Index of a cell.
+ * \return The frame state (0 to num_frame_states - 1).
+ */
+int AnimatedRegions::get_frame_state(int cell_index) const {
+
+  const int sequences = cell_sequences[cell_index];
+  int frame_012 = 0;
+  int frame_0121 = 0;
+  if (sequences & (1 << AnimatedTilePattern::ANIMATION_SEQUENCE_012)) {
+    frame_012 = AnimatedTilePattern::get_current_frame(
+        AnimatedTilePattern::ANIMATION_SEQUENCE_012
+    );
+  }
+  if (sequences & (1 << AnimatedTilePattern::ANIMATION_SEQUENCE_0121)) {
+    frame_0121 = AnimatedTilePattern::get_current_frame(
+        AnimatedTilePattern::ANIMATION_SEQUENCE_0121
+    );
+  }
+  return frame_012 * 3 + frame_0121;
+}
+
+/**
+ * \brief Draws a layer of animated regions of tiles on the current map.
+ */
+void AnimatedRegions::draw_on_map() {
+
+  if (!frames_cached) {
+    // Some tiles cannot be pre-rendered: draw them all individually.
+    for (const TilePtr& tile: tiles) {
+      tile->draw_on_map();
+    }
+    return;
+  }
+
+  // Check all grid cells that overlap the camera.
+  const int num_rows = animated_tiles.get_num_rows();
+  const int num_columns = animated_tiles.get_num_columns();
+  const Size& cell_size = animated_tiles.get_cell_size();
+  const Rectangle& camera_position = map.get_camera_position();
+
+  const int row1 = camera_position.get_y() / cell_size.height;
+  const int row2 = (camera_position.get_y() + camera_position.get_height()) / cell_size.height;
+  const int column1 = camera_position.get_x() / cell_size.width;
+  const int column2 = (camera_position.get_x() + camera_position.get_width()) / cell_size.width;
+
+  if (row1 > row2 || column1 > column2) {
+    // No cell.
+    return;
+  }
+
+  for (int i = row1; i <= row2; ++i) {
+    if (i < 0 || i >= num_rows) {
+      continue;
+    }
+
+    for (int j = column1; j <= column2; ++j) {
+      if (j < 0 || j >= num_columns) {
+        continue;
+      }
+
+      const int cell_index = i * num_columns + j;
+      if (animated_tiles.get_elements(cell_index).empty()) {
+        // Nothing animated here.
+        continue;
+      }
+
+      // Make sure the current frame of this cell is built.
+      const int frame_state = get_frame_state(cell_index);
+      std::vector<SurfacePtr>& frames = frame_surfaces[cell_index];
+      if (frames.empty() || frames[frame_state] == nullptr) {
+        // Lazily build the frame.
+        build_frame(cell_index, frame_state);
+      }
+
+      const Point cell_xy = {
+          j * cell_size.width,
+          i * cell_size.height
+      };
+
+      const Point dst_position = cell_xy - camera_position.get_xy();
+      frames[frame_state]->draw(
+          map.get_visible_surface(), dst_position
+      );
+    }
+  }
+
+  // Free the frames of cells that are no longer visible:
+  // up to 9 surfaces per cell would otherwise stay for the whole map.
+  for (size_t k = 0; k < cells_with_frames.size(); ) {
+    const int cell_index = cells_with_frames[k];
+    const int row = cell_index / num_columns;
+    const int column = cell_index % num_columns;
+    if (row < row1 || row > row2 || column < column1 || column > column2) {
+      frame_surfaces[cell_index].clear();
+      cells_with_frames[k] = cells_with_frames.back();
+      cells_with_frames.pop_back();
+    }
+    else {
+      ++k;
+    }
+  }
+}
+
+/**
+ * \brief Draws all tiles of a cell on its surface for the current frame.
+ * \param cell_index Index of the cell to draw.
+ * \param frame_state The frame state it corresponds to.
+ */
+void AnimatedRegions::build_frame(int cell_index, int frame_state) {
+
+  Debug::check_assertion(
+      cell_index >= 0 && (size_t) cell_index < animated_tiles.get_num_cells(),
+      "Wrong cell index"
+  );
+
+  std::vector<SurfacePtr>& frames = frame_surfaces[cell_index];
+  if (frames.empty()) {
+    frames.resize(num_frame_states);
+    cells_with_frames.push_back(cell_index);
+  }
+  Debug::check_assertion(frames[frame_state] == nullptr,
+      "This frame is already built"
+  );
+
+  const int row = cell_index / animated_tiles.get_num_columns();
+  const int column = cell_index % animated_tiles.get_num_columns();
+
+  // Position of this cell on the map.
+  const Size cell_size = animated_tiles.get_cell_size();
+  const Point cell_xy = {
+      column * cell_size.width,
+      row * cell_size.height
+  };
+
+  SurfacePtr frame_surface = Surface::create(cell_size);
+  frames[frame_state] = frame_surface;
+
+  const std::vector<TilePtr>& tiles_in_cell =
+      animated_tiles.get_elements(cell_index);
+  for (const TilePtr& tile: tiles_in_cell) {
+    tile->draw(frame_surface, cell_xy);
+  }
+}
+
+}
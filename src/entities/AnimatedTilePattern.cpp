@@ -118,6 +118,23 @@ void AnimatedTilePattern::update() {
   }
 }
 
+/**
+ * \brief Returns the frame currently displayed by an animation sequence.
+ * \param sequence An animation sequence type.
+ * \return The current frame (0 to 2) of this sequence.
+ */
+int AnimatedTilePattern::get_current_frame(AnimationSequence sequence) {
+  return current_frames[sequence];
+}
+
+/**
+ * \brief Returns the animation sequence type of this tile pattern.
+ * \return The animation sequence: 0-1-2 or 0-1-2-1.
+ */
+AnimatedTilePattern::AnimationSequence AnimatedTilePattern::get_sequence() const {
+  return sequence;
+}
+
 /**
  * \brief Draws the tile image on a surface.
  * \param dst_surface the surface to draw
@@ -160,5 +177,14 @@ bool AnimatedTilePattern::is_drawn_at_its_position() const {
   return !parallax;
 }
 
+/**
+ * \brief Returns whether this tile pattern is an animation that only
+ * cycles through frames of the tileset.
+ * \return true unless this pattern also makes parallax scrolling
+ */
+bool AnimatedTilePattern::is_animated_by_frames() const {
+  return !parallax;
+}
+
 }
 
@@ -16,6 +16,7 @@
  */
 #include "solarus/entities/Detector.h"
 #include "solarus/entities/Hero.h"
+#include "solarus/entities/MapEntities.h"
 #include "solarus/Map.h"
 #include "solarus/KeysEffect.h"
 #include "solarus/Sprite.h"
@@ -64,6 +65,15 @@ bool Detector::is_detector() const {
   return true;
 }
 
+/**
+ * \brief Returns the collision modes of this detector.
+ * \return The detector's collision modes
+ * (an OR combination of collision modes).
+ */
+int Detector::get_collision_modes() const {
+  return collision_modes;
+}
+
 /**
  * \brief Sets the collision modes of this detector.
  * \param collision_modes the detector's collision modes
@@ -75,6 +85,10 @@ void Detector::set_collision_modes(int collision_modes) {
     enable_pixel_collisions();
   }
   this->collision_modes = collision_modes;
+
+  if (is_on_map() && get_map().is_loaded()) {
+    get_entities().notify_detector_collision_modes_changed(*this);
+  }
 }
 
 /**
@@ -32,8 +32,8 @@
 #include "solarus/Map.h"
 #include "solarus/Savegame.h"
 #include "solarus/Sprite.h"
-#include <list>
 #include <lua.hpp>
+#include <vector>
 
 namespace Solarus {
 
@@ -198,7 +198,7 @@ void Door::set_open(bool door_open) {
  */
 void Door::update_dynamic_tiles() {
 
-  std::list<MapEntity*> tiles = get_entities().get_entities_with_prefix(EntityType::DYNAMIC_TILE, get_name() + "_closed");
+  std::vector<MapEntity*> tiles = get_entities().get_entities_with_prefix(EntityType::DYNAMIC_TILE, get_name() + "_closed");
   for (MapEntity* tile: tiles) {
     tile->set_enabled(is_closed() || is_opening());
   }
@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/GroundBits.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Rectangle.h"
+
+namespace Solarus {
+
+/**
+ * \brief Creates ground bits where all squares are traversable.
+ * \param width8 Number of 8x8 squares on a row of the map.
+ * \param height8 Number of 8x8 squares on a column of the map.
+ */
+GroundBits::GroundBits(int width8, int height8):
+  width8(width8),
+  height8(height8),
+  nb_integers_per_row((width8 * 8 + 31) >> 5),
+  nb_integers_per_row8((width8 + 31) >> 5),
+  wall_bits(nb_integers_per_row * height8 * 8, 0),
+  entity_dependent_bits(nb_integers_per_row8 * height8, 0) {
+
+  Debug::check_assertion(width8 >= 0 && height8 >= 0,
+      "Invalid ground bits size");
+}
+
+/**
+ * \brief Sets the ground of an 8x8 square.
+ *
+ * Coordinates outside the range of the map are not an error:
+ * in this case, this function does nothing.
+ *
+ * \param x8 X coordinate of the square (divided by 8).
+ * \param y8 Y coordinate of the square (divided by 8).
+ * \param ground The ground of this square.
+ */
+void GroundBits::set_ground(int x8, int y8, Ground ground) {
+
+  if (x8 < 0 || x8 >= width8 || y8 < 0 || y8 >= height8) {
+    return;
+  }
+
+  // The 8 pixels of a row of the square are always in the same integer.
+  const int x = x8 * 8;
+  const int shift = x & 31;
+  const uint32_t square_mask = ~(UINT32_C(0xFF) << shift);
+  for (int y_in_square = 0; y_in_square < 8; ++y_in_square) {
+    uint32_t& integer = wall_bits[(y8 * 8 + y_in_square) * nb_integers_per_row + (x >> 5)];
+    integer = (integer & square_mask) | (get_wall_mask(ground, y_in_square) << shift);
+  }
+
+  uint32_t& integer8 = entity_dependent_bits[y8 * nb_integers_per_row8 + (x8 >> 5)];
+  const uint32_t bit8 = UINT32_C(1) << (x8 & 31);
+  if (is_entity_dependent(ground)) {
+    integer8 |= bit8;
+  }
+  else {
+    integer8 &= ~bit8;
+  }
+}
+
+/**
+ * \brief Returns whether a pixel of the border of a rectangle is a wall.
+ *
+ * Like Map::test_collision_with_obstacles(), only the border is checked.
+ *
+ * \param box A non-empty rectangle entirely inside the map.
+ * \return \c true if at least one pixel of the border is a wall.
+ */
+bool GroundBits::has_wall_on_border(const Rectangle& box) const {
+
+  const int x1 = box.get_x();
+  const int x2 = x1 + box.get_width() - 1;
+  const int y1 = box.get_y();
+  const int y2 = y1 + box.get_height() - 1;
+
+  if (test_row(&wall_bits[y1 * nb_integers_per_row], x1, x2)
+      || test_row(&wall_bits[y2 * nb_integers_per_row], x1, x2)) {
+    return true;
+  }
+
+  for (int y = y1 + 1; y < y2; ++y) {
+    const uint32_t* row = &wall_bits[y * nb_integers_per_row];
+    if (test_bit(row, x1) || test_bit(row, x2)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * \brief Returns whether the border of a rectangle touches a square whose
+ * ground is an obstacle only for some entities.
+ * \param box A non-empty rectangle entirely inside the map.
+ * \return \c true if such a square is on the border of the rectangle.
+ */
+bool GroundBits::has_entity_dependent_ground_on_border(const Rectangle& box) const {
+
+  const int x1 = box.get_x() >> 3;
+  const int x2 = (box.get_x() + box.get_width() - 1) >> 3;
+  const int y1 = box.get_y() >> 3;
+  const int y2 = (box.get_y() + box.get_height() - 1) >> 3;
+
+  if (test_row(&entity_dependent_bits[y1 * nb_integers_per_row8], x1, x2)
+      || test_row(&entity_dependent_bits[y2 * nb_integers_per_row8], x1, x2)) {
+    return true;
+  }
+
+  for (int y = y1 + 1; y < y2; ++y) {
+    const uint32_t* row = &entity_dependent_bits[y * nb_integers_per_row8];
+    if (test_bit(row, x1) || test_bit(row, x2)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * \brief Returns whether a ground is an obstacle for some entities only.
+ * \param ground A ground.
+ * \return \c true if whether it is an obstacle depends on the entity.
+ */
+bool GroundBits::is_entity_dependent(Ground ground) {
+
+  switch (ground) {
+
+  case Ground::LOW_WALL:
+  case Ground::SHALLOW_WATER:
+  case Ground::DEEP_WATER:
+  case Ground::HOLE:
+  case Ground::LAVA:
+  case Ground::PRICKLE:
+  case Ground::LADDER:
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+/**
+ * \brief Returns the wall pixels of a row of an 8x8 square.
+ *
+ * This is the same shape as in Map::test_collision_with_ground().
+ *
+ * \param ground Ground of the square.
+ * \param y_in_square Row in the square (0 to 7).
+ * \return 8 bits where the bit (1 << x_in_square) is set if the pixel is
+ * a wall.
+ */
+uint32_t GroundBits::get_wall_mask(Ground ground, int y_in_square) {
+
+  switch (ground) {
+
+  case Ground::WALL:
+    return 0xFF;
+
+  case Ground::WALL_TOP_RIGHT:
+  case Ground::WALL_TOP_RIGHT_WATER:
+    // y_in_square <= x_in_square
+    return (0xFF << y_in_square) & 0xFF;
+
+  case Ground::WALL_TOP_LEFT:
+  case Ground::WALL_TOP_LEFT_WATER:
+    // y_in_square <= 7 - x_in_square
+    return 0xFF >> y_in_square;
+
+  case Ground::WALL_BOTTOM_LEFT:
+  case Ground::WALL_BOTTOM_LEFT_WATER:
+    // y_in_square >= x_in_square
+    return 0xFF >> (7 - y_in_square);
+
+  case Ground::WALL_BOTTOM_RIGHT:
+  case Ground::WALL_BOTTOM_RIGHT_WATER:
+    // y_in_square >= 7 - x_in_square
+    return (0xFF << (7 - y_in_square)) & 0xFF;
+
+  default:
+    return 0;
+  }
+}
+
+/**
+ * \brief Returns whether at least one bit is set in a range of a row.
+ * \param row The integers of a row.
+ * \param x1 First bit of the range.
+ * \param x2 Last bit of the range (included).
+ * \return \c true if a bit is set between x1 and x2.
+ */
+bool GroundBits::test_row(const uint32_t* row, int x1, int x2) {
+
+  const int first_integer = x1 >> 5;
+  const int last_integer = x2 >> 5;
+  const uint32_t first_mask = UINT32_C(0xFFFFFFFF) << (x1 & 31);
+  const uint32_t last_mask = UINT32_C(0xFFFFFFFF) >> (31 - (x2 & 31));
+
+  if (first_integer == last_integer) {
+    return (row[first_integer] & first_mask & last_mask) != 0;
+  }
+
+  uint32_t bits = row[first_integer] & first_mask;
+  for (int i = first_integer + 1; i < last_integer; ++i) {
+    bits |= row[i];
+  }
+  bits |= row[last_integer] & last_mask;
+  return bits != 0;
+}
+
+/**
+ * \brief Returns whether a bit of a row is set.
+ * \param row The integers of a row.
+ * \param x Index of the bit.
+ * \return \c true if this bit is set.
+ */
+bool GroundBits::test_bit(const uint32_t* row, int x) {
+  return (row[x >> 5] & (UINT32_C(1) << (x & 31))) != 0;
+}
+
+}
+
@@ -866,7 +866,7 @@ bool Hero::is_on_raised_blocks() const {
  */
 Stairs* Hero::get_stairs_overlapping() {
 
-  std::list<Stairs*> all_stairs = get_entities().get_stairs(get_layer());
+  const std::vector<Stairs*>& all_stairs = get_entities().get_stairs(get_layer());
   for (Stairs* stairs: all_stairs) {
 
     if (overlaps(*stairs)) {
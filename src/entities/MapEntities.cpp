@@ -25,17 +25,72 @@
 #include "solarus/entities/Stairs.h"
 #include "solarus/entities/Separator.h"
 #include "solarus/entities/Destination.h"
+#include "solarus/entities/Detector.h"
 #include "solarus/entities/NonAnimatedRegions.h"
+#include "solarus/entities/AnimatedRegions.h"
+#include "solarus/movements/FlowField.h"
+#include "solarus/movements/PathFindingTerrain.h"
 #include "solarus/Map.h"
 #include "solarus/Game.h"
 #include "solarus/lowlevel/Surface.h"
 #include "solarus/lowlevel/Color.h"
 #include "solarus/lowlevel/Music.h"
 #include "solarus/lowlevel/Debug.h"
+#include <algorithm>
 #include <sstream>
+#include <unordered_set>
+#include <utility>
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Removes all occurrences of a value from a vector.
+ *
+ * The order of the other elements is preserved.
+ *
+ * \param elements The vector to change.
+ * \param value The value to remove.
+ */
+template<typename T, typename U>
+void remove_value(std::vector<T>& elements, const U& value) {
+
+  elements.erase(std::remove(elements.begin(), elements.end(), value), elements.end());
+}
+
+/**
+ * \brief Removes the elements of a vector that satisfy a predicate.
+ *
+ * The order of the other elements is preserved.
+ *
+ * \param elements The vector to change.
+ * \param predicate Returns \c true for elements to remove.
+ */
+template<typename T, typename Predicate>
+void remove_values_if(std::vector<T>& elements, Predicate predicate) {
+
+  elements.erase(std::remove_if(elements.begin(), elements.end(), predicate), elements.end());
+}
+
+/**
+ * \brief Moves a value to the beginning of a vector.
+ *
+ * The value is added if it was not there.
+ * The order of the other elements is preserved.
+ *
+ * \param elements The vector to change.
+ * \param value The value to move.
+ */
+template<typename T, typename U>
+void push_front(std::vector<T>& elements, const U& value) {
+
+  remove_value(elements, value);
+  elements.insert(elements.begin(), value);
+}
+
+}
+
 /**
  * \brief Constructor.
  * \param game The game.
@@ -48,7 +103,11 @@ MapEntities::MapEntities(Game& game, Map& map):
   map_height8(0),
   tiles_grid_size(0),
   hero(*game.get_hero()),
+  next_ground_modifier_rank(0),
   default_destination(nullptr),
+  num_obstacle_queries(0),
+  num_obstacle_candidates(0),
+  next_insertion_rank(1),
   boomerang(nullptr) {
 
   Layer hero_layer = hero.get_layer();
@@ -58,6 +117,16 @@ MapEntities::MapEntities(Game& game, Map& map):
   this->named_entities[hero.get_name()] = &hero;
 }
 
+/**
+ * \brief Destructor.
+ *
+ * Defined here so that the header does not need the complete types
+ * of the regions, path finding terrains and flow fields.
+ */
+MapEntities::~MapEntities() {
+
+}
+
 /**
  * \brief Notifies an entity that it is being removed.
  * \param entity The entity being removed.
@@ -81,7 +150,7 @@ Hero& MapEntities::get_hero() {
  * \brief Returns all entities expect tiles and the hero.
  * \return The entities except tiles and the hero.
  */
-const std::list<MapEntityPtr>& MapEntities::get_entities() {
+const std::vector<MapEntityPtr>& MapEntities::get_entities() {
   return all_entities;
 }
 
@@ -90,16 +159,100 @@ const std::list<MapEntityPtr>& MapEntities::get_entities() {
  * \param layer The layer.
  * \return The obstacle entities on that layer.
  */
-const std::list<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_obstacle_entities(Layer layer) {
   return obstacle_entities[layer];
 }
 
+/**
+ * \brief Returns the entities (other that tiles) that may be obstacles in a
+ * rectangle.
+ *
+ * Only the cells of the obstacle grid overlapping the rectangle are
+ * inspected, so the result may contain entities that do not actually overlap
+ * the rectangle: callers still have to test each of them.
+ * Each entity is returned only once.
+ *
+ * \param layer The layer.
+ * \param where The rectangle to get obstacles from.
+ * \param[out] obstacles Vector where the candidate obstacles are appended.
+ */
+void MapEntities::get_obstacle_entities(
+    Layer layer,
+    const Rectangle& where,
+    std::vector<MapEntity*>& obstacles
+) const {
+
+  ++num_obstacle_queries;
+
+  if (obstacle_grid[layer] == nullptr) {
+    // The map is not loaded yet.
+    return;
+  }
+
+  const size_t first = obstacles.size();
+  obstacle_grid[layer]->get_elements(where, obstacles);
+  num_obstacle_candidates += obstacles.size() - first;
+}
+
+/**
+ * \brief Returns the precomputed obstacle bits of the tiles of a layer.
+ * \param layer The layer.
+ * \return The ground bits of the tiles on that layer.
+ */
+const GroundBits& MapEntities::get_tile_ground_bits(Layer layer) const {
+  return *tiles_ground_bits[layer];
+}
+
+/**
+ * \brief Returns the static passability of path finding nodes on a layer.
+ * \param layer The layer.
+ * \return The path finding terrain of that layer.
+ */
+PathFindingTerrain& MapEntities::get_path_finding_terrain(Layer layer) {
+
+  if (path_finding_terrain[layer] == nullptr) {
+    path_finding_terrain[layer] = std::unique_ptr<PathFindingTerrain>(
+        new PathFindingTerrain(*tiles_ground_bits[layer], map_width8, map_height8)
+    );
+  }
+  return *path_finding_terrain[layer];
+}
+
+/**
+ * \brief Returns the flow field that leads to an entity.
+ *
+ * The field is created the first time it is requested, and shared by
+ * all entities that chase the same target.
+ * It is destroyed when the target is removed from the map.
+ * Call FlowField::update() before using it.
+ *
+ * \param target The entity to reach.
+ * \return The flow field toward this entity, or nullptr if the entity is
+ * being removed from the map.
+ */
+FlowField* MapEntities::get_flow_field(const MapEntity& target) {
+
+  if (target.is_being_removed()) {
+    // A new field would never be destroyed.
+    return nullptr;
+  }
+
+  for (const std::unique_ptr<FlowField>& flow_field: flow_fields) {
+    if (&flow_field->get_target() == &target) {
+      return flow_field.get();
+    }
+  }
+
+  flow_fields.emplace_back(new FlowField(map, target));
+  return flow_fields.back().get();
+}
+
 /**
  * \brief Returns the entities that are sensible to the ground below them.
  * \param layer The layer.
  * \return The ground observers on that layer.
  */
-const std::list<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
   return ground_observers[layer];
 }
 
@@ -108,18 +261,276 @@ const std::list<MapEntity*>& MapEntities::get_ground_observers(Layer layer) {
  * \param layer The layer.
  * \return The ground observers on that layer.
  */
-const std::list<MapEntity*>& MapEntities::get_ground_modifiers(Layer layer) {
+const std::vector<MapEntity*>& MapEntities::get_ground_modifiers(Layer layer) {
   return ground_modifiers[layer];
 }
 
+/**
+ * \brief Returns whether a ground modifier overlaps a rectangle.
+ *
+ * Disabled ground modifiers and the ones that do not change the ground
+ * are also taken into account.
+ *
+ * \param layer The layer.
+ * \param where A rectangle of the map.
+ * \return \c true if at least one ground modifier overlaps this rectangle.
+ */
+bool MapEntities::overlaps_ground_modifiers(Layer layer, const Rectangle& where) const {
+
+  if (ground_modifiers[layer].empty()) {
+    return false;
+  }
+
+  if (ground_modifier_grid[layer] == nullptr) {
+    // The map is not loaded yet.
+    return true;
+  }
+
+  const Grid<MapEntity*>& grid = *ground_modifier_grid[layer];
+  const Point& xy = where.get_xy();
+  const size_t first_cell = grid.get_cell_index(xy);
+  const size_t last_cell = grid.get_cell_index(
+      xy + Point(where.get_width() - 1, where.get_height() - 1));
+  const size_t num_columns = grid.get_num_columns();
+  for (size_t i = first_cell / num_columns; i <= last_cell / num_columns; ++i) {
+    for (size_t j = first_cell % num_columns; j <= last_cell % num_columns; ++j) {
+      for (const MapEntity* ground_modifier: grid.get_elements(i * num_columns + j)) {
+        if (ground_modifier->overlaps(where)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * \brief Returns the entity that decides the ground at a point, if any.
+ *
+ * If several ground modifiers are at this point, the last one added wins.
+ *
+ * \param layer The layer.
+ * \param xy A point of the map.
+ * \return The enabled ground modifier that changes the ground at this point,
+ * or nullptr if the ground is defined by static tiles.
+ */
+const MapEntity* MapEntities::get_ground_modifier(Layer layer, const Point& xy) const {
+
+  if (ground_modifiers[layer].empty()) {
+    // Fast path: most maps have no dynamic ground.
+    return nullptr;
+  }
+
+  if (ground_modifier_grid[layer] == nullptr) {
+    // The map is not loaded yet.
+    for (auto it = ground_modifiers[layer].rbegin(); it != ground_modifiers[layer].rend(); ++it) {
+      const MapEntity& ground_modifier = **it;
+      if (ground_modifier.overlaps(xy.x, xy.y)
+          && ground_modifier.get_modified_ground() != Ground::EMPTY
+          && ground_modifier.is_enabled()
+          && !ground_modifier.is_being_removed()) {
+        return &ground_modifier;
+      }
+    }
+    return nullptr;
+  }
+
+  const Grid<MapEntity*>& grid = *ground_modifier_grid[layer];
+  const std::vector<MapEntity*>& candidates = grid.get_elements(grid.get_cell_index(xy));
+  const MapEntity* result = nullptr;
+  uint32_t result_rank = 0;
+  for (const MapEntity* ground_modifier: candidates) {
+    if (ground_modifier->overlaps(xy.x, xy.y)
+        && ground_modifier->get_modified_ground() != Ground::EMPTY
+        && ground_modifier->is_enabled()
+        && !ground_modifier->is_being_removed()) {
+      const uint32_t rank = ground_modifier_ranks.at(ground_modifier);
+      if (result == nullptr || rank > result_rank) {
+        result = ground_modifier;
+        result_rank = rank;
+      }
+    }
+  }
+  return result;
+}
+
 /**
  * \brief Returns all detectors on the map.
  * \return the detectors
  */
-const std::list<Detector*>& MapEntities::get_detectors() {
+const std::vector<Detector*>& MapEntities::get_detectors() {
   return detectors;
 }
 
+/**
+ * \brief Returns the detectors that may detect an entity.
+ *
+ * Only the cells of the detector grid overlapping the detection box of the
+ * entity are inspected. Detectors that have a custom collision test are in
+ * all cells.
+ * The result may contain detectors that do not actually detect the entity:
+ * callers still have to test each of them.
+ * Each detector is returned only once, in the order detectors were added
+ * to the map, like the full list of detectors: the grid keeps this order.
+ *
+ * \param entity The entity to check.
+ * \param[out] detectors Vector where the candidate detectors are appended.
+ */
+void MapEntities::get_detectors(
+    const MapEntity& entity,
+    std::vector<Detector*>& detectors
+) const {
+
+  if (detector_grid == nullptr) {
+    // The map is not loaded yet.
+    detectors.insert(detectors.end(), this->detectors.begin(), this->detectors.end());
+    return;
+  }
+
+  detector_grid->get_elements(get_detection_box(entity), detectors);
+}
+
+/**
+ * \brief Returns the entities (other than tiles) that a detector may detect.
+ *
+ * If the detector has a custom collision test, all entities are returned.
+ * Otherwise, only the cells of the entity grid overlapping the detector are
+ * inspected.
+ * Entities are returned in the order they were added to the map, the hero
+ * first: the grid keeps this order.
+ * The result may contain entities that are not actually detected:
+ * callers still have to test each of them.
+ * The hero is included.
+ *
+ * \param detector The detector.
+ * \param[out] entities Vector where the candidate entities are appended.
+ */
+void MapEntities::get_entities(
+    const Detector& detector,
+    std::vector<MapEntity*>& entities
+) const {
+
+  if (entity_grid == nullptr ||
+      (detector.get_collision_modes() & COLLISION_CUSTOM) != 0) {
+    entities.push_back(&hero);
+    for (const MapEntityPtr& entity: all_entities) {
+      entities.push_back(entity.get());
+    }
+    return;
+  }
+
+  entity_grid->get_elements(detector.get_bounding_box(), entities);
+}
+
+/**
+ * \brief Returns the order in which an entity was added to the map.
+ * \param entity An entity other than a tile.
+ * \return Its rank, or 0 for the hero who is never added.
+ */
+uint32_t MapEntities::get_insertion_rank(const MapEntity& entity) const {
+
+  const auto it = insertion_ranks.find(&entity);
+  if (it == insertion_ranks.end()) {
+    // The hero.
+    return 0;
+  }
+  return it->second;
+}
+
+/**
+ * \brief Returns the entities stored in the cells of the entity grid that
+ * overlap a rectangle.
+ *
+ * The result may contain entities far from the rectangle: callers still
+ * have to test each of them.
+ * If the grid does not exist yet, all entities are returned.
+ *
+ * \param where The rectangle to inspect.
+ * \param[out] candidates Vector where the entities are appended.
+ */
+void MapEntities::get_entity_candidates(
+    const Rectangle& where,
+    std::vector<MapEntity*>& candidates
+) const {
+
+  if (entity_grid == nullptr) {
+    candidates.push_back(&hero);
+    for (const MapEntityPtr& entity: all_entities) {
+      candidates.push_back(entity.get());
+    }
+    return;
+  }
+
+  entity_grid->get_elements(where, candidates);
+}
+
+/**
+ * \brief Returns the entities whose bounding box overlaps a rectangle.
+ *
+ * Only the cells of the entity grid overlapping the rectangle are
+ * inspected.
+ * The hero is included, tiles and entities being removed are not.
+ *
+ * \param where The rectangle to test.
+ * \param[out] entities Vector where the entities found are appended.
+ */
+void MapEntities::get_entities_in_rectangle(
+    const Rectangle& where,
+    std::vector<MapEntity*>& entities
+) const {
+
+  std::vector<MapEntity*> candidates;
+  get_entity_candidates(where, candidates);
+
+  for (MapEntity* entity: candidates) {
+    if (entity->overlaps(where) && !entity->is_being_removed()) {
+      entities.push_back(entity);
+    }
+  }
+}
+
+/**
+ * \brief Returns the entities whose origin point is close to a point.
+ *
+ * The entity grid stores entities by a box that contains their origin
+ * point, so only the cells around the circle are inspected.
+ * The hero is included, tiles and entities being removed are not.
+ *
+ * \param center Center of the circle.
+ * \param radius Maximum distance in pixels between the center and the
+ * origin point of entities.
+ * \param[out] entities Vector where the entities found are appended.
+ */
+void MapEntities::get_entities_in_radius(
+    const Point& center,
+    int radius,
+    std::vector<MapEntity*>& entities
+) const {
+
+  if (radius < 0) {
+    return;
+  }
+
+  const Rectangle where(
+      center.x - radius,
+      center.y - radius,
+      radius * 2 + 1,
+      radius * 2 + 1
+  );
+  std::vector<MapEntity*> candidates;
+  get_entity_candidates(where, candidates);
+
+  const int64_t max_distance2 = static_cast<int64_t>(radius) * radius;
+  for (MapEntity* entity: candidates) {
+    const Point& xy = entity->get_xy();
+    const int64_t dx = xy.x - center.x;
+    const int64_t dy = xy.y - center.y;
+    if (dx * dx + dy * dy <= max_distance2 && !entity->is_being_removed()) {
+      entities.push_back(entity);
+    }
+  }
+}
+
 /**
  * \brief Returns the default destination of the map.
  * \return The default destination, or nullptr if there exists no destination
@@ -134,7 +545,7 @@ Destination* MapEntities::get_default_destination() {
  * \param layer the layer
  * \return the stairs on this layer
  */
-const std::list<Stairs*>& MapEntities::get_stairs(Layer layer) {
+const std::vector<Stairs*>& MapEntities::get_stairs(Layer layer) {
   return stairs[layer];
 }
 
@@ -143,7 +554,7 @@ const std::list<Stairs*>& MapEntities::get_stairs(Layer layer) {
  * \param layer the layer
  * \return the crystal blocks on this layer
  */
-const std::list<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
+const std::vector<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
   return crystal_blocks[layer];
 }
 
@@ -151,7 +562,7 @@ const std::list<CrystalBlock*>& MapEntities::get_crystal_blocks(Layer layer) {
  * \brief Returns all separators of the map.
  * \return The separators.
  */
-const std::list<const Separator*>& MapEntities::get_separators() const {
+const std::vector<const Separator*>& MapEntities::get_separators() const {
   return separators;
 }
 
@@ -171,6 +582,10 @@ void MapEntities::set_tile_ground(Layer layer, int x8, int y8, Ground ground) {
   if (x8 >= 0 && x8 < map_width8 && y8 >= 0 && y8 < map_height8) {
     int index = y8 * map_width8 + x8;
     tiles_ground[layer][index] = ground;
+    tiles_ground_bits[layer]->set_ground(x8, y8, ground);
+    if (path_finding_terrain[layer] != nullptr) {
+      path_finding_terrain[layer]->notify_ground_changed(x8, y8);
+    }
   }
 }
 
@@ -215,20 +630,89 @@ MapEntity* MapEntities::find_entity(const std::string& name) {
   return entity;
 }
 
+/**
+ * \brief Returns the named entities whose name starts with a prefix.
+ *
+ * Names are sorted, so these entities are consecutive in named_entities.
+ * The range may also contain the hero, static tiles and entities being
+ * removed: use is_found_by_prefix() to filter them.
+ *
+ * \param prefix Prefix of the name.
+ * \return The range of named_entities having this prefix.
+ */
+MapEntities::NamedEntityRange MapEntities::get_named_entities_with_prefix(
+    const std::string& prefix) const {
+
+  const auto begin = named_entities.lower_bound(prefix);
+  auto end = begin;
+  while (end != named_entities.end() &&
+      end->first.compare(0, prefix.size(), prefix) == 0) {
+    ++end;
+  }
+  return std::make_pair(begin, end);
+}
+
+/**
+ * \brief Returns whether an entity can be returned by prefix searches.
+ *
+ * The hero and static tiles have names but are not part of all_entities.
+ *
+ * \param entity An entity.
+ * \return \c true if prefix searches should consider this entity.
+ */
+bool MapEntities::is_found_by_prefix(const MapEntity& entity) {
+
+  return entity.get_type() != EntityType::HERO &&
+      entity.get_type() != EntityType::TILE &&
+      !entity.is_being_removed();
+}
+
+/**
+ * \brief Sorts entities in the order they were added to the map.
+ * \param entities Entities other than tiles and the hero.
+ */
+void MapEntities::sort_by_insertion_rank(std::vector<MapEntity*>& entities) const {
+
+  std::vector<std::pair<uint32_t, MapEntity*>> ranked_entities;
+  ranked_entities.reserve(entities.size());
+  for (MapEntity* entity: entities) {
+    ranked_entities.emplace_back(get_insertion_rank(*entity), entity);
+  }
+  std::sort(ranked_entities.begin(), ranked_entities.end());
+  for (size_t i = 0; i < entities.size(); ++i) {
+    entities[i] = ranked_entities[i].second;
+  }
+}
+
 /**
  * \brief Returns the entities of the map having the specified name prefix.
+ *
+ * Entities are returned in the order they were added to the map.
+ *
  * \param prefix Prefix of the name.
  * \return The entities of this type and having this prefix in their name.
  */
-std::list<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& prefix) {
+std::vector<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& prefix) {
 
-  std::list<MapEntity*> entities;
+  std::vector<MapEntity*> entities;
 
-  for (const MapEntityPtr& entity: all_entities) {
-    if (entity->has_prefix(prefix) && !entity->is_being_removed()) {
-      entities.push_back(entity.get());
+  if (prefix.empty()) {
+    // Unnamed entities also match.
+    for (const MapEntityPtr& entity: all_entities) {
+      if (!entity->is_being_removed()) {
+        entities.push_back(entity.get());
+      }
+    }
+    return entities;
+  }
+
+  const NamedEntityRange range = get_named_entities_with_prefix(prefix);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (is_found_by_prefix(*it->second)) {
+      entities.push_back(it->second);
     }
   }
+  sort_by_insertion_rank(entities);
 
   return entities;
 }
@@ -236,24 +720,66 @@ std::list<MapEntity*> MapEntities::get_entities_with_prefix(const std::string& p
 /**
  * \brief Returns the entities of the map with the specified type and having
  * the specified name prefix.
+ *
+ * Entities are returned in the order they were added to the map.
+ *
  * \param type Type of entity.
  * \param prefix Prefix of the name.
  * \return The entities of this type and having this prefix in their name.
  */
-std::list<MapEntity*> MapEntities::get_entities_with_prefix(
+std::vector<MapEntity*> MapEntities::get_entities_with_prefix(
     EntityType type, const std::string& prefix) {
 
-  std::list<MapEntity*> entities;
+  std::vector<MapEntity*> entities;
 
-  for (const MapEntityPtr& entity: all_entities) {
-    if (entity->get_type() == type && entity->has_prefix(prefix) && !entity->is_being_removed()) {
-      entities.push_back(entity.get());
+  if (prefix.empty()) {
+    for (const MapEntityPtr& entity: all_entities) {
+      if (entity->get_type() == type && !entity->is_being_removed()) {
+        entities.push_back(entity.get());
+      }
+    }
+    return entities;
+  }
+
+  const NamedEntityRange range = get_named_entities_with_prefix(prefix);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second->get_type() == type && is_found_by_prefix(*it->second)) {
+      entities.push_back(it->second);
     }
   }
+  sort_by_insertion_rank(entities);
 
   return entities;
 }
 
+/**
+ * \brief Returns the number of entities having the specified name prefix.
+ * \param prefix Prefix of the name.
+ * \return The number of entities with this prefix.
+ */
+int MapEntities::get_num_entities_with_prefix(const std::string& prefix) const {
+
+  int num_entities = 0;
+
+  if (prefix.empty()) {
+    for (const MapEntityPtr& entity: all_entities) {
+      if (!entity->is_being_removed()) {
+        ++num_entities;
+      }
+    }
+    return num_entities;
+  }
+
+  const NamedEntityRange range = get_named_entities_with_prefix(prefix);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (is_found_by_prefix(*it->second)) {
+      ++num_entities;
+    }
+  }
+
+  return num_entities;
+}
+
 /**
  * \brief Returns whether there exists at least one entity with the specified
  * name prefix on the map.
@@ -262,10 +788,22 @@ std::list<MapEntity*> MapEntities::get_entities_with_prefix(
  */
 bool MapEntities::has_entity_with_prefix(const std::string& prefix) const {
 
-  for (const MapEntityPtr& entity: all_entities) {
-    if (entity->has_prefix(prefix) && !entity->is_being_removed()) {
+  if (prefix.empty()) {
+    for (const MapEntityPtr& entity: all_entities) {
+      if (!entity->is_being_removed()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto it = named_entities.lower_bound(prefix);
+  while (it != named_entities.end() &&
+      it->first.compare(0, prefix.size(), prefix) == 0) {
+    if (is_found_by_prefix(*it->second)) {
       return true;
     }
+    ++it;
   }
 
   return false;
@@ -279,21 +817,21 @@ void MapEntities::bring_to_front(MapEntity& entity) {
 
   Layer layer = entity.get_layer();
   if (entity.can_be_drawn() && !entity.is_drawn_in_y_order()) {
-    entities_drawn_first[layer].remove(&entity);
+    remove_value(entities_drawn_first[layer], &entity);
     entities_drawn_first[layer].push_back(&entity);  // Displayed last.
   }
 
   if (entity.can_be_obstacle()) {
     if (entity.has_layer_independent_collisions()) {
-      obstacle_entities[LAYER_LOW].remove(&entity);
+      remove_value(obstacle_entities[LAYER_LOW], &entity);
       obstacle_entities[LAYER_LOW].push_back(&entity);
-      obstacle_entities[LAYER_INTERMEDIATE].remove(&entity);
+      remove_value(obstacle_entities[LAYER_INTERMEDIATE], &entity);
       obstacle_entities[LAYER_INTERMEDIATE].push_back(&entity);
-      obstacle_entities[LAYER_HIGH].remove(&entity);
+      remove_value(obstacle_entities[LAYER_HIGH], &entity);
       obstacle_entities[LAYER_HIGH].push_back(&entity);
     }
     else {
-      obstacle_entities[layer].remove(&entity);
+      remove_value(obstacle_entities[layer], &entity);
       obstacle_entities[layer].push_back(&entity);
     }
   }
@@ -309,22 +847,17 @@ void MapEntities::bring_to_back(MapEntity& entity) {
 
   Layer layer = entity.get_layer();
   if (entity.can_be_drawn() && !entity.is_drawn_in_y_order()) {
-    entities_drawn_first[layer].remove(&entity);
-    entities_drawn_first[layer].push_front(&entity);  // Displayed first.
+    push_front(entities_drawn_first[layer], &entity);  // Displayed first.
   }
 
   if (entity.can_be_obstacle()) {
     if (entity.has_layer_independent_collisions()) {
-      obstacle_entities[LAYER_LOW].remove(&entity);
-      obstacle_entities[LAYER_LOW].push_front(&entity);
-      obstacle_entities[LAYER_INTERMEDIATE].remove(&entity);
-      obstacle_entities[LAYER_INTERMEDIATE].push_front(&entity);
-      obstacle_entities[LAYER_HIGH].remove(&entity);
-      obstacle_entities[LAYER_HIGH].push_front(&entity);
+      push_front(obstacle_entities[LAYER_LOW], &entity);
+      push_front(obstacle_entities[LAYER_INTERMEDIATE], &entity);
+      push_front(obstacle_entities[LAYER_HIGH], &entity);
     }
     else {
-      obstacle_entities[layer].remove(&entity);
-      obstacle_entities[layer].push_front(&entity);
+      push_front(obstacle_entities[layer], &entity);
     }
   }
 
@@ -336,17 +869,22 @@ void MapEntities::bring_to_back(MapEntity& entity) {
  */
 void MapEntities::notify_map_started() {
 
-  for (const MapEntityPtr& entity: all_entities) {
+  // Callbacks may create entities: don't keep references to the vector.
+  for (size_t i = 0; i < all_entities.size(); ++i) {
+    MapEntity* entity = all_entities[i].get();
     entity->notify_map_started();
     entity->notify_tileset_changed();
   }
   hero.notify_map_started();
   hero.notify_tileset_changed();
 
-  // Setup non-animated tiles pre-drawing.
+  // Setup non-animated and animated tiles pre-drawing.
   for (int layer = 0; layer < LAYER_NB; layer++) {
-    non_animated_regions[layer]->build(tiles_in_animated_regions[layer]);
-    // Now, tiles_in_animated_regions contains the tiles that won't be optimized.
+    std::vector<TilePtr> tiles_in_animated_regions;
+    non_animated_regions[layer]->build(tiles_in_animated_regions);
+    // Now, tiles_in_animated_regions contains the tiles that won't be optimized
+    // as non-animated ones.
+    animated_regions[layer]->build(tiles_in_animated_regions);
   }
 }
 
@@ -356,8 +894,8 @@ void MapEntities::notify_map_started() {
  */
 void MapEntities::notify_map_opening_transition_finished() {
 
-  for (const MapEntityPtr& entity: all_entities) {
-    entity->notify_map_opening_transition_finished();
+  for (size_t i = 0; i < all_entities.size(); ++i) {
+    all_entities[i]->notify_map_opening_transition_finished();
   }
   hero.notify_map_opening_transition_finished();
 }
@@ -368,13 +906,14 @@ void MapEntities::notify_map_opening_transition_finished() {
  */
 void MapEntities::notify_tileset_changed() {
 
-  // Redraw optimized tiles (i.e. non animated ones).
+  // Redraw optimized tiles.
   for (int layer = 0; layer < LAYER_NB; layer++) {
     non_animated_regions[layer]->notify_tileset_changed();
+    animated_regions[layer]->notify_tileset_changed();
   }
 
-  for (const MapEntityPtr& entity: all_entities) {
-    entity->notify_tileset_changed();
+  for (size_t i = 0; i < all_entities.size(); ++i) {
+    all_entities[i]->notify_tileset_changed();
   }
   hero.notify_tileset_changed();
 }
@@ -384,8 +923,8 @@ void MapEntities::notify_tileset_changed() {
  */
 void MapEntities::notify_map_finished() {
 
-  for (const MapEntityPtr& entity: all_entities) {
-    notify_entity_removed(entity.get());
+  for (size_t i = 0; i < all_entities.size(); ++i) {
+    notify_entity_removed(all_entities[i].get());
   }
 }
 
@@ -570,6 +1109,7 @@ void MapEntities::add_entity(const MapEntityPtr& entity) {
   }
   else {
     Layer layer = entity->get_layer();
+    insertion_ranks[entity.get()] = next_insertion_rank++;
 
     // update the detectors list
     if (entity->is_detector()) {
@@ -589,7 +1129,9 @@ void MapEntities::add_entity(const MapEntityPtr& entity) {
         // but usually, an entity collides with only one layer
         obstacle_entities[layer].push_back(entity.get());
       }
+      update_obstacle_grid(*entity);
     }
+    update_detection_grids(*entity);
 
     // update the ground observers list
     if (entity->is_ground_observer()) {
@@ -598,7 +1140,7 @@ void MapEntities::add_entity(const MapEntityPtr& entity) {
 
     // update the ground modifiers list
     if (entity->is_ground_modifier()) {
-      ground_modifiers[layer].push_back(entity.get());
+      add_ground_modifier(*entity, layer);
     }
 
     // update the sprites list
@@ -719,7 +1261,7 @@ void MapEntities::remove_entity(const std::string& name) {
  */
 void MapEntities::remove_entities_with_prefix(const std::string& prefix) {
 
-  std::list<MapEntity*> entities = get_entities_with_prefix(prefix);
+  const std::vector<MapEntity*> entities = get_entities_with_prefix(prefix);
   for (MapEntity* entity: entities) {
     remove_entity(entity);
   }
@@ -730,82 +1272,77 @@ void MapEntities::remove_entities_with_prefix(const std::string& prefix) {
  */
 void MapEntities::remove_marked_entities() {
 
-  // remove the marked entities
-  for (MapEntity* entity: entities_to_remove) {
-
-    Layer layer = entity->get_layer();
-
-    // remove it from the obstacle entities list if present
-    if (entity->can_be_obstacle()) {
+  if (entities_to_remove.empty()) {
+    return;
+  }
 
-      if (entity->has_layer_independent_collisions()) {
-        for (int i = 0; i < LAYER_NB; i++) {
-          obstacle_entities[i].remove(entity);
-        }
-      }
-      else {
-        obstacle_entities[layer].remove(entity);
-      }
-    }
+  // First update what is indexed per entity.
+  // Iterate by index: destroying an entity may mark other ones.
+  for (size_t i = 0; i < entities_to_remove.size(); ++i) {
 
-    // remove it from the detectors list if present
-    if (entity->is_detector()) {
-      detectors.remove(static_cast<Detector*>(entity));
-    }
+    MapEntity* entity = entities_to_remove[i];
 
-    // remove it from the ground observers list if present
-    if (entity->is_ground_observer()) {
-      ground_observers[layer].remove(entity);
-    }
+    remove_from_obstacle_grid(*entity);
+    remove_from_detection_grids(*entity);
+    insertion_ranks.erase(entity);
 
     // remove it from the ground modifiers list if present
     if (entity->is_ground_modifier()) {
-      ground_modifiers[layer].remove(entity);
+      remove_ground_modifier(*entity, entity->get_layer());
     }
 
-    // remove it from the sprite entities list if present
-    if (entity->is_drawn_in_y_order()) {
-      entities_drawn_y_order[layer].remove(entity);
-    }
-    else if (entity->can_be_drawn()) {
-      entities_drawn_first[layer].remove(entity);
-    }
-
-    // remove it from the whole list
-    MapEntityPtr shared_entity = std::static_pointer_cast<MapEntity>(entity->shared_from_this());
-    all_entities.remove(shared_entity);
     const std::string& name = entity->get_name();
     if (!name.empty()) {
       named_entities.erase(name);
     }
 
-    // update the specific entities lists
-    switch (entity->get_type()) {
-
-      case EntityType::STAIRS:
-        stairs[layer].remove(static_cast<Stairs*>(entity));
-        break;
-
-      case EntityType::CRYSTAL_BLOCK:
-        crystal_blocks[layer].remove(static_cast<CrystalBlock*>(entity));
-        break;
-
-      case EntityType::SEPARATOR:
-        separators.remove(static_cast<Separator*>(entity));
-        break;
+    if (entity == this->boomerang) {
+      this->boomerang = nullptr;
+    }
+  }
 
-      case EntityType::BOOMERANG:
-        this->boomerang = nullptr;
-        break;
+  // Then compact all lists in a single pass each,
+  // keeping the order of the remaining entities.
+  // Entities are removed from every list, whatever their current properties.
+  const std::unordered_set<const MapEntity*> removed(
+      entities_to_remove.begin(), entities_to_remove.end()
+  );
+  const auto& is_removed = [&removed](const MapEntity* entity) {
+    return removed.find(entity) != removed.end();
+  };
 
-      default:
-      break;
+  for (int layer = 0; layer < LAYER_NB; ++layer) {
+    remove_values_if(obstacle_entities[layer], is_removed);
+    remove_values_if(ground_observers[layer], is_removed);
+    remove_values_if(ground_modifiers[layer], is_removed);
+    remove_values_if(entities_drawn_first[layer], is_removed);
+    remove_values_if(entities_drawn_y_order[layer], is_removed);
+    remove_values_if(stairs[layer], is_removed);
+    remove_values_if(crystal_blocks[layer], is_removed);
+  }
+  remove_values_if(detectors, is_removed);
+  remove_values_if(separators, is_removed);
+  remove_values_if(flow_fields, [&is_removed](const std::unique_ptr<FlowField>& flow_field) {
+    return is_removed(&flow_field->get_target());
+  });
+
+  // Keep the removed entities alive until they are notified.
+  std::vector<MapEntityPtr> removed_entities;
+  removed_entities.reserve(removed.size());
+  for (MapEntityPtr& entity: all_entities) {
+    if (is_removed(entity.get())) {
+      removed_entities.push_back(std::move(entity));
     }
-
-    // destroy it
-    notify_entity_removed(shared_entity.get());
   }
+  remove_values_if(all_entities, [](const MapEntityPtr& entity) {
+    return entity == nullptr;
+  });
   entities_to_remove.clear();
+
+  // destroy them
+  for (const MapEntityPtr& entity: removed_entities) {
+    notify_entity_removed(entity.get());
+  }
 }
 
 /**
@@ -823,8 +1360,8 @@ void MapEntities::set_suspended(bool suspended) {
   hero.set_suspended(suspended);
 
   // other entities
-  for (const MapEntityPtr& entity: all_entities) {
-    entity->set_suspended(suspended);
+  for (size_t i = 0; i < all_entities.size(); ++i) {
+    all_entities[i]->set_suspended(suspended);
   }
 
   // note that we don't suspend the tiles
@@ -844,11 +1381,14 @@ void MapEntities::update() {
   for (int layer = 0; layer < LAYER_NB; layer++) {
 
     // Sort the entities drawn in y order.
-    entities_drawn_y_order[layer].sort(compare_y);
+    sort_entities_drawn_y_order(Layer(layer));
   }
 
-  for (const MapEntityPtr& entity: all_entities) {
+  // Entities created during this loop are also updated,
+  // so iterate by index: the vector may grow.
+  for (size_t i = 0; i < all_entities.size(); ++i) {
 
+    MapEntity* entity = all_entities[i].get();
     if (!entity->is_being_removed()) {
       entity->update();
     }
@@ -869,17 +1409,16 @@ void MapEntities::draw() {
     // in other words, draw all regions containing animated tiles
     // (and maybe more, but we don't care because non-animated tiles
     // will be drawn later)
-    for (unsigned int i = 0; i < tiles_in_animated_regions[layer].size(); i++) {
-      tiles_in_animated_regions[layer][i]->draw_on_map();
-    }
+    animated_regions[layer]->draw_on_map();
 
     // draw the non-animated tiles (with transparent rectangles on the regions of animated tiles
     // since they are already drawn)
     non_animated_regions[layer]->draw_on_map();
 
     // draw the first sprites
-    for (MapEntity* entity: entities_drawn_first[layer]) {
+    for (size_t i = 0; i < entities_drawn_first[layer].size(); ++i) {
 
+      MapEntity* entity = entities_drawn_first[layer][i];
       if (entity->is_enabled()) {
         entity->draw_on_map();
       }
@@ -887,8 +1426,9 @@ void MapEntities::draw() {
 
     // draw the sprites at the hero's level, in the order
     // defined by their y position (including the hero)
-    for (MapEntity* entity: entities_drawn_y_order[layer]) {
+    for (size_t i = 0; i < entities_drawn_y_order[layer].size(); ++i) {
 
+      MapEntity* entity = entities_drawn_y_order[layer][i];
       if (entity->is_enabled()) {
         entity->draw_on_map();
       }
@@ -896,6 +1436,17 @@ void MapEntities::draw() {
   }
 }
 
+/**
+ * \brief Builds in advance the optimized tiles the camera is moving toward.
+ * \param deadline Real time when this function should stop.
+ */
+void MapEntities::prefetch_tiles(uint32_t deadline) {
+
+  for (int layer = 0; layer < LAYER_NB; ++layer) {
+    non_animated_regions[layer]->prefetch_cells(deadline);
+  }
+}
+
 /**
  * \brief Compares the y position of two entities.
  * \param first an entity
@@ -909,6 +1460,46 @@ bool MapEntities::compare_y(MapEntity* first, MapEntity* second) {
   return first->get_top_left_y() + first->get_height() < second->get_top_left_y() + second->get_height();
 }
 
+/**
+ * \brief Sorts the entities of a layer that are drawn in y order.
+ * \param layer The layer to sort.
+ */
+void MapEntities::sort_entities_drawn_y_order(Layer layer) {
+
+  sort_y_order(entities_drawn_y_order[layer]);
+}
+
+/**
+ * \brief Sorts entities by their y position.
+ *
+ * The entities are expected to be already sorted since the previous cycle,
+ * and usually only a few of them have moved since then, so an insertion
+ * sort is almost linear here.
+ * Like std::list::sort(), it is stable: entities with the same y keep their
+ * relative order.
+ *
+ * \param entities The entities to sort.
+ */
+void MapEntities::sort_y_order(std::vector<MapEntity*>& entities) {
+
+  const size_t size = entities.size();
+  for (size_t i = 1; i < size; ++i) {
+
+    MapEntity* entity = entities[i];
+    if (!compare_y(entity, entities[i - 1])) {
+      // Already in place: the most common case.
+      continue;
+    }
+
+    size_t j = i;
+    do {
+      entities[j] = entities[j - 1];
+      --j;
+    } while (j > 0 && compare_y(entity, entities[j - 1]));
+    entities[j] = entity;
+  }
+}
+
 /**
  * \brief Sets whether an entity is drawn in Y order or in creation order.
  * \param entity The entity to change.
@@ -920,11 +1511,11 @@ void MapEntities::set_entity_drawn_in_y_order(
 
   const Layer layer = entity.get_layer();
   if (drawn_in_y_order) {
-    entities_drawn_first[layer].remove(&entity);
+    remove_value(entities_drawn_first[layer], &entity);
     entities_drawn_y_order[layer].push_back(&entity);
   }
   else {
-    entities_drawn_y_order[layer].remove(&entity);
+    remove_value(entities_drawn_y_order[layer], &entity);
     entities_drawn_first[layer].push_back(&entity);
   }
 }
@@ -945,34 +1536,38 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
 
     // update the obstacle list
     if (entity.can_be_obstacle() && !entity.has_layer_independent_collisions()) {
-      obstacle_entities[old_layer].remove(&entity);
+      remove_value(obstacle_entities[old_layer], &entity);
       obstacle_entities[layer].push_back(&entity);
     }
 
     // update the ground observers list
     if (entity.is_ground_observer()) {
-      ground_observers[old_layer].remove(&entity);
+      remove_value(ground_observers[old_layer], &entity);
       ground_observers[layer].push_back(&entity);
     }
 
     // update the ground modifiers list
     if (entity.is_ground_modifier()) {
-      ground_modifiers[old_layer].remove(&entity);
-      ground_modifiers[layer].push_back(&entity);
+      remove_ground_modifier(entity, old_layer);
+      add_ground_modifier(entity, layer);
     }
 
     // update the sprites list
     if (entity.is_drawn_in_y_order()) {
-      entities_drawn_y_order[old_layer].remove(&entity);
+      remove_value(entities_drawn_y_order[old_layer], &entity);
       entities_drawn_y_order[layer].push_back(&entity);
     }
     else if (entity.can_be_drawn()) {
-      entities_drawn_first[old_layer].remove(&entity);
+      remove_value(entities_drawn_first[old_layer], &entity);
       entities_drawn_first[layer].push_back(&entity);
     }
 
     // update the entity after the lists because this function might be called again
     entity.set_layer(layer);
+
+    if (entity.can_be_obstacle()) {
+      update_obstacle_grid(entity);
+    }
   }
 }
 
@@ -984,7 +1579,7 @@ void MapEntities::set_entity_layer(MapEntity& entity, Layer layer) {
 void MapEntities::notify_entity_ground_observer_changed(MapEntity& entity) {
 
   Layer layer = entity.get_layer();
-  ground_observers[layer].remove(&entity);
+  remove_value(ground_observers[layer], &entity);
   if (entity.is_ground_observer()) {
     ground_observers[layer].push_back(&entity);
   }
@@ -998,12 +1593,246 @@ void MapEntities::notify_entity_ground_observer_changed(MapEntity& entity) {
 void MapEntities::notify_entity_ground_modifier_changed(MapEntity& entity) {
 
   Layer layer = entity.get_layer();
-  ground_modifiers[layer].remove(&entity);
+  remove_ground_modifier(entity, layer);
   if (entity.is_ground_modifier()) {
-    ground_modifiers[layer].push_back(&entity);
+    add_ground_modifier(entity, layer);
   }
 }
 
+/**
+ * \brief This function should be called when the position or the size of an
+ * entity has changed.
+ *
+ * It keeps the spatial structures of the map up to date.
+ *
+ * \param entity The entity whose bounding box has changed.
+ */
+void MapEntities::notify_entity_bounding_box_changed(MapEntity& entity) {
+
+  if (entity.can_be_obstacle()) {
+    update_obstacle_grid(entity);
+  }
+  update_detection_grids(entity);
+
+  if (ground_modifier_grid[LAYER_LOW] != nullptr) {
+    // Does nothing if the entity is not a ground modifier.
+    ground_modifier_grid[entity.get_layer()]->move(&entity);
+  }
+}
+
+/**
+ * \brief This function should be called when the collision modes of a
+ * detector have changed.
+ * \param detector The detector whose collision modes have changed.
+ */
+void MapEntities::notify_detector_collision_modes_changed(Detector& detector) {
+
+  update_detection_grids(detector);
+}
+
+/**
+ * \brief Creates the obstacle, detection and ground modifier grids once the
+ * size of the map is known.
+ *
+ * This function is called by the map loader before entities are created.
+ */
+void MapEntities::initialize_grids() {
+
+  for (int layer = 0; layer < LAYER_NB; ++layer) {
+    obstacle_grid[layer] = std::unique_ptr<Grid<MapEntity*>>(
+        new Grid<MapEntity*>(map.get_size(), Size(64, 64))
+    );
+    ground_modifier_grid[layer] = std::unique_ptr<Grid<MapEntity*>>(
+        new Grid<MapEntity*>(map.get_size(), Size(64, 64))
+    );
+  }
+  entity_grid = std::unique_ptr<Grid<MapEntity*>>(
+      new Grid<MapEntity*>(map.get_size(), Size(64, 64))
+  );
+  detector_grid = std::unique_ptr<Grid<Detector*>>(
+      new Grid<Detector*>(map.get_size(), Size(64, 64))
+  );
+
+  // The hero was added before the size of the map was known.
+  update_obstacle_grid(hero);
+  update_detection_grids(hero);
+}
+
+/**
+ * \brief Stores an obstacle entity in the cells of the obstacle grid that
+ * correspond to its current bounding box and layer.
+ *
+ * \param entity An entity that can be an obstacle.
+ */
+void MapEntities::update_obstacle_grid(MapEntity& entity) {
+
+  if (obstacle_grid[LAYER_LOW] == nullptr) {
+    // The map is not loaded yet.
+    return;
+  }
+
+  const bool layer_independent = entity.has_layer_independent_collisions();
+  for (int layer = 0; layer < LAYER_NB; ++layer) {
+
+    Grid<MapEntity*>& grid = *obstacle_grid[layer];
+    if (layer_independent || layer == entity.get_layer()) {
+      if (!grid.move(&entity)) {
+        grid.add(&entity);
+      }
+    }
+    else {
+      grid.remove(&entity);
+    }
+  }
+}
+
+/**
+ * \brief Removes an entity from the obstacle grid if it is there.
+ * \param entity The entity to remove.
+ */
+void MapEntities::remove_from_obstacle_grid(MapEntity& entity) {
+
+  if (obstacle_grid[LAYER_LOW] == nullptr) {
+    return;
+  }
+
+  for (int layer = 0; layer < LAYER_NB; ++layer) {
+    obstacle_grid[layer]->remove(&entity);
+  }
+}
+
+/**
+ * \brief Returns the rectangle where an entity can be detected by detectors.
+ *
+ * This is the bounding box of the entity extended to its origin point
+ * and enlarged by one pixel on each side, so that it also contains
+ * its facing point and its touching points.
+ *
+ * \param entity An entity.
+ * \return The detection box of this entity.
+ */
+Rectangle MapEntities::get_detection_box(const MapEntity& entity) {
+
+  const Rectangle& bounding_box = entity.get_bounding_box();
+  const Point& xy = entity.get_xy();
+  const int x1 = std::min(bounding_box.get_x(), xy.x) - 1;
+  const int y1 = std::min(bounding_box.get_y(), xy.y) - 1;
+  const int x2 = std::max(bounding_box.get_x() + bounding_box.get_width(), xy.x + 1) + 1;
+  const int y2 = std::max(bounding_box.get_y() + bounding_box.get_height(), xy.y + 1) + 1;
+  return Rectangle(x1, y1, x2 - x1, y2 - y1);
+}
+
+/**
+ * \brief Stores an entity in the cells of the entity grid that correspond
+ * to its detection box, and a detector in the cells of the detector grid
+ * that correspond to its bounding box.
+ * \param entity An entity other than a tile.
+ */
+void MapEntities::update_detection_grids(MapEntity& entity) {
+
+  if (entity_grid == nullptr) {
+    // The map is not loaded yet.
+    return;
+  }
+
+  // Grid queries return entities in the order they were added to the map.
+  const Rectangle& detection_box = get_detection_box(entity);
+  if (!entity_grid->move(&entity, detection_box)) {
+    entity_grid->add(&entity, detection_box, get_insertion_rank(entity));
+  }
+
+  if (!entity.is_detector()) {
+    return;
+  }
+
+  Detector* detector = static_cast<Detector*>(&entity);
+  Rectangle box = detector->get_bounding_box();
+  if ((detector->get_collision_modes() & COLLISION_CUSTOM) != 0) {
+    // A custom collision test can detect entities anywhere.
+    box = Rectangle(detector_grid->get_grid_size());
+  }
+  if (!detector_grid->move(detector, box)) {
+    detector_grid->add(detector, box, get_insertion_rank(entity));
+  }
+}
+
+/**
+ * \brief Removes an entity from the entity grid and from the detector grid
+ * if it is there.
+ * \param entity The entity to remove.
+ */
+void MapEntities::remove_from_detection_grids(MapEntity& entity) {
+
+  if (entity_grid == nullptr) {
+    return;
+  }
+
+  entity_grid->remove(&entity);
+  if (entity.is_detector()) {
+    detector_grid->remove(static_cast<Detector*>(&entity));
+  }
+}
+
+/**
+ * \brief Adds a ground modifier on top of the existing ones of a layer.
+ * \param entity An entity that modifies the ground.
+ * \param layer The layer where to add it.
+ */
+void MapEntities::add_ground_modifier(MapEntity& entity, Layer layer) {
+
+  ground_modifiers[layer].push_back(&entity);
+  ground_modifier_ranks[&entity] = next_ground_modifier_rank++;
+  if (ground_modifier_grid[layer] != nullptr) {
+    ground_modifier_grid[layer]->add(&entity);
+  }
+}
+
+/**
+ * \brief Removes an entity from the ground modifiers of a layer if it is there.
+ * \param entity The entity to remove.
+ * \param layer The layer where it is.
+ */
+void MapEntities::remove_ground_modifier(MapEntity& entity, Layer layer) {
+
+  remove_value(ground_modifiers[layer], &entity);
+  ground_modifier_ranks.erase(&entity);
+  if (ground_modifier_grid[layer] != nullptr) {
+    ground_modifier_grid[layer]->remove(&entity);
+  }
+}
+
+/**
+ * \brief Returns the number of obstacle queries since the last call to
+ * reset_obstacle_query_stats().
+ * \return The number of calls to get_obstacle_entities(Layer, const Rectangle&, std::vector<MapEntity*>&).
+ */
+uint32_t MapEntities::get_num_obstacle_queries() const {
+  return num_obstacle_queries;
+}
+
+/**
+ * \brief Returns the total number of candidate obstacles examined by
+ * obstacle queries since the last call to reset_obstacle_query_stats().
+ *
+ * Divide it by get_num_obstacle_queries() to get the average number of
+ * candidates per query, to be compared with the size of
+ * get_obstacle_entities(Layer).
+ *
+ * \return The number of candidates examined.
+ */
+uint32_t MapEntities::get_num_obstacle_candidates() const {
+  return num_obstacle_candidates;
+}
+
+/**
+ * \brief Resets the obstacle query counters.
+ */
+void MapEntities::reset_obstacle_query_stats() {
+
+  num_obstacle_queries = 0;
+  num_obstacle_candidates = 0;
+}
+
 /**
  * \brief Returns whether a rectangle overlaps with a raised crystal block.
  * \param layer the layer to check
@@ -1012,9 +1841,7 @@ void MapEntities::notify_entity_ground_modifier_changed(MapEntity& entity) {
  */
 bool MapEntities::overlaps_raised_blocks(Layer layer, const Rectangle& rectangle) {
 
-  std::list<CrystalBlock*> blocks = get_crystal_blocks(layer);
-
-  for (const CrystalBlock* block: blocks) {
+  for (const CrystalBlock* block: crystal_blocks[layer]) {
     if (block->overlaps(rectangle) && block->is_raised()) {
       return true;
     }
@@ -1048,9 +1875,10 @@ void MapEntities::remove_boomerang() {
 void MapEntities::remove_arrows() {
 
   // TODO this function may be slow if there are a lot of entities: store the arrows?
-  for (const MapEntityPtr& entity: all_entities) {
+  for (size_t i = 0; i < all_entities.size(); ++i) {
+    MapEntity* entity = all_entities[i].get();
     if (entity->get_type() == EntityType::ARROW) {
-      remove_entity(entity.get());
+      remove_entity(entity);
     }
   }
 }
@@ -195,9 +195,11 @@ Ground MapEntity::get_modified_ground() const {
 void MapEntity::update_ground_observers() {
 
   // Update overlapping entities sensible to their ground.
-  const std::list<MapEntity*>& ground_observers =
+  // Iterate by index: updating the ground of an entity may change the list.
+  const std::vector<MapEntity*>& ground_observers =
       get_entities().get_ground_observers(get_layer());
-  for (MapEntity* ground_observer: ground_observers) {
+  for (size_t i = 0; i < ground_observers.size(); ++i) {
+    MapEntity* ground_observer = ground_observers[i];
     // Update the ground of entities that overlap or were just overlapping this one.
 
     if (overlaps(ground_observer->get_ground_point())
@@ -673,6 +675,7 @@ int MapEntity::get_y() const {
  */
 void MapEntity::set_x(int x) {
   bounding_box.set_x(x - origin.x);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -684,6 +687,7 @@ void MapEntity::set_x(int x) {
  */
 void MapEntity::set_y(int y) {
   bounding_box.set_y(y - origin.y);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -751,6 +755,7 @@ Point MapEntity::get_top_left_xy() const {
  */
 void MapEntity::set_top_left_x(int x) {
   bounding_box.set_x(x);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -759,6 +764,7 @@ void MapEntity::set_top_left_x(int x) {
  */
 void MapEntity::set_top_left_y(int y) {
   bounding_box.set_y(y);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -834,6 +840,7 @@ void MapEntity::set_size(int width, int height) {
   Debug::check_assertion(width % 8 == 0 && height % 8 == 0,
       "Invalid entity size: width and height must be multiple of 8");
   bounding_box.set_size(width, height);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -843,6 +850,7 @@ void MapEntity::set_size(int width, int height) {
 void MapEntity::set_size(const Size& size) {
 
   bounding_box.set_size(size);
+  notify_bounding_box_changed();
 }
 
 /**
@@ -867,6 +875,21 @@ const Rectangle& MapEntity::get_bounding_box() const {
  */
 void MapEntity::set_bounding_box(const Rectangle &bounding_box) {
   this->bounding_box = bounding_box;
+  notify_bounding_box_changed();
+}
+
+/**
+ * \brief Keeps the spatial structures of the map up to date when the bounding
+ * box of this entity has just changed.
+ *
+ * Unlike notify_position_changed(), this function is called for every change
+ * of the bounding box, including the ones not made by a movement.
+ */
+void MapEntity::notify_bounding_box_changed() {
+
+  if (is_on_map() && map->is_loaded()) {
+    get_entities().notify_entity_bounding_box_changed(*this);
+  }
 }
 
 /**
@@ -1106,6 +1129,7 @@ void MapEntity::set_origin(int x, int y) {
 
   bounding_box.add_xy(origin.x - x, origin.y - y);
   origin = { x, y };
+  notify_bounding_box_changed();
 }
 
 /**
@@ -2176,7 +2200,7 @@ bool MapEntity::is_in_same_region(const MapEntity& other) const {
   const Point& this_center = get_center_point();
   const Point& other_center = other.get_center_point();
 
-  const std::list<const Separator*>& separators = get_entities().get_separators();
+  const std::vector<const Separator*>& separators = get_entities().get_separators();
   for (const Separator* separator: separators) {
 
     if (separator->is_vertical()) {
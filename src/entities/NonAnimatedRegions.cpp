@@ -19,10 +19,115 @@
 #include "solarus/entities/Tile.h"
 #include "solarus/lowlevel/Surface.h"
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/System.h"
+#include "solarus/Arguments.h"
 #include "solarus/Map.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <set>
 
 namespace Solarus {
 
+namespace {
+
+// Default memory budget of cell surfaces, in bytes.
+const size_t default_max_cells_size = 16 * 1024 * 1024;
+
+// Number of drawings the camera motion is extrapolated to when prefetching.
+const int prefetch_num_draws = 32;
+
+size_t max_cells_size = default_max_cells_size;
+size_t cells_size = 0;
+size_t peak_cells_size = 0;
+uint64_t use_counter = 0;  // Number of layers drawn so far.
+int num_cells_built = 0;
+int num_cells_prefetched = 0;
+int num_cells_evicted = 0;
+uint64_t cells_build_time = 0;  // In microseconds.
+std::set<NonAnimatedRegions*> all_regions;
+
+}  // Anonymous namespace.
+
+/**
+ * \brief Initializes the management of non-animated regions.
+ *
+ * Options recognized:
+ *   -tile-cache-size=<bytes>
+ *
+ * This is the memory budget of the intermediate surfaces of all maps.
+ * Cells currently visible are always kept, even if they exceed it.
+ *
+ * \param args Command-line arguments.
+ */
+void NonAnimatedRegions::initialize(const Arguments& args) {
+
+  max_cells_size = args.get_argument_size("-tile-cache-size", default_max_cells_size);
+}
+
+/**
+ * \brief Resets the counters of non-animated regions.
+ */
+void NonAnimatedRegions::quit() {
+
+  max_cells_size = default_max_cells_size;
+  peak_cells_size = 0;
+  use_counter = 0;
+  num_cells_built = 0;
+  num_cells_prefetched = 0;
+  num_cells_evicted = 0;
+  cells_build_time = 0;
+}
+
+/**
+ * \brief Returns the memory currently used by the cell surfaces of all maps.
+ * \return The size in bytes.
+ */
+size_t NonAnimatedRegions::get_cells_size() {
+  return cells_size;
+}
+
+/**
+ * \brief Returns the maximum memory used by cell surfaces at the same time.
+ * \return The size in bytes since initialization.
+ */
+size_t NonAnimatedRegions::get_peak_cells_size() {
+  return peak_cells_size;
+}
+
+/**
+ * \brief Returns the number of cell surfaces drawn.
+ * \return The number of cells built since initialization,
+ * including prefetched ones.
+ */
+int NonAnimatedRegions::get_num_cells_built() {
+  return num_cells_built;
+}
+
+/**
+ * \brief Returns the number of cell surfaces drawn before being visible.
+ * \return The number of cells prefetched since initialization.
+ */
+int NonAnimatedRegions::get_num_cells_prefetched() {
+  return num_cells_prefetched;
+}
+
+/**
+ * \brief Returns the number of cell surfaces freed to respect the budget.
+ * \return The number of cells evicted since initialization.
+ */
+int NonAnimatedRegions::get_num_cells_evicted() {
+  return num_cells_evicted;
+}
+
+/**
+ * \brief Returns the total time spent drawing cell surfaces.
+ * \return The time in microseconds since initialization.
+ */
+uint64_t NonAnimatedRegions::get_cells_build_time() {
+  return cells_build_time;
+}
+
 /**
  * \brief Constructor.
  * \param map The map. Its size must be known.
@@ -33,6 +138,18 @@ NonAnimatedRegions::NonAnimatedRegions(Map& map, Layer layer):
   layer(layer),
   non_animated_tiles(map.get_size(), Size(512, 256)) {
 
+  all_regions.insert(this);
+}
+
+/**
+ * \brief Destructor.
+ */
+NonAnimatedRegions::~NonAnimatedRegions() {
+
+  for (size_t i = 0; i < optimized_tiles_surfaces.size(); ++i) {
+    release_cell(i);
+  }
+  all_regions.erase(this);
 }
 
 /**
@@ -70,6 +187,7 @@ void NonAnimatedRegions::build(std::vector<TilePtr>& rejected_tiles) {
 
   // Create the surfaces where all non-animated tiles will be drawn.
   optimized_tiles_surfaces.resize(non_animated_tiles.get_num_cells());
+  cells_last_use.resize(non_animated_tiles.get_num_cells(), 0);
 
   // Mark animated 8x8 squares of the map.
   for (unsigned i = 0; i < tiles.size(); ++i) {
@@ -120,8 +238,8 @@ void NonAnimatedRegions::build(std::vector<TilePtr>& rejected_tiles) {
  */
 void NonAnimatedRegions::notify_tileset_changed() {
 
-  for (unsigned i = 0; i < non_animated_tiles.get_num_cells(); ++i) {
-    optimized_tiles_surfaces[i] = nullptr;
+  for (size_t i = 0; i < optimized_tiles_surfaces.size(); ++i) {
+    release_cell(i);
   }
   // Everything will be redrawn when necessary.
 }
@@ -164,12 +282,22 @@ bool NonAnimatedRegions::overlaps_animated_tile(Tile& tile) const {
  */
 void NonAnimatedRegions::draw_on_map() {
 
+  ++use_counter;
+
   // Check all grid cells that overlap the camera.
   const int num_rows = non_animated_tiles.get_num_rows();
   const int num_columns = non_animated_tiles.get_num_columns();
   const Size& cell_size = non_animated_tiles.get_cell_size();
   const Rectangle& camera_position = map.get_camera_position();
 
+  // Remember where the camera goes, unless it jumped.
+  camera_motion = camera_position.get_xy() - previous_camera_xy;
+  previous_camera_xy = camera_position.get_xy();
+  if (std::abs(camera_motion.x) >= cell_size.width ||
+      std::abs(camera_motion.y) >= cell_size.height) {
+    camera_motion = Point();
+  }
+
   const int row1 = camera_position.get_y() / cell_size.height;
   const int row2 = (camera_position.get_y() + camera_position.get_height()) / cell_size.height;
   const int column1 = camera_position.get_x() / cell_size.width;
@@ -194,8 +322,11 @@ void NonAnimatedRegions::draw_on_map() {
       int cell_index = i * num_columns + j;
       if (optimized_tiles_surfaces[cell_index] == nullptr) {
         // Lazily build the cell.
+        // Visible cells are needed anyway, even without room.
+        free_cells(get_cell_surface_size(), LAYER_NB);
         build_cell(cell_index);
       }
+      cells_last_use[cell_index] = use_counter;
 
       const Point cell_xy = {
           j * cell_size.width,
@@ -234,8 +365,15 @@ void NonAnimatedRegions::build_cell(int cell_index) {
       row * cell_size.height
   };
 
+  using Clock = std::chrono::steady_clock;
+  const Clock::time_point start_time = Clock::now();
+
   SurfacePtr cell_surface = Surface::create(cell_size);
   optimized_tiles_surfaces[cell_index] = cell_surface;
+  cells_last_use[cell_index] = use_counter;
+  cells_size += get_cell_surface_size();
+  peak_cells_size = std::max(peak_cells_size, cells_size);
+  ++num_cells_built;
   // Let this surface as a software destination because it is built only
   // once (here) and never changes later.
 
@@ -271,6 +409,140 @@ void NonAnimatedRegions::build_cell(int cell_index) {
       }
     }
   }
+
+  cells_build_time += std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - start_time).count();
+}
+
+/**
+ * \brief Frees the surface of a cell if it is built.
+ * \param cell_index Index of the cell to free.
+ */
+void NonAnimatedRegions::release_cell(int cell_index) {
+
+  if (optimized_tiles_surfaces[cell_index] == nullptr) {
+    return;
+  }
+
+  optimized_tiles_surfaces[cell_index] = nullptr;
+  cells_size -= get_cell_surface_size();
+}
+
+/**
+ * \brief Returns the memory used by the surface of a cell.
+ * \return The size in bytes of a 32-bit cell surface.
+ */
+size_t NonAnimatedRegions::get_cell_surface_size() const {
+
+  const Size& cell_size = non_animated_tiles.get_cell_size();
+  return cell_size.width * cell_size.height * 4;
+}
+
+/**
+ * \brief Frees the least recently drawn cells of all maps until a new cell
+ * fits in the memory budget.
+ *
+ * Cells drawn during the current frame are never freed.
+ * A frame draws each layer once, so these are the cells drawn during the
+ * last LAYER_NB drawings.
+ *
+ * \param size_needed Size in bytes of the cell to build.
+ * \param min_age Number of layer drawings during which a cell drawn or
+ * built is kept. At least LAYER_NB.
+ * \return \c true if there is now enough room for it.
+ */
+bool NonAnimatedRegions::free_cells(size_t size_needed, uint64_t min_age) {
+
+  while (cells_size + size_needed > max_cells_size) {
+
+    NonAnimatedRegions* oldest_regions = nullptr;
+    int oldest_index = -1;
+    uint64_t oldest_use = use_counter;
+    for (NonAnimatedRegions* regions: all_regions) {
+      for (size_t i = 0; i < regions->optimized_tiles_surfaces.size(); ++i) {
+        if (regions->optimized_tiles_surfaces[i] == nullptr) {
+          continue;
+        }
+        const uint64_t last_use = regions->cells_last_use[i];
+        if (last_use + min_age <= use_counter && last_use < oldest_use) {
+          oldest_regions = regions;
+          oldest_index = i;
+          oldest_use = last_use;
+        }
+      }
+    }
+
+    if (oldest_regions == nullptr) {
+      // Everything is in use.
+      return false;
+    }
+    oldest_regions->release_cell(oldest_index);
+    ++num_cells_evicted;
+  }
+  return true;
+}
+
+/**
+ * \brief Builds in advance the cells the camera is moving toward.
+ *
+ * The camera motion observed at the last drawing is extrapolated, and the
+ * cells that will become visible are built until the deadline.
+ * A cell is only built if the average time of previous builds still fits
+ * before the deadline.
+ * Like visible cells, they may evict the least recently drawn ones,
+ * but not the ones drawn or prefetched recently: this would make
+ * prefetched cells evict each other.
+ *
+ * \param deadline Real time when this function should stop building cells.
+ */
+void NonAnimatedRegions::prefetch_cells(uint32_t deadline) {
+
+  if (optimized_tiles_surfaces.empty() || camera_motion == Point()) {
+    return;
+  }
+
+  const int num_rows = non_animated_tiles.get_num_rows();
+  const int num_columns = non_animated_tiles.get_num_columns();
+  const Size& cell_size = non_animated_tiles.get_cell_size();
+  Rectangle predicted_position = map.get_camera_position();
+  predicted_position.add_xy(camera_motion * prefetch_num_draws);
+
+  const int row1 = std::max(
+      predicted_position.get_y() / cell_size.height, 0);
+  const int row2 = std::min(
+      (predicted_position.get_y() + predicted_position.get_height()) / cell_size.height,
+      num_rows - 1);
+  const int column1 = std::max(
+      predicted_position.get_x() / cell_size.width, 0);
+  const int column2 = std::min(
+      (predicted_position.get_x() + predicted_position.get_width()) / cell_size.width,
+      num_columns - 1);
+
+  for (int i = row1; i <= row2; ++i) {
+    for (int j = column1; j <= column2; ++j) {
+
+      const int cell_index = i * num_columns + j;
+      if (optimized_tiles_surfaces[cell_index] != nullptr) {
+        continue;
+      }
+
+      const uint32_t now = System::get_real_time();
+      const uint64_t average_build_time = num_cells_built > 0 ?
+          cells_build_time / num_cells_built : 0;  // In microseconds.
+      if (now >= deadline ||
+          static_cast<uint64_t>(deadline - now) * 1000 < average_build_time) {
+        return;
+      }
+
+      if (!free_cells(get_cell_surface_size(), LAYER_NB * prefetch_num_draws)) {
+        // No room left in the budget.
+        return;
+      }
+
+      build_cell(cell_index);
+      ++num_cells_prefetched;
+    }
+  }
 }
 
 }
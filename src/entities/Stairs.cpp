@@ -22,7 +22,7 @@
 #include "solarus/lowlevel/Sound.h"
 #include "solarus/Game.h"
 #include "solarus/Map.h"
-#include <list>
+#include <vector>
 
 namespace Solarus {
 
@@ -362,7 +362,7 @@ void Stairs::notify_enabled(bool enabled) {
  */
 void Stairs::update_dynamic_tiles() {
 
-  std::list<MapEntity*> tiles = get_entities().get_entities_with_prefix(
+  std::vector<MapEntity*> tiles = get_entities().get_entities_with_prefix(
       EntityType::DYNAMIC_TILE, get_name() + "_enabled");
   for (MapEntity* tile: tiles) {
     tile->set_enabled(is_enabled());
@@ -132,6 +132,20 @@ bool TilePattern::is_animated() const {
   return true;
 }
 
+/**
+ * \brief Returns whether this tile pattern is an animation that only
+ * cycles through frames of the tileset.
+ *
+ * Such patterns always look the same for a given animation frame, so
+ * regions containing them can be pre-rendered once per frame.
+ * Returns false by default.
+ *
+ * \return true if this tile pattern is only animated by its frames
+ */
+bool TilePattern::is_animated_by_frames() const {
+  return false;
+}
+
 /**
  * \brief Returns whether tiles having this tile pattern are drawn at their
  * position.
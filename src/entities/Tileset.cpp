@@ -46,7 +46,7 @@ Tileset::Tileset(const std::string& id):
  * \brief Returns the id of this tileset.
  * \return the tileset id
  */
-const std::string& Tileset::get_id() {
+const std::string& Tileset::get_id() const {
   return id;
 }
 
@@ -127,19 +127,39 @@ void Tileset::add_tile_pattern(
 void Tileset::load() {
 
   // Load the tileset data file.
-  std::string file_name = std::string("tilesets/") + id + ".dat";
+  const std::string& file_name = std::string("tilesets/") + id + ".dat";
   TilesetData data;
   bool success = data.import_from_quest_file(file_name);
   if (success) {
-    // Get the imported data.
-    this->background_color = data.get_background_color();
-    for (const auto& kvp : data.get_patterns()) {
-      add_tile_pattern(kvp.first, kvp.second);
-    }
+    load(data);
+  }
+  else {
+    load_images();
   }
+}
+
+/**
+ * \brief Loads the tileset from data already parsed.
+ *
+ * The images are taken from the image cache if they are decoded.
+ *
+ * \param data The content of the tileset data file.
+ */
+void Tileset::load(const TilesetData& data) {
+
+  this->background_color = data.get_background_color();
+  for (const auto& kvp : data.get_patterns()) {
+    add_tile_pattern(kvp.first, kvp.second);
+  }
+  load_images();
+}
+
+/**
+ * \brief Loads the tiles image and the entities image of the tileset.
+ */
+void Tileset::load_images() {
 
-  // Load the tileset images.
-  file_name = std::string("tilesets/") + id + ".tiles.png";
+  std::string file_name = std::string("tilesets/") + id + ".tiles.png";
   tiles_image = Surface::create(file_name, Surface::DIR_DATA);
   if (tiles_image == nullptr) {
     Debug::error(std::string("Missing tiles image for tileset '") + id + "': " + file_name);
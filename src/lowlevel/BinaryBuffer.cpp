@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/BinaryBuffer.h"
+
+namespace Solarus {
+
+/**
+ * \brief Creates a writer.
+ * \param buffer The buffer to append values to.
+ */
+BinaryWriter::BinaryWriter(std::string& buffer):
+  buffer(buffer) {
+
+}
+
+/**
+ * \brief Appends a byte.
+ * \param value The value to write.
+ */
+void BinaryWriter::write_uint8(uint8_t value) {
+
+  buffer += static_cast<char>(value);
+}
+
+/**
+ * \brief Appends an unsigned 32-bit integer.
+ * \param value The value to write.
+ */
+void BinaryWriter::write_uint32(uint32_t value) {
+
+  for (int i = 0; i < 4; ++i) {
+    write_uint8(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+/**
+ * \brief Appends a signed 32-bit integer.
+ * \param value The value to write.
+ */
+void BinaryWriter::write_int32(int32_t value) {
+
+  write_uint32(static_cast<uint32_t>(value));
+}
+
+/**
+ * \brief Appends an unsigned 64-bit integer.
+ * \param value The value to write.
+ */
+void BinaryWriter::write_uint64(uint64_t value) {
+
+  write_uint32(static_cast<uint32_t>(value));
+  write_uint32(static_cast<uint32_t>(value >> 32));
+}
+
+/**
+ * \brief Appends raw bytes.
+ * \param bytes The bytes to write.
+ * \param size Number of bytes to write.
+ */
+void BinaryWriter::write_bytes(const char* bytes, size_t size) {
+
+  buffer.append(bytes, size);
+}
+
+/**
+ * \brief Creates a reader.
+ * \param data The memory area to read.
+ * \param size Size of the memory area in bytes.
+ */
+BinaryReader::BinaryReader(const char* data, size_t size):
+  data(data),
+  size(size),
+  position(0) {
+
+}
+
+/**
+ * \brief Returns the number of bytes already read.
+ * \return The current position.
+ */
+size_t BinaryReader::get_position() const {
+  return position;
+}
+
+/**
+ * \brief Returns the number of bytes not read yet.
+ * \return The number of remaining bytes.
+ */
+size_t BinaryReader::get_num_remaining() const {
+  return size - position;
+}
+
+/**
+ * \brief Reads a byte.
+ * \param value The value read.
+ * \return \c false if the end of the memory area is reached.
+ */
+bool BinaryReader::read_uint8(uint8_t& value) {
+
+  if (position + 1 > size) {
+    return false;
+  }
+  value = static_cast<uint8_t>(data[position]);
+  ++position;
+  return true;
+}
+
+/**
+ * \brief Reads an unsigned 32-bit integer.
+ * \param value The value read.
+ * \return \c false if the end of the memory area is reached.
+ */
+bool BinaryReader::read_uint32(uint32_t& value) {
+
+  if (position + 4 > size) {
+    return false;
+  }
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&data[position]);
+  value = static_cast<uint32_t>(bytes[0]) |
+      (static_cast<uint32_t>(bytes[1]) << 8) |
+      (static_cast<uint32_t>(bytes[2]) << 16) |
+      (static_cast<uint32_t>(bytes[3]) << 24);
+  position += 4;
+  return true;
+}
+
+/**
+ * \brief Reads a signed 32-bit integer.
+ * \param value The value read.
+ * \return \c false if the end of the memory area is reached.
+ */
+bool BinaryReader::read_int32(int32_t& value) {
+
+  uint32_t unsigned_value;
+  if (!read_uint32(unsigned_value)) {
+    return false;
+  }
+  value = static_cast<int32_t>(unsigned_value);
+  return true;
+}
+
+/**
+ * \brief Reads an unsigned 64-bit integer.
+ * \param value The value read.
+ * \return \c false if the end of the memory area is reached.
+ */
+bool BinaryReader::read_uint64(uint64_t& value) {
+
+  uint32_t low, high;
+  if (get_num_remaining() < 8) {
+    return false;
+  }
+  read_uint32(low);
+  read_uint32(high);
+  value = (static_cast<uint64_t>(high) << 32) | low;
+  return true;
+}
+
+/**
+ * \brief Reads raw bytes without copying them.
+ * \param size Number of bytes to read.
+ * \param bytes A pointer to these bytes in the memory area.
+ * \return \c false if the end of the memory area is reached.
+ */
+bool BinaryReader::read_bytes(size_t size, const char*& bytes) {
+
+  if (size > get_num_remaining()) {
+    return false;
+  }
+  bytes = &data[position];
+  position += size;
+  return true;
+}
+
+}
+
@@ -31,6 +31,7 @@ namespace {
   bool abort_on_die = false;
   const std::string error_output_file_name = "error.txt";
   std::ofstream error_output_file;
+  thread_local std::vector<DeferredMessage>* deferred_messages = nullptr;
 
 }
 
@@ -73,6 +74,11 @@ void SOLARUS_API set_abort_on_die(bool abort) {
  */
 void SOLARUS_API warning(const std::string& message) {
 
+  if (deferred_messages != nullptr) {
+    deferred_messages->push_back({ false, message });
+    return;
+  }
+
   if (!error_output_file.is_open()) {
     error_output_file.open(error_output_file_name.c_str());
   }
@@ -89,6 +95,11 @@ void SOLARUS_API warning(const std::string& message) {
  */
 void SOLARUS_API error(const std::string& message) {
 
+  if (deferred_messages != nullptr) {
+    deferred_messages->push_back({ true, message });
+    return;
+  }
+
   if (die_on_error) {
     // Errors are fatal.
     die(message);
@@ -159,5 +170,39 @@ void SOLARUS_API die(const std::string& error_message) {
   }
 }
 
+/**
+ * \brief Makes errors and warnings of the calling thread stored instead
+ * of printed.
+ *
+ * Threads other than the main one must not print messages or die:
+ * they can store them and let the main thread call
+ * print_deferred_messages() later.
+ *
+ * \param messages Where to store the messages of the calling thread,
+ * or nullptr to print them again.
+ */
+void SOLARUS_API set_deferred_messages(std::vector<DeferredMessage>* messages) {
+  deferred_messages = messages;
+}
+
+/**
+ * \brief Prints errors and warnings stored by another thread.
+ *
+ * Errors are fatal if set_die_on_error() was called.
+ *
+ * \param messages The messages to print, in their order of occurrence.
+ */
+void SOLARUS_API print_deferred_messages(const std::vector<DeferredMessage>& messages) {
+
+  for (const DeferredMessage& message: messages) {
+    if (message.error) {
+      error(message.message);
+    }
+    else {
+      warning(message.message);
+    }
+  }
+}
+
 }
 }
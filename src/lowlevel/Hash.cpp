@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Hash.h"
+
+namespace Solarus {
+namespace Hash {
+
+/**
+ * \brief Returns the 64-bit FNV-1a hash of a buffer.
+ *
+ * This hash is fast but not cryptographic: it is only used to detect that
+ * a file was changed since some data was computed from it.
+ *
+ * \param buffer The data to hash.
+ * \return The hash.
+ */
+uint64_t get_fnv1a_hash(const std::string& buffer) {
+
+  uint64_t hash = UINT64_C(14695981039346656037);
+  for (const char c: buffer) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= UINT64_C(1099511628211);
+  }
+  return hash;
+}
+
+}
+}
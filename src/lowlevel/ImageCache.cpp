@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/ImageCache.h"
+#include "solarus/lowlevel/BinaryBuffer.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Hash.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lowlevel/Video.h"
+#include "solarus/Arguments.h"
+#include "solarus/CurrentQuest.h"
+#include <SDL.h>
+#include <SDL_image.h>
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief An image kept in the cache.
+ */
+struct CachedImage {
+  std::shared_ptr<SDL_Surface> image;        /**< The decoded pixels, in the video format. */
+  uint64_t last_use;                         /**< Value of use_counter when last requested. */
+  bool preloaded;                            /**< Whether it was decoded in advance and never
+                                              * requested yet: such images are freed last. */
+};
+
+const size_t default_max_unused_size = 8 * 1024 * 1024;
+const std::string disk_cache_dir = "images.cache";
+const std::string disk_cache_magic = "Solarus decoded image 1\n";
+
+bool disk_cache_enabled = false;
+size_t max_unused_size = default_max_unused_size;  /**< Bytes of images not used by any
+                                                    * surface kept before freeing them. */
+std::map<std::string, CachedImage> images;   /**< Images indexed by file name relative
+                                              * to the data directory. */
+uint64_t use_counter = 0;
+int num_hits = 0;
+int num_misses = 0;
+
+/**
+ * \brief Creates the shared pointer that owns an SDL surface.
+ * \param image The surface to own.
+ * \return The shared pointer.
+ */
+std::shared_ptr<SDL_Surface> make_shared_image(SDL_Surface* image) {
+  return std::shared_ptr<SDL_Surface>(image, SDL_FreeSurface);
+}
+
+/**
+ * \brief Returns the size in memory of the pixels of an image.
+ * \param image An image.
+ * \return The size in bytes.
+ */
+size_t get_image_size(const SDL_Surface& image) {
+  return static_cast<size_t>(image.pitch) * image.h;
+}
+
+/**
+ * \brief Returns the name of the file that stores the decoded pixels of an
+ * image, relative to the quest write directory.
+ * \param file_name Image file name relative to the data directory.
+ * \return The name of the decoded file.
+ */
+std::string get_disk_cache_file_name(const std::string& file_name) {
+
+  char name[17];
+  std::snprintf(name, sizeof(name), "%016llx",
+      static_cast<unsigned long long>(Hash::get_fnv1a_hash(file_name)));
+  return disk_cache_dir + "/" + name;
+}
+
+/**
+ * \brief Decodes an image file and converts it to the video pixel format.
+ *
+ * This function is thread-safe.
+ *
+ * \param buffer Content of the PNG file.
+ * \return The decoded image, or nullptr in case of error.
+ */
+SDL_Surface* decode_png(const std::string& buffer) {
+
+  SDL_RWops* rw = SDL_RWFromMem(const_cast<char*>(buffer.data()), (int) buffer.size());
+  SDL_Surface* image = IMG_Load_RW(rw, 0);
+  SDL_RWclose(rw);
+  if (image == nullptr) {
+    return nullptr;
+  }
+
+  SDL_PixelFormat* pixel_format = Video::get_pixel_format();
+  if (image->format->format != pixel_format->format) {
+    SDL_Surface* converted_image = SDL_ConvertSurface(image, pixel_format, 0);
+    SDL_FreeSurface(image);
+    image = converted_image;
+  }
+  return image;
+}
+
+/**
+ * \brief Reads the decoded pixels of an image from the quest write directory.
+ * \param file_name Image file name relative to the data directory.
+ * \param source_hash Hash of the current PNG file.
+ * \return The image, or nullptr if it is not saved or is outdated.
+ */
+SDL_Surface* read_disk_cache(const std::string& file_name, uint64_t source_hash) {
+
+  const std::string cache_file_name = get_disk_cache_file_name(file_name);
+  if (!QuestFiles::data_file_exists(cache_file_name)) {
+    return nullptr;
+  }
+
+  const std::string buffer = QuestFiles::data_file_read(cache_file_name);
+  if (buffer.compare(0, disk_cache_magic.size(), disk_cache_magic) != 0) {
+    return nullptr;
+  }
+
+  SDL_PixelFormat* pixel_format = Video::get_pixel_format();
+  BinaryReader reader(buffer.data() + disk_cache_magic.size(),
+      buffer.size() - disk_cache_magic.size());
+  uint64_t saved_hash = 0;
+  uint32_t format = 0;
+  int32_t width = 0;
+  int32_t height = 0;
+  uint32_t blend_mode = 0;
+  if (!reader.read_uint64(saved_hash) ||
+      !reader.read_uint32(format) ||
+      !reader.read_int32(width) ||
+      !reader.read_int32(height) ||
+      !reader.read_uint32(blend_mode) ||
+      saved_hash != source_hash ||
+      format != pixel_format->format ||
+      width <= 0 ||
+      height <= 0) {
+    return nullptr;
+  }
+
+  const size_t row_size = static_cast<size_t>(width) * pixel_format->BytesPerPixel;
+  const char* pixels = nullptr;
+  if (!reader.read_bytes(row_size * height, pixels)) {
+    return nullptr;
+  }
+
+  SDL_Surface* image = SDL_CreateRGBSurface(
+      0,
+      width,
+      height,
+      pixel_format->BitsPerPixel,
+      pixel_format->Rmask,
+      pixel_format->Gmask,
+      pixel_format->Bmask,
+      pixel_format->Amask
+  );
+  if (image == nullptr) {
+    return nullptr;
+  }
+
+  char* dst_pixels = static_cast<char*>(image->pixels);
+  for (int32_t y = 0; y < height; ++y) {
+    std::copy(pixels + y * row_size, pixels + (y + 1) * row_size, dst_pixels + y * image->pitch);
+  }
+  SDL_SetSurfaceBlendMode(image, static_cast<SDL_BlendMode>(blend_mode));
+  return image;
+}
+
+/**
+ * \brief Saves the decoded pixels of an image in the quest write directory.
+ * \param file_name Image file name relative to the data directory.
+ * \param source_hash Hash of the PNG file.
+ * \param image The decoded image, in the video pixel format.
+ */
+void write_disk_cache(
+    const std::string& file_name,
+    uint64_t source_hash,
+    const SDL_Surface& image) {
+
+  SDL_BlendMode blend_mode = SDL_BLENDMODE_NONE;
+  SDL_GetSurfaceBlendMode(const_cast<SDL_Surface*>(&image), &blend_mode);
+
+  const size_t row_size = static_cast<size_t>(image.w) * image.format->BytesPerPixel;
+  std::string buffer = disk_cache_magic;
+  buffer.reserve(buffer.size() + 28 + row_size * image.h);
+  BinaryWriter writer(buffer);
+  writer.write_uint64(source_hash);
+  writer.write_uint32(image.format->format);
+  writer.write_int32(image.w);
+  writer.write_int32(image.h);
+  writer.write_uint32(static_cast<uint32_t>(blend_mode));
+  const char* pixels = static_cast<const char*>(image.pixels);
+  for (int y = 0; y < image.h; ++y) {
+    writer.write_bytes(pixels + y * image.pitch, row_size);
+  }
+
+  QuestFiles::data_file_mkdir(disk_cache_dir);
+  QuestFiles::data_file_save(get_disk_cache_file_name(file_name), buffer);
+}
+
+/**
+ * \brief Loads an image from the data files, or from the decoded pixels
+ * saved in the quest write directory if they are up to date.
+ * \param file_name Image file name relative to the data directory.
+ * \return The image, or nullptr if the file does not exist.
+ */
+SDL_Surface* load_image(const std::string& file_name) {
+
+  if (!QuestFiles::data_file_exists(file_name)) {
+    return nullptr;
+  }
+
+  const std::string& buffer = QuestFiles::data_file_read(file_name);
+
+  const bool use_disk_cache = disk_cache_enabled &&
+      !QuestFiles::get_quest_write_dir().empty();
+  uint64_t source_hash = 0;
+  if (use_disk_cache) {
+    source_hash = Hash::get_fnv1a_hash(buffer);
+    SDL_Surface* image = read_disk_cache(file_name, source_hash);
+    if (image != nullptr) {
+      return image;
+    }
+  }
+
+  SDL_Surface* image = decode_png(buffer);
+  Debug::check_assertion(image != nullptr,
+      std::string("Cannot load image '") + file_name + "'");
+  if (use_disk_cache) {
+    write_disk_cache(file_name, source_hash, *image);
+  }
+  return image;
+}
+
+/**
+ * \brief Frees images not used by any surface, least recently used first,
+ * until they fit in the memory budget.
+ *
+ * Images preloaded and not requested yet also count in the budget,
+ * but they are only freed when no other unused image remains.
+ */
+void free_unused_images() {
+
+  size_t unused_size = 0;
+  for (const auto& kvp: images) {
+    if (kvp.second.image.use_count() == 1) {
+      unused_size += get_image_size(*kvp.second.image);
+    }
+  }
+
+  while (unused_size > max_unused_size) {
+    auto oldest = images.end();
+    for (auto it = images.begin(); it != images.end(); ++it) {
+      if (it->second.image.use_count() != 1) {
+        continue;
+      }
+      if (oldest == images.end() ||
+          it->second.preloaded < oldest->second.preloaded ||
+          (it->second.preloaded == oldest->second.preloaded &&
+           it->second.last_use < oldest->second.last_use)) {
+        oldest = it;
+      }
+    }
+    unused_size -= get_image_size(*oldest->second.image);
+    images.erase(oldest);
+  }
+}
+
+}  // Anonymous namespace.
+
+/**
+ * \brief Initializes the image cache.
+ *
+ * Options recognized:
+ *   -image-cache=yes|no
+ *   -image-cache-size=<bytes>
+ *
+ * With -image-cache=yes, decoded images are saved in the quest write
+ * directory, so that the next launches do not decode them again.
+ * -image-cache-size is the memory budget of the images not used by any
+ * surface, including the ones decoded in advance.
+ *
+ * \param args Command-line arguments.
+ */
+void ImageCache::initialize(const Arguments& args) {
+
+  disk_cache_enabled = args.get_argument_value("-image-cache") == "yes";
+  max_unused_size = args.get_argument_size("-image-cache-size", default_max_unused_size);
+}
+
+/**
+ * \brief Frees all images of the cache.
+ *
+ * Surfaces still using them keep their own reference.
+ */
+void ImageCache::quit() {
+
+  images.clear();
+  max_unused_size = default_max_unused_size;
+  use_counter = 0;
+  num_hits = 0;
+  num_misses = 0;
+}
+
+/**
+ * \brief Returns the decoded pixels of an image file.
+ *
+ * The image is shared: it must not be modified.
+ *
+ * \param file_name Name of the image file, relative to the data directory
+ * or to the language directory.
+ * \param language_specific \c true if the file is relative to the current
+ * language directory.
+ * \return The image in the video pixel format, or nullptr if the file does
+ * not exist.
+ */
+std::shared_ptr<SDL_Surface> ImageCache::get_image(
+    const std::string& file_name, bool language_specific) {
+
+  std::string full_file_name = file_name;
+  if (language_specific) {
+    if (CurrentQuest::get_language().empty()) {
+      return nullptr;
+    }
+    full_file_name = std::string("languages/") +
+        CurrentQuest::get_language() + "/" + file_name;
+  }
+
+  const auto it = images.find(full_file_name);
+  if (it != images.end()) {
+    ++num_hits;
+    it->second.last_use = ++use_counter;
+    it->second.preloaded = false;
+    return it->second.image;
+  }
+
+  ++num_misses;
+  SDL_Surface* image = load_image(full_file_name);
+  if (image == nullptr) {
+    return nullptr;
+  }
+
+  CachedImage& cached_image = images[full_file_name];
+  cached_image.image = make_shared_image(image);
+  cached_image.last_use = ++use_counter;
+  cached_image.preloaded = false;
+  free_unused_images();
+  return cached_image.image;
+}
+
+/**
+ * \brief Returns whether an image is currently in the cache.
+ * \param file_name Name of the image file, relative to the data directory.
+ * \return \c true if it is decoded.
+ */
+bool ImageCache::has_image(const std::string& file_name) {
+
+  return images.find(file_name) != images.end();
+}
+
+/**
+ * \brief Stores an image decoded in advance.
+ *
+ * Does nothing if this image is already in the cache.
+ *
+ * \param file_name Name of the image file, relative to the data directory.
+ * \param image The decoded image, in the video pixel format.
+ * The cache takes ownership of it.
+ */
+void ImageCache::add_image(const std::string& file_name, SDL_Surface* image) {
+
+  add_image(file_name, make_shared_image(image));
+}
+
+/**
+ * \brief Stores an image decoded in advance.
+ *
+ * Does nothing if this image is already in the cache.
+ *
+ * \param file_name Name of the image file, relative to the data directory.
+ * \param image The decoded image, in the video pixel format.
+ * It must not be modified anymore.
+ */
+void ImageCache::add_image(
+    const std::string& file_name, const std::shared_ptr<SDL_Surface>& image) {
+
+  if (has_image(file_name)) {
+    return;
+  }
+
+  CachedImage& cached_image = images[file_name];
+  cached_image.image = image;
+  cached_image.last_use = ++use_counter;
+  cached_image.preloaded = true;
+  free_unused_images();
+}
+
+/**
+ * \brief Decodes an image file without adding it to the cache.
+ *
+ * This function can be called from any thread: the result can then be
+ * given to add_image() by the main thread.
+ *
+ * \param buffer Content of a PNG file.
+ * \return The image in the video pixel format, or nullptr if it could
+ * not be decoded.
+ */
+std::shared_ptr<SDL_Surface> ImageCache::decode_image(const std::string& buffer) {
+
+  SDL_Surface* image = decode_png(buffer);
+  if (image == nullptr) {
+    return nullptr;
+  }
+  return make_shared_image(image);
+}
+
+/**
+ * \brief Returns the number of images found in the cache.
+ * \return The number of hits since initialization.
+ */
+int ImageCache::get_num_hits() {
+  return num_hits;
+}
+
+/**
+ * \brief Returns the number of images that had to be loaded.
+ * \return The number of misses since initialization.
+ */
+int ImageCache::get_num_misses() {
+  return num_misses;
+}
+
+}
+
@@ -21,6 +21,7 @@
 #include "solarus/lua/LuaContext.h"
 #include <lua.hpp>
 #include <algorithm>
+#include <chrono>
 #include <sstream>
 
 namespace Solarus {
@@ -50,7 +51,17 @@ Music::Music():
   format(NO_FORMAT),
   loop(false),
   callback_ref(),
-  source(AL_NONE) {
+  ogg_format(AL_NONE),
+  ogg_sample_rate(0),
+  ogg_num_channels(0),
+  decoded_data(),
+  decoding_thread(),
+  decoding_stopped(false),
+  decoding_finished(false),
+  decoding_error(0),
+  source(AL_NONE),
+  free_buffers(),
+  pcm_chunk() {
 
   for (int i = 0; i < nb_buffers; i++) {
     buffers[i] = AL_NONE;
@@ -73,7 +84,17 @@ Music::Music(
   format(OGG),
   loop(loop),
   callback_ref(callback_ref),
-  source(AL_NONE) {
+  ogg_format(AL_NONE),
+  ogg_sample_rate(0),
+  ogg_num_channels(0),
+  decoded_data(),
+  decoding_thread(),
+  decoding_stopped(false),
+  decoding_finished(false),
+  decoding_error(0),
+  source(AL_NONE),
+  free_buffers(),
+  pcm_chunk() {
 
   Debug::check_assertion(!loop || callback_ref.is_empty(),
       "Attempt to set both a loop and a callback to music"
@@ -84,6 +105,16 @@ Music::Music(
   }
 }
 
+/**
+ * \brief Destructor.
+ *
+ * Stops the decoding thread if it is still running.
+ */
+Music::~Music() {
+
+  stop_decoding_thread();
+}
+
 /**
  * \brief Initializes the music system.
  */
@@ -111,6 +142,7 @@ void Music::quit() {
  * \return \c true if the music system is initialized.
  */
 bool Music::is_initialized() {
+  return it_decoder != nullptr;
 }
 
 /**
@@ -366,6 +398,8 @@ void Music::update() {
  * \brief Updates this music when it is playing.
  *
  * This function handles the double buffering.
+ * For OGG musics, it only moves the data decoded by the decoding thread
+ * into the buffers.
  *
  * \return \c true if the music keeps playing, \c false if the end is reached.
  */
@@ -374,13 +408,18 @@ bool Music::update_playing() {
   // Get the empty buffers.
   ALint nb_empty;
   alGetSourcei(source, AL_BUFFERS_PROCESSED, &nb_empty);
-
-  // Refill them.
   for (int i = 0; i < nb_empty; i++) {
     ALuint buffer;
     alSourceUnqueueBuffers(source, 1, &buffer);  // Unqueue the buffer.
+    free_buffers.push_back(buffer);
+  }
 
-    // Fill it by decoding more data.
+  // Refill them.
+  bool filled = true;
+  while (!free_buffers.empty() && filled) {
+    const ALuint buffer = free_buffers.back();
+
+    // Fill it with more data.
     switch (format) {
 
       case IT:
@@ -388,7 +427,7 @@ bool Music::update_playing() {
         break;
 
       case OGG:
-        decode_ogg(buffer, 4096);
+        filled = fill_buffer_from_decoded_data(buffer);
         break;
 
       case NO_FORMAT:
@@ -396,13 +435,33 @@ bool Music::update_playing() {
         break;
     }
 
-    alSourceQueueBuffers(source, 1, &buffer);  // Queue it again.
+    if (filled) {
+      alSourceQueueBuffers(source, 1, &buffer);  // Queue it again.
+      free_buffers.pop_back();
+    }
   }
 
   // Check whether there is still something playing.
   ALint status;
   alGetSourcei(source, AL_SOURCE_STATE, &status);
   if (status != AL_PLAYING) {
+
+    if (format == OGG && free_buffers.size() == size_t(nb_buffers)) {
+      // Nothing left to play for now.
+      const long error = decoding_error;
+      if (error != 0) {
+        std::ostringstream oss;
+        oss << "Error while decoding ogg chunk: " << error;
+        Debug::error(oss.str());
+        return false;
+      }
+
+      // Either the end is reached or the decoding thread is late.
+      return !decoding_finished ||
+          (decoded_data != nullptr &&
+           decoded_data->get_num_readable() >= size_t(ogg_num_channels));
+    }
+
     // The end of the file is reached, or we need to decode more data.
     alSourcePlay(source);
   }
@@ -411,7 +470,6 @@ bool Music::update_playing() {
   return status == AL_PLAYING;
 }
 
-
 /**
  * \brief Decodes a chunk of IT data into PCM data for the current music.
  * \param destination_buffer the destination buffer to write
@@ -420,12 +478,14 @@ bool Music::update_playing() {
 void Music::decode_it(ALuint destination_buffer, ALsizei nb_samples) {
 
   // Decode the IT data.
-  std::vector<ALushort> raw_data(nb_samples);
-  int bytes_read = it_decoder->decode(raw_data.data(), nb_samples);
+  if (pcm_chunk.size() < size_t(nb_samples)) {
+    pcm_chunk.resize(nb_samples);
+  }
+  int bytes_read = it_decoder->decode(pcm_chunk.data(), nb_samples);
 
   if (bytes_read > 0) {
     // Put this decoded data into the buffer.
-    alBufferData(destination_buffer, AL_FORMAT_STEREO16, raw_data.data(), nb_samples, 44100);
+    alBufferData(destination_buffer, AL_FORMAT_STEREO16, pcm_chunk.data(), nb_samples, 44100);
 
     int error = alGetError();
     if (error != AL_NO_ERROR) {
@@ -439,37 +499,63 @@ void Music::decode_it(ALuint destination_buffer, ALsizei nb_samples) {
 
 /**
  * \brief Decodes a chunk of OGG data into PCM data for the current music.
+ *
+ * This function is only used to fill the first buffers, before the decoding
+ * thread starts.
+ *
  * \param destination_buffer The destination buffer to write.
  * \param nb_samples Number of samples to write.
  */
 void Music::decode_ogg(ALuint destination_buffer, ALsizei nb_samples) {
 
-  // read the encoded music properties
-  vorbis_info* info = ov_info(&ogg_file, -1);
-  ALsizei sample_rate = ALsizei(info->rate);
-
-  ALenum al_format = AL_NONE;
-  if (info->channels == 1) {
-    al_format = AL_FORMAT_MONO16;
+  // decode the OGG data
+  const size_t nb_values = nb_samples * ogg_num_channels;
+  if (pcm_chunk.size() < nb_values) {
+    pcm_chunk.resize(nb_values);
   }
-  else if (info->channels == 2) {
-    al_format = AL_FORMAT_STEREO16;
+  const long values_read = read_ogg(pcm_chunk.data(), long(nb_values));
+  if (values_read < 0) {
+    std::ostringstream oss;
+    oss << "Error while decoding ogg chunk: " << values_read;
+    Debug::error(oss.str());
+    return;
   }
 
-  // decode the OGG data
-  std::vector<ALshort> raw_data(nb_samples * info->channels);
+  // Put this decoded data into the buffer.
+  alBufferData(destination_buffer, ogg_format, pcm_chunk.data(),
+      ALsizei(values_read * sizeof(ALshort)), ogg_sample_rate);
+
+  int error = alGetError();
+  if (error != AL_NO_ERROR) {
+    std::ostringstream oss;
+    oss << "Failed to fill the audio buffer with decoded OGG data for music file '"
+        << file_name << "': error " << error;
+    Debug::error(oss.str());
+  }
+}
+
+/**
+ * \brief Decodes OGG data.
+ *
+ * This function can be called from the decoding thread:
+ * it does not report errors itself.
+ *
+ * \param destination Where to write the decoded samples.
+ * \param nb_values Number of values to decode (samples * channels).
+ * \return The number of values decoded (less than requested only at the
+ * end of the file), or a negative vorbisfile error code.
+ */
+long Music::read_ogg(ALshort* destination, long nb_values) {
+
   int bitstream;
   long bytes_read;
   long total_bytes_read = 0;
-  long remaining_bytes = nb_samples * info->channels * sizeof(ALshort);
+  long remaining_bytes = nb_values * sizeof(ALshort);
   do {
-    bytes_read = ov_read(&ogg_file, ((char*) raw_data.data()) + total_bytes_read, int(remaining_bytes), 0, 2, 1, &bitstream);
+    bytes_read = ov_read(&ogg_file, ((char*) destination) + total_bytes_read, int(remaining_bytes), 0, 2, 1, &bitstream);
     if (bytes_read < 0) {
       if (bytes_read != OV_HOLE) { // OV_HOLE is normal when the music loops
-        std::ostringstream oss;
-        oss << "Error while decoding ogg chunk: " << bytes_read;
-        Debug::error(oss.str());
-        return;
+        return bytes_read;
       }
     }
     else {
@@ -479,8 +565,31 @@ void Music::decode_ogg(ALuint destination_buffer, ALsizei nb_samples) {
   }
   while (remaining_bytes > 0 && bytes_read > 0);
 
-  // Put this decoded data into the buffer.
-  alBufferData(destination_buffer, al_format, raw_data.data(), ALsizei(total_bytes_read), sample_rate);
+  return total_bytes_read / sizeof(ALshort);
+}
+
+/**
+ * \brief Fills a buffer with data from the decoding thread.
+ * \param destination_buffer The buffer to fill.
+ * \return \c false if no decoded data is available yet.
+ */
+bool Music::fill_buffer_from_decoded_data(ALuint destination_buffer) {
+
+  if (decoded_data == nullptr) {
+    // The file could not be opened.
+    return false;
+  }
+
+  // Only take whole samples.
+  size_t nb_values = std::min(decoded_data->get_num_readable(), pcm_chunk.size());
+  nb_values -= nb_values % ogg_num_channels;
+  if (nb_values == 0) {
+    return false;
+  }
+  decoded_data->read(pcm_chunk.data(), nb_values);
+
+  alBufferData(destination_buffer, ogg_format, pcm_chunk.data(),
+      ALsizei(nb_values * sizeof(ALshort)), ogg_sample_rate);
 
   int error = alGetError();
   if (error != AL_NO_ERROR) {
@@ -489,6 +598,66 @@ void Music::decode_ogg(ALuint destination_buffer, ALsizei nb_samples) {
         << file_name << "': error " << error;
     Debug::error(oss.str());
   }
+  return true;
+}
+
+/**
+ * \brief Starts decoding the rest of the OGG music in a separate thread.
+ *
+ * The first buffers should already be filled.
+ */
+void Music::start_decoding_thread() {
+
+  // Keep about two seconds of decoded music ahead of OpenAL.
+  decoded_data = std::unique_ptr<RingBuffer<ALshort>>(
+      new RingBuffer<ALshort>(ogg_sample_rate * ogg_num_channels * 2)
+  );
+  decoding_stopped = false;
+  decoding_finished = false;
+  decoding_error = 0;
+  decoding_thread = std::thread(&Music::run_decoding_thread, this);
+}
+
+/**
+ * \brief Stops the decoding thread if it is running and waits for it.
+ */
+void Music::stop_decoding_thread() {
+
+  if (decoding_thread.joinable()) {
+    decoding_stopped = true;
+    decoding_thread.join();
+  }
+}
+
+/**
+ * \brief Main function of the decoding thread.
+ *
+ * Decodes the OGG music into decoded_data whenever there is room for a
+ * chunk, until the end of the file or until asked to stop.
+ * This is the only thread that uses ogg_file while it runs.
+ */
+void Music::run_decoding_thread() {
+
+  std::vector<ALshort> chunk(4096 * ogg_num_channels);
+  while (!decoding_stopped) {
+
+    if (decoded_data->get_num_writable() < chunk.size()) {
+      // Enough data is waiting: let OpenAL play it.
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+
+    const long nb_values = read_ogg(chunk.data(), long(chunk.size()));
+    if (nb_values < 0) {
+      decoding_error = nb_values;
+      break;
+    }
+    if (nb_values == 0) {
+      break;
+    }
+    decoded_data->write(chunk.data(), nb_values);
+  }
+  decoding_finished = true;
 }
 
 /**
@@ -552,11 +721,25 @@ bool Music::start() {
         oss << "Cannot load music file '" << file_name
             << "' from memory: error " << error;
         Debug::error(oss.str());
+        decoding_finished = true;
       }
       else {
+        // read the encoded music properties
+        vorbis_info* info = ov_info(&ogg_file, -1);
+        ogg_sample_rate = ALsizei(info->rate);
+        ogg_num_channels = info->channels;
+        ogg_format = AL_NONE;
+        if (info->channels == 1) {
+          ogg_format = AL_FORMAT_MONO16;
+        }
+        else if (info->channels == 2) {
+          ogg_format = AL_FORMAT_STEREO16;
+        }
+
         for (int i = 0; i < nb_buffers; i++) {
           decode_ogg(buffers[i], 4096);
         }
+        start_decoding_thread();
       }
       break;
     }
@@ -598,6 +781,9 @@ void Music::stop() {
   // Release the callback if any.
   callback_ref.clear();
 
+  // The decoding thread must not use the file anymore.
+  stop_decoding_thread();
+
   // empty the source
   alSourceStop(source);
 
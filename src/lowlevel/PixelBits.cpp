@@ -25,6 +25,40 @@
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Reads a pixel from a row of an SDL surface.
+ * \param row The first byte of the row.
+ * \param x Index of the pixel in the row.
+ * \param bytes_per_pixel Size of a pixel in bytes (1 to 4).
+ * \return The value of this pixel.
+ */
+uint32_t get_pixel(const uint8_t* row, int x, int bytes_per_pixel) {
+
+  switch (bytes_per_pixel) {
+
+    case 4:
+      return reinterpret_cast<const uint32_t*>(row)[x];
+
+    case 1:
+      return row[x];
+
+    case 2:
+      return reinterpret_cast<const uint16_t*>(row)[x];
+
+    case 3:
+    {
+      const uint8_t* bytes = &row[x * 3];
+      return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+    }
+  }
+
+  return 0;
+}
+
+}
+
 /**
  * \brief Creates a pixel bits object.
  * \param surface The surface where the image is.
@@ -33,18 +67,20 @@ namespace Solarus {
 PixelBits::PixelBits(const Surface& surface, const Rectangle& image_position):
   width(0),
   height(0),
-  nb_integers_per_row(0),
-  bits() {
+  nb_words_per_row(0),
+  bits(),
+  opaque_spans() {
 
   // Create a list of boolean values representing the transparency of each pixel.
   // This list is implemented as bit fields.
 
   Debug::check_assertion(surface.internal_surface != nullptr,
     "Attempt to read a surface that doesn't have pixel buffer in RAM.");
+  SDL_Surface& sdl_surface = *surface.internal_surface;
 
   // Clip the rectangle passed as parameter.
   const Rectangle clipped_image_position(
-      image_position.get_intersection(Rectangle(surface.get_size()))
+      image_position.get_intersection(Rectangle(0, 0, sdl_surface.w, sdl_surface.h))
   );
 
   if (clipped_image_position.is_flat()) {
@@ -53,39 +89,92 @@ PixelBits::PixelBits(const Surface& surface, const Rectangle& image_position):
 
   width = clipped_image_position.get_width();
   height = clipped_image_position.get_height();
-
-  nb_integers_per_row = width >> 5; // width / 32
-  if ((width & 31) != 0) { // width % 32 != 0
-    nb_integers_per_row++;
-  }
-
-  int pixel_index = clipped_image_position.get_y() * surface.get_width() + clipped_image_position.get_x();
-
-  bits.resize(height);
+  nb_words_per_row = ((width + 63) >> 6) + 1;
+
+  // Read the pixel buffer directly: the transparency rules are the ones
+  // of Surface::is_pixel_transparent().
+  const SDL_PixelFormat& format = *sdl_surface.format;
+  const int bytes_per_pixel = format.BytesPerPixel;
+  Debug::check_assertion(bytes_per_pixel >= 1 && bytes_per_pixel <= 4,
+      "Unknown pixel depth");
+  uint32_t colorkey = 0;
+  const bool with_colorkey = SDL_GetColorKey(&sdl_surface, &colorkey) == 0;
+  const uint32_t alpha_mask = format.Amask;
+
+  bits.assign(height * nb_words_per_row, 0);
+  opaque_spans.resize(height);
+
+  SDL_LockSurface(&sdl_surface);
+  const uint8_t* pixels = static_cast<const uint8_t*>(sdl_surface.pixels);
   for (int i = 0; i < height; ++i) {
-    bits[i].resize(nb_integers_per_row);
+    const uint8_t* row = pixels +
+        (clipped_image_position.get_y() + i) * sdl_surface.pitch;
+    uint64_t* row_bits = &bits[i * nb_words_per_row];
 
-    // Fill the bits for this row, using nb_integers_per_row sequences of 32 bits.
-    int k = -1;
-    uint32_t mask = 0x00000000;  // Current bit in the sequence of 32 bits.
+    uint64_t word = 0;
     for (int j = 0; j < width; ++j) {
-      if (mask == 0x00000000) {
-        // Time for a new sequence of 32 bits.
-        k++;
-        mask = 0x80000000;
-        bits[i][k] = 0x00000000;  // Initialize the sequence to transparent.
+      const int x = clipped_image_position.get_x() + j;
+      const uint32_t pixel = bytes_per_pixel == 4 ?
+          reinterpret_cast<const uint32_t*>(row)[x] :  // The most common case.
+          get_pixel(row, x, bytes_per_pixel);
+      const bool transparent =
+          (with_colorkey && pixel == colorkey) ||
+          (alpha_mask != 0 && (pixel & alpha_mask) == 0);
+      if (!transparent) {
+        word |= UINT64_C(1) << (j & 63);
       }
-
-      // If the pixel is opaque.
-      if (!surface.is_pixel_transparent(pixel_index)) {
-        bits[i][k] |= mask;
+      if ((j & 63) == 63) {
+        row_bits[j >> 6] = word;
+        word = 0;
       }
+    }
+    if ((width & 63) != 0) {
+      row_bits[width >> 6] = word;
+    }
 
-      mask >>= 1;
-      ++pixel_index;
+    // Find the opaque pixels at both ends of the row.
+    OpaqueSpan& span = opaque_spans[i];
+    span.begin = width;
+    span.end = 0;
+    for (int k = 0; k < nb_words_per_row - 1; ++k) {
+      if (row_bits[k] == 0) {
+        continue;
+      }
+      int first = 0;
+      while ((row_bits[k] & (UINT64_C(1) << first)) == 0) {
+        ++first;
+      }
+      int last = 63;
+      while ((row_bits[k] & (UINT64_C(1) << last)) == 0) {
+        --last;
+      }
+      span.begin = std::min(span.begin, k * 64 + first);
+      span.end = k * 64 + last + 1;
     }
-    pixel_index += surface.get_width() - width;
   }
+  SDL_UnlockSurface(&sdl_surface);
+}
+
+/**
+ * \brief Returns the transparency bits of 64 consecutive pixels of a row.
+ *
+ * Pixels after the end of the row are considered transparent.
+ *
+ * \param row A row of the image.
+ * \param x Index of the first pixel in the row, between 0 and width - 1.
+ * \return The bits of pixels x to x + 63: bit i is set if pixel x + i is
+ * opaque.
+ */
+uint64_t PixelBits::get_bits(int row, int x) const {
+
+  const uint64_t* row_bits = &bits[row * nb_words_per_row];
+  const int word = x >> 6;
+  const int shift = x & 63;
+  if (shift == 0) {
+    return row_bits[word];
+  }
+  // The zero word at the end of each row makes word + 1 always valid.
+  return (row_bits[word] >> shift) | (row_bits[word + 1] << (64 - shift));
 }
 
 /**
@@ -103,7 +192,7 @@ bool PixelBits::test_collision(
 ) const {
   const bool debug_pixel_collisions = false;
 
-  if (bits.empty()) {
+  if (bits.empty() || other.bits.empty()) {
     // No image.
     return false;
   }
@@ -126,108 +215,33 @@ bool PixelBits::test_collision(
   }
 
   // Compute the intersection between both rectangles.
-  const int intersection_x = std::max(bounding_box1.get_x(), bounding_box2.get_x());
-  const int intersection_y = std::max(bounding_box1.get_y(), bounding_box2.get_y());
-  const Rectangle intersection(
-      intersection_x,
-      intersection_y,
-      std::min(bounding_box1.get_x() + bounding_box1.get_width(),
-          bounding_box2.get_x() + bounding_box2.get_width()) - intersection_x,
-      std::min(bounding_box1.get_y() + bounding_box1.get_height(),
-          bounding_box2.get_y() + bounding_box2.get_height()) - intersection_y);
-
-  if (debug_pixel_collisions) {
-    std::cout << "intersection: " << intersection << "\n";
-  }
-
-  // compute the relative position of the intersection rectangle for each bounding_box
-  Point offset1 = intersection.get_xy() - bounding_box1.get_xy();
-  Point offset2 = intersection.get_xy() - bounding_box2.get_xy();
-
-  if (debug_pixel_collisions) {
-    std::cout << "offset1.x = " << offset1.x << ", offset1.y = " << offset1.y;
-    std::cout << ", offset2.x = " << offset2.x << ", offset2.y = " << offset2.y << std::endl;
-  }
-
-  // For each row of the intersection, we will call row 'a' the row coming from the right bounding box
-  // and row 'b' the one coming from the left bounding box.
-
-  std::vector<std::vector<uint32_t>>::const_iterator rows_a;           // for each row: array of masks of the right bounding box
-  std::vector<std::vector<uint32_t>>::const_iterator rows_b;           // for each row: array of masks of the left bounding box
-
-  int nb_masks_per_row_a;    // number of masks on row a that are in the intersection (row b may have one more mask)
-  int nb_masks_per_row_b;    // number of masks on row b that are in the intersection
-  int nb_unused_masks_row_b; // number of unused masks on row b (i.e. before the intersection)
-  int nb_unused_bits_row_b;  // number of unused bits on the first used mask of row b
-  int nb_used_bits_row_b;    // number of bits used on the first used mask of row b
-
-  // make sure row a starts after row b
-  if (bounding_box1.get_x() > bounding_box2.get_x()) {
-    rows_a = this->bits.begin() + offset1.y;
-    rows_b = other.bits.begin() + offset2.y;
-    nb_unused_masks_row_b = offset2.x >> 5;
-    nb_unused_bits_row_b = offset2.x & 31;
-  }
-  else {
-    rows_a = other.bits.begin() + offset2.y;
-    rows_b = this->bits.begin() + offset1.y;
-    nb_unused_masks_row_b = offset1.x >> 5;
-    nb_unused_bits_row_b = offset1.x & 31;
-  }
-  nb_used_bits_row_b = 32 - nb_unused_bits_row_b;
-
-  // compute the number of masks in the intersection on row a
-  nb_masks_per_row_a = intersection.get_width() >> 5;
-  if ((intersection.get_width() & 31) != 0) {
-    nb_masks_per_row_a++;
-  }
-
-  // compute the number of masks in the intersection on row b
-  nb_masks_per_row_b = (intersection.get_width() + nb_unused_bits_row_b) >> 5;
-  if (((intersection.get_width() + nb_unused_bits_row_b) & 31) != 0) {
-    nb_masks_per_row_b++;
-  }
-
-  // check the collisions each row of the intersection rectangle
-  for (int i = 0; i < intersection.get_height(); ++i) {
-
-    // current row
-    const std::vector<uint32_t>& bits_a = *rows_a;
-    const std::vector<uint32_t>& bits_b = *rows_b;
-
-    ++rows_a;
-    ++rows_b;
-
-    if (debug_pixel_collisions) {
-      std::cout << "*** checking row " << i << " of the intersection rectangle\n";
-    }
-
-    // Check each mask.
-    for (int j = 0; j < nb_masks_per_row_a; ++j) {
-
-      // We compare the left of a with the right part of b,
-      // and the right part of a with the right part of the next b if any.
-
-      uint32_t mask_a = bits_a[j];
-      uint32_t mask_b = bits_b[j + nb_unused_masks_row_b];
-      uint32_t mask_a_left = mask_a >> nb_unused_bits_row_b;
-      uint32_t next_mask_b_left = 0x00000000;
-      if (j + 1 < nb_masks_per_row_a ||            // Not the last a-mask.
-          nb_masks_per_row_b > nb_masks_per_row_a  // Last a-mask but there exists one more b-mask.
-          ) {
-        // We are still inside the intersection: next_mask_b_left exists.
-        next_mask_b_left = bits_b[j + nb_unused_masks_row_b + 1] >> nb_used_bits_row_b;
-      }
-
-      if (debug_pixel_collisions) {
-        std::cout << "mask_a = ";
-        print_mask(mask_a);
-        std::cout << ", mask b = ";
-        print_mask(mask_b);
-        std::cout << "\n";
-      }
-
-      if (((mask_a_left & mask_b) | (mask_a & next_mask_b_left)) != 0x00000000) {
+  const int intersection_x1 = std::max(location1.x, location2.x);
+  const int intersection_y1 = std::max(location1.y, location2.y);
+  const int intersection_x2 = std::min(location1.x + width, location2.x + other.width);
+  const int intersection_y2 = std::min(location1.y + height, location2.y + other.height);
+
+  // Check the collisions each row of the intersection rectangle.
+  for (int y = intersection_y1; y < intersection_y2; ++y) {
+
+    const int row1 = y - location1.y;
+    const int row2 = y - location2.y;
+
+    // Only test pixels that can be opaque in both rows.
+    const OpaqueSpan& span1 = opaque_spans[row1];
+    const OpaqueSpan& span2 = other.opaque_spans[row2];
+    const int begin = std::max(
+        intersection_x1,
+        std::max(location1.x + span1.begin, location2.x + span2.begin)
+    );
+    const int end = std::min(
+        intersection_x2,
+        std::min(location1.x + span1.end, location2.x + span2.end)
+    );
+
+    // Compare 64 pixels at once. Bits read after end are all zero
+    // in at least one of the images.
+    for (int x = begin; x < end; x += 64) {
+      if ((get_bits(row1, x - location1.x) & other.get_bits(row2, x - location2.x)) != 0) {
         return true;
       }
     }
@@ -243,38 +257,17 @@ void PixelBits::print() const {
 
   std::cout << "frame size is " << width << " x " << height << std::endl;
   for (int i = 0; i < height; i++) {
-    int k = -1;
-    uint32_t mask = 0x00000000;
+    const uint64_t* row_bits = &bits[i * nb_words_per_row];
     for (int j = 0; j < width; j++) {
-
-      if (mask == 0x00000000) {
-        k++;
-        mask = 0x80000000;
-      }
-
-      if (bits[i][k] & mask) {
+      if ((row_bits[j >> 6] & (UINT64_C(1) << (j & 63))) != 0) {
         std::cout << "X";
       }
       else {
         std::cout << ".";
       }
-
-      mask >>= 1;
     }
     std::cout << std::endl;
   }
 }
 
-/**
- * \brief Prints an ASCII representation of a 32-bit mask (for debugging purposes only).
- */
-void PixelBits::print_mask(uint32_t mask) const {
-
-  for (int i = 0; i < 32; i++) {
-    std::cout << (((mask & 0x80000000) != 0x00000000) ? "X" : ".");
-    mask <<= 1;
-  }
-}
-
 }
-
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Profiler.h"
+#include "solarus/lowlevel/Debug.h"
+#include <chrono>
+#include <vector>
+
+namespace Solarus {
+namespace Profiler {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+bool enabled = false;                    /**< Whether measures are taken. */
+uint64_t phase_times[num_phases] = { };  /**< Time spent in each phase in nanoseconds. */
+std::vector<Phase> phase_stack;          /**< Phases being measured, innermost last. */
+Clock::time_point last_date;             /**< When the innermost phase was last resumed. */
+
+/**
+ * \brief Adds the time elapsed since the last event to the innermost phase.
+ * \param now The current date.
+ */
+void charge_current_phase(const Clock::time_point& now) {
+
+  if (!phase_stack.empty()) {
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last_date);
+    phase_times[static_cast<int>(phase_stack.back())] += elapsed.count();
+  }
+  last_date = now;
+}
+
+}
+
+/**
+ * \brief Enables or disables the measures.
+ * \param enabled \c true to start measuring phases.
+ */
+void set_enabled(bool enabled) {
+  Profiler::enabled = enabled;
+}
+
+/**
+ * \brief Returns whether the measures are enabled.
+ * \return \c true if phases are measured.
+ */
+bool is_enabled() {
+  return enabled;
+}
+
+/**
+ * \brief Sets the time of all phases to zero.
+ */
+void reset() {
+
+  for (uint64_t& phase_time : phase_times) {
+    phase_time = 0;
+  }
+  last_date = Clock::now();
+}
+
+/**
+ * \brief Returns the time spent in a phase since the last reset.
+ *
+ * The time spent in nested phases is not included.
+ *
+ * \param phase A phase.
+ * \return The time spent in nanoseconds.
+ */
+uint64_t get_time(Phase phase) {
+  return phase_times[static_cast<int>(phase)];
+}
+
+/**
+ * \brief Returns the name of a phase.
+ * \param phase A phase.
+ * \return The name of this phase, like "entity_update".
+ */
+const std::string& get_phase_name(Phase phase) {
+
+  static const std::string names[num_phases] = {
+      "lua_update",
+      "entity_update",
+      "collision",
+      "draw",
+      "render"
+  };
+  return names[static_cast<int>(phase)];
+}
+
+/**
+ * \brief Starts measuring a phase.
+ *
+ * The enclosing phase, if any, is paused until end_phase() is called.
+ * Prefer ScopedPhase to calling this function directly.
+ *
+ * \param phase The phase to start.
+ */
+void begin_phase(Phase phase) {
+
+  charge_current_phase(Clock::now());
+  phase_stack.push_back(phase);
+}
+
+/**
+ * \brief Stops measuring the innermost phase and resumes the enclosing one.
+ */
+void end_phase() {
+
+  Debug::check_assertion(!phase_stack.empty(), "No phase is being measured");
+
+  charge_current_phase(Clock::now());
+  phase_stack.pop_back();
+}
+
+}
+}
+
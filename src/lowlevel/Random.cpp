@@ -25,6 +25,27 @@
 namespace Solarus {
 namespace Random {
 
+namespace {
+
+/**
+ * \brief Returns the random engine of the current thread.
+ * \return The random engine.
+ */
+std::mt19937& get_engine() {
+
+  // The engine is not initialized with std::random_device
+  // because not every main platform support non-deterministic
+  // random numbers generation yet.
+  //
+  // The engine is thread_local so that every thread has
+  // its own to avoid thread-safety problems while still being
+  // more efficient than a mutex-based solution.
+  thread_local std::mt19937 engine(std::time(nullptr));
+  return engine;
+}
+
+}
+
 /**
  * \brief Initializes the random number generator.
  */
@@ -39,6 +60,17 @@ void quit() {
   // nothing to do
 }
 
+/**
+ * \brief Makes the random numbers of the current thread reproducible.
+ *
+ * By default, the generator is initialized with the current time.
+ *
+ * \param seed The seed to use.
+ */
+void set_seed(unsigned int seed) {
+  get_engine().seed(seed);
+}
+
 /**
  * \brief Returns a random integer number in [0, x[ with a uniform distribution.
  *
@@ -59,23 +91,16 @@ int get_number(unsigned int x) {
  */
 int get_number(int x, int y) {
 
-  // Initialize the engine and the distribution
+  // Initialize the distribution
   //
-  // The engine is not initialized with std::random_device
-  // because not every main platform support non-deterministic
-  // random numbers generation yet.
-  //
-  // The variables are thread_local so that every thread has
-  // its own to avoid thread-safety problems while still being
-  // more efficient than a mutex-based solution
-  //
-  // These variables need to be known in the function but not
-  // needed outside of it, so it is easier to have them as
-  // thread_local function-local variables (one instance per
+  // The distribution is thread_local like the engine.
+  // It needs to be known in the function but not
+  // needed outside of it, so it is easier to have it as
+  // a thread_local function-local variable (one instance per
   // thread, initialized once, like a static variable) rather
-  // than maintaining them in the body of a class.
+  // than maintaining it in the body of a class.
   //
-  thread_local std::mt19937 engine(std::time(nullptr));
+  std::mt19937& engine = get_engine();
   thread_local std::uniform_int_distribution<int> dist{};
 
   // Type of the parameters of the distribution
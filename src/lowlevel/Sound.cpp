@@ -15,9 +15,13 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <algorithm>
+#include <atomic>
 #include <cstring>  // memcpy
 #include <sstream>
+#include <thread>
+#include <vector>
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Hash.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Music.h"
 #include "solarus/lowlevel/Sound.h"
@@ -30,6 +34,9 @@ ALCdevice* Sound::device = nullptr;
 ALCcontext* Sound::context = nullptr;
 bool Sound::initialized = false;
 bool Sound::sounds_preloaded = false;
+bool Sound::pcm_cache_enabled = false;
+int Sound::num_cache_hits = 0;
+int Sound::num_cache_misses = 0;
 float Sound::volume = 1.0;
 std::list<Sound*> Sound::current_sounds;
 std::map<std::string, Sound> Sound::all_sounds;
@@ -69,12 +76,82 @@ Sound::~Sound() {
   }
 }
 
+namespace {
+
+/**
+ * \brief Name of the decoded sound cache file, in the quest write directory.
+ */
+const std::string pcm_cache_file_name = "sounds.cache";
+
+/**
+ * \brief First bytes of the decoded sound cache file.
+ *
+ * Change the version number when the format changes.
+ */
+const std::string pcm_cache_magic = "Solarus decoded sounds 1\n";
+
+/**
+ * \brief Appends the bytes of a value to a buffer.
+ * \param buffer The buffer.
+ * \param value The value to append.
+ */
+template<typename T>
+void append_value(std::string& buffer, const T& value) {
+  buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * \brief Reads the bytes of a value from a buffer.
+ * \param buffer The buffer.
+ * \param position Where to read. Advanced after the value.
+ * \param value The value read.
+ * \return \c false if the buffer is too short.
+ */
+template<typename T>
+bool read_value(const std::string& buffer, size_t& position, T& value) {
+
+  if (buffer.size() - position < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(&value, buffer.data() + position, sizeof(T));
+  position += sizeof(T);
+  return true;
+}
+
+/**
+ * \brief Reads a string prefixed by its size from a buffer.
+ * \param buffer The buffer.
+ * \param position Where to read. Advanced after the string.
+ * \param value The string read.
+ * \return \c false if the buffer is too short.
+ */
+bool read_string(const std::string& buffer, size_t& position, std::string& value) {
+
+  uint64_t size = 0;
+  if (!read_value(buffer, position, size) ||
+      buffer.size() - position < size) {
+    return false;
+  }
+  value = buffer.substr(position, size);
+  position += size;
+  return true;
+}
+
+}
+
 /**
  * \brief Initializes the audio (music and sound) system.
  *
  * This method should be called when the application starts.
+ * Options recognized:
+ *   -no-audio
+ *   -sound-cache=yes|no
+ *
  * If the argument -no-audio is provided, this function has no effect and
  * there will be no sound.
+ * With -sound-cache=yes, sounds decoded by load_all() are saved in the
+ * quest write directory, so that the next launches do not decode them
+ * again.
  *
  * \param args Command-line arguments.
  */
@@ -86,6 +163,8 @@ void Sound::initialize(const Arguments& args) {
     return;
   }
 
+  pcm_cache_enabled = args.get_argument_value("-sound-cache") == "yes";
+
   // Initialize OpenAL.
 
   device = alcOpenDevice(nullptr);
@@ -154,22 +233,175 @@ bool Sound::is_initialized() {
 
 /**
  * \brief Loads and decodes all sounds listed in the game database.
+ *
+ * Sounds are decoded in parallel by a few threads.
+ * If the cache is enabled, sounds whose file did not change since the
+ * previous launch are taken from the cache instead.
  */
 void Sound::load_all() {
 
-  if (is_initialized() && !sounds_preloaded) {
+  if (!is_initialized() || sounds_preloaded) {
+    return;
+  }
 
-    const std::map<std::string, std::string>& sound_elements =
-        CurrentQuest::get_resources(ResourceType::SOUND);
-    for (const auto& kvp: sound_elements) {
-      const std::string& sound_id = kvp.first;
+  /**
+   * \brief A sound to load.
+   */
+  struct SoundToLoad {
+    std::string id;
+    std::string file_name;
+    std::string encoded_data;
+    uint64_t source_hash;
+    PcmData pcm;
+    bool decoded;
+    std::string error_message;
+  };
+
+  std::map<std::string, CachedSound> cache;
+  if (pcm_cache_enabled) {
+    read_pcm_cache(cache);
+  }
 
-      all_sounds[sound_id] = Sound(sound_id);
-      all_sounds[sound_id].load();
+  // Read the files and find the sounds to decode.
+  // Files are read here because the quest files API is not thread-safe.
+  const std::map<std::string, std::string>& sound_elements =
+      CurrentQuest::get_resources(ResourceType::SOUND);
+  std::vector<SoundToLoad> sounds;
+  std::vector<SoundToLoad*> sounds_to_decode;
+  sounds.reserve(sound_elements.size());
+  for (const auto& kvp: sound_elements) {
+    const auto it = all_sounds.find(kvp.first);
+    if (it != all_sounds.end() && it->second.buffer != AL_NONE) {
+      // Already loaded when it was played.
+      continue;
     }
 
-    sounds_preloaded = true;
+    SoundToLoad sound;
+    sound.id = kvp.first;
+    sound.file_name = get_file_name(sound.id);
+    sound.source_hash = 0;
+    sound.decoded = false;
+    if (!QuestFiles::data_file_exists(sound.file_name)) {
+      sound.error_message = std::string("Cannot find sound file '") + sound.file_name + "'";
+    }
+    else {
+      sound.encoded_data = QuestFiles::data_file_read(sound.file_name);
+    }
+    sounds.push_back(std::move(sound));
   }
+
+  bool cache_changed = false;
+  for (SoundToLoad& sound: sounds) {
+    if (!sound.error_message.empty()) {
+      continue;
+    }
+
+    if (pcm_cache_enabled) {
+      sound.source_hash = Hash::get_fnv1a_hash(sound.encoded_data);
+      const auto it = cache.find(sound.id);
+      if (it != cache.end() && it->second.source_hash == sound.source_hash) {
+        // Unchanged since the cache was written.
+        sound.pcm = std::move(it->second.pcm);
+        sound.decoded = true;
+        sound.encoded_data.clear();
+        ++num_cache_hits;
+        continue;
+      }
+      cache_changed = true;
+    }
+    sounds_to_decode.push_back(&sound);
+    ++num_cache_misses;
+  }
+
+  // Decode the other ones in parallel.
+  std::atomic<size_t> next_sound_index(0);
+  const auto& decode_sounds = [&]() {
+    size_t index;
+    while ((index = next_sound_index++) < sounds_to_decode.size()) {
+      SoundToLoad& sound = *sounds_to_decode[index];
+      sound.decoded = decode_pcm(sound.encoded_data, sound.pcm, sound.error_message);
+      sound.encoded_data.clear();
+      sound.encoded_data.shrink_to_fit();
+    }
+  };
+
+  const size_t num_threads = std::min(
+      std::max(std::thread::hardware_concurrency(), 1u),
+      static_cast<unsigned>(sounds_to_decode.size())
+  );
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; ++i) {
+    threads.emplace_back(decode_sounds);
+  }
+  decode_sounds();  // This thread helps too.
+  for (std::thread& thread: threads) {
+    thread.join();
+  }
+
+  // Create the OpenAL buffers.
+  for (SoundToLoad& sound: sounds) {
+    Sound& loaded_sound = all_sounds.emplace(sound.id, Sound(sound.id)).first->second;
+
+    if (!sound.decoded) {
+      std::string message = sound.error_message;
+      if (message.empty()) {
+        message = std::string("Cannot decode sound file '") + sound.file_name + "'";
+      }
+      else if (message.find(sound.file_name) == std::string::npos) {
+        message += " in sound file '" + sound.file_name + "'";
+      }
+      Debug::error(message);
+      continue;
+    }
+
+    loaded_sound.buffer = create_buffer(sound.pcm, sound.file_name);
+
+    if (pcm_cache_enabled) {
+      CachedSound& cached_sound = cache[sound.id];
+      cached_sound.source_hash = sound.source_hash;
+      cached_sound.pcm = std::move(sound.pcm);
+    }
+  }
+
+  if (pcm_cache_enabled) {
+    // Forget sounds that are no longer in the quest.
+    for (auto it = cache.begin(); it != cache.end();) {
+      if (sound_elements.find(it->first) == sound_elements.end()) {
+        it = cache.erase(it);
+        cache_changed = true;
+      }
+      else {
+        ++it;
+      }
+    }
+
+    if (cache_changed) {
+      write_pcm_cache(cache);
+    }
+  }
+
+  sounds_preloaded = true;
+}
+
+/**
+ * \brief Creates the OpenAL buffer of a sound decoded elsewhere.
+ *
+ * Does nothing if this sound is already loaded.
+ *
+ * \param sound_id Id of the sound.
+ * \param pcm Its decoded data, as returned by decode_pcm().
+ */
+void Sound::load_decoded(const std::string& sound_id, const PcmData& pcm) {
+
+  if (!is_initialized()) {
+    return;
+  }
+
+  Sound& sound = all_sounds.emplace(sound_id, Sound(sound_id)).first->second;
+  if (sound.buffer != AL_NONE) {
+    return;
+  }
+  sound.buffer = create_buffer(pcm, get_file_name(sound_id));
 }
 
 /**
@@ -216,6 +448,22 @@ void Sound::set_volume(int volume) {
   Sound::volume = volume / 100.0;
 }
 
+/**
+ * \brief Returns the number of sounds found in the decoded sound cache.
+ * \return The number of sounds load_all() did not decode.
+ */
+int Sound::get_num_cache_hits() {
+  return num_cache_hits;
+}
+
+/**
+ * \brief Returns the number of sounds decoded by load_all().
+ * \return The number of sounds decoded at preloading time.
+ */
+int Sound::get_num_cache_misses() {
+  return num_cache_misses;
+}
+
 /**
  * \brief Updates the audio (music and sound) system.
  *
@@ -263,6 +511,20 @@ bool Sound::update_playing() {
   return !sources.empty();
 }
 
+/**
+ * \brief Returns the name of the file of a sound.
+ * \param sound_id Id of a sound.
+ * \return The file name, relative to the data directory.
+ */
+std::string Sound::get_file_name(const std::string& sound_id) {
+
+  std::string file_name = std::string("sounds/" + sound_id);
+  if (sound_id.find(".") == std::string::npos) {
+    file_name += ".ogg";
+  }
+  return file_name;
+}
+
 /**
  * \brief Loads and decodes the sound into memory.
  */
@@ -272,13 +534,8 @@ void Sound::load() {
     Debug::error("Previous audio error not cleaned");
   }
 
-  std::string file_name = std::string("sounds/" + id);
-  if (id.find(".") == std::string::npos) {
-    file_name += ".ogg";
-  }
-
   // Create an OpenAL buffer with the sound decoded by the library.
-  buffer = decode_file(file_name);
+  buffer = decode_file(get_file_name(id));
 
   // buffer is now AL_NONE if there was an error.
 }
@@ -341,109 +598,203 @@ bool Sound::start() {
  */
 ALuint Sound::decode_file(const std::string& file_name) {
 
-  ALuint buffer = AL_NONE;
-
   if (!QuestFiles::data_file_exists(file_name)) {
     Debug::error(std::string("Cannot find sound file '") + file_name + "'");
     return AL_NONE;
   }
 
+  PcmData pcm;
+  std::string error_message;
+  if (!decode_pcm(QuestFiles::data_file_read(file_name), pcm, error_message)) {
+    Debug::error(error_message + " in sound file '" + file_name + "'");
+    return AL_NONE;
+  }
+
+  return create_buffer(pcm, file_name);
+}
+
+/**
+ * \brief Decodes an Ogg Vorbis sound.
+ *
+ * This function does not use OpenAL or the quest files, and does not
+ * report errors itself: it can be called from any thread.
+ * Mono sounds stay mono.
+ *
+ * \param encoded_data Content of the sound file.
+ * \param pcm The decoded data.
+ * \param error_message The error if the sound could not be decoded.
+ * \return \c true in case of success.
+ */
+bool Sound::decode_pcm(
+    const std::string& encoded_data,
+    PcmData& pcm,
+    std::string& error_message
+) {
   // load the sound file
   SoundFromMemory mem;
   mem.loop = false;
   mem.position = 0;
-  mem.data = QuestFiles::data_file_read(file_name);
+  mem.data = encoded_data;
 
   OggVorbis_File file;
   int error = ov_open_callbacks(&mem, &file, nullptr, 0, ogg_callbacks);
-
   if (error) {
     std::ostringstream oss;
-    oss << "Cannot load sound file '" << file_name
-        << "' from memory: error " << error;
-    Debug::error(oss.str());
+    oss << "Cannot load sound from memory: error " << error;
+    error_message = oss.str();
+    return false;
   }
-  else {
 
-    // read the encoded sound properties
-    vorbis_info* info = ov_info(&file, -1);
-    ALsizei sample_rate = ALsizei(info->rate);
+  // read the encoded sound properties
+  vorbis_info* info = ov_info(&file, -1);
+  pcm.sample_rate = ALsizei(info->rate);
 
-    ALenum format = AL_NONE;
-    if (info->channels == 1) {
-      format = AL_FORMAT_MONO16;
-    }
-    else if (info->channels == 2) {
-      format = AL_FORMAT_STEREO16;
-    }
+  pcm.format = AL_NONE;
+  if (info->channels == 1) {
+    pcm.format = AL_FORMAT_MONO16;
+  }
+  else if (info->channels == 2) {
+    pcm.format = AL_FORMAT_STEREO16;
+  }
 
-    if (format == AL_NONE) {
-      Debug::error(std::string("Invalid audio format for sound file '")
-          + file_name + "'");
+  bool success = true;
+  if (pcm.format == AL_NONE) {
+    error_message = "Invalid audio format";
+    success = false;
+  }
+  else {
+    // decode the sound with vorbisfile
+    pcm.samples.clear();
+    const ogg_int64_t nb_samples = ov_pcm_total(&file, -1);
+    if (nb_samples > 0) {
+      pcm.samples.reserve(size_t(nb_samples) * info->channels * sizeof(ALshort));
     }
-    else {
-      // decode the sound with vorbisfile
-      std::vector<char> samples;
-      int bitstream;
-      long bytes_read;
-      long total_bytes_read = 0;
-      const int buffer_size = 4096;
-      char samples_buffer[buffer_size];
-      do {
-        bytes_read = ov_read(&file, samples_buffer, buffer_size, 0, 2, 1, &bitstream);
-        if (bytes_read < 0) {
-          std::ostringstream oss;
-          oss << "Error while decoding ogg chunk in sound file '"
-              << file_name << "': " << bytes_read;
-          Debug::error(oss.str());
-        }
-        else {
-          total_bytes_read += bytes_read;
-          if (format == AL_FORMAT_STEREO16) {
-            samples.insert(samples.end(), samples_buffer, samples_buffer + bytes_read);
-          }
-          else {
-            // mono sound files make no sound on some machines
-            // workaround: convert them on-the-fly into stereo sounds
-            // TODO find a better solution
-            for (int i = 0; i < bytes_read; i += 2) {
-              samples.insert(samples.end(), samples_buffer + i, samples_buffer + i + 2);
-              samples.insert(samples.end(), samples_buffer + i, samples_buffer + i + 2);
-            }
-            total_bytes_read += bytes_read;
-          }
-        }
-      }
-      while (bytes_read > 0);
 
-      // copy the samples into an OpenAL buffer
-      alGenBuffers(1, &buffer);
-      if (alGetError() != AL_NO_ERROR) {
-          Debug::error("Failed to generate audio buffer");
-      }
-      alBufferData(buffer,
-          AL_FORMAT_STEREO16,
-          reinterpret_cast<ALshort*>(samples.data()),
-          ALsizei(total_bytes_read),
-          sample_rate);
-      ALenum error = alGetError();
-      if (error != AL_NO_ERROR) {
+    int bitstream;
+    long bytes_read;
+    const int buffer_size = 4096;
+    char samples_buffer[buffer_size];
+    do {
+      bytes_read = ov_read(&file, samples_buffer, buffer_size, 0, 2, 1, &bitstream);
+      if (bytes_read < 0) {
         std::ostringstream oss;
-        oss << "Cannot copy the sound samples of '"
-            << file_name << "' into buffer " << buffer
-            << ": error " << error;
-        Debug::error(oss.str());
-        buffer = AL_NONE;
+        oss << "Error while decoding ogg chunk: " << bytes_read;
+        error_message = oss.str();
+        success = false;
+      }
+      else {
+        pcm.samples.append(samples_buffer, bytes_read);
       }
     }
-    ov_clear(&file);
+    while (bytes_read > 0);
   }
+  ov_clear(&file);
 
-  mem.data.clear();
+  return success;
+}
+
+/**
+ * \brief Copies decoded samples into a new OpenAL buffer.
+ * \param pcm The decoded sound.
+ * \param file_name Name of the sound file, for error messages.
+ * \return The buffer created, or AL_NONE in case of error.
+ */
+ALuint Sound::create_buffer(const PcmData& pcm, const std::string& file_name) {
+
+  ALuint buffer = AL_NONE;
+  alGenBuffers(1, &buffer);
+  if (alGetError() != AL_NO_ERROR) {
+    Debug::error("Failed to generate audio buffer");
+  }
+  alBufferData(buffer,
+      pcm.format,
+      reinterpret_cast<const ALshort*>(pcm.samples.data()),
+      ALsizei(pcm.samples.size()),
+      pcm.sample_rate);
+  ALenum error = alGetError();
+  if (error != AL_NO_ERROR) {
+    std::ostringstream oss;
+    oss << "Cannot copy the sound samples of '"
+        << file_name << "' into buffer " << buffer
+        << ": error " << error;
+    Debug::error(oss.str());
+    buffer = AL_NONE;
+  }
 
   return buffer;
 }
 
+/**
+ * \brief Reads the decoded sound cache file if any.
+ *
+ * An invalid file is ignored.
+ *
+ * \param cache The cached sounds, indexed by sound id.
+ */
+void Sound::read_pcm_cache(std::map<std::string, CachedSound>& cache) {
+
+  cache.clear();
+  if (QuestFiles::get_quest_write_dir().empty() ||
+      !QuestFiles::data_file_exists(pcm_cache_file_name)) {
+    return;
+  }
+
+  const std::string buffer = QuestFiles::data_file_read(pcm_cache_file_name);
+  if (buffer.compare(0, pcm_cache_magic.size(), pcm_cache_magic) != 0) {
+    return;
+  }
+
+  size_t position = pcm_cache_magic.size();
+  while (position < buffer.size()) {
+    std::string sound_id;
+    CachedSound cached_sound;
+    int32_t num_channels = 0;
+    int32_t sample_rate = 0;
+    if (!read_string(buffer, position, sound_id) ||
+        !read_value(buffer, position, cached_sound.source_hash) ||
+        !read_value(buffer, position, num_channels) ||
+        !read_value(buffer, position, sample_rate) ||
+        !read_string(buffer, position, cached_sound.pcm.samples) ||
+        (num_channels != 1 && num_channels != 2)) {
+      // Truncated or corrupted file.
+      cache.clear();
+      return;
+    }
+    cached_sound.pcm.format = (num_channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    cached_sound.pcm.sample_rate = sample_rate;
+    cache[sound_id] = std::move(cached_sound);
+  }
+}
+
+/**
+ * \brief Saves the decoded sound cache file.
+ *
+ * Does nothing if the quest has no write directory.
+ *
+ * \param cache The sounds to save, indexed by sound id.
+ */
+void Sound::write_pcm_cache(const std::map<std::string, CachedSound>& cache) {
+
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return;
+  }
+
+  std::string buffer = pcm_cache_magic;
+  for (const auto& kvp: cache) {
+    const CachedSound& cached_sound = kvp.second;
+    append_value(buffer, static_cast<uint64_t>(kvp.first.size()));
+    buffer += kvp.first;
+    append_value(buffer, cached_sound.source_hash);
+    append_value(buffer, static_cast<int32_t>(
+        cached_sound.pcm.format == AL_FORMAT_MONO16 ? 1 : 2));
+    append_value(buffer, static_cast<int32_t>(cached_sound.pcm.sample_rate));
+    append_value(buffer, static_cast<uint64_t>(cached_sound.pcm.samples.size()));
+    buffer += cached_sound.pcm.samples;
+  }
+
+  QuestFiles::data_file_save(pcm_cache_file_name, buffer);
+}
+
 /**
  * \brief Loads an encoded sound from memory.
  *
@@ -20,6 +20,7 @@
 #include "solarus/lowlevel/Rectangle.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/ImageCache.h"
 #include "solarus/lowlevel/Video.h"
 #include "solarus/lowlevel/PixelFilter.h"
 #include "solarus/lua/LuaContext.h"
@@ -29,6 +30,211 @@
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Allocator that recycles the memory of single objects.
+ *
+ * Subsurface nodes are created and destroyed by thousands at each frame.
+ * Freed blocks are kept for later allocations of the same type instead of
+ * being returned to the system.
+ */
+template<typename T>
+class RecyclingAllocator {
+
+  public:
+
+    using value_type = T;
+
+    RecyclingAllocator() = default;
+
+    template<typename U>
+    RecyclingAllocator(const RecyclingAllocator<U>& /* other */) {
+    }
+
+    T* allocate(size_t n) {
+
+      std::vector<void*>& free_blocks = get_free_blocks();
+      if (n == 1 && !free_blocks.empty()) {
+        void* block = free_blocks.back();
+        free_blocks.pop_back();
+        return static_cast<T*>(block);
+      }
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t n) {
+
+      if (n == 1) {
+        get_free_blocks().push_back(block);
+        return;
+      }
+      ::operator delete(block);
+    }
+
+    template<typename U>
+    bool operator==(const RecyclingAllocator<U>& /* other */) const {
+      return true;
+    }
+
+    template<typename U>
+    bool operator!=(const RecyclingAllocator<U>& /* other */) const {
+      return false;
+    }
+
+  private:
+
+    static std::vector<void*>& get_free_blocks() {
+      static std::vector<void*> free_blocks;
+      return free_blocks;
+    }
+
+};
+
+/**
+ * \brief A drawing operation recorded while traversing the subsurface tree.
+ */
+struct RenderCommand {
+  SDL_Texture* texture;   /**< Texture to copy, or nullptr to fill a rectangle with a color. */
+  Rectangle src_rect;     /**< Region of the texture to copy. */
+  Rectangle dst_rect;     /**< Where to draw on the renderer. */
+  uint8_t r, g, b;        /**< Fill color if there is no texture. */
+  uint8_t alpha;          /**< Opacity of the texture or alpha of the fill color. */
+};
+
+std::vector<RenderCommand> render_commands;  /**< Commands of the current frame.
+                                              * Cleared at each frame but the memory is kept. */
+int num_render_commands = 0;                 /**< Commands recorded during the last frame. */
+int num_render_copies = 0;                   /**< SDL_RenderCopy() calls during the last frame. */
+
+/**
+ * \brief Returns whether a rectangle is drawn without scaling.
+ * \param command A texture copy command.
+ * \return \c true if the source and destination have the same non-empty size.
+ */
+bool is_unscaled(const RenderCommand& command) {
+
+  return command.src_rect.get_width() > 0
+      && command.src_rect.get_height() > 0
+      && command.src_rect.get_width() == command.dst_rect.get_width()
+      && command.src_rect.get_height() == command.dst_rect.get_height();
+}
+
+/**
+ * \brief Extends a texture copy with the next one if it continues it.
+ *
+ * This is the case when both copy adjacent regions of the same texture
+ * to adjacent places with the same opacity, like neighbor tiles.
+ *
+ * \param command The command to extend.
+ * \param next The command that follows it.
+ * \return \c true if next was merged into command.
+ */
+bool merge_render_commands(RenderCommand& command, const RenderCommand& next) {
+
+  if (next.texture != command.texture
+      || next.alpha != command.alpha
+      || !is_unscaled(command)
+      || !is_unscaled(next)) {
+    return false;
+  }
+
+  Rectangle& src = command.src_rect;
+  Rectangle& dst = command.dst_rect;
+  const Rectangle& next_src = next.src_rect;
+  const Rectangle& next_dst = next.dst_rect;
+
+  if (src.get_y() == next_src.get_y()
+      && src.get_height() == next_src.get_height()
+      && dst.get_y() == next_dst.get_y()
+      && src.get_x() + src.get_width() == next_src.get_x()
+      && dst.get_x() + dst.get_width() == next_dst.get_x()) {
+    // Horizontally adjacent.
+    src.add_width(next_src.get_width());
+    dst.add_width(next_dst.get_width());
+    return true;
+  }
+
+  if (src.get_x() == next_src.get_x()
+      && src.get_width() == next_src.get_width()
+      && dst.get_x() == next_dst.get_x()
+      && src.get_y() + src.get_height() == next_src.get_y()
+      && dst.get_y() + dst.get_height() == next_dst.get_y()) {
+    // Vertically adjacent.
+    src.add_height(next_src.get_height());
+    dst.add_height(next_dst.get_height());
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * \brief Converts a rectangle to the SDL type.
+ * \param rectangle A rectangle.
+ * \return The equivalent SDL rectangle.
+ */
+SDL_Rect to_sdl_rect(const Rectangle& rectangle) {
+
+  SDL_Rect sdl_rect;
+  sdl_rect.x = rectangle.get_x();
+  sdl_rect.y = rectangle.get_y();
+  sdl_rect.w = rectangle.get_width();
+  sdl_rect.h = rectangle.get_height();
+  return sdl_rect;
+}
+
+/**
+ * \brief Performs all drawing operations recorded for this frame.
+ *
+ * Consecutive copies that continue each other are merged, and the texture
+ * opacity is only changed when needed.
+ *
+ * \param renderer The renderer where to draw.
+ */
+void submit_render_commands(SDL_Renderer* renderer) {
+
+  num_render_commands = (int) render_commands.size();
+  num_render_copies = 0;
+
+  SDL_Texture* current_texture = nullptr;
+  uint8_t current_alpha = 0;
+  const size_t size = render_commands.size();
+  size_t i = 0;
+  while (i < size) {
+
+    RenderCommand command = render_commands[i];
+    ++i;
+
+    if (command.texture == nullptr) {
+      // Background color.
+      SDL_SetRenderDrawColor(renderer, command.r, command.g, command.b, command.alpha);
+      const SDL_Rect dst_rect = to_sdl_rect(command.dst_rect);
+      SDL_RenderFillRect(renderer, &dst_rect);
+      continue;
+    }
+
+    while (i < size && merge_render_commands(command, render_commands[i])) {
+      ++i;
+    }
+
+    if (command.texture != current_texture || command.alpha != current_alpha) {
+      SDL_SetTextureAlphaMod(command.texture, command.alpha);
+      current_texture = command.texture;
+      current_alpha = command.alpha;
+    }
+
+    const SDL_Rect src_rect = to_sdl_rect(command.src_rect);
+    const SDL_Rect dst_rect = to_sdl_rect(command.dst_rect);
+    SDL_RenderCopy(renderer, command.texture, &src_rect, &dst_rect);
+    ++num_render_copies;
+  }
+
+  render_commands.clear();
+}
+
+}
+
 /**
  * \brief Stores the tree of what surfaces have to be drawn on other surfaces.
  *
@@ -53,18 +259,22 @@ class Surface::SubSurfaceNode {
      * \param src_rect Region of the surface to draw.
      * \param dst_rect The rectangle where to draw the surface, relative to
      * the parent surface.
-     * \param subsurfaces Surfaces drawn onto src_surface.
+     * \param subsurfaces Surfaces drawn onto src_surface (possibly nullptr).
+     * \param num_subsurfaces Number of elements of subsurfaces to use: the
+     * list may grow later but this node only sees what was drawn so far.
      */
     SubSurfaceNode(
-        SurfacePtr src_surface,
+        const SurfacePtr& src_surface,
         const Rectangle& src_rect,
         const Rectangle& dst_rect,
-        const std::vector<SubSurfaceNodePtr>& subsurfaces
+        const std::shared_ptr<SubSurfaceList>& subsurfaces,
+        size_t num_subsurfaces
     ):
       src_surface(src_surface),
       src_rect(src_rect),
       dst_rect(dst_rect),
-      subsurfaces(subsurfaces) {
+      subsurfaces(subsurfaces),
+      num_subsurfaces(num_subsurfaces) {
 
       // Clip the source rectangle to the size of the source surface.
       // Otherwise, SDL_RenderCopy() will stretch the image.
@@ -92,7 +302,9 @@ class Surface::SubSurfaceNode {
     SurfacePtr src_surface;                      /**< Surface to draw. */
     Rectangle src_rect;                          /**< Region of the surface to draw. */
     Rectangle dst_rect;                          /**< The rectangle where to draw the surface, relative to the parent surface. */
-    std::vector<SubSurfaceNodePtr> subsurfaces;  /**< Subsurfaces drawn onto src_surface. */
+    std::shared_ptr<const SubSurfaceList>
+        subsurfaces;                             /**< Subsurfaces drawn onto src_surface. */
+    size_t num_subsurfaces;                      /**< Number of elements of subsurfaces to draw. */
 };
 
 /**
@@ -104,7 +316,10 @@ Surface::Surface(int width, int height):
   Drawable(),
   software_destination(true),
   internal_surface(nullptr),
+  internal_surface_shared(false),
   internal_texture(nullptr),
+  atlas_region(nullptr),
+  atlas_allowed(false),
   internal_color(nullptr),
   is_rendered(false),
   internal_opacity(255),
@@ -125,10 +340,28 @@ Surface::Surface(int width, int height):
  * The created surface takes ownership of this object.
  */
 Surface::Surface(SDL_Surface* internal_surface):
+  Surface(std::shared_ptr<SDL_Surface>(internal_surface, SDL_Surface_Deleter())) {
+
+  internal_surface_shared = false;
+}
+
+/**
+ * \brief Creates a surface that shares the pixels of an SDL surface.
+ *
+ * The pixels are copied the first time this surface is modified, so the
+ * SDL surface can be shared by several surfaces, like images loaded from
+ * the same file.
+ *
+ * \param shared_internal_surface The internal surface data to share.
+ */
+Surface::Surface(const std::shared_ptr<SDL_Surface>& shared_internal_surface):
   Drawable(),
   software_destination(true),
-  internal_surface(internal_surface),
+  internal_surface(shared_internal_surface),
+  internal_surface_shared(true),
   internal_texture(nullptr),
+  atlas_region(nullptr),
+  atlas_allowed(false),
   internal_color(nullptr),
   is_rendered(false),
   internal_opacity(255) {
@@ -174,26 +407,34 @@ SurfacePtr Surface::create(const Size& size) {
 SurfacePtr Surface::create(const std::string& file_name,
     ImageDirectory base_directory) {
 
-  SDL_Surface* sdl_surface = get_surface_from_file(file_name, base_directory);
+  std::shared_ptr<SDL_Surface> sdl_surface = get_surface_from_file(file_name, base_directory);
 
   if (sdl_surface == nullptr) {
     return nullptr;
   }
 
   SurfacePtr surface = std::make_shared<Surface>(sdl_surface);
+
+  // Images from files are packed into the texture atlas at load time.
+  surface->atlas_allowed = true;
+  if (Video::is_acceleration_enabled()) {
+    surface->create_texture_from_surface();
+    surface->is_rendered = true;  // The texture is up to date.
+  }
   return surface;
 }
 
 /**
  * \brief Returns the SDL_Surface corresponding to the requested file.
  *
- * The returned SDL_Surface has to be manually deleted.
+ * The returned SDL_Surface comes from the image cache and is shared with
+ * other surfaces: it must be copied before being modified.
  *
  * \param file_name Name of the image file to load, relative to the base directory specified.
  * \param base_directory The base directory to use.
- * \return The SDL_Surface.
+ * \return The SDL_Surface, or nullptr if the file does not exist.
  */
-SDL_Surface* Surface::get_surface_from_file(
+std::shared_ptr<SDL_Surface> Surface::get_surface_from_file(
     const std::string& file_name,
     ImageDirectory base_directory) {
 
@@ -209,22 +450,7 @@ SDL_Surface* Surface::get_surface_from_file(
   }
   std::string prefixed_file_name = prefix + file_name;
 
-  if (!QuestFiles::data_file_exists(prefixed_file_name, language_specific)) {
-    // File not found.
-    return nullptr;
-  }
-
-  const std::string& buffer = QuestFiles::data_file_read(prefixed_file_name, language_specific);
-  SDL_RWops* rw = SDL_RWFromMem(const_cast<char*>(buffer.data()), (int) buffer.size());
-
-  SDL_Surface* software_surface = IMG_Load_RW(rw, 0);
-
-  SDL_RWclose(rw);
-
-  Debug::check_assertion(software_surface != nullptr,
-      std::string("Cannot load image '") + prefixed_file_name + "'");
-
-  return software_surface;
+  return ImageCache::get_image(prefixed_file_name, language_specific);
 }
 
 /**
@@ -250,10 +476,39 @@ void Surface::convert_software_surface() {
         "Failed to convert software surface");
 
     internal_surface = SDL_Surface_UniquePtr(converted_surface);
+    internal_surface_shared = false;
     SDL_SetSurfaceAlphaMod(internal_surface.get(), opacity);  // Re-apply the alpha.
   }
 }
 
+/**
+ * \brief Makes sure that the software surface is not shared before
+ * modifying it.
+ *
+ * Copies the pixels if they come from the image cache.
+ */
+void Surface::detach_software_surface() {
+
+  if (!internal_surface_shared) {
+    return;
+  }
+
+  SDL_Surface* copied_surface = SDL_ConvertSurface(
+      internal_surface.get(),
+      internal_surface->format,
+      0
+  );
+  Debug::check_assertion(copied_surface != nullptr,
+      "Failed to copy software surface");
+
+  SDL_BlendMode blend_mode = SDL_BLENDMODE_NONE;
+  SDL_GetSurfaceBlendMode(internal_surface.get(), &blend_mode);
+  SDL_SetSurfaceBlendMode(copied_surface, blend_mode);
+
+  internal_surface = SDL_Surface_UniquePtr(copied_surface);
+  internal_surface_shared = false;
+}
+
 /**
  * \brief Creates a hardware texture from the software surface.
  *
@@ -272,24 +527,52 @@ void Surface::create_texture_from_surface() {
     // for performance reasons.
     convert_software_surface();
 
-    // Create the texture.
-    internal_texture = SDL_Texture_UniquePtr(
-        SDL_CreateTexture(
-            main_renderer,
-            Video::get_pixel_format()->format,
-            SDL_TEXTUREACCESS_STATIC,
-            internal_surface->w,
-            internal_surface->h
-        )
-    );
-    SDL_SetTextureBlendMode(internal_texture.get(), SDL_BLENDMODE_BLEND);
+    if (atlas_allowed) {
+      // Try to share a texture with other images.
+      atlas_region = TextureAtlas::add_image(*internal_surface);
+    }
 
-    // Copy the pixels of the software surface to the GPU texture.
-    SDL_UpdateTexture(internal_texture.get(), nullptr, internal_surface->pixels, internal_surface->pitch);
+    if (atlas_region == nullptr) {
+      // Create the texture.
+      internal_texture = SDL_Texture_UniquePtr(
+          SDL_CreateTexture(
+              main_renderer,
+              Video::get_pixel_format()->format,
+              SDL_TEXTUREACCESS_STATIC,
+              internal_surface->w,
+              internal_surface->h
+          )
+      );
+      SDL_SetTextureBlendMode(internal_texture.get(), SDL_BLENDMODE_BLEND);
+
+      // Copy the pixels of the software surface to the GPU texture.
+      SDL_UpdateTexture(internal_texture.get(), nullptr, internal_surface->pixels, internal_surface->pitch);
+    }
     SDL_GetSurfaceAlphaMod(internal_surface.get(), &internal_opacity);
   }
 }
 
+/**
+ * \brief Copies the pixels of the software surface to the existing
+ * hardware texture or atlas region.
+ */
+void Surface::update_texture_from_surface() {
+
+  convert_software_surface();
+  if (atlas_region != nullptr) {
+    atlas_region->update(*internal_surface);
+  }
+  else {
+    SDL_UpdateTexture(
+        internal_texture.get(),
+        nullptr,
+        internal_surface->pixels,
+        internal_surface->pitch
+    );
+  }
+  SDL_GetSurfaceAlphaMod(internal_surface.get(), &internal_opacity);
+}
+
 /**
  * \brief Returns the width of the surface.
  * \return the width in pixels
@@ -329,6 +612,7 @@ void Surface::set_opacity(uint8_t opacity) {
 
     // The surface must be 32-bit with alpha value for this function to work.
     convert_software_surface();
+    detach_software_surface();
 
     int error = SDL_SetSurfaceAlphaMod(internal_surface.get(), opacity);
     if (error != 0) {
@@ -468,6 +752,7 @@ void Surface::create_software_surface() {
       )
   );
   SDL_SetSurfaceBlendMode(internal_surface.get(), SDL_BLENDMODE_BLEND);
+  internal_surface_shared = false;
   is_rendered = false;
 
   Debug::check_assertion(internal_surface != nullptr,
@@ -489,9 +774,15 @@ void Surface::clear() {
   if (internal_texture != nullptr) {
     internal_texture = nullptr;
   }
+  atlas_region = nullptr;
 
   if (internal_surface != nullptr) {
-    if (software_destination) {
+    if (software_destination && internal_surface_shared) {
+      // No need to copy pixels that will be erased.
+      internal_surface = nullptr;
+      create_software_surface();
+    }
+    else if (software_destination) {
       SDL_FillRect(
           internal_surface.get(),
           nullptr,
@@ -500,6 +791,7 @@ void Surface::clear() {
     }
     else {
       internal_surface = nullptr;
+      internal_surface_shared = false;
     }
   }
 }
@@ -522,6 +814,7 @@ void Surface::clear(const Rectangle& where) {
     return;
   }
 
+  detach_software_surface();
   SDL_FillRect(
       internal_surface.get(),
       where.get_internal_rect(),
@@ -572,19 +865,28 @@ void Surface::add_subsurface(
     const Rectangle& region,
     const Point& dst_position) {
 
-  SubSurfaceNodePtr node(new SubSurfaceNode(
+  // The node shares the subsurfaces of the source instead of copying them.
+  const std::shared_ptr<SubSurfaceList>& src_subsurfaces = src_surface->subsurfaces;
+  SubSurfaceNodePtr node = std::allocate_shared<SubSurfaceNode>(
+      RecyclingAllocator<SubSurfaceNode>(),
       src_surface,
       region,
       Rectangle(dst_position),
-      src_surface->subsurfaces
-  ));
+      src_subsurfaces,
+      src_subsurfaces != nullptr ? src_subsurfaces->size() : 0
+  );
 
   // Clear the subsurface queue if the current dst_surface has already been rendered.
   if (is_rendered) {
     clear_subsurfaces();
   }
 
-  subsurfaces.push_back(node);
+  if (subsurfaces == nullptr) {
+    subsurfaces = std::allocate_shared<SubSurfaceList>(
+        RecyclingAllocator<SubSurfaceList>()
+    );
+  }
+  subsurfaces->push_back(node);
 }
 
 /**
@@ -592,7 +894,14 @@ void Surface::add_subsurface(
  */
 void Surface::clear_subsurfaces() {
 
-  subsurfaces.clear();
+  if (subsurfaces.use_count() == 1) {
+    // Nobody else uses the list: keep its memory.
+    subsurfaces->clear();
+  }
+  else {
+    // Nodes still use it: start a new one.
+    subsurfaces = nullptr;
+  }
 }
 
 /**
@@ -624,20 +933,21 @@ void Surface::raw_draw_region(
     if (dst_surface.internal_surface == nullptr) {
       dst_surface.create_software_surface();
     }
+    dst_surface.detach_software_surface();
 
     // First, draw subsurfaces if any.
     // They can exist if the video mode recently switched from an accelerated
     // one to a software one.
-    if (!subsurfaces.empty()) {
+    if (subsurfaces != nullptr && !subsurfaces->empty()) {
 
       if (this->internal_surface == nullptr) {
         create_software_surface();
       }
 
-      std::vector<SubSurfaceNodePtr> subsurfaces = this->subsurfaces;
-      this->subsurfaces.clear();  // Avoid infinite recursive calls if there are cycles.
+      // Avoid infinite recursive calls if there are cycles.
+      std::shared_ptr<SubSurfaceList> subsurfaces = std::move(this->subsurfaces);
 
-      for (SubSurfaceNodePtr& subsurface: subsurfaces) {
+      for (const SubSurfaceNodePtr& subsurface: *subsurfaces) {
 
         // TODO draw the subsurfaces of the whole tree recursively instead.
         // The current version is not correct because it handles only one level
@@ -648,7 +958,6 @@ void Surface::raw_draw_region(
             *this,
             subsurface->dst_rect.get_xy()
         );
-        subsurface = nullptr;
       }
       clear_subsurfaces();
     }
@@ -730,6 +1039,7 @@ void Surface::apply_pixel_filter(
   Debug::check_assertion(dst_surface.get_height() == get_height() * factor,
       "Wrong destination surface size");
 
+  dst_surface.detach_software_surface();
   SDL_Surface* src_internal_surface = this->internal_surface.get();
   SDL_Surface* dst_internal_surface = dst_surface.internal_surface.get();
 
@@ -759,42 +1069,73 @@ void Surface::apply_pixel_filter(
 /**
  * \brief Draws the internal texture if any, and all subtextures on the
  * renderer.
+ *
+ * The whole tree of subsurfaces is first flattened into a list of drawing
+ * commands, which are then performed in a single pass.
+ *
  * \param renderer The renderer where to draw.
  */
 void Surface::render(SDL_Renderer* renderer) {
 
   const Rectangle size(get_size());
-  render(renderer, size, size, size, 255, subsurfaces);
+  render_commands.clear();
+  add_render_commands(
+      size,
+      size,
+      size,
+      255,
+      subsurfaces.get(),
+      subsurfaces != nullptr ? subsurfaces->size() : 0
+  );
+  submit_render_commands(renderer);
 }
 
 /**
- * \brief Renders the internal texture if any, and all subsurfaces that are
- * drawn onto it.
- * \param renderer The renderer where to draw.
+ * \brief Returns the number of drawing operations of the last rendered
+ * frame, before consecutive texture copies were merged.
+ * \return The number of drawing commands recorded.
+ */
+int Surface::get_num_render_commands() {
+  return num_render_commands;
+}
+
+/**
+ * \brief Returns the number of SDL_RenderCopy() calls of the last rendered
+ * frame.
+ * \return The number of texture copies actually performed.
+ */
+int Surface::get_num_render_copies() {
+  return num_render_copies;
+}
+
+/**
+ * \brief Records the drawing of the internal texture if any, and of all
+ * subsurfaces that are drawn onto it.
  * \param src_rect The subrectangle of the texture to draw.
  * \param dst_rect The position where to draw on the renderer.
  * \param clip_rect A portion of the renderer where to restrict the drawing.
  * \param opacity The opacity of the parent surface.
- * \param subsurfaces The subsurfaces drawn onto this texture. They will be
- * renderered recursively.
+ * \param subsurfaces The subsurfaces drawn onto this texture (possibly nullptr).
+ * They will be recorded recursively.
+ * \param num_subsurfaces Number of elements of subsurfaces to record.
  */
-void Surface::render(
-    SDL_Renderer* renderer,
+void Surface::add_render_commands(
     const Rectangle& src_rect,
     const Rectangle& dst_rect,
     const Rectangle& clip_rect,
     uint8_t opacity,
-    const std::vector<SubSurfaceNodePtr>& subsurfaces
+    const SubSurfaceList* subsurfaces,
+    size_t num_subsurfaces
 ) {
 
   //FIXME SDL_RenderSetClipRect is buggy for now, but should be fixed soon.
   // It means that software and hardware surface doesn't have the exact same behavior for now.
-  // Uncomment the two lines using it when https://bugzilla.libsdl.org/show_bug.cgi?id=2336 will be solved.
+  // Use clip_rect for textures when https://bugzilla.libsdl.org/show_bug.cgi?id=2336 will be solved.
 
   // Accelerate the internal software surface.
   if (internal_surface != nullptr) {
 
-    if (internal_texture == nullptr) {
+    if (internal_texture == nullptr && atlas_region == nullptr) {
       create_texture_from_surface();
     }
 
@@ -802,14 +1143,7 @@ void Surface::render(
     else if (
         (software_destination || !Video::is_acceleration_enabled())
          && !is_rendered) {
-      convert_software_surface();
-      SDL_UpdateTexture(
-          internal_texture.get(),
-          nullptr,
-          internal_surface->pixels,
-          internal_surface->pitch
-      );
-      SDL_GetSurfaceAlphaMod(internal_surface.get(), &internal_opacity);
+      update_texture_from_surface();
     }
   }
 
@@ -817,38 +1151,44 @@ void Surface::render(
 
   // Draw the internal color as background color.
   if (internal_color != nullptr) {
-    uint8_t r, g, b, a;
-    internal_color->get_components(r, g, b, a);
-
-    SDL_SetRenderDrawColor(renderer, r, g, b, std::min((uint8_t) a, current_opacity));
-    //SDL_RenderSetClipRect(renderer, clip_rect.get_internal_rect());
-    SDL_RenderFillRect(renderer, clip_rect.get_internal_rect());
+    RenderCommand command;
+    uint8_t a;
+    internal_color->get_components(command.r, command.g, command.b, a);
+    command.texture = nullptr;
+    command.dst_rect = clip_rect;
+    command.alpha = std::min(a, current_opacity);
+    render_commands.push_back(command);
   }
 
   // Draw the internal texture.
-  if (internal_texture != nullptr) {
-    SDL_SetTextureAlphaMod(internal_texture.get(), current_opacity);
-    //SDL_RenderSetClipRect(renderer, clip_rect.get_internal_rect());
-
-    SDL_RenderCopy(
-        renderer,
-        internal_texture.get(),
-        src_rect.get_internal_rect(),
-        dst_rect.get_internal_rect()
-    );
+  SDL_Texture* texture = internal_texture.get();
+  Rectangle texture_src_rect = src_rect;
+  if (atlas_region != nullptr) {
+    texture = atlas_region->get_texture();
+    texture_src_rect.add_xy(atlas_region->get_position());
+  }
+  if (texture != nullptr) {
+    RenderCommand command;
+    command.texture = texture;
+    command.src_rect = texture_src_rect;
+    command.dst_rect = dst_rect;
+    command.r = command.g = command.b = 0;
+    command.alpha = current_opacity;
+    render_commands.push_back(command);
   }
 
-  // The surface is rendered. Now draw all subtextures.
-  for (const SubSurfaceNodePtr& subsurface: subsurfaces) {
+  // The surface is recorded. Now record all subtextures.
+  for (size_t i = 0; i < num_subsurfaces; ++i) {
 
     // subsurface has to be drawn on this surface
+    const SubSurfaceNode& subsurface = *(*subsurfaces)[i];
 
     // Calculate absolute destination subrectangle position on screen.
     Rectangle subsurface_dst_rect(
-        dst_rect.get_x() + subsurface->dst_rect.get_x() - src_rect.get_x(),
-        dst_rect.get_y() + subsurface->dst_rect.get_y() - src_rect.get_y(),
-        subsurface->src_rect.get_width(),
-        subsurface->src_rect.get_height()
+        dst_rect.get_x() + subsurface.dst_rect.get_x() - src_rect.get_x(),
+        dst_rect.get_y() + subsurface.dst_rect.get_y() - src_rect.get_y(),
+        subsurface.src_rect.get_width(),
+        subsurface.src_rect.get_height()
     );
 
     // Set the intersection of the subsurface destination and this surface's clip as clipping rectangle.
@@ -857,14 +1197,14 @@ void Surface::render(
         clip_rect.get_internal_rect(),
         superimposed_clip_rect.get_internal_rect())) {
 
-      // If there is an intersection, render the subsurface.
-      subsurface->src_surface->render(
-          renderer,
-          subsurface->src_rect,
+      // If there is an intersection, record the subsurface.
+      subsurface.src_surface->add_render_commands(
+          subsurface.src_rect,
           subsurface_dst_rect,
           superimposed_clip_rect,
           current_opacity,
-          subsurface->subsurfaces
+          subsurface.subsurfaces.get(),
+          subsurface.num_subsurfaces
       );
     }
   }
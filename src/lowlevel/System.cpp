@@ -17,6 +17,7 @@
 #include "solarus/lowlevel/Color.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/FontResource.h"
+#include "solarus/lowlevel/ImageCache.h"
 #include "solarus/lowlevel/InputEvent.h"
 #include "solarus/lowlevel/Random.h"
 #include "solarus/lowlevel/Sound.h"
@@ -62,6 +63,7 @@ void System::initialize(const Arguments& args) {
 
   // video
   Video::initialize(args);
+  ImageCache::initialize(args);
   FontResource::initialize();
   Sprite::initialize();
 }
@@ -78,6 +80,7 @@ void System::quit() {
   Sound::quit();
   Sprite::quit();
   FontResource::quit();
+  ImageCache::quit();
   Video::quit();
   QuestFiles::quit();
 
@@ -0,0 +1,484 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/TextureAtlas.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Video.h"
+#include <SDL_render.h>
+#include <algorithm>
+#include <vector>
+
+namespace Solarus {
+
+namespace {
+
+constexpr int max_page_size = 2048;  /**< Size of the pages if the renderer supports it. */
+constexpr int padding = 1;           /**< Transparent pixels around each image to avoid
+                                      * bleeding with neighbors when scaling. */
+
+}
+
+/**
+ * \brief A large texture with images packed in horizontal shelves.
+ *
+ * Each image goes in the shelf that best fits its height.
+ * The space of removed images is reused when their whole shelf becomes
+ * empty.
+ */
+class TextureAtlas::Page {
+
+  public:
+
+    /**
+     * \brief Creates an empty page.
+     * \param renderer The renderer of the texture.
+     * \param size Width and height of the page in pixels.
+     */
+    Page(SDL_Renderer* renderer, int size):
+      texture(nullptr),
+      size(size),
+      bytes_per_pixel(Video::get_pixel_format()->BytesPerPixel),
+      next_shelf_y(0),
+      num_images(0),
+      used_area(0),
+      in_atlas(true) {
+
+      texture = SDL_CreateTexture(
+          renderer,
+          Video::get_pixel_format()->format,
+          SDL_TEXTUREACCESS_STATIC,
+          size,
+          size
+      );
+      Debug::check_assertion(texture != nullptr,
+          std::string("Failed to create a texture atlas page: ") + SDL_GetError());
+      SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+      // Initial pixels are undefined: each shelf is cleared when it opens.
+    }
+
+    ~Page() {
+      destroy_texture();
+    }
+
+    Page(const Page& other) = delete;
+    Page& operator=(const Page& other) = delete;
+
+    /**
+     * \brief Returns the texture of this page.
+     * \return The texture, or nullptr if the atlas was destroyed.
+     */
+    SDL_Texture* get_texture() const {
+      return texture;
+    }
+
+    /**
+     * \brief Destroys the texture of this page.
+     *
+     * Must be called before the renderer is destroyed.
+     * The page is then no longer part of the atlas.
+     */
+    void destroy_texture() {
+
+      if (texture != nullptr) {
+        SDL_DestroyTexture(texture);
+        texture = nullptr;
+      }
+      detach();
+    }
+
+    /**
+     * \brief Marks this page as no longer part of the list of pages.
+     */
+    void detach() {
+      in_atlas = false;
+    }
+
+    /**
+     * \brief Returns whether this page is still in the list of pages.
+     * \return \c false after the atlas was destroyed.
+     */
+    bool is_in_atlas() const {
+      return in_atlas;
+    }
+
+    /**
+     * \brief Returns the width and height of this page.
+     * \return The size of the page in pixels.
+     */
+    int get_size() const {
+      return size;
+    }
+
+    /**
+     * \brief Returns the GPU memory used by this page.
+     * \return The size of the texture in bytes.
+     */
+    int get_memory_size() const {
+      return size * size * bytes_per_pixel;
+    }
+
+    /**
+     * \brief Returns the area of images stored in this page.
+     * \return The area in pixels, padding excluded.
+     */
+    int get_used_area() const {
+      return used_area;
+    }
+
+    /**
+     * \brief Returns whether this page contains no image.
+     * \return \c true if the page is empty.
+     */
+    bool is_empty() const {
+      return num_images == 0;
+    }
+
+    /**
+     * \brief Finds some space for an image in this page.
+     * \param width Width of the image.
+     * \param height Height of the image.
+     * \param[out] rectangle Position of the image in the page.
+     * \return \c false if there is not enough space.
+     */
+    bool allocate(int width, int height, Rectangle& rectangle) {
+
+      const int padded_width = width + 2 * padding;
+      const int padded_height = height + 2 * padding;
+
+      // Find the shelf that wastes the least height.
+      Shelf* best_shelf = nullptr;
+      for (Shelf& shelf : shelves) {
+        if (shelf.height >= padded_height &&
+            shelf.next_x + padded_width <= size &&
+            (best_shelf == nullptr || shelf.height < best_shelf->height)) {
+          best_shelf = &shelf;
+        }
+      }
+
+      if (best_shelf == nullptr) {
+        // Open a new shelf.
+        if (next_shelf_y + padded_height > size ||
+            padded_width > size) {
+          return false;
+        }
+        shelves.push_back({ next_shelf_y, padded_height, 0, 0 });
+        next_shelf_y += padded_height;
+        best_shelf = &shelves.back();
+        clear_shelf(*best_shelf);
+      }
+
+      rectangle = Rectangle(
+          best_shelf->next_x + padding,
+          best_shelf->y + padding,
+          width,
+          height
+      );
+      best_shelf->next_x += padded_width;
+      ++best_shelf->num_images;
+      ++num_images;
+      used_area += width * height;
+      return true;
+    }
+
+    /**
+     * \brief Releases the space of an image.
+     *
+     * The space becomes available again when its shelf is empty.
+     *
+     * \param rectangle Position of the image in the page.
+     */
+    void release(const Rectangle& rectangle) {
+
+      Debug::check_assertion(num_images > 0, "No image in this atlas page");
+
+      --num_images;
+      used_area -= rectangle.get_width() * rectangle.get_height();
+
+      const auto it = std::find_if(shelves.begin(), shelves.end(),
+          [&](const Shelf& shelf) {
+        return rectangle.get_y() >= shelf.y &&
+            rectangle.get_y() < shelf.y + shelf.height;
+      });
+      Debug::check_assertion(it != shelves.end() && it->num_images > 0,
+          "No such image in this atlas page");
+
+      --it->num_images;
+      if (it->num_images > 0) {
+        return;
+      }
+
+      // Keep the shelf for images of a similar height.
+      it->next_x = 0;
+      clear_shelf(*it);
+
+      // Give the height of empty shelves at the bottom back to the page.
+      // Shelves are ordered by y.
+      while (!shelves.empty() && shelves.back().num_images == 0) {
+        next_shelf_y = shelves.back().y;
+        shelves.pop_back();
+      }
+    }
+
+  private:
+
+    /**
+     * \brief A row of images of similar heights.
+     */
+    struct Shelf {
+      int y;           /**< Y coordinate of the shelf in the page. */
+      int height;      /**< Height of the shelf, padding included. */
+      int next_x;      /**< X coordinate of the free space of the shelf. */
+      int num_images;  /**< Number of images in the shelf. */
+    };
+
+    /**
+     * \brief Makes all pixels of a shelf transparent.
+     *
+     * The texture is updated one row at a time to avoid allocating a
+     * buffer of the size of the shelf.
+     *
+     * \param shelf The shelf to clear.
+     */
+    void clear_shelf(const Shelf& shelf) {
+
+      if (texture == nullptr) {
+        return;
+      }
+
+      const std::vector<uint8_t> transparent_row(size * bytes_per_pixel, 0);
+      SDL_Rect row_rect;
+      row_rect.x = 0;
+      row_rect.w = size;
+      row_rect.h = 1;
+      for (int y = shelf.y; y < shelf.y + shelf.height; ++y) {
+        row_rect.y = y;
+        SDL_UpdateTexture(texture, &row_rect, transparent_row.data(), size * bytes_per_pixel);
+      }
+    }
+
+    SDL_Texture* texture;          /**< The GPU texture of this page. */
+    int size;                      /**< Width and height of the texture. */
+    int bytes_per_pixel;           /**< Bytes per pixel of the texture format. */
+    std::vector<Shelf> shelves;    /**< Rows of images from top to bottom. */
+    int next_shelf_y;              /**< Y coordinate of the next shelf to open. */
+    int num_images;                /**< Number of images in this page. */
+    int used_area;                 /**< Area of the images in this page, padding excluded. */
+    bool in_atlas;                 /**< Whether the page is still in the list of pages. */
+
+};
+
+namespace {
+
+/**
+ * \brief The pages containing at least one image.
+ *
+ * Regions may outlive this list during static destruction:
+ * pages are then detached so that regions do not touch it anymore.
+ */
+struct PageList {
+
+  std::vector<std::shared_ptr<TextureAtlas::Page>> pages;
+
+  ~PageList() {
+    for (const std::shared_ptr<TextureAtlas::Page>& page : pages) {
+      page->detach();
+    }
+  }
+
+};
+
+PageList page_list;
+std::vector<std::shared_ptr<TextureAtlas::Page>>& pages = page_list.pages;
+
+}
+
+/**
+ * \brief Creates a region of the atlas.
+ * \param page The page containing the image.
+ * \param rectangle Position and size of the image in the page.
+ */
+TextureAtlas::Region::Region(
+    const std::shared_ptr<Page>& page,
+    const Rectangle& rectangle):
+  page(page),
+  rectangle(rectangle) {
+
+}
+
+/**
+ * \brief Destroys this region and releases its space.
+ *
+ * The page is destroyed if it becomes empty.
+ */
+TextureAtlas::Region::~Region() {
+
+  page->release(rectangle);
+  if (page->is_empty() && page->is_in_atlas()) {
+    // After quit() or during static destruction, the list of pages may not
+    // exist anymore: only touch it while the page is in it.
+    pages.erase(std::remove(pages.begin(), pages.end(), page), pages.end());
+  }
+}
+
+/**
+ * \brief Returns the texture containing this image.
+ * \return The texture of the page, or nullptr if the atlas was destroyed.
+ */
+SDL_Texture* TextureAtlas::Region::get_texture() const {
+  return page->get_texture();
+}
+
+/**
+ * \brief Returns the position of this image in the texture.
+ * \return Coordinates of the upper-left corner of the image in the page.
+ */
+Point TextureAtlas::Region::get_position() const {
+  return rectangle.get_xy();
+}
+
+/**
+ * \brief Copies the pixels of an image to this region.
+ * \param surface The image. It must have the size of the region and the
+ * pixel format of the video system.
+ */
+void TextureAtlas::Region::update(SDL_Surface& surface) {
+
+  SDL_Texture* texture = page->get_texture();
+  if (texture == nullptr) {
+    return;
+  }
+
+  Debug::check_assertion(
+      surface.w == rectangle.get_width() && surface.h == rectangle.get_height(),
+      "Wrong image size for this texture atlas region");
+
+  SDL_Rect dst_rect;
+  dst_rect.x = rectangle.get_x();
+  dst_rect.y = rectangle.get_y();
+  dst_rect.w = rectangle.get_width();
+  dst_rect.h = rectangle.get_height();
+  SDL_UpdateTexture(texture, &dst_rect, surface.pixels, surface.pitch);
+}
+
+/**
+ * \brief Stores an image in the atlas.
+ * \param surface The image to store. It must have the pixel format of the
+ * video system.
+ * \return The region of the atlas where the image was stored, or nullptr if
+ * the image is too big or if there is no renderer.
+ */
+TextureAtlas::RegionPtr TextureAtlas::add_image(SDL_Surface& surface) {
+
+  SDL_Renderer* renderer = Video::get_renderer();
+  if (renderer == nullptr) {
+    return nullptr;
+  }
+
+  int page_size = max_page_size;
+  SDL_RendererInfo renderer_info;
+  if (SDL_GetRendererInfo(renderer, &renderer_info) == 0) {
+    if (renderer_info.max_texture_width > 0) {
+      page_size = std::min(page_size, renderer_info.max_texture_width);
+    }
+    if (renderer_info.max_texture_height > 0) {
+      page_size = std::min(page_size, renderer_info.max_texture_height);
+    }
+  }
+
+  if (surface.w + 2 * padding > page_size ||
+      surface.h + 2 * padding > page_size) {
+    // Too big: the image will have its own texture.
+    return nullptr;
+  }
+
+  Rectangle rectangle;
+  std::shared_ptr<Page> page;
+  for (const std::shared_ptr<Page>& candidate : pages) {
+    if (candidate->allocate(surface.w, surface.h, rectangle)) {
+      page = candidate;
+      break;
+    }
+  }
+
+  if (page == nullptr) {
+    // All pages are full.
+    page = std::make_shared<Page>(renderer, page_size);
+    pages.push_back(page);
+    page->allocate(surface.w, surface.h, rectangle);
+  }
+
+  RegionPtr region(new Region(page, rectangle));
+  region->update(surface);
+  return region;
+}
+
+/**
+ * \brief Destroys the textures of all pages.
+ *
+ * Must be called before the renderer is destroyed.
+ * Existing regions remain valid but have no texture anymore.
+ */
+void TextureAtlas::quit() {
+
+  for (const std::shared_ptr<Page>& page : pages) {
+    page->destroy_texture();
+  }
+  pages.clear();
+}
+
+/**
+ * \brief Returns the number of pages of the atlas.
+ * \return The number of textures allocated for the atlas.
+ */
+int TextureAtlas::get_num_pages() {
+  return (int) pages.size();
+}
+
+/**
+ * \brief Returns the GPU memory used by the pages of the atlas.
+ * \return The size of all pages in bytes.
+ */
+int TextureAtlas::get_memory_size() {
+
+  int memory_size = 0;
+  for (const std::shared_ptr<Page>& page : pages) {
+    memory_size += page->get_memory_size();
+  }
+  return memory_size;
+}
+
+/**
+ * \brief Returns the proportion of the atlas that is used by images.
+ * \return The area of images divided by the area of pages, between 0 and 1.
+ */
+double TextureAtlas::get_fill_ratio() {
+
+  int used_area = 0;
+  int total_area = 0;
+  for (const std::shared_ptr<Page>& page : pages) {
+    used_area += page->get_used_area();
+    total_area += page->get_size() * page->get_size();
+  }
+
+  if (total_area == 0) {
+    return 0.0;
+  }
+  return (double) used_area / total_area;
+}
+
+}
+
@@ -19,6 +19,7 @@
 #include "solarus/lowlevel/Rectangle.h"
 #include "solarus/lowlevel/Size.h"
 #include "solarus/lowlevel/Surface.h"
+#include "solarus/lowlevel/TextureAtlas.h"
 #include "solarus/lowlevel/Color.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Debug.h"
@@ -276,6 +277,8 @@ void Video::quit() {
 
   all_video_modes.clear();
 
+  TextureAtlas::quit();
+
   if (pixel_format != nullptr) {
     SDL_FreeFormat(pixel_format);
     pixel_format = nullptr;
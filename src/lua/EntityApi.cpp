@@ -49,6 +49,7 @@
 #include "solarus/Map.h"
 #include "solarus/Savegame.h"
 #include "solarus/Sprite.h"
+#include <algorithm>
 #include <sstream>
 
 namespace Solarus {
@@ -112,6 +113,7 @@ void LuaContext::register_entity_module() {
       { "get_bounding_box", entity_api_get_bounding_box },\
       { "overlaps", entity_api_overlaps },\
       { "get_distance", entity_api_get_distance },\
+      { "get_nearby_entities", entity_api_get_nearby_entities },\
       { "get_angle", entity_api_get_angle },\
       { "get_direction4_to", entity_api_get_direction4_to },\
       { "get_direction8_to", entity_api_get_direction8_to },\
@@ -559,6 +561,82 @@ void LuaContext::push_entity(lua_State* l, MapEntity& entity) {
   push_userdata(l, entity);
 }
 
+/**
+ * \brief Pushes a function that iterates over entities onto the stack.
+ *
+ * Each call of the function returns the next entity, and nil at the end.
+ * This is meant to be used in generic for loops.
+ *
+ * \param l A Lua context.
+ * \param entities The entities to iterate over.
+ */
+void LuaContext::push_entity_iterator(
+    lua_State* l, const std::vector<MapEntity*>& entities) {
+
+  lua_createtable(l, static_cast<int>(entities.size()), 0);
+  int i = 0;
+  for (MapEntity* entity: entities) {
+    push_entity(l, *entity);
+    lua_rawseti(l, -2, ++i);
+  }
+  lua_pushinteger(l, 0);
+  lua_pushcclosure(l, l_entity_iterator_next, 2);
+}
+
+/**
+ * \brief Keeps only the entities matching the optional type and layer
+ * arguments of a function.
+ *
+ * Arguments at index and index + 1 are an entity type name and a layer.
+ * Each of them may be nil or missing to accept any value.
+ *
+ * \param l A Lua context.
+ * \param index Index of the type argument in the stack.
+ * \param entities The entities to filter.
+ */
+void LuaContext::filter_entities(
+    lua_State* l, int index, std::vector<MapEntity*>& entities) {
+
+  if (!lua_isnoneornil(l, index)) {
+    const EntityType type = LuaTools::check_enum<EntityType>(
+        l, index, EntityTypeInfo::get_entity_type_names()
+    );
+    entities.erase(std::remove_if(entities.begin(), entities.end(),
+        [type](const MapEntity* entity) {
+          return entity->get_type() != type;
+        }), entities.end());
+  }
+
+  if (!lua_isnoneornil(l, index + 1)) {
+    const Layer layer = LuaTools::check_layer(l, index + 1);
+    entities.erase(std::remove_if(entities.begin(), entities.end(),
+        [layer](const MapEntity* entity) {
+          return entity->get_layer() != layer;
+        }), entities.end());
+  }
+}
+
+/**
+ * \brief Iterator function created by push_entity_iterator().
+ *
+ * Upvalues: array of entities, index of the last entity returned.
+ *
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::l_entity_iterator_next(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const int index = static_cast<int>(lua_tointeger(l, lua_upvalueindex(2))) + 1;
+    lua_rawgeti(l, lua_upvalueindex(1), index);
+    if (!lua_isnil(l, -1)) {
+      lua_pushinteger(l, index);
+      lua_replace(l, lua_upvalueindex(2));
+    }
+    return 1;
+  });
+}
+
 /**
  * \brief Returns the Lua metatable name corresponding to a type of map entity.
  * \param entity_type A type of map entity.
@@ -934,6 +1012,29 @@ int LuaContext::entity_api_get_distance(lua_State* l) {
   });
 }
 
+/**
+ * \brief Implementation of entity:get_nearby_entities().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::entity_api_get_nearby_entities(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    MapEntity& entity = *check_entity(l, 1);
+    const int radius = LuaTools::check_int(l, 2);
+
+    std::vector<MapEntity*> entities;
+    entity.get_map().get_entities().get_entities_in_radius(
+        entity.get_xy(), radius, entities
+    );
+    entities.erase(std::remove(entities.begin(), entities.end(), &entity), entities.end());
+    filter_entities(l, 3, entities);
+
+    push_entity_iterator(l, entities);
+    return 1;
+  });
+}
+
 /**
  * \brief Implementation of entity:get_angle().
  * \param l The Lua context that is calling this function.
@@ -4818,10 +4919,7 @@ int LuaContext::custom_entity_api_set_modified_ground(lua_State* l) {
  */
 void LuaContext::entity_on_update(MapEntity& entity) {
 
-  // This particular method is tried so often that we want to optimize
-  // the std::string construction.
-  static const std::string method_name = "on_update";
-  if (!userdata_has_field(entity, method_name)) {
+  if (!userdata_has_field(entity, LuaEvent::ON_UPDATE)) {
     return;
   }
 
@@ -4840,7 +4938,7 @@ void LuaContext::entity_on_update(MapEntity& entity) {
  */
 void LuaContext::entity_on_suspended(MapEntity& entity, bool suspended) {
 
-  if (!userdata_has_field(entity, "on_suspended")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_SUSPENDED)) {
     return;
   }
 
@@ -4858,7 +4956,7 @@ void LuaContext::entity_on_suspended(MapEntity& entity, bool suspended) {
  */
 void LuaContext::entity_on_created(MapEntity& entity) {
 
-  if (!userdata_has_field(entity, "on_created")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_CREATED)) {
     return;
   }
 
@@ -4877,7 +4975,7 @@ void LuaContext::entity_on_created(MapEntity& entity) {
 void LuaContext::entity_on_removed(MapEntity& entity) {
 
   push_entity(l, entity);
-  if (userdata_has_field(entity, "on_removed")) {
+  if (userdata_has_field(entity, LuaEvent::ON_REMOVED)) {
     on_removed();
   }
   remove_timers(-1);  // Stop timers associated to this entity.
@@ -4893,7 +4991,7 @@ void LuaContext::entity_on_removed(MapEntity& entity) {
  */
 void LuaContext::entity_on_enabled(MapEntity& entity) {
 
-  if (!userdata_has_field(entity, "on_enabled")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_ENABLED)) {
     return;
   }
 
@@ -4911,7 +5009,7 @@ void LuaContext::entity_on_enabled(MapEntity& entity) {
  */
 void LuaContext::entity_on_disabled(MapEntity& entity) {
 
-  if (!userdata_has_field(entity, "on_disabled")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_DISABLED)) {
     return;
   }
 
@@ -4929,7 +5027,7 @@ void LuaContext::entity_on_disabled(MapEntity& entity) {
  */
 void LuaContext::entity_on_pre_draw(MapEntity& entity) {
 
-  if (!userdata_has_field(entity, "on_pre_draw")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_PRE_DRAW)) {
     return;
   }
 
@@ -4947,7 +5045,7 @@ void LuaContext::entity_on_pre_draw(MapEntity& entity) {
  */
 void LuaContext::entity_on_post_draw(MapEntity& entity) {
 
-  if (!userdata_has_field(entity, "on_post_draw")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_POST_DRAW)) {
     return;
   }
 
@@ -4968,7 +5066,7 @@ void LuaContext::entity_on_post_draw(MapEntity& entity) {
 void LuaContext::entity_on_position_changed(
     MapEntity& entity, const Point& xy, Layer layer) {
 
-  if (!userdata_has_field(entity, "on_position_changed")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_POSITION_CHANGED)) {
     return;
   }
 
@@ -4988,7 +5086,7 @@ void LuaContext::entity_on_position_changed(
 void LuaContext::entity_on_obstacle_reached(
     MapEntity& entity, Movement& movement) {
 
-  if (!userdata_has_field(entity, "on_obstacle_reached")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_OBSTACLE_REACHED)) {
     return;
   }
 
@@ -5008,7 +5106,7 @@ void LuaContext::entity_on_obstacle_reached(
 void LuaContext::entity_on_movement_changed(
     MapEntity& entity, Movement& movement) {
 
-  if (!userdata_has_field(entity, "on_movement_changed")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_MOVEMENT_CHANGED)) {
     return;
   }
 
@@ -5026,7 +5124,7 @@ void LuaContext::entity_on_movement_changed(
  */
 void LuaContext::entity_on_movement_finished(MapEntity& entity) {
 
-  if (!userdata_has_field(entity, "on_movement_finished")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_MOVEMENT_FINISHED)) {
     return;
   }
 
@@ -5045,7 +5143,7 @@ void LuaContext::entity_on_movement_finished(MapEntity& entity) {
  */
 bool LuaContext::entity_on_interaction(MapEntity& entity) {
 
-  if (!userdata_has_field(entity, "on_interaction")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_INTERACTION)) {
     return false;
   }
 
@@ -5068,7 +5166,7 @@ bool LuaContext::entity_on_interaction(MapEntity& entity) {
 bool LuaContext::entity_on_interaction_item(
     MapEntity& entity, EquipmentItem& item_used) {
 
-  if (!userdata_has_field(entity, "on_interaction_item")) {
+  if (!userdata_has_field(entity, LuaEvent::ON_INTERACTION_ITEM)) {
     return false;
   }
 
@@ -5089,7 +5187,7 @@ bool LuaContext::entity_on_interaction_item(
 void LuaContext::hero_on_state_changed(
     Hero& hero, const std::string& state_name) {
 
-  if (!userdata_has_field(hero, "on_state_changed")) {
+  if (!userdata_has_field(hero, LuaEvent::ON_STATE_CHANGED)) {
     return;
   }
 
@@ -5109,7 +5207,7 @@ void LuaContext::hero_on_state_changed(
  */
 bool LuaContext::hero_on_taking_damage(Hero& hero, int damage) {
 
-  if (!userdata_has_field(hero, "on_taking_damage")) {
+  if (!userdata_has_field(hero, LuaEvent::ON_TAKING_DAMAGE)) {
     return false;
   }
 
@@ -5128,7 +5226,7 @@ bool LuaContext::hero_on_taking_damage(Hero& hero, int damage) {
  */
 void LuaContext::destination_on_activated(Destination& destination) {
 
-  if (!userdata_has_field(destination, "on_activated")) {
+  if (!userdata_has_field(destination, LuaEvent::ON_ACTIVATED)) {
     return;
   }
 
@@ -5146,7 +5244,7 @@ void LuaContext::destination_on_activated(Destination& destination) {
  */
 void LuaContext::teletransporter_on_activated(Teletransporter& teletransporter) {
 
-  if (!userdata_has_field(teletransporter, "on_activated")) {
+  if (!userdata_has_field(teletransporter, LuaEvent::ON_ACTIVATED)) {
     return;
   }
 
@@ -5164,7 +5262,7 @@ void LuaContext::teletransporter_on_activated(Teletransporter& teletransporter)
  */
 void LuaContext::npc_on_collision_fire(Npc& npc) {
 
-  if (!userdata_has_field(npc, "on_collision_fire")) {
+  if (!userdata_has_field(npc, LuaEvent::ON_COLLISION_FIRE)) {
     return;
   }
 
@@ -5182,7 +5280,7 @@ void LuaContext::npc_on_collision_fire(Npc& npc) {
  */
 void LuaContext::block_on_moving(Block& block) {
 
-  if (!userdata_has_field(block, "on_moving")) {
+  if (!userdata_has_field(block, LuaEvent::ON_MOVING)) {
     return;
   }
 
@@ -5200,7 +5298,7 @@ void LuaContext::block_on_moving(Block& block) {
  */
 void LuaContext::block_on_moved(Block& block) {
 
-  if (!userdata_has_field(block, "on_moved")) {
+  if (!userdata_has_field(block, LuaEvent::ON_MOVED)) {
     return;
   }
 
@@ -5219,7 +5317,7 @@ void LuaContext::block_on_moved(Block& block) {
  */
 bool LuaContext::chest_on_empty(Chest& chest) {
 
-  if (!userdata_has_field(chest, "on_empty")) {
+  if (!userdata_has_field(chest, LuaEvent::ON_EMPTY)) {
     return false;
   }
 
@@ -5238,7 +5336,7 @@ bool LuaContext::chest_on_empty(Chest& chest) {
  */
 void LuaContext::switch_on_activated(Switch& sw) {
 
-  if (!userdata_has_field(sw, "on_activated")) {
+  if (!userdata_has_field(sw, LuaEvent::ON_ACTIVATED)) {
     return;
   }
 
@@ -5256,7 +5354,7 @@ void LuaContext::switch_on_activated(Switch& sw) {
  */
 void LuaContext::switch_on_inactivated(Switch& sw) {
 
-  if (!userdata_has_field(sw, "on_inactivated")) {
+  if (!userdata_has_field(sw, LuaEvent::ON_INACTIVATED)) {
     return;
   }
 
@@ -5274,7 +5372,7 @@ void LuaContext::switch_on_inactivated(Switch& sw) {
  */
 void LuaContext::switch_on_left(Switch& sw) {
 
-  if (!userdata_has_field(sw, "on_left")) {
+  if (!userdata_has_field(sw, LuaEvent::ON_LEFT)) {
     return;
   }
 
@@ -5292,7 +5390,7 @@ void LuaContext::switch_on_left(Switch& sw) {
  */
 void LuaContext::sensor_on_activated(Sensor& sensor) {
 
-  if (!userdata_has_field(sensor, "on_activated")) {
+  if (!userdata_has_field(sensor, LuaEvent::ON_ACTIVATED)) {
     return;
   }
 
@@ -5310,7 +5408,7 @@ void LuaContext::sensor_on_activated(Sensor& sensor) {
  */
 void LuaContext::sensor_on_activated_repeat(Sensor& sensor) {
 
-  if (!userdata_has_field(sensor, "on_activated_repeat")) {
+  if (!userdata_has_field(sensor, LuaEvent::ON_ACTIVATED_REPEAT)) {
     return;
   }
 
@@ -5325,7 +5423,7 @@ void LuaContext::sensor_on_activated_repeat(Sensor& sensor) {
  */
 void LuaContext::sensor_on_left(Sensor& sensor) {
 
-  if (!userdata_has_field(sensor, "on_left")) {
+  if (!userdata_has_field(sensor, LuaEvent::ON_LEFT)) {
     return;
   }
 
@@ -5343,7 +5441,7 @@ void LuaContext::sensor_on_left(Sensor& sensor) {
  */
 void LuaContext::sensor_on_collision_explosion(Sensor& sensor) {
 
-  if (!userdata_has_field(sensor, "on_collision_explosion")) {
+  if (!userdata_has_field(sensor, LuaEvent::ON_COLLISION_EXPLOSION)) {
     return;
   }
 
@@ -5362,7 +5460,7 @@ void LuaContext::sensor_on_collision_explosion(Sensor& sensor) {
  */
 void LuaContext::separator_on_activating(Separator& separator, int direction4) {
 
-  if (!userdata_has_field(separator, "on_activating")) {
+  if (!userdata_has_field(separator, LuaEvent::ON_ACTIVATING)) {
     return;
   }
 
@@ -5381,7 +5479,7 @@ void LuaContext::separator_on_activating(Separator& separator, int direction4) {
  */
 void LuaContext::separator_on_activated(Separator& separator, int direction4) {
 
-  if (!userdata_has_field(separator, "on_activated")) {
+  if (!userdata_has_field(separator, LuaEvent::ON_ACTIVATED)) {
     return;
   }
 
@@ -5399,7 +5497,7 @@ void LuaContext::separator_on_activated(Separator& separator, int direction4) {
  */
 void LuaContext::door_on_opened(Door& door) {
 
-  if (!userdata_has_field(door, "on_opened")) {
+  if (!userdata_has_field(door, LuaEvent::ON_OPENED)) {
     return;
   }
 
@@ -5417,7 +5515,7 @@ void LuaContext::door_on_opened(Door& door) {
  */
 void LuaContext::door_on_closed(Door& door) {
 
-  if (!userdata_has_field(door, "on_closed")) {
+  if (!userdata_has_field(door, LuaEvent::ON_CLOSED)) {
     return;
   }
 
@@ -5436,7 +5534,7 @@ void LuaContext::door_on_closed(Door& door) {
  */
 bool LuaContext::shop_treasure_on_buying(ShopTreasure& shop_treasure) {
 
-  if (!userdata_has_field(shop_treasure, "on_buying")) {
+  if (!userdata_has_field(shop_treasure, LuaEvent::ON_BUYING)) {
     return true;
   }
 
@@ -5455,7 +5553,7 @@ bool LuaContext::shop_treasure_on_buying(ShopTreasure& shop_treasure) {
  */
 void LuaContext::shop_treasure_on_bought(ShopTreasure& shop_treasure) {
 
-  if (!userdata_has_field(shop_treasure, "on_bought")) {
+  if (!userdata_has_field(shop_treasure, LuaEvent::ON_BOUGHT)) {
     return;
   }
 
@@ -5473,7 +5571,7 @@ void LuaContext::shop_treasure_on_bought(ShopTreasure& shop_treasure) {
  */
 void LuaContext::destructible_on_looked(Destructible& destructible) {
 
-  if (!userdata_has_field(destructible, "on_looked")) {
+  if (!userdata_has_field(destructible, LuaEvent::ON_LOOKED)) {
     return;
   }
 
@@ -5491,7 +5589,7 @@ void LuaContext::destructible_on_looked(Destructible& destructible) {
  */
 void LuaContext::destructible_on_cut(Destructible& destructible) {
 
-  if (!userdata_has_field(destructible, "on_cut")) {
+  if (!userdata_has_field(destructible, LuaEvent::ON_CUT)) {
     return;
   }
 
@@ -5509,7 +5607,7 @@ void LuaContext::destructible_on_cut(Destructible& destructible) {
  */
 void LuaContext::destructible_on_lifting(Destructible& destructible) {
 
-  if (!userdata_has_field(destructible, "on_lifting")) {
+  if (!userdata_has_field(destructible, LuaEvent::ON_LIFTING)) {
     return;
   }
 
@@ -5527,7 +5625,7 @@ void LuaContext::destructible_on_lifting(Destructible& destructible) {
  */
 void LuaContext::destructible_on_exploded(Destructible& destructible) {
 
-  if (!userdata_has_field(destructible, "on_exploded")) {
+  if (!userdata_has_field(destructible, LuaEvent::ON_EXPLODED)) {
     return;
   }
 
@@ -5545,7 +5643,7 @@ void LuaContext::destructible_on_exploded(Destructible& destructible) {
  */
 void LuaContext::destructible_on_regenerating(Destructible& destructible) {
 
-  if (!userdata_has_field(destructible, "on_regenerating")) {
+  if (!userdata_has_field(destructible, LuaEvent::ON_REGENERATING)) {
     return;
   }
 
@@ -5565,7 +5663,7 @@ void LuaContext::enemy_on_restarted(Enemy& enemy) {
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (userdata_has_field(enemy, "on_restarted")) {
+  if (userdata_has_field(enemy, LuaEvent::ON_RESTARTED)) {
     on_restarted();
   }
   lua_pop(l, 1);
@@ -5584,7 +5682,7 @@ void LuaContext::enemy_on_restarted(Enemy& enemy) {
 void LuaContext::enemy_on_collision_enemy(Enemy& enemy,
     Enemy& other_enemy, Sprite& other_sprite, Sprite& this_sprite) {
 
-  if (!userdata_has_field(enemy, "on_collision_enemy")) {
+  if (!userdata_has_field(enemy, LuaEvent::ON_COLLISION_ENEMY)) {
     return;
   }
 
@@ -5605,7 +5703,7 @@ void LuaContext::enemy_on_collision_enemy(Enemy& enemy,
 void LuaContext::enemy_on_custom_attack_received(Enemy& enemy,
     EnemyAttack attack, Sprite* sprite) {
 
-  if (!userdata_has_field(enemy, "on_custom_attack_received")) {
+  if (!userdata_has_field(enemy, LuaEvent::ON_CUSTOM_ATTACK_RECEIVED)) {
     return;
   }
 
@@ -5624,7 +5722,7 @@ void LuaContext::enemy_on_custom_attack_received(Enemy& enemy,
 bool LuaContext::enemy_on_hurt_by_sword(
     Enemy& enemy, Hero& hero, Sprite& enemy_sprite) {
 
-  if (!userdata_has_field(enemy, "on_hurt_by_sword")) {
+  if (!userdata_has_field(enemy, LuaEvent::ON_HURT_BY_SWORD)) {
     return false;
   }
 
@@ -5646,7 +5744,7 @@ void LuaContext::enemy_on_hurt(Enemy& enemy, EnemyAttack attack) {
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (userdata_has_field(enemy, "on_hurt")) {
+  if (userdata_has_field(enemy, LuaEvent::ON_HURT)) {
     on_hurt(attack);
   }
   lua_pop(l, 1);
@@ -5663,7 +5761,7 @@ void LuaContext::enemy_on_dying(Enemy& enemy) {
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (userdata_has_field(enemy, "on_dying")) {
+  if (userdata_has_field(enemy, LuaEvent::ON_DYING)) {
     on_dying();
   }
   lua_pop(l, 1);
@@ -5678,7 +5776,7 @@ void LuaContext::enemy_on_dying(Enemy& enemy) {
  */
 void LuaContext::enemy_on_dead(Enemy& enemy) {
 
-  if (!userdata_has_field(enemy, "on_dead")) {
+  if (!userdata_has_field(enemy, LuaEvent::ON_DEAD)) {
     return;
   }
 
@@ -5698,7 +5796,7 @@ void LuaContext::enemy_on_immobilized(Enemy& enemy) {
 
   push_enemy(l, enemy);
   remove_timers(-1);  // Stop timers associated to this enemy.
-  if (userdata_has_field(enemy, "on_immobilized")) {
+  if (userdata_has_field(enemy, LuaEvent::ON_IMMOBILIZED)) {
     on_immobilized();
   }
   lua_pop(l, 1);
@@ -5716,7 +5814,7 @@ void LuaContext::enemy_on_immobilized(Enemy& enemy) {
  */
 bool LuaContext::enemy_on_attacking_hero(Enemy& enemy, Hero& hero, Sprite* attacker_sprite) {
 
-  if (!userdata_has_field(enemy, "on_attacking_hero")) {
+  if (!userdata_has_field(enemy, LuaEvent::ON_ATTACKING_HERO)) {
     return false;
   }
 
@@ -5737,7 +5835,7 @@ bool LuaContext::enemy_on_attacking_hero(Enemy& enemy, Hero& hero, Sprite* attac
 void LuaContext::custom_entity_on_ground_below_changed(
     CustomEntity& custom_entity, Ground ground_below) {
 
-  if (!userdata_has_field(custom_entity, "on_ground_below_changed")) {
+  if (!userdata_has_field(custom_entity, LuaEvent::ON_GROUND_BELOW_CHANGED)) {
     return;
   }
 
@@ -24,7 +24,8 @@ namespace Solarus {
  */
 ExportableToLua::ExportableToLua():
   known_to_lua(false),
-  with_lua_table(false) {
+  with_lua_table(false),
+  lua_callbacks() {
 
 }
 
@@ -1541,7 +1541,7 @@ int LuaContext::game_api_simulate_command_released(lua_State* l) {
  */
 void LuaContext::game_on_started(Game& game) {
 
-  if (!userdata_has_field(game.get_savegame(), "on_started")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_STARTED)) {
     return;
   }
 
@@ -1560,7 +1560,7 @@ void LuaContext::game_on_started(Game& game) {
 void LuaContext::game_on_finished(Game& game) {
 
   push_game(l, game.get_savegame());
-  if (userdata_has_field(game.get_savegame(), "on_finished")) {
+  if (userdata_has_field(game.get_savegame(), LuaEvent::ON_FINISHED)) {
     on_finished();
   }
   remove_timers(-1);  // Stop timers and menus associated to this game.
@@ -1578,10 +1578,7 @@ void LuaContext::game_on_finished(Game& game) {
 void LuaContext::game_on_update(Game& game) {
 
   push_game(l, game.get_savegame());
-  // This particular method is tried so often that we want to save optimize
-  // the std::string construction.
-  static const std::string method_name = "on_update";
-  if (userdata_has_field(game.get_savegame(), method_name)) {
+  if (userdata_has_field(game.get_savegame(), LuaEvent::ON_UPDATE)) {
     on_update();
   }
   menus_on_update(-1);
@@ -1599,7 +1596,7 @@ void LuaContext::game_on_update(Game& game) {
 void LuaContext::game_on_draw(Game& game, const SurfacePtr& dst_surface) {
 
   push_game(l, game.get_savegame());
-  if (userdata_has_field(game.get_savegame(), "on_draw")) {
+  if (userdata_has_field(game.get_savegame(), LuaEvent::ON_DRAW)) {
     on_draw(dst_surface);
   }
   menus_on_draw(-1, dst_surface);
@@ -1616,7 +1613,7 @@ void LuaContext::game_on_draw(Game& game, const SurfacePtr& dst_surface) {
  */
 void LuaContext::game_on_map_changed(Game& game, Map& map) {
 
-  if (!userdata_has_field(game.get_savegame(), "on_map_changed")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_MAP_CHANGED)) {
     return;
   }
 
@@ -1634,7 +1631,7 @@ void LuaContext::game_on_map_changed(Game& game, Map& map) {
  */
 void LuaContext::game_on_paused(Game& game) {
 
-  if (!userdata_has_field(game.get_savegame(), "on_paused")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_PAUSED)) {
     return;
   }
 
@@ -1652,7 +1649,7 @@ void LuaContext::game_on_paused(Game& game) {
  */
 void LuaContext::game_on_unpaused(Game& game) {
 
-  if (!userdata_has_field(game.get_savegame(), "on_unpaused")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_UNPAUSED)) {
     return;
   }
 
@@ -1677,7 +1674,7 @@ bool LuaContext::game_on_dialog_started(
     const Dialog& dialog,
     const ScopedLuaRef& info_ref
 ) {
-  if (!userdata_has_field(game.get_savegame(), "on_dialog_started")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_DIALOG_STARTED)) {
     return false;
   }
 
@@ -1699,7 +1696,7 @@ bool LuaContext::game_on_dialog_started(
 void LuaContext::game_on_dialog_finished(Game& game,
     const Dialog& dialog) {
 
-  if (!userdata_has_field(game.get_savegame(), "on_dialog_finished")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_DIALOG_FINISHED)) {
     return;
   }
 
@@ -1718,7 +1715,7 @@ void LuaContext::game_on_dialog_finished(Game& game,
  */
 bool LuaContext::game_on_game_over_started(Game& game) {
 
-  if (!userdata_has_field(game.get_savegame(), "on_game_over_started")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_GAME_OVER_STARTED)) {
     return false;
   }
 
@@ -1738,7 +1735,7 @@ bool LuaContext::game_on_game_over_started(Game& game) {
  */
 void LuaContext::game_on_game_over_finished(Game& game) {
 
-  if (!userdata_has_field(game.get_savegame(), "on_game_over_finished")) {
+  if (!userdata_has_field(game.get_savegame(), LuaEvent::ON_GAME_OVER_FINISHED)) {
     return;
   }
 
@@ -1783,7 +1780,7 @@ bool LuaContext::game_on_command_pressed(Game& game, GameCommand command) {
 
   bool handled = false;
   push_game(l, game.get_savegame());
-  if (userdata_has_field(game.get_savegame(), "on_command_pressed")) {
+  if (userdata_has_field(game.get_savegame(), LuaEvent::ON_COMMAND_PRESSED)) {
     handled = on_command_pressed(command);
   }
   if (!handled) {
@@ -1807,7 +1804,7 @@ bool LuaContext::game_on_command_released(Game& game, GameCommand command) {
 
   bool handled = false;
   push_game(l, game.get_savegame());
-  if (userdata_has_field(game.get_savegame(), "on_command_released")) {
+  if (userdata_has_field(game.get_savegame(), LuaEvent::ON_COMMAND_RELEASED)) {
     handled = on_command_released(command);
   }
   if (!handled) {
@@ -765,7 +765,7 @@ int LuaContext::item_api_set_finished(lua_State* l) {
  */
 void LuaContext::item_on_started(EquipmentItem& item) {
 
-  if (!userdata_has_field(item, "on_started")) {
+  if (!userdata_has_field(item, LuaEvent::ON_STARTED)) {
     return;
   }
 
@@ -784,7 +784,7 @@ void LuaContext::item_on_started(EquipmentItem& item) {
 void LuaContext::item_on_finished(EquipmentItem& item) {
 
   push_item(l, item);
-  if (userdata_has_field(item, "on_finished")) {
+  if (userdata_has_field(item, LuaEvent::ON_FINISHED)) {
     on_finished();
   }
   remove_timers(-1);  // Stop timers and menus associated to this item.
@@ -801,10 +801,7 @@ void LuaContext::item_on_finished(EquipmentItem& item) {
  */
 void LuaContext::item_on_update(EquipmentItem& item) {
 
-  // This particular method is tried so often that we want to save optimize
-  // the std::string construction.
-  static const std::string method_name = "on_update";
-  if (!userdata_has_field(item, method_name)) {
+  if (!userdata_has_field(item, LuaEvent::ON_UPDATE)) {
     return;
   }
 
@@ -823,7 +820,7 @@ void LuaContext::item_on_update(EquipmentItem& item) {
  */
 void LuaContext::item_on_suspended(EquipmentItem& item, bool suspended) {
 
-  if (!userdata_has_field(item, "on_suspended")) {
+  if (!userdata_has_field(item, LuaEvent::ON_SUSPENDED)) {
     return;
   }
 
@@ -841,7 +838,7 @@ void LuaContext::item_on_suspended(EquipmentItem& item, bool suspended) {
  */
 void LuaContext::item_on_created(EquipmentItem& item) {
 
-  if (!userdata_has_field(item, "on_created")) {
+  if (!userdata_has_field(item, LuaEvent::ON_CREATED)) {
     return;
   }
 
@@ -860,7 +857,7 @@ void LuaContext::item_on_created(EquipmentItem& item) {
  */
 void LuaContext::item_on_map_changed(EquipmentItem& item, Map& map) {
 
-  if (!userdata_has_field(item, "on_map_changed")) {
+  if (!userdata_has_field(item, LuaEvent::ON_MAP_CHANGED)) {
     return;
   }
 
@@ -880,7 +877,7 @@ void LuaContext::item_on_map_changed(EquipmentItem& item, Map& map) {
 void LuaContext::item_on_pickable_created(EquipmentItem& item,
     Pickable& pickable) {
 
-  if (!userdata_has_field(item, "on_pickable_created")) {
+  if (!userdata_has_field(item, LuaEvent::ON_PICKABLE_CREATED)) {
     return;
   }
 
@@ -899,7 +896,7 @@ void LuaContext::item_on_pickable_created(EquipmentItem& item,
  */
 void LuaContext::item_on_obtaining(EquipmentItem& item, const Treasure& treasure) {
 
-  if (!userdata_has_field(item, "on_obtaining")) {
+  if (!userdata_has_field(item, LuaEvent::ON_OBTAINING)) {
     return;
   }
 
@@ -918,7 +915,7 @@ void LuaContext::item_on_obtaining(EquipmentItem& item, const Treasure& treasure
  */
 void LuaContext::item_on_obtained(EquipmentItem& item, const Treasure& treasure) {
 
-  if (!userdata_has_field(item, "on_obtained")) {
+  if (!userdata_has_field(item, LuaEvent::ON_OBTAINED)) {
     return;
   }
 
@@ -937,7 +934,7 @@ void LuaContext::item_on_obtained(EquipmentItem& item, const Treasure& treasure)
  */
 void LuaContext::item_on_variant_changed(EquipmentItem& item, int variant) {
 
-  if (!userdata_has_field(item, "on_variant_changed")) {
+  if (!userdata_has_field(item, LuaEvent::ON_VARIANT_CHANGED)) {
     return;
   }
 
@@ -956,7 +953,7 @@ void LuaContext::item_on_variant_changed(EquipmentItem& item, int variant) {
  */
 void LuaContext::item_on_amount_changed(EquipmentItem& item, int amount) {
 
-  if (!userdata_has_field(item, "on_amount_changed")) {
+  if (!userdata_has_field(item, LuaEvent::ON_AMOUNT_CHANGED)) {
     return;
   }
 
@@ -974,7 +971,7 @@ void LuaContext::item_on_amount_changed(EquipmentItem& item, int amount) {
  */
 void LuaContext::item_on_using(EquipmentItem& item) {
 
-  if (!userdata_has_field(item, "on_using")) {
+  if (!userdata_has_field(item, LuaEvent::ON_USING)) {
     return;
   }
 
@@ -993,7 +990,7 @@ void LuaContext::item_on_using(EquipmentItem& item) {
  */
 void LuaContext::item_on_ability_used(EquipmentItem& item, Ability ability) {
 
-  if (!userdata_has_field(item, "on_ability_used")) {
+  if (!userdata_has_field(item, LuaEvent::ON_ABILITY_USED)) {
     return;
   }
 
@@ -1012,7 +1009,7 @@ void LuaContext::item_on_ability_used(EquipmentItem& item, Ability ability) {
  */
 void LuaContext::item_on_npc_interaction(EquipmentItem& item, Npc& npc) {
 
-  if (!userdata_has_field(item, "on_npc_interaction")) {
+  if (!userdata_has_field(item, LuaEvent::ON_NPC_INTERACTION)) {
     return;
   }
 
@@ -1034,7 +1031,7 @@ void LuaContext::item_on_npc_interaction(EquipmentItem& item, Npc& npc) {
 bool LuaContext::item_on_npc_interaction_item(EquipmentItem& item, Npc& npc,
     EquipmentItem& item_used) {
 
-  if (!userdata_has_field(item, "on_npc_interaction_item")) {
+  if (!userdata_has_field(item, LuaEvent::ON_NPC_INTERACTION_ITEM)) {
     return false;
   }
 
@@ -1054,7 +1051,7 @@ bool LuaContext::item_on_npc_interaction_item(EquipmentItem& item, Npc& npc,
  */
 void LuaContext::item_on_npc_collision_fire(EquipmentItem& item, Npc& npc) {
 
-  if (!userdata_has_field(item, "on_npc_collision_fire")) {
+  if (!userdata_has_field(item, LuaEvent::ON_NPC_COLLISION_FIRE)) {
     return;
   }
 
@@ -51,7 +51,8 @@ std::map<lua_State*, LuaContext*> LuaContext::lua_contexts;
  */
 LuaContext::LuaContext(MainLoop& main_loop):
   l(nullptr),
-  main_loop(main_loop) {
+  main_loop(main_loop),
+  next_timer_schedule_id(1) {
 
 }
 
@@ -178,6 +179,8 @@ void LuaContext::exit() {
     lua_close(l);
     lua_contexts.erase(l);
     l = nullptr;
+    metatable_callbacks.reset();
+    type_metatable_callbacks.clear();
   }
 }
 
@@ -384,6 +387,8 @@ void LuaContext::notify_camera_reached_target(Map& map) {
   timer_api_start(l);
   const TimerPtr& timer = check_timer(l, -1);
   timer->set_suspended_with_map(false);
+  // A timer started during a dialog is suspended and not scheduled yet.
+  schedule_timer(*timer);
   lua_settop(l, 0);
 }
 
@@ -537,6 +542,43 @@ bool LuaContext::userdata_has_field(
   return it->second.find(key) != it->second.end();
 }
 
+/**
+ * \brief Returns whether a userdata defines a callback.
+ *
+ * The callback may be defined on the userdata itself or in the metatable
+ * of its type.
+ *
+ * This is the version to use for events called by the engine:
+ * when no callback is defined, it only tests bits and does not access Lua.
+ *
+ * \param userdata A userdata.
+ * \param event The event to test.
+ * \return \c true if this callback exists on the userdata.
+ */
+bool LuaContext::userdata_has_field(
+    const ExportableToLua& userdata, LuaEvent event) const {
+
+  if (userdata.has_lua_callback(event)) {
+    return true;
+  }
+
+  const int index = static_cast<int>(event);
+  if (!metatable_callbacks.test(index)) {
+    // No type defines this event.
+    return false;
+  }
+
+  const auto& it = type_metatable_callbacks.find(userdata.get_lua_type_name());
+  if (it == type_metatable_callbacks.end() ||
+      !it->second.test(index)) {
+    return false;
+  }
+
+  // The field was set in the metatable at some point: it may have been
+  // set back to nil since.
+  return userdata_has_metafield(userdata, get_lua_event_name(event).c_str());
+}
+
 /**
  * \brief Returns whether the metatable of a userdata has the specified field.
  * \param userdata A userdata.
@@ -833,6 +875,7 @@ void LuaContext::register_type(
   // Create the metatable for the type, add it to the Lua registry.
   luaL_newmetatable(l, module_name.c_str());
                                   // meta
+  const int meta_index = lua_gettop(l);
 
   // Store a metafield __solarus_type with the module name.
   lua_pushstring(l, module_name.c_str());
@@ -862,7 +905,26 @@ void LuaContext::register_type(
                                   // meta nil meta
     lua_setfield(l, -3, "__index");
                                   // meta nil
+    lua_pop(l, 1);
+                                  // meta
+  }
+  else {
+                                  // meta __index meta
+    lua_pop(l, 2);
+                                  // meta
   }
+  Debug::check_assertion(lua_gettop(l) == meta_index,
+      "Unexpected Lua stack after setting __index");
+
+  // Detect callbacks that scripts define in the metatable.
+  lua_newtable(l);
+                                  // meta meta_meta
+  lua_pushcfunction(l, type_metatable_meta_newindex);
+                                  // meta meta_meta __newindex
+  lua_setfield(l, -2, "__newindex");
+                                  // meta meta_meta
+  lua_setmetatable(l, -2);
+                                  // meta
   lua_settop(l, 0);
                                   // --
 }
@@ -1174,6 +1236,56 @@ int LuaContext::userdata_meta_newindex_as_table(lua_State* l) {
       // Assigning nil: remove the key from the list.
       get_lua_context(l).userdata_fields[userdata.get()].erase(lua_tostring(l, 2));
     }
+
+    LuaEvent event;
+    if (get_lua_event_by_name(lua_tostring(l, 2), event)) {
+      userdata->set_lua_callback(event, !lua_isnil(l, 3));
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * \brief Implementation of __newindex for the metatable of userdata types.
+ *
+ * This is called when a script adds a field to the metatable of a type,
+ * typically to define a callback for all objects of that type.
+ * The field is stored normally and its event, if any, is recorded.
+ *
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::type_metatable_meta_newindex(lua_State* l) {
+
+  LuaTools::check_type(l, 1, LUA_TTABLE);
+  LuaTools::check_any(l, 2);
+  LuaTools::check_any(l, 3);
+
+  lua_settop(l, 3);
+                                  // meta key value
+  lua_pushvalue(l, 2);
+                                  // meta key value key
+  lua_pushvalue(l, 3);
+                                  // meta key value key value
+  lua_rawset(l, 1);
+                                  // meta key value
+
+  LuaEvent event;
+  if (lua_type(l, 2) == LUA_TSTRING &&
+      !lua_isnil(l, 3) &&
+      get_lua_event_by_name(lua_tostring(l, 2), event)) {
+
+    lua_getfield(l, 1, "__solarus_type");
+                                  // meta key value type_name/nil
+    if (lua_isstring(l, -1)) {
+      LuaContext& lua_context = get_lua_context(l);
+      const int index = static_cast<int>(event);
+      lua_context.type_metatable_callbacks[lua_tostring(l, -1)].set(index);
+      lua_context.metatable_callbacks.set(index);
+    }
+    lua_pop(l, 1);
+                                  // meta key value
   }
 
   return 0;
@@ -14,17 +14,38 @@
  * You should have received a copy of the GNU General Public License along
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
+#include "solarus/lowlevel/BinaryBuffer.h"
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Hash.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lua/LuaData.h"
 #include <lua.hpp>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <ostream>
 #include <sstream>
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Magic number at the beginning of compiled data files.
+ */
+const char compiled_magic[] = "SOLDATC\n";
+constexpr size_t compiled_magic_size = sizeof(compiled_magic) - 1;
+
+/**
+ * \brief Version of the compiled format.
+ *
+ * Compiled files of another version are ignored.
+ */
+constexpr uint32_t compiled_format_version = 1;
+
+}  // Anonymous namespace.
+
 /**
  * \brief Imports a Lua data file from memory to this object.
  * \param[in] buffer A memory area with the content of a data file
@@ -97,9 +118,110 @@ bool LuaData::import_from_quest_file(
   const std::string& buffer = QuestFiles::data_file_read(
       quest_file_name, language_specific
   );
+
+  // Prefer the compiled version if it is up to date.
+  const std::string& compiled_buffer = read_compiled_quest_file(
+      quest_file_name, language_specific
+  );
+  if (!compiled_buffer.empty() &&
+      import_from_compiled_buffer(buffer, compiled_buffer)) {
+    return true;
+  }
+
   return import_from_buffer(buffer);
 }
 
+/**
+ * \brief Imports the compiled version of a data file to this object.
+ *
+ * Compiled files are only a cache of the Lua source, that stays the
+ * reference: this function fails without error message if the compiled
+ * buffer was not made from this exact source, or is not valid.
+ * In this case, the object is left unchanged and the caller should import
+ * the source instead.
+ *
+ * \param[in] buffer Content of the Lua source file.
+ * \param[in] compiled_buffer Content of the compiled file.
+ * \return \c true in case of success.
+ */
+bool LuaData::import_from_compiled_buffer(
+    const std::string& buffer,
+    const std::string& compiled_buffer
+) {
+  BinaryReader reader(compiled_buffer.data(), compiled_buffer.size());
+
+  const char* magic = nullptr;
+  uint32_t version = 0;
+  uint64_t source_size = 0;
+  uint64_t source_hash = 0;
+  if (!reader.read_bytes(compiled_magic_size, magic) ||
+      std::memcmp(magic, compiled_magic, compiled_magic_size) != 0 ||
+      !reader.read_uint32(version) ||
+      version != compiled_format_version ||
+      !reader.read_uint64(source_size) ||
+      !reader.read_uint64(source_hash)) {
+    return false;
+  }
+
+  // Check the size first to avoid hashing in most cases of outdated files.
+  if (source_size != buffer.size() ||
+      source_hash != Hash::get_fnv1a_hash(buffer)) {
+    return false;
+  }
+
+  return import_from_binary(reader) && reader.get_num_remaining() == 0;
+}
+
+/**
+ * \brief Saves this object in the compiled format.
+ * \param[in] buffer Content of the Lua source file this object was
+ * imported from.
+ * \param[out] compiled_buffer The compiled data.
+ * \return \c true in case of success, \c false if the data cannot be
+ * compiled.
+ */
+bool LuaData::export_to_compiled_buffer(
+    const std::string& buffer,
+    std::string& compiled_buffer
+) const {
+  compiled_buffer.clear();
+  BinaryWriter writer(compiled_buffer);
+  writer.write_bytes(compiled_magic, compiled_magic_size);
+  writer.write_uint32(compiled_format_version);
+  writer.write_uint64(buffer.size());
+  writer.write_uint64(Hash::get_fnv1a_hash(buffer));
+  return export_to_binary(writer);
+}
+
+/**
+ * \brief Returns the name of the compiled version of a data file.
+ * \param file_name Name of a Lua data file.
+ * \return Name of the corresponding compiled file.
+ */
+std::string LuaData::get_compiled_file_name(const std::string& file_name) {
+  return file_name + "c";
+}
+
+/**
+ * \brief Reads the compiled version of a quest data file if it exists.
+ * \param[in] quest_file_name Path of the Lua data file, relative to the
+ * quest data path.
+ * \param[in] language_specific \c true to search in the language-specific
+ * directory of the current language.
+ * \return The content of the compiled file, or an empty string if there is
+ * no compiled file.
+ */
+std::string LuaData::read_compiled_quest_file(
+    const std::string& quest_file_name,
+    bool language_specific
+) {
+  const std::string& compiled_file_name = get_compiled_file_name(quest_file_name);
+  if (!QuestFiles::data_file_exists(compiled_file_name, language_specific)) {
+    return "";
+  }
+  return QuestFiles::data_file_read(compiled_file_name, language_specific);
+}
+
 /**
  * \brief Saves this object into memory as Lua.
  * \param[out] buffer The buffer to write.
@@ -177,4 +299,28 @@ bool LuaData::export_to_lua(std::ostream& /* out */) const {
   return false;
 }
 
+/**
+ * \brief Loads data from the binary part of a compiled data file.
+ * \param reader The binary data, positioned after the header.
+ * \return \c true in case of success, \c false if the data is not valid.
+ * In case of failure, the object must be left unchanged.
+ */
+bool LuaData::import_from_binary(BinaryReader& /* reader */) {
+
+  // The compiled format is optional. Not implemented by default.
+  return false;
+}
+
+/**
+ * \brief Saves this data as the binary part of a compiled data file.
+ * \param writer The binary data to append to.
+ * \return \c true in case of success, \c false if the data
+ * could not be exported.
+ */
+bool LuaData::export_to_binary(BinaryWriter& /* writer */) const {
+
+  // The compiled format is optional. Not implemented by default.
+  return false;
+}
+
 }
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lua/LuaEvent.h"
+#include <unordered_map>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Lua name of each event, in the order of the LuaEvent enum.
+ */
+const std::string lua_event_names[num_lua_events] = {
+    "on_ability_used",
+    "on_activated",
+    "on_activated_repeat",
+    "on_activating",
+    "on_amount_changed",
+    "on_animation_changed",
+    "on_animation_finished",
+    "on_attacking_hero",
+    "on_bought",
+    "on_buying",
+    "on_camera_back",
+    "on_changed",
+    "on_closed",
+    "on_collision_enemy",
+    "on_collision_explosion",
+    "on_collision_fire",
+    "on_command_pressed",
+    "on_command_released",
+    "on_created",
+    "on_custom_attack_received",
+    "on_cut",
+    "on_dead",
+    "on_dialog_finished",
+    "on_dialog_started",
+    "on_direction_changed",
+    "on_disabled",
+    "on_draw",
+    "on_dying",
+    "on_empty",
+    "on_enabled",
+    "on_exploded",
+    "on_finished",
+    "on_frame_changed",
+    "on_game_over_finished",
+    "on_game_over_started",
+    "on_ground_below_changed",
+    "on_hurt",
+    "on_hurt_by_sword",
+    "on_immobilized",
+    "on_inactivated",
+    "on_interaction",
+    "on_interaction_item",
+    "on_left",
+    "on_lifting",
+    "on_looked",
+    "on_map_changed",
+    "on_moved",
+    "on_movement_changed",
+    "on_movement_finished",
+    "on_moving",
+    "on_npc_collision_fire",
+    "on_npc_interaction",
+    "on_npc_interaction_item",
+    "on_obstacle_reached",
+    "on_obtained",
+    "on_obtained_treasure",
+    "on_obtaining",
+    "on_obtaining_treasure",
+    "on_opened",
+    "on_opening_transition_finished",
+    "on_paused",
+    "on_pickable_created",
+    "on_position_changed",
+    "on_post_draw",
+    "on_pre_draw",
+    "on_regenerating",
+    "on_removed",
+    "on_restarted",
+    "on_started",
+    "on_state_changed",
+    "on_suspended",
+    "on_taking_damage",
+    "on_unpaused",
+    "on_update",
+    "on_using",
+    "on_variant_changed"
+};
+
+}
+
+/**
+ * \brief Returns the Lua name of an event.
+ * \param event An event.
+ * \return The name of the callback, like "on_created".
+ */
+const std::string& get_lua_event_name(LuaEvent event) {
+  return lua_event_names[static_cast<int>(event)];
+}
+
+/**
+ * \brief Returns the event with the given Lua name.
+ * \param[in] name Name of a field of a Lua object.
+ * \param[out] event The corresponding event if any.
+ * \return \c true if this name is the name of an event.
+ */
+bool get_lua_event_by_name(const std::string& name, LuaEvent& event) {
+
+  static std::unordered_map<std::string, LuaEvent> events_by_name;
+  if (events_by_name.empty()) {
+    for (int i = 0; i < num_lua_events; ++i) {
+      events_by_name[lua_event_names[i]] = static_cast<LuaEvent>(i);
+    }
+  }
+
+  const auto it = events_by_name.find(name);
+  if (it == events_by_name.end()) {
+    return false;
+  }
+  event = it->second;
+  return true;
+}
+
+}
+
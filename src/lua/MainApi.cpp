@@ -20,6 +20,7 @@
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/System.h"
 #include "solarus/MainLoop.h"
+#include "solarus/ResourcePreloader.h"
 #include "solarus/Settings.h"
 #include <lua.hpp>
 
@@ -49,6 +50,8 @@ void LuaContext::register_main_module() {
       { "get_angle", main_api_get_angle },
       { "get_metatable", main_api_get_metatable },
       { "get_os", main_api_get_os },
+      { "preload_resources", main_api_preload_resources },
+      { "get_preload_progress", main_api_get_preload_progress },
       { nullptr, nullptr }
   };
 
@@ -305,6 +308,38 @@ int LuaContext::main_api_get_os(lua_State* l) {
   return 1;
 }
 
+/**
+ * \brief Implementation of sol.main.preload_resources().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_preload_resources(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    ResourcePreloader::start();
+
+    return 0;
+  });
+}
+
+/**
+ * \brief Implementation of sol.main.get_preload_progress().
+ *
+ * Returns the number of files already preloaded and the number of files
+ * known so far. The preloading is finished when both are equal.
+ *
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_get_preload_progress(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    lua_pushinteger(l, ResourcePreloader::get_num_loaded());
+    lua_pushinteger(l, ResourcePreloader::get_num_total());
+    return 2;
+  });
+}
+
 /**
  * \brief Calls sol.main.on_started() if it exists.
  *
@@ -98,6 +98,7 @@ void LuaContext::register_map_module() {
       { "get_entities", map_api_get_entities },
       { "get_entities_count", map_api_get_entities_count },
       { "has_entities", map_api_has_entities },
+      { "get_entities_in_rectangle", map_api_get_entities_in_rectangle },
       { "get_hero", map_api_get_hero },
       { "set_entities_enabled", map_api_set_entities_enabled },
       { "remove_entities", map_api_remove_entities },
@@ -1260,6 +1261,8 @@ int LuaContext::l_camera_do_callback(lua_State* l) {
     timer_api_start(l);
     const TimerPtr& timer = check_timer(l, -1);
     timer->set_suspended_with_map(false);
+    // A timer started during a dialog is suspended and not scheduled yet.
+    get_lua_context(l).schedule_timer(*timer);
 
     return 0;
   });
@@ -1607,7 +1610,7 @@ int LuaContext::map_api_open_doors(lua_State* l) {
 
     bool done = false;
     MapEntities& entities = map.get_entities();
-    std::list<MapEntity*> doors = entities.get_entities_with_prefix(EntityType::DOOR, prefix);
+    std::vector<MapEntity*> doors = entities.get_entities_with_prefix(EntityType::DOOR, prefix);
     for (auto it = doors.begin(); it != doors.end(); ++it) {
       Door* door = static_cast<Door*>(*it);
       if (!door->is_open() || door->is_closing()) {
@@ -1639,7 +1642,7 @@ int LuaContext::map_api_close_doors(lua_State* l) {
 
     bool done = false;
     MapEntities& entities = map.get_entities();
-    std::list<MapEntity*> doors = entities.get_entities_with_prefix(EntityType::DOOR, prefix);
+    std::vector<MapEntity*> doors = entities.get_entities_with_prefix(EntityType::DOOR, prefix);
     for (auto it = doors.begin(); it != doors.end(); ++it) {
       Door* door = static_cast<Door*>(*it);
       if (door->is_open() || door->is_opening()) {
@@ -1671,7 +1674,7 @@ int LuaContext::map_api_set_doors_open(lua_State* l) {
     bool open = LuaTools::opt_boolean(l, 3, true);
 
     MapEntities& entities = map.get_entities();
-    std::list<MapEntity*> doors = entities.get_entities_with_prefix(EntityType::DOOR, prefix);
+    std::vector<MapEntity*> doors = entities.get_entities_with_prefix(EntityType::DOOR, prefix);
     for (auto it = doors.begin(); it != doors.end(); ++it) {
       Door* door = static_cast<Door*>(*it);
       door->set_open(open);
@@ -1733,24 +1736,11 @@ int LuaContext::map_api_get_entities(lua_State* l) {
     Map& map = *check_map(l, 1);
     const std::string& prefix = LuaTools::check_string(l, 2);
 
-    const std::list<MapEntity*> entities =
+    const std::vector<MapEntity*> entities =
         map.get_entities().get_entities_with_prefix(prefix);
 
-    lua_newtable(l);
-    for (auto it = entities.begin(); it != entities.end(); ++it) {
-      MapEntity* entity = *it;
-      push_entity(l, *entity);
-      lua_pushboolean(l, true);
-      lua_rawset(l, -3);
-    }
-    lua_getglobal(l, "pairs");
-    lua_pushvalue(l, -2);
-    lua_call(l, 1, 3);  // TODO don't call the pairs global value, implement our
-    // own iterator instead.
-    // Or at least store pairs in the registry (like we do
-    // with io.open) to be sure it is the original one.
-
-    return 3;
+    push_entity_iterator(l, entities);
+    return 1;
   });
 }
 
@@ -1765,10 +1755,7 @@ int LuaContext::map_api_get_entities_count(lua_State* l) {
     Map& map = *check_map(l, 1);
     const std::string& prefix = LuaTools::check_string(l, 2);
 
-    const std::list<MapEntity*> entities =
-        map.get_entities().get_entities_with_prefix(prefix);
-
-    lua_pushinteger(l, entities.size());
+    lua_pushinteger(l, map.get_entities().get_num_entities_with_prefix(prefix));
     return 1;
   });
 }
@@ -1789,6 +1776,31 @@ int LuaContext::map_api_has_entities(lua_State* l) {
   });
 }
 
+/**
+ * \brief Implementation of map:get_entities_in_rectangle().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::map_api_get_entities_in_rectangle(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const Map& map = *check_map(l, 1);
+    const int x = LuaTools::check_int(l, 2);
+    const int y = LuaTools::check_int(l, 3);
+    const int width = LuaTools::check_int(l, 4);
+    const int height = LuaTools::check_int(l, 5);
+
+    std::vector<MapEntity*> entities;
+    map.get_entities().get_entities_in_rectangle(
+        Rectangle(x, y, width, height), entities
+    );
+    filter_entities(l, 6, entities);
+
+    push_entity_iterator(l, entities);
+    return 1;
+  });
+}
+
 /**
  * \brief Implementation of map:get_hero().
  * \param l The Lua context that is calling this function.
@@ -1817,10 +1829,10 @@ int LuaContext::map_api_set_entities_enabled(lua_State* l) {
     const std::string& prefix = LuaTools::check_string(l, 2);
     bool enabled = LuaTools::opt_boolean(l, 3, true);
 
-    std::list<MapEntity*> entities =
+    const std::vector<MapEntity*> entities =
         map.get_entities().get_entities_with_prefix(prefix);
-    for (auto it = entities.begin(); it != entities.end(); ++it) {
-      (*it)->set_enabled(enabled);
+    for (MapEntity* entity: entities) {
+      entity->set_enabled(enabled);
     }
 
     return 0;
@@ -1874,7 +1886,7 @@ int LuaContext::map_api_create_entity(lua_State* l) {
  */
 void LuaContext::map_on_started(Map& map, Destination* destination) {
 
-  if (!userdata_has_field(map, "on_started")) {
+  if (!userdata_has_field(map, LuaEvent::ON_STARTED)) {
     return;
   }
 
@@ -1893,7 +1905,7 @@ void LuaContext::map_on_started(Map& map, Destination* destination) {
 void LuaContext::map_on_finished(Map& map) {
 
   push_map(l, map);
-  if (userdata_has_field(map, "on_finished")) {
+  if (userdata_has_field(map, LuaEvent::ON_FINISHED)) {
     on_finished();
   }
   remove_timers(-1);  // Stop timers and menus associated to this map.
@@ -1911,10 +1923,7 @@ void LuaContext::map_on_finished(Map& map) {
 void LuaContext::map_on_update(Map& map) {
 
   push_map(l, map);
-  // This particular method is tried so often that we want to save optimize
-  // the std::string construction.
-  static const std::string method_name = "on_update";
-  if (userdata_has_field(map, method_name)) {
+  if (userdata_has_field(map, LuaEvent::ON_UPDATE)) {
     on_update();
   }
   menus_on_update(-1);
@@ -1932,7 +1941,7 @@ void LuaContext::map_on_update(Map& map) {
 void LuaContext::map_on_draw(Map& map, const SurfacePtr& dst_surface) {
 
   push_map(l, map);
-  if (userdata_has_field(map, "on_draw")) {
+  if (userdata_has_field(map, LuaEvent::ON_DRAW)) {
     on_draw(dst_surface);
   }
   menus_on_draw(-1, dst_surface);
@@ -1975,7 +1984,7 @@ bool LuaContext::map_on_command_pressed(Map& map, GameCommand command) {
 
   bool handled = false;
   push_map(l, map);
-  if (userdata_has_field(map, "on_command_pressed")) {
+  if (userdata_has_field(map, LuaEvent::ON_COMMAND_PRESSED)) {
     handled = on_command_pressed(command);
   }
   if (!handled) {
@@ -1999,7 +2008,7 @@ bool LuaContext::map_on_command_released(Map& map, GameCommand command) {
 
   bool handled = false;
   push_map(l, map);
-  if (userdata_has_field(map, "on_command_released")) {
+  if (userdata_has_field(map, LuaEvent::ON_COMMAND_RELEASED)) {
     handled = on_command_released(command);
   }
   if (!handled) {
@@ -2019,7 +2028,7 @@ bool LuaContext::map_on_command_released(Map& map, GameCommand command) {
  */
 void LuaContext::map_on_suspended(Map& map, bool suspended) {
 
-  if (!userdata_has_field(map, "on_suspended")) {
+  if (!userdata_has_field(map, LuaEvent::ON_SUSPENDED)) {
     return;
   }
 
@@ -2039,7 +2048,7 @@ void LuaContext::map_on_suspended(Map& map, bool suspended) {
 void LuaContext::map_on_opening_transition_finished(Map& map,
     Destination* destination) {
 
-  if (!userdata_has_field(map, "on_opening_transition_finished")) {
+  if (!userdata_has_field(map, LuaEvent::ON_OPENING_TRANSITION_FINISHED)) {
     //return;
   }
 
@@ -2057,7 +2066,7 @@ void LuaContext::map_on_opening_transition_finished(Map& map,
  */
 void LuaContext::map_on_camera_back(Map& map) {
 
-  if (!userdata_has_field(map, "on_camera_back")) {
+  if (!userdata_has_field(map, LuaEvent::ON_CAMERA_BACK)) {
     return;
   }
 
@@ -2076,7 +2085,7 @@ void LuaContext::map_on_camera_back(Map& map) {
  */
 void LuaContext::map_on_obtaining_treasure(Map& map, const Treasure& treasure) {
 
-  if (!userdata_has_field(map, "on_obtaining_treasure")) {
+  if (!userdata_has_field(map, LuaEvent::ON_OBTAINING_TREASURE)) {
     return;
   }
 
@@ -2095,7 +2104,7 @@ void LuaContext::map_on_obtaining_treasure(Map& map, const Treasure& treasure) {
  */
 void LuaContext::map_on_obtained_treasure(Map& map, const Treasure& treasure) {
 
-  if (!userdata_has_field(map, "on_obtained_treasure")) {
+  if (!userdata_has_field(map, LuaEvent::ON_OBTAINED_TREASURE)) {
     return;
   }
 
@@ -225,6 +225,8 @@ void LuaContext::register_movement_module() {
       { "set_target", path_finding_movement_api_set_target },
       { "get_speed", path_finding_movement_api_get_speed },
       { "set_speed", path_finding_movement_api_set_speed },
+      { "is_flow_field_enabled", path_finding_movement_api_is_flow_field_enabled },
+      { "set_flow_field_enabled", path_finding_movement_api_set_flow_field_enabled },
       { nullptr, nullptr }
   };
   register_type(
@@ -1374,6 +1376,36 @@ int LuaContext::path_finding_movement_api_set_speed(lua_State* l) {
   });
 }
 
+/**
+ * \brief Implementation of path_finding_movement:is_flow_field_enabled().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::path_finding_movement_api_is_flow_field_enabled(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const PathFindingMovement& movement = *check_path_finding_movement(l, 1);
+    lua_pushboolean(l, movement.is_flow_field_enabled());
+    return 1;
+  });
+}
+
+/**
+ * \brief Implementation of path_finding_movement:set_flow_field_enabled().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::path_finding_movement_api_set_flow_field_enabled(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    PathFindingMovement& movement = *check_path_finding_movement(l, 1);
+    bool flow_field_enabled = LuaTools::opt_boolean(l, 2, true);
+    movement.set_flow_field_enabled(flow_field_enabled);
+
+    return 0;
+  });
+}
+
 /**
  * \brief Returns whether a value is a userdata of type circle movement.
  * \param l A Lua context.
@@ -1943,7 +1975,7 @@ void LuaContext::movement_on_position_changed(
   }
   lua_pop(l, 2);
                                   // ... movement
-  if (userdata_has_field(movement, "on_position_changed")) {
+  if (userdata_has_field(movement, LuaEvent::ON_POSITION_CHANGED)) {
     on_position_changed(xy);
   }
   lua_pop(l, 1);
@@ -1958,7 +1990,7 @@ void LuaContext::movement_on_position_changed(
  */
 void LuaContext::movement_on_obstacle_reached(Movement& movement) {
 
-  if (!userdata_has_field(movement, "on_obstacle_reached")) {
+  if (!userdata_has_field(movement, LuaEvent::ON_OBSTACLE_REACHED)) {
     return;
   }
 
@@ -1976,7 +2008,7 @@ void LuaContext::movement_on_obstacle_reached(Movement& movement) {
  */
 void LuaContext::movement_on_changed(Movement& movement) {
 
-  if (!userdata_has_field(movement, "on_changed")) {
+  if (!userdata_has_field(movement, LuaEvent::ON_CHANGED)) {
     return;
   }
 
@@ -1994,7 +2026,7 @@ void LuaContext::movement_on_changed(Movement& movement) {
  */
 void LuaContext::movement_on_finished(Movement& movement) {
 
-  if (!userdata_has_field(movement, "on_finished")) {
+  if (!userdata_has_field(movement, LuaEvent::ON_FINISHED)) {
     return;
   }
 
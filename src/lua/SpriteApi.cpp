@@ -430,7 +430,7 @@ int LuaContext::sprite_api_synchronize(lua_State *l) {
 void LuaContext::sprite_on_animation_finished(Sprite& sprite,
     const std::string& animation) {
 
-  if (!userdata_has_field(sprite, "on_animation_finished")) {
+  if (!userdata_has_field(sprite, LuaEvent::ON_ANIMATION_FINISHED)) {
     return;
   }
 
@@ -450,7 +450,7 @@ void LuaContext::sprite_on_animation_finished(Sprite& sprite,
 void LuaContext::sprite_on_animation_changed(
     Sprite& sprite, const std::string& animation) {
 
-  if (!userdata_has_field(sprite, "on_animation_changed")) {
+  if (!userdata_has_field(sprite, LuaEvent::ON_ANIMATION_CHANGED)) {
     return;
   }
 
@@ -471,7 +471,7 @@ void LuaContext::sprite_on_animation_changed(
 void LuaContext::sprite_on_direction_changed(Sprite& sprite,
     const std::string& animation, int direction) {
 
-  if (!userdata_has_field(sprite, "on_direction_changed")) {
+  if (!userdata_has_field(sprite, LuaEvent::ON_DIRECTION_CHANGED)) {
     return;
   }
 
@@ -492,7 +492,7 @@ void LuaContext::sprite_on_direction_changed(Sprite& sprite,
 void LuaContext::sprite_on_frame_changed(Sprite& sprite,
     const std::string& animation, int frame) {
 
-  if (!userdata_has_field(sprite, "on_frame_changed")) {
+  if (!userdata_has_field(sprite, LuaEvent::ON_FRAME_CHANGED)) {
     return;
   }
 
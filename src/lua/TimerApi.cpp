@@ -24,8 +24,10 @@
 #include "solarus/MainLoop.h"
 #include "solarus/Map.h"
 #include "solarus/Timer.h"
-#include <list>
+#include <algorithm>
+#include <functional>
 #include <sstream>
+#include <vector>
 
 namespace Solarus {
 
@@ -100,6 +102,27 @@ void LuaContext::push_timer(lua_State* l, const TimerPtr& timer) {
   push_userdata(l, *timer);
 }
 
+namespace {
+
+/**
+ * \brief Returns the context object at the specified index.
+ * \param l A Lua context.
+ * \param context_index Index of a table or userdata in the stack.
+ * \return The C++ object if this is a userdata, the Lua table otherwise.
+ */
+const void* get_timer_context(lua_State* l, int context_index) {
+
+  if (lua_type(l, context_index) == LUA_TUSERDATA) {
+    ExportableToLuaPtr* userdata = static_cast<ExportableToLuaPtr*>(
+        lua_touserdata(l, context_index)
+    );
+    return userdata->get();
+  }
+  return lua_topointer(l, context_index);
+}
+
+}
+
 /**
  * \brief Registers a timer into a context (table or a userdata).
  * \param timer A timer.
@@ -111,36 +134,29 @@ void LuaContext::add_timer(
     int context_index,
     const ScopedLuaRef& callback_ref
 ) {
-  const void* context;
-  if (lua_type(l, context_index) == LUA_TUSERDATA) {
-    ExportableToLuaPtr* userdata = static_cast<ExportableToLuaPtr*>(
-        lua_touserdata(l, context_index)
-    );
-    context = userdata->get();
-  }
-  else {
-    context = lua_topointer(l, context_index);
-  }
+  const void* context = get_timer_context(l, context_index);
 
   callback_ref.push();
 
 #ifndef NDEBUG
   // Sanity check: check the uniqueness of the ref.
-  for (const auto& kvp: timers) {
-    if (kvp.second.callback_ref.get() == callback_ref.get()) {
-      std::ostringstream oss;
-      oss << "Callback ref " << callback_ref.get()
-          << " is already used by a timer (duplicate luaL_unref?)";
-      Debug::die(oss.str());
-    }
+  if (!timer_callback_refs.insert(callback_ref.get()).second) {
+    std::ostringstream oss;
+    oss << "Callback ref " << callback_ref.get()
+        << " is already used by a timer (duplicate luaL_unref?)";
+    Debug::die(oss.str());
   }
 #endif
 
-  Debug::check_assertion(timers.find(timer) == timers.end(),
+  Debug::check_assertion(timers.find(timer.get()) == timers.end(),
       "Duplicate timer in the system");
 
-  timers[timer].callback_ref = callback_ref;
-  timers[timer].context = context;
+  LuaTimerData& timer_data = timers[timer.get()];
+  timer_data.timer = timer;
+  timer_data.callback_ref = callback_ref;
+  timer_data.context = context;
+  timer_data.schedule_id = 0;
+  context_timers[context].push_back(timer);
 
   Game* game = main_loop.get_game();
   if (game != nullptr) {
@@ -176,6 +192,8 @@ void LuaContext::add_timer(
       timer->set_suspended(initially_suspended);
     }
   }
+
+  schedule_timer(*timer);
 }
 
 /**
@@ -186,9 +204,11 @@ void LuaContext::add_timer(
  * \param timer A timer.
  */
 void LuaContext::remove_timer(const TimerPtr& timer) {
-  if (timers.find(timer) != timers.end()) {
-    timers[timer].callback_ref.clear();
-    timers_to_remove.push_back(timer);
+
+  const auto it = timers.find(timer.get());
+  if (it != timers.end() &&
+      !it->second.callback_ref.is_empty()) {
+    cancel_timer(it->second);
   }
 }
 
@@ -201,21 +221,17 @@ void LuaContext::remove_timer(const TimerPtr& timer) {
  */
 void LuaContext::remove_timers(int context_index) {
 
-  const void* context;
-  if (lua_type(l, context_index) == LUA_TUSERDATA) {
-    ExportableToLuaPtr* userdata = static_cast<ExportableToLuaPtr*>(
-        lua_touserdata(l, context_index));
-    context = userdata->get();
-  }
-  else {
-    context = lua_topointer(l, context_index);
+  const void* context = get_timer_context(l, context_index);
+
+  const auto it = context_timers.find(context);
+  if (it == context_timers.end()) {
+    return;
   }
 
-  for (auto& kvp: timers) {
-    const TimerPtr& timer = kvp.first;
-    if (kvp.second.context == context) {
-      kvp.second.callback_ref.clear();
-      timers_to_remove.push_back(timer);
+  for (const TimerPtr& timer: it->second) {
+    LuaTimerData& timer_data = timers[timer.get()];
+    if (!timer_data.callback_ref.is_empty()) {
+      cancel_timer(timer_data);
     }
   }
 }
@@ -224,38 +240,160 @@ void LuaContext::remove_timers(int context_index) {
  * \brief Destroys immediately all existing timers.
  */
 void LuaContext::destroy_timers() {
+
   timers.clear();
+  timer_schedule.clear();
+  context_timers.clear();
+  timers_to_remove.clear();
+  timer_callback_refs.clear();
 }
 
 /**
- * \brief Updates all timers currently running for this script.
+ * \brief Stops a timer: its callback won't be called.
+ *
+ * The timer is actually unregistered at the end of the next update.
+ *
+ * \param timer_data The timer to stop. Its callback must not be cleared yet.
+ */
+void LuaContext::cancel_timer(LuaTimerData& timer_data) {
+
+#ifndef NDEBUG
+  timer_callback_refs.erase(timer_data.callback_ref.get());
+#endif
+  timer_data.callback_ref.clear();
+  timer_data.schedule_id = 0;
+  timers_to_remove.push_back(timer_data.timer);
+}
+
+/**
+ * \brief Puts a timer in the schedule at its next update date.
+ *
+ * This must be called whenever the timer changes in a way that affects its
+ * next update date: start, suspension, resuming, new expiration date or
+ * clock sound.
+ * A previous entry of the timer in the schedule becomes invalid.
+ * Suspended and removed timers are not scheduled.
+ *
+ * \param timer A timer.
+ */
+void LuaContext::schedule_timer(const Timer& timer) {
+
+  const auto it = timers.find(&timer);
+  if (it == timers.end()) {
+    return;
+  }
+
+  LuaTimerData& timer_data = it->second;
+  if (timer_data.callback_ref.is_empty() ||
+      timer.is_suspended()) {
+    timer_data.schedule_id = 0;
+    return;
+  }
+
+  timer_data.schedule_id = next_timer_schedule_id++;
+  timer_schedule.push_back({
+      timer.get_next_update_date(),
+      timer_data.schedule_id,
+      &timer
+  });
+  std::push_heap(timer_schedule.begin(), timer_schedule.end(),
+      std::greater<ScheduledTimer>());
+
+  if (timer_schedule.size() > 2 * timers.size() + 64) {
+    // Too many invalid entries: clean them up.
+    rebuild_timer_schedule();
+  }
+}
+
+/**
+ * \brief Removes the invalid entries of the schedule.
+ */
+void LuaContext::rebuild_timer_schedule() {
+
+  timer_schedule.erase(
+      std::remove_if(timer_schedule.begin(), timer_schedule.end(),
+          [&](const ScheduledTimer& entry) {
+    const auto it = timers.find(entry.timer);
+    return it == timers.end() || it->second.schedule_id != entry.schedule_id;
+  }), timer_schedule.end());
+  std::make_heap(timer_schedule.begin(), timer_schedule.end(),
+      std::greater<ScheduledTimer>());
+}
+
+/**
+ * \brief Updates the timers that have something to do at this date.
+ *
+ * Timers are handled by increasing update date, and in the order they were
+ * scheduled when several of them have the same date.
  */
 void LuaContext::update_timers() {
 
-  // Update all timers.
-  for (const auto& kvp: timers) {
+  const uint32_t now = System::now();
+
+  // Timers rescheduled during this update wait for the next one,
+  // like when all timers were updated once per cycle.
+  // Some of them may still be due (a repeating timer shorter than the
+  // main loop step, or a clock sound): put them aside so that they do not
+  // hide the other due timers.
+  const uint64_t first_new_schedule_id = next_timer_schedule_id;
+  std::vector<ScheduledTimer> rescheduled_entries;
+
+  while (!timer_schedule.empty() &&
+      timer_schedule.front().date <= now) {
+
+    const ScheduledTimer entry = timer_schedule.front();
+    std::pop_heap(timer_schedule.begin(), timer_schedule.end(),
+        std::greater<ScheduledTimer>());
+    timer_schedule.pop_back();
+
+    const auto it = timers.find(entry.timer);
+    if (it == timers.end() ||
+        it->second.schedule_id != entry.schedule_id) {
+      // Outdated entry.
+      continue;
+    }
 
-    const TimerPtr& timer = kvp.first;
-    const ScopedLuaRef& callback_ref = kvp.second.callback_ref;
-    if (!callback_ref.is_empty()) {
-      // The timer is not being removed: update it.
-      timer->update();
-      if (timer->is_finished()) {
-        do_timer_callback(timer);
-      }
+    if (entry.schedule_id >= first_new_schedule_id) {
+      // Already updated during this cycle.
+      rescheduled_entries.push_back(entry);
+      continue;
+    }
+    it->second.schedule_id = 0;
+
+    // The timer is not being removed: update it.
+    const TimerPtr timer = it->second.timer;
+    timer->update();
+    if (timer->is_finished()) {
+      do_timer_callback(timer);
     }
+    schedule_timer(*timer);
+  }
+
+  for (const ScheduledTimer& entry: rescheduled_entries) {
+    timer_schedule.push_back(entry);
+    std::push_heap(timer_schedule.begin(), timer_schedule.end(),
+        std::greater<ScheduledTimer>());
   }
 
   // Destroy the ones that should be removed.
   for (const TimerPtr& timer: timers_to_remove) {
 
-    const auto& it = timers.find(timer);
-    if (it != timers.end()) {
-      timers.erase(it);
+    const auto& it = timers.find(timer.get());
+    if (it == timers.end() ||
+        !it->second.callback_ref.is_empty()) {
+      // Already removed, or restarted since.
+      continue;
+    }
 
-      Debug::check_assertion(timers.find(timer) == timers.end(),
-          "Failed to remove timer");
+    std::vector<TimerPtr>& timers_in_context = context_timers[it->second.context];
+    timers_in_context.erase(
+        std::remove(timers_in_context.begin(), timers_in_context.end(), timer),
+        timers_in_context.end()
+    );
+    if (timers_in_context.empty()) {
+      context_timers.erase(it->second.context);
     }
+    timers.erase(it);
   }
   timers_to_remove.clear();
 }
@@ -268,9 +406,10 @@ void LuaContext::update_timers() {
 void LuaContext::notify_timers_map_suspended(bool suspended) {
 
   for (const auto& kvp: timers) {
-    const TimerPtr& timer = kvp.first;
+    const TimerPtr& timer = kvp.second.timer;
     if (timer->is_suspended_with_map()) {
       timer->notify_map_suspended(suspended);
+      schedule_timer(*timer);
     }
   }
 }
@@ -287,11 +426,14 @@ void LuaContext::set_entity_timers_suspended(
     MapEntity& entity, bool suspended
 ) {
 
-  for (const auto& kvp: timers) {
-    const TimerPtr& timer = kvp.first;
-    if (kvp.second.context == &entity) {
-      timer->set_suspended(suspended);
-    }
+  const auto it = context_timers.find(&entity);
+  if (it == context_timers.end()) {
+    return;
+  }
+
+  for (const TimerPtr& timer: it->second) {
+    timer->set_suspended(suspended);
+    schedule_timer(*timer);
   }
 }
 
@@ -309,11 +451,10 @@ void LuaContext::do_timer_callback(const TimerPtr& timer) {
 
   Debug::check_assertion(timer->is_finished(), "This timer is still running");
 
-  auto it = timers.find(timer);
+  auto it = timers.find(timer.get());
   if (it != timers.end() &&
       !it->second.callback_ref.is_empty()) {
-    ScopedLuaRef& callback_ref = it->second.callback_ref;
-    push_ref(l, callback_ref);
+    push_ref(l, it->second.callback_ref);
     const bool success = call_function(0, 1, "timer callback");
 
     bool repeat = false;
@@ -322,6 +463,14 @@ void LuaContext::do_timer_callback(const TimerPtr& timer) {
       lua_pop(l, 1);
     }
 
+    // The callback may have created timers: find this one again.
+    it = timers.find(timer.get());
+    if (it == timers.end() ||
+        it->second.callback_ref.is_empty()) {
+      // The callback stopped the timer.
+      return;
+    }
+
     if (repeat) {
       // The callback returned true: reschedule the timer.
       timer->set_expiration_date(timer->get_expiration_date() + timer->get_initial_duration());
@@ -330,10 +479,12 @@ void LuaContext::do_timer_callback(const TimerPtr& timer) {
         // the main loop stepsize.
         do_timer_callback(timer);
       }
+      else {
+        schedule_timer(*timer);
+      }
     }
     else {
-      callback_ref.clear();
-      timers_to_remove.push_back(timer);
+      cancel_timer(it->second);
     }
   }
 }
@@ -453,6 +604,7 @@ int LuaContext::timer_api_set_with_sound(lua_State* l) {
     bool with_sound = LuaTools::opt_boolean(l, 2, true);
 
     timer->set_with_sound(with_sound);
+    get_lua_context(l).schedule_timer(*timer);
 
     return 0;
   });
@@ -485,6 +637,7 @@ int LuaContext::timer_api_set_suspended(lua_State* l) {
     bool suspended = LuaTools::opt_boolean(l, 2, true);
 
     timer->set_suspended(suspended);
+    get_lua_context(l).schedule_timer(*timer);
 
     return 0;
   });
@@ -525,6 +678,7 @@ int LuaContext::timer_api_set_suspended_with_map(lua_State* l) {
       // If the game is running, suspend/resume the timer like the map.
       timer->notify_map_suspended(game->get_current_map().is_suspended());
     }
+    lua_context.schedule_timer(*timer);
 
     return 0;
   });
@@ -541,7 +695,7 @@ int LuaContext::timer_api_get_remaining_time(lua_State* l) {
     const TimerPtr& timer = check_timer(l, 1);
 
     LuaContext& lua_context = get_lua_context(l);
-    const auto it = lua_context.timers.find(timer);
+    const auto it = lua_context.timers.find(timer.get());
     if (it == lua_context.timers.end() ||
         it->second.callback_ref.is_empty()) {
       // This timer is already finished or was canceled.
@@ -570,7 +724,7 @@ int LuaContext::timer_api_set_remaining_time(lua_State* l) {
     uint32_t remaining_time = LuaTools::check_int(l, 2);
 
     LuaContext& lua_context = get_lua_context(l);
-    const auto it = lua_context.timers.find(timer);
+    const auto it = lua_context.timers.find(timer.get());
     if (it != lua_context.timers.end() &&
         !it->second.callback_ref.is_empty()) {
       // The timer is still active.
@@ -581,6 +735,9 @@ int LuaContext::timer_api_set_remaining_time(lua_State* l) {
         // Execute the callback now.
         lua_context.do_timer_callback(timer);
       }
+      else {
+        lua_context.schedule_timer(*timer);
+      }
     }
 
     return 0;
@@ -0,0 +1,781 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/CustomEntity.h"
+#include "solarus/entities/MapEntities.h"
+#include "solarus/entities/NonAnimatedRegions.h"
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/ImageCache.h"
+#include "solarus/lowlevel/Profiler.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lowlevel/Random.h"
+#include "solarus/lowlevel/Sound.h"
+#include "solarus/lowlevel/TextureAtlas.h"
+#include "solarus/movements/FlowField.h"
+#include "solarus/movements/PathFinding.h"
+#include "solarus/movements/RandomMovement.h"
+#include "solarus/Arguments.h"
+#include "solarus/EntityData.h"
+#include "solarus/Game.h"
+#include "solarus/GameCommands.h"
+#include "solarus/Map.h"
+#include "solarus/MapCache.h"
+#include "solarus/MapData.h"
+#include "solarus/MainLoop.h"
+#include "solarus/Savegame.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief A game command pressed or released at a given tick.
+ */
+struct ScriptedCommand {
+  int tick;              /**< Tick when the command happens, from the start of the measures. */
+  GameCommand command;   /**< The game command. */
+  bool pressed;          /**< \c true for a press, \c false for a release. */
+};
+
+/**
+ * \brief Statistics of a measure over all ticks.
+ */
+struct Statistics {
+  uint64_t total = 0;    /**< Sum of all ticks in nanoseconds. */
+  uint64_t max = 0;      /**< Slowest tick in nanoseconds. */
+
+  void add(uint64_t value) {
+    total += value;
+    max = std::max(max, value);
+  }
+};
+
+/**
+ * \brief Reads a command script.
+ *
+ * Each non-empty line has the form "<tick> press|release <command>",
+ * for example "120 press right". Lines starting with '#' are ignored.
+ *
+ * \param file_name The script file, relative to the working directory.
+ * \return The commands sorted by tick.
+ */
+std::vector<ScriptedCommand> load_command_script(const std::string& file_name) {
+
+  std::ifstream file(file_name);
+  if (!file) {
+    Debug::die("Cannot open command script '" + file_name + "'");
+  }
+
+  std::vector<ScriptedCommand> commands;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    std::istringstream iss(line);
+    int tick = 0;
+    std::string action;
+    std::string command_name;
+    if (!(iss >> tick >> action >> command_name) ||
+        (action != "press" && action != "release")) {
+      std::ostringstream oss;
+      oss << file_name << ":" << line_number << ": syntax error";
+      Debug::die(oss.str());
+    }
+
+    const GameCommand command = GameCommands::get_command_by_name(command_name);
+    if (command == GameCommand::NONE) {
+      std::ostringstream oss;
+      oss << file_name << ":" << line_number << ": no such game command: '"
+          << command_name << "'";
+      Debug::die(oss.str());
+    }
+    commands.push_back({ tick, command, action == "press" });
+  }
+
+  std::stable_sort(commands.begin(), commands.end(),
+      [](const ScriptedCommand& a, const ScriptedCommand& b) {
+    return a.tick < b.tick;
+  });
+  return commands;
+}
+
+/**
+ * \brief Returns the value of an option as an unsigned integer.
+ *
+ * A warning is printed if the value is not a valid number.
+ *
+ * \param args Command-line arguments.
+ * \param key The option.
+ * \param default_value The value to return if the option is missing
+ * or invalid.
+ * \return The value of the option.
+ */
+unsigned int get_unsigned_argument(
+    const Arguments& args, const std::string& key, unsigned int default_value) {
+
+  const size_t value = args.get_argument_size(key, default_value);
+  if (value > std::numeric_limits<unsigned int>::max()) {
+    Debug::warning("Invalid value for option " + key + ": too big");
+    return default_value;
+  }
+  return static_cast<unsigned int>(value);
+}
+
+/**
+ * \brief Returns the value of an option as a number of things to do.
+ *
+ * A warning is printed if the value is not a valid number.
+ *
+ * \param args Command-line arguments.
+ * \param key The option.
+ * \param default_value The value to return if the option is missing
+ * or invalid.
+ * \return The value of the option.
+ */
+int get_count_argument(
+    const Arguments& args, const std::string& key, int default_value) {
+
+  const size_t value = args.get_argument_size(key, default_value);
+  if (value > static_cast<size_t>(std::numeric_limits<int>::max())) {
+    Debug::warning("Invalid value for option " + key + ": too big");
+    return default_value;
+  }
+  return static_cast<int>(value);
+}
+
+/**
+ * \brief Writes the statistics of a measure as a JSON object.
+ * \param out Where to write.
+ * \param statistics The statistics.
+ * \param num_ticks Number of ticks measured.
+ */
+void write_statistics(std::ostream& out, const Statistics& statistics, int num_ticks) {
+
+  out << "{ \"total_ms\": " << statistics.total / 1.0e6
+      << ", \"mean_us\": " << (num_ticks > 0 ? statistics.total / 1.0e3 / num_ticks : 0.0)
+      << ", \"max_us\": " << statistics.max / 1.0e3
+      << " }";
+}
+
+/**
+ * \brief Returns a string as a JSON string literal.
+ * \param value The string.
+ * \return The quoted and escaped string.
+ */
+std::string to_json_string(const std::string& value) {
+
+  std::string result = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+/**
+ * \brief Adds entities to the current map, to measure their update time.
+ *
+ * One entity out of four gets a random movement, the other ones stay
+ * still. They have no sprite and no model.
+ *
+ * \param game The current game.
+ * \param num_entities Number of entities to create.
+ */
+void add_bench_entities(Game& game, int num_entities) {
+
+  Map& map = game.get_current_map();
+  for (int i = 0; i < num_entities; ++i) {
+    std::shared_ptr<CustomEntity> entity = std::make_shared<CustomEntity>(
+        game, "", 0, static_cast<Layer>(Random::get_number(LAYER_NB)),
+        Point(Random::get_number(8, std::max(9, map.get_width() - 8)),
+            Random::get_number(13, std::max(14, map.get_height() - 3))),
+        Size(16, 16), "", ""
+    );
+    if (i % 4 == 0) {
+      entity->set_movement(std::make_shared<RandomMovement>(32, 48));
+    }
+    map.get_entities().add_entity(entity);
+  }
+}
+
+/**
+ * \brief Compares the sorting of entities drawn in y order
+ * as a list, like before, and as a vector, like the engine does now.
+ *
+ * Each frame, about one entity out of ten moves by up to 2 pixels
+ * vertically, then both containers are sorted again.
+ * The entities are not added to the map: only their position is used.
+ *
+ * \param out Where to write the results, as a JSON array.
+ * \param game The current game.
+ */
+void bench_y_order(std::ostream& out, Game& game) {
+
+  using Clock = std::chrono::steady_clock;
+  const int num_frames = 200;
+  const int sizes[] = { 50, 500, 5000 };
+
+  out << "[";
+  for (int num_entities : sizes) {
+
+    std::vector<std::shared_ptr<CustomEntity>> entities;
+    std::list<MapEntity*> list;
+    std::vector<MapEntity*> vector;
+    for (int i = 0; i < num_entities; ++i) {
+      std::shared_ptr<CustomEntity> entity = std::make_shared<CustomEntity>(
+          game, "", 0, LAYER_LOW,
+          Point(Random::get_number(0, 1024), Random::get_number(0, 1024)),
+          Size(16, 16), "", ""
+      );
+      list.push_back(entity.get());
+      vector.push_back(entity.get());
+      entities.push_back(entity);
+    }
+    list.sort(MapEntities::compare_y);
+    MapEntities::sort_y_order(vector);
+
+    uint64_t list_time = 0;
+    uint64_t vector_time = 0;
+    for (int frame = 0; frame < num_frames; ++frame) {
+
+      for (const std::shared_ptr<CustomEntity>& entity : entities) {
+        if (Random::get_number(10) == 0) {
+          entity->set_y(entity->get_y() + Random::get_number(-2, 3));
+        }
+      }
+
+      Clock::time_point start = Clock::now();
+      list.sort(MapEntities::compare_y);
+      list_time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - start).count();
+
+      start = Clock::now();
+      MapEntities::sort_y_order(vector);
+      vector_time += std::chrono::duration_cast<std::chrono::nanoseconds>(
+          Clock::now() - start).count();
+    }
+
+    out << (num_entities == sizes[0] ? "\n" : ",\n")
+        << "    { \"entities\": " << num_entities
+        << ", \"list_sort_us\": " << list_time / 1.0e3 / num_frames
+        << ", \"vector_sort_us\": " << vector_time / 1.0e3 / num_frames
+        << " }";
+  }
+  out << "\n  ]";
+}
+
+constexpr int maze_size = 31;  /**< Cells on each side of the benchmark maze. */
+
+/**
+ * \brief Returns where to place an entity on a cell of the benchmark maze.
+ * \param cell Coordinates of the cell, in cells.
+ * \return The origin point of a 16x16 custom entity on this cell.
+ */
+Point get_maze_cell_xy(const Point& cell) {
+
+  return Point((cell.x * 2 + 1) * 16 + 8, (cell.y * 2 + 1) * 16 + 13);
+}
+
+/**
+ * \brief Returns a random cell of the benchmark maze near another one.
+ * \param cell A cell of the maze.
+ * \return A cell at most 6 cells away horizontally plus vertically,
+ * so that paths to it are not rejected as too far by PathFinding.
+ */
+Point get_random_maze_cell_near(const Point& cell) {
+
+  const int dx = Random::get_number(-6, 7);
+  const int dy = Random::get_number(-6 + std::abs(dx), 7 - std::abs(dx));
+  return Point(
+      std::min(std::max(cell.x + dx, 0), maze_size - 1),
+      std::min(std::max(cell.y + dy, 0), maze_size - 1)
+  );
+}
+
+/**
+ * \brief Generates a maze map and loads it, for the path finding and chaser benchmarks.
+ *
+ * The maze has maze_size * maze_size cells of 16x16 pixels separated by
+ * walls of 16 pixels. It is built with a randomized depth-first search,
+ * then one inner wall out of ten is opened so that cells are connected
+ * by several paths, like on real maps.
+ * Walls are tiles of the first 8x8 or 16x16 wall pattern of the tileset
+ * of the current map. The floor is the default ground of the low layer.
+ *
+ * \param game The current game.
+ * \return The loaded maze map, or nullptr if the tileset has no suitable
+ * wall pattern.
+ */
+std::shared_ptr<Map> load_bench_maze(Game& game) {
+
+  const std::string& tileset_id = game.get_current_map().get_tileset_id();
+  TilesetData tileset_data;
+  if (!tileset_data.import_from_quest_file("tilesets/" + tileset_id + ".dat")) {
+    return nullptr;
+  }
+
+  std::string wall_pattern_id;
+  for (const auto& kvp : tileset_data.get_patterns()) {
+    const TilePatternData& pattern = kvp.second;
+    const Rectangle& frame = pattern.get_frame();
+    if (pattern.get_ground() == Ground::WALL &&
+        !pattern.is_multi_frame() &&
+        pattern.get_scrolling() == TileScrolling::NONE &&
+        16 % frame.get_width() == 0 &&
+        16 % frame.get_height() == 0) {
+      wall_pattern_id = kvp.first;
+      break;
+    }
+  }
+  if (wall_pattern_id.empty()) {
+    Debug::warning("No 8x8 or 16x16 wall pattern in tileset '" + tileset_id +
+        "': cannot build the benchmark maze");
+    return nullptr;
+  }
+
+  // Squares of 16x16 pixels: cells have odd coordinates, walls are between them.
+  const int num_squares = maze_size * 2 + 1;
+  std::vector<bool> walls(num_squares * num_squares, true);
+  const Point offsets[] = { { 1, 0 }, { 0, -1 }, { -1, 0 }, { 0, 1 } };
+  std::vector<Point> stack = { Point(0, 0) };
+  walls[num_squares + 1] = false;
+  while (!stack.empty()) {
+
+    const Point cell = stack.back();
+    Point neighbours[4];
+    int num_neighbours = 0;
+    for (const Point& offset : offsets) {
+      const Point neighbour = cell + offset;
+      if (neighbour.x >= 0 && neighbour.x < maze_size &&
+          neighbour.y >= 0 && neighbour.y < maze_size &&
+          walls[(neighbour.y * 2 + 1) * num_squares + neighbour.x * 2 + 1]) {
+        neighbours[num_neighbours++] = neighbour;
+      }
+    }
+    if (num_neighbours == 0) {
+      stack.pop_back();
+      continue;
+    }
+
+    const Point& next = neighbours[Random::get_number(num_neighbours)];
+    walls[(cell.y + next.y + 1) * num_squares + cell.x + next.x + 1] = false;
+    walls[(next.y * 2 + 1) * num_squares + next.x * 2 + 1] = false;
+    stack.push_back(next);
+  }
+
+  for (int y = 1; y < num_squares - 1; ++y) {
+    for (int x = 1; x < num_squares - 1; ++x) {
+      if (x % 2 != y % 2 && Random::get_number(10) == 0) {
+        walls[y * num_squares + x] = false;
+      }
+    }
+  }
+
+  const std::string map_id = "bench/maze";
+  std::shared_ptr<MapData> data = std::make_shared<MapData>();
+  data->set_size(Size(num_squares * 16, num_squares * 16));
+  data->set_tileset_id(tileset_id);
+  for (int y = 0; y < num_squares; ++y) {
+    for (int x = 0; x < num_squares; ++x) {
+      if (walls[y * num_squares + x]) {
+        EntityData tile(EntityType::TILE);
+        tile.set_xy(Point(x * 16, y * 16));
+        tile.set_string("pattern", wall_pattern_id);
+        data->add_entity(tile);
+      }
+    }
+  }
+  game.get_map_cache().add_map(map_id, data);
+
+  std::shared_ptr<Map> maze = std::make_shared<Map>(map_id);
+  maze->load(game);
+  return maze;
+}
+
+/**
+ * \brief Measures A* path queries between random cells of the maze.
+ *
+ * Targets are close enough to be accepted by PathFinding,
+ * but the walls often force longer paths.
+ *
+ * \param out Where to write the results, as a JSON object.
+ * \param game The current game.
+ * \param maze The benchmark maze.
+ * \param num_queries Number of paths to compute.
+ */
+void bench_path_finding(std::ostream& out, Game& game, Map& maze, int num_queries) {
+
+  using Clock = std::chrono::steady_clock;
+
+  std::shared_ptr<CustomEntity> source = std::make_shared<CustomEntity>(
+      game, "", 0, LAYER_LOW, get_maze_cell_xy(Point(0, 0)), Size(16, 16), "", ""
+  );
+  std::shared_ptr<CustomEntity> target = std::make_shared<CustomEntity>(
+      game, "", 0, LAYER_LOW, get_maze_cell_xy(Point(0, 0)), Size(16, 16), "", ""
+  );
+  maze.get_entities().add_entity(source);
+  maze.get_entities().add_entity(target);
+
+  Statistics statistics;
+  int num_found = 0;
+  for (int i = 0; i < num_queries; ++i) {
+
+    const Point source_cell(Random::get_number(maze_size), Random::get_number(maze_size));
+    source->set_xy(get_maze_cell_xy(source_cell));
+    target->set_xy(get_maze_cell_xy(get_random_maze_cell_near(source_cell)));
+
+    const Clock::time_point start = Clock::now();
+    PathFinding path_finding(maze, *source, *target);
+    const std::string& path = path_finding.compute_path();
+    statistics.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start).count());
+
+    if (!path.empty()) {
+      ++num_found;
+    }
+  }
+
+  out << "{ \"queries\": " << num_queries
+      << ", \"found\": " << num_found
+      << ", \"time\": ";
+  write_statistics(out, statistics, num_queries);
+  out << " }";
+}
+
+/**
+ * \brief Compares chasing one target with a path finding per chaser and
+ * with a flow field shared by all chasers.
+ *
+ * Each round, the target goes to a random cell of the maze and the
+ * chasers to cells around it. Then each chaser computes an A* path to
+ * the target, and on the other side the flow field is rebuilt once and
+ * each chaser takes its next steps from it, like PathFindingMovement does.
+ *
+ * \param out Where to write the results, as a JSON object.
+ * \param game The current game.
+ * \param maze The benchmark maze.
+ * \param num_chasers Number of entities chasing the target.
+ */
+void bench_chasers(std::ostream& out, Game& game, Map& maze, int num_chasers) {
+
+  using Clock = std::chrono::steady_clock;
+  const int num_rounds = 50;
+
+  std::shared_ptr<CustomEntity> target = std::make_shared<CustomEntity>(
+      game, "", 0, LAYER_LOW, get_maze_cell_xy(Point(0, 0)), Size(16, 16), "", ""
+  );
+  maze.get_entities().add_entity(target);
+  std::vector<std::shared_ptr<CustomEntity>> chasers;
+  for (int i = 0; i < num_chasers; ++i) {
+    std::shared_ptr<CustomEntity> chaser = std::make_shared<CustomEntity>(
+        game, "", 0, LAYER_LOW, get_maze_cell_xy(Point(0, 0)), Size(16, 16), "", ""
+    );
+    maze.get_entities().add_entity(chaser);
+    chasers.push_back(chaser);
+  }
+
+  FlowField flow_field(maze, *target);
+  Statistics path_finding_statistics;
+  Statistics flow_field_statistics;
+  int num_paths_found = 0;
+  int num_flow_paths_found = 0;
+  for (int round = 0; round < num_rounds; ++round) {
+
+    const Point target_cell(Random::get_number(maze_size), Random::get_number(maze_size));
+    target->set_xy(get_maze_cell_xy(target_cell));
+    for (const std::shared_ptr<CustomEntity>& chaser : chasers) {
+      chaser->set_xy(get_maze_cell_xy(get_random_maze_cell_near(target_cell)));
+    }
+
+    Clock::time_point start = Clock::now();
+    for (const std::shared_ptr<CustomEntity>& chaser : chasers) {
+      PathFinding path_finding(maze, *chaser, *target);
+      if (!path_finding.compute_path().empty()) {
+        ++num_paths_found;
+      }
+    }
+    path_finding_statistics.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start).count());
+
+    start = Clock::now();
+    flow_field.update();
+    for (const std::shared_ptr<CustomEntity>& chaser : chasers) {
+      if (!flow_field.compute_path(*chaser, 4).empty()) {
+        ++num_flow_paths_found;
+      }
+    }
+    flow_field_statistics.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start).count());
+  }
+
+  out << "{ \"chasers\": " << num_chasers
+      << ", \"rounds\": " << num_rounds
+      << ",\n    \"path_finding\": { \"found\": " << num_paths_found << ", \"time\": ";
+  write_statistics(out, path_finding_statistics, num_rounds);
+  out << " },\n    \"flow_field\": { \"found\": " << num_flow_paths_found << ", \"time\": ";
+  write_statistics(out, flow_field_statistics, num_rounds);
+  out << " } }";
+}
+
+/**
+ * \brief Runs the benchmark.
+ * \param args Command-line arguments.
+ * \return The exit status of the program.
+ */
+int run_bench(Arguments args) {
+
+  // No window and no sound by default: build machines have none.
+  if (!args.has_argument("-bench-video") && !args.has_argument("-no-video")) {
+    args.add_argument("-no-video");
+  }
+  if (!args.has_argument("-bench-audio") && !args.has_argument("-no-audio")) {
+    args.add_argument("-no-audio");
+  }
+
+  const int num_ticks = get_count_argument(args, "-bench-ticks", 1000);
+  const unsigned int seed = get_unsigned_argument(args, "-bench-seed", 0);
+  std::string savegame_file_name = args.get_argument_value("-bench-savegame");
+  if (savegame_file_name.empty()) {
+    savegame_file_name = "bench.dat";
+  }
+  const std::string& map_id = args.get_argument_value("-bench-map");
+  const std::string& destination_name = args.get_argument_value("-bench-destination");
+  const std::string& script_file_name = args.get_argument_value("-bench-script");
+  const std::string& output_file_name = args.get_argument_value("-bench-output");
+  const bool y_order_enabled = args.has_argument("-bench-y-order");
+  const int num_entities = get_count_argument(args, "-bench-entities", 0);
+  const int num_path_queries = get_count_argument(args, "-bench-paths", 0);
+  const int num_chasers = get_count_argument(args, "-bench-chasers", 0);
+
+  std::vector<ScriptedCommand> commands;
+  if (!script_file_name.empty()) {
+    commands = load_command_script(script_file_name);
+  }
+
+  Random::set_seed(seed);
+  MainLoop main_loop(args);
+
+  using Clock = std::chrono::steady_clock;
+
+  // Measure the preloading of sounds, which is part of the startup time
+  // of most quests. This does nothing without -bench-audio, or if the
+  // quest already preloaded them when it started.
+  const Clock::time_point sound_preload_start = Clock::now();
+  Sound::load_all();
+  const double sound_preload_time = std::chrono::duration<double, std::milli>(
+      Clock::now() - sound_preload_start).count();
+
+  // Start the game directly, without the title screens of the quest.
+  std::shared_ptr<Savegame> savegame = std::make_shared<Savegame>(
+      main_loop, savegame_file_name
+  );
+  savegame->initialize();
+  if (!map_id.empty()) {
+    savegame->set_string(Savegame::KEY_STARTING_MAP, map_id);
+    savegame->set_string(Savegame::KEY_STARTING_POINT, destination_name);
+  }
+  main_loop.set_game(new Game(main_loop, savegame));
+
+  // The first step starts the game and loads the map: don't measure it.
+  main_loop.step();
+  if (main_loop.get_game() == nullptr || !main_loop.get_game()->has_current_map()) {
+    Debug::die("Failed to start the game");
+  }
+  if (num_entities > 0) {
+    add_bench_entities(*main_loop.get_game(), num_entities);
+  }
+
+  Profiler::set_enabled(true);
+  Statistics phase_statistics[Profiler::num_phases];
+  Statistics tick_statistics;
+  uint64_t previous_times[Profiler::num_phases] = { };
+  size_t next_command_index = 0;
+  int tick = 0;
+
+  Profiler::reset();
+  for (tick = 0; tick < num_ticks && !main_loop.is_exiting(); ++tick) {
+
+    const Clock::time_point tick_start = Clock::now();
+
+    Game* game = main_loop.get_game();
+    while (next_command_index < commands.size() &&
+        commands[next_command_index].tick <= tick) {
+      const ScriptedCommand& command = commands[next_command_index];
+      if (game != nullptr) {
+        if (command.pressed) {
+          game->simulate_command_pressed(command.command);
+        }
+        else {
+          game->simulate_command_released(command.command);
+        }
+      }
+      ++next_command_index;
+    }
+
+    main_loop.step();
+    main_loop.draw();
+
+    const uint64_t tick_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - tick_start).count();
+    tick_statistics.add(tick_time);
+
+    for (int i = 0; i < Profiler::num_phases; ++i) {
+      const uint64_t phase_time = Profiler::get_time(static_cast<Profiler::Phase>(i));
+      phase_statistics[i].add(phase_time - previous_times[i]);
+      previous_times[i] = phase_time;
+    }
+  }
+  Profiler::set_enabled(false);
+
+  // The generated maze goes through the map cache: count what happened before.
+  const int map_cache_hits = main_loop.get_game() != nullptr ?
+      main_loop.get_game()->get_map_cache().get_num_hits() : 0;
+  const int map_cache_misses = main_loop.get_game() != nullptr ?
+      main_loop.get_game()->get_map_cache().get_num_misses() : 0;
+
+  // Micro-benchmarks, once the measured ticks are over.
+  std::ostringstream micro_results;
+  if (y_order_enabled && main_loop.get_game() != nullptr) {
+    micro_results << "  \"y_order\": ";
+    bench_y_order(micro_results, *main_loop.get_game());
+    micro_results << ",\n";
+  }
+  if ((num_path_queries > 0 || num_chasers > 0) && main_loop.get_game() != nullptr) {
+    Game& game = *main_loop.get_game();
+    const std::shared_ptr<Map>& maze = load_bench_maze(game);
+    if (maze != nullptr) {
+      if (num_path_queries > 0) {
+        micro_results << "  \"path_finding\": ";
+        bench_path_finding(micro_results, game, *maze, num_path_queries);
+        micro_results << ",\n";
+      }
+      if (num_chasers > 0) {
+        micro_results << "  \"chasers\": ";
+        bench_chasers(micro_results, game, *maze, num_chasers);
+        micro_results << ",\n";
+      }
+      maze->unload();
+    }
+  }
+
+  // Write the results.
+  std::ofstream output_file;
+  if (!output_file_name.empty()) {
+    output_file.open(output_file_name);
+    if (!output_file) {
+      Debug::die("Cannot write benchmark output '" + output_file_name + "'");
+    }
+  }
+  std::ostream& out = output_file_name.empty() ? std::cout : output_file;
+
+  out << "{\n";
+  out << "  \"quest\": " << to_json_string(QuestFiles::get_quest_path()) << ",\n";
+  Game* game = main_loop.get_game();
+  out << "  \"map\": " << to_json_string(game != nullptr && game->has_current_map() ?
+      game->get_current_map().get_id() : "") << ",\n";
+  out << "  \"ticks\": " << tick << ",\n";
+  out << "  \"seed\": " << seed << ",\n";
+  out << "  \"added_entities\": " << num_entities << ",\n";
+  out << "  \"sound_preload_ms\": " << sound_preload_time << ",\n";
+  out << "  \"sound_cache\": { \"hits\": " << Sound::get_num_cache_hits()
+      << ", \"misses\": " << Sound::get_num_cache_misses() << " },\n";
+  out << "  \"map_cache\": { \"hits\": " << map_cache_hits
+      << ", \"misses\": " << map_cache_misses << " },\n";
+  out << "  \"image_cache\": { \"hits\": " << ImageCache::get_num_hits()
+      << ", \"misses\": " << ImageCache::get_num_misses() << " },\n";
+  out << "  \"texture_atlas\": { \"pages\": " << TextureAtlas::get_num_pages()
+      << ", \"bytes\": " << TextureAtlas::get_memory_size()
+      << ", \"fill_ratio\": " << TextureAtlas::get_fill_ratio() << " },\n";
+  out << "  \"tile_cells\": { \"built\": " << NonAnimatedRegions::get_num_cells_built()
+      << ", \"prefetched\": " << NonAnimatedRegions::get_num_cells_prefetched()
+      << ", \"evicted\": " << NonAnimatedRegions::get_num_cells_evicted()
+      << ", \"build_us\": " << NonAnimatedRegions::get_cells_build_time()
+      << ", \"bytes\": " << NonAnimatedRegions::get_cells_size()
+      << ", \"peak_bytes\": " << NonAnimatedRegions::get_peak_cells_size() << " },\n";
+  out << micro_results.str();
+  out << "  \"tick\": ";
+  write_statistics(out, tick_statistics, tick);
+  out << ",\n";
+  out << "  \"phases\": {\n";
+  for (int i = 0; i < Profiler::num_phases; ++i) {
+    const Profiler::Phase phase = static_cast<Profiler::Phase>(i);
+    out << "    " << to_json_string(Profiler::get_phase_name(phase)) << ": ";
+    write_statistics(out, phase_statistics[i], tick);
+    out << (i < Profiler::num_phases - 1 ? ",\n" : "\n");
+  }
+  out << "  }\n";
+  out << "}" << std::endl;
+
+  return 0;
+}
+
+}
+
+}
+
+/**
+ * \brief Entry point of the benchmark runner.
+ *
+ * Usage: solarus_bench [options] [quest_path]
+ *
+ * Loads a quest, starts a game and runs a fixed number of simulation steps
+ * as fast as possible, then writes the time spent in each phase as JSON.
+ * Time is simulated, so that runs are reproducible.
+ *
+ * Options, in addition to the ones of solarus:
+ *   -bench-ticks=N              number of simulation steps to measure (default 1000)
+ *   -bench-savegame=file        savegame to start, in the quest write directory (default bench.dat)
+ *   -bench-map=id               starting map instead of the one of the savegame
+ *   -bench-destination=name     destination on this map (default: the default destination)
+ *   -bench-script=file          game commands to replay (lines "<tick> press|release <command>")
+ *   -bench-seed=N               seed of the random numbers (default 0)
+ *   -bench-output=file          where to write the results (default: standard output)
+ *   -bench-entities=N           add N entities to the map before the measures,
+ *                               to time their update on a crowded map
+ *   -bench-paths=N              also time N path finding queries in a generated maze
+ *   -bench-chasers=N            also compare N entities chasing a target in the maze
+ *                               with A* and with a shared flow field
+ *   -bench-y-order              also compare sorting 50, 500 and 5000 entities
+ *                               in y order as a list and as a vector
+ *   -bench-video                keep the window (-no-video is implied otherwise)
+ *   -bench-audio                keep the audio (-no-audio is implied otherwise)
+ *                               and measure the preloading of sounds
+ *                               (add -sound-cache=yes to use the decoded sound cache)
+ */
+int main(int argc, char** argv) {
+
+  return Solarus::run_bench(Solarus::Arguments(argc, argv));
+}
+
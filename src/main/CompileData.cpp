@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/Arguments.h"
+#include "solarus/CurrentQuest.h"
+#include "solarus/MapData.h"
+#include "solarus/ResourceType.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Compiles a map data file of the quest.
+ * \param map_id Id of the map.
+ * \return \c true in case of success.
+ */
+bool compile_map(const std::string& map_id) {
+
+  const std::string& file_name = std::string("maps/") + map_id + ".dat";
+  if (QuestFiles::data_file_get_location(file_name) != QuestFiles::LOCATION_DATA_DIRECTORY) {
+    std::cerr << "Skipping '" << file_name << "': not in a data directory" << std::endl;
+    return false;
+  }
+
+  const std::string& buffer = QuestFiles::data_file_read(file_name);
+  MapData data;
+  if (!data.import_from_buffer(buffer)) {
+    std::cerr << "Failed to load '" << file_name << "'" << std::endl;
+    return false;
+  }
+
+  std::string compiled_buffer;
+  if (!data.export_to_compiled_buffer(buffer, compiled_buffer)) {
+    std::cerr << "Failed to compile '" << file_name << "'" << std::endl;
+    return false;
+  }
+
+  // Make sure that the compiled map gives back the same data.
+  std::string lua_buffer;
+  std::string compiled_lua_buffer;
+  MapData compiled_data;
+  if (!compiled_data.import_from_compiled_buffer(buffer, compiled_buffer) ||
+      !data.export_to_buffer(lua_buffer) ||
+      !compiled_data.export_to_buffer(compiled_lua_buffer) ||
+      lua_buffer != compiled_lua_buffer) {
+    std::cerr << "Compiled map differs from '" << file_name << "'" << std::endl;
+    return false;
+  }
+
+  const std::string& output_file_name = QuestFiles::get_quest_path() + "/data/" +
+      LuaData::get_compiled_file_name(file_name);
+  std::ofstream output_file(output_file_name, std::ios::binary);
+  output_file.write(compiled_buffer.data(), compiled_buffer.size());
+  if (!output_file) {
+    std::cerr << "Cannot write '" << output_file_name << "'" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+}
+
+/**
+ * \brief Compiles the data files of a quest.
+ * \param args Command-line arguments.
+ * \return The exit status of the program.
+ */
+int compile_data(const Arguments& args) {
+
+  QuestFiles::initialize(args);
+  CurrentQuest::initialize();
+
+  int num_compiled = 0;
+  int num_errors = 0;
+  for (const auto& kvp: CurrentQuest::get_resources(ResourceType::MAP)) {
+    if (compile_map(kvp.first)) {
+      ++num_compiled;
+    }
+    else {
+      ++num_errors;
+    }
+  }
+
+  std::cout << num_compiled << " map(s) compiled, " << num_errors << " error(s)" << std::endl;
+
+  CurrentQuest::quit();
+  QuestFiles::quit();
+  return num_errors == 0 ? 0 : 1;
+}
+
+}
+
+/**
+ * \brief Entry point of the data compiler.
+ *
+ * Usage: solarus_compile_data [quest_path]
+ *
+ * Writes next to each map data file of the quest data directory a compiled
+ * version (maps/xxx.datc), that the engine loads without running Lua.
+ * The Lua files stay the reference: a compiled file is ignored as soon as
+ * its source changes, so this program only has to be run again to get the
+ * speedup back.
+ * Quests in an archive cannot be compiled: compile their data directory
+ * before making the archive.
+ */
+int main(int argc, char** argv) {
+
+  return Solarus::compile_data(Solarus::Arguments(argc, argv));
+}
+
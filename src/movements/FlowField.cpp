@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/movements/FlowField.h"
+#include "solarus/movements/PathFindingTerrain.h"
+#include "solarus/entities/MapEntities.h"
+#include "solarus/entities/MapEntity.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/Map.h"
+#include <algorithm>
+
+namespace Solarus {
+
+/**
+ * \brief Creates a flow field toward an entity.
+ *
+ * The field is built on the first call to update().
+ *
+ * \param map The map.
+ * \param target The entity to reach.
+ */
+FlowField::FlowField(Map& map, const MapEntity& target):
+  map(map),
+  target(target),
+  width8(map.get_width8()),
+  height8(map.get_height8()),
+  layer(LAYER_LOW),
+  target_node(),
+  terrain_version(0),
+  built(false),
+  distances(width8 * height8, -1),
+  reached_nodes(),
+  open_list() {
+
+}
+
+/**
+ * \brief Returns the entity this field leads to.
+ * \return The target entity.
+ */
+const MapEntity& FlowField::get_target() const {
+  return target;
+}
+
+/**
+ * \brief Rebuilds the field if the target or the terrain have changed.
+ */
+void FlowField::update() {
+
+  Point node = target.get_bounding_box().get_xy();
+  node.x = (node.x + 4) / 8 * 8;
+  node.y = (node.y + 4) / 8 * 8;
+  const Layer target_layer = target.get_layer();
+  const uint32_t version =
+      map.get_entities().get_path_finding_terrain(target_layer).get_version();
+
+  if (built &&
+      node == target_node &&
+      target_layer == layer &&
+      version == terrain_version) {
+    // Nothing has changed.
+    return;
+  }
+
+  target_node = node;
+  layer = target_layer;
+  terrain_version = version;
+  rebuild();
+  built = true;
+}
+
+/**
+ * \brief Runs the Dijkstra search from the node of the target.
+ */
+void FlowField::rebuild() {
+
+  for (int index: reached_nodes) {
+    distances[index] = -1;
+  }
+  reached_nodes.clear();
+
+  if (target_node.x < 0 || target_node.x >= width8 * 8 ||
+      target_node.y < 0 || target_node.y >= height8 * 8) {
+    // The target is outside the map: nothing is reachable.
+    return;
+  }
+
+  PathFindingTerrain& terrain = map.get_entities().get_path_finding_terrain(layer);
+
+  const int target_index = (target_node.y / 8) * width8 + target_node.x / 8;
+  distances[target_index] = 0;
+  reached_nodes.push_back(target_index);
+  open_list.push_back({ 0, target_index });
+
+  while (!open_list.empty()) {
+
+    const OpenNode open_node = open_list.front();
+    std::pop_heap(open_list.begin(), open_list.end());
+    open_list.pop_back();
+
+    const int index = open_node.index;
+    if (open_node.distance != distances[index]) {
+      // Outdated entry.
+      continue;
+    }
+
+    const int x8 = index % width8;
+    const int y8 = index / width8;
+    for (int i = 0; i < 8; ++i) {
+
+      // We go backwards: the transition to check goes from the neighbour
+      // to the current node.
+      const Point& offset = PathFindingTerrain::neighbour_offsets[i];
+      const int neighbour_x8 = x8 + offset.x / 8;
+      const int neighbour_y8 = y8 + offset.y / 8;
+      if (neighbour_x8 < 0 || neighbour_x8 >= width8 ||
+          neighbour_y8 < 0 || neighbour_y8 >= height8) {
+        continue;
+      }
+
+      const int distance = open_node.distance + ((i & 1) ? 11 : 8);
+      const int neighbour_index = neighbour_y8 * width8 + neighbour_x8;
+      if (distance > max_distance ||
+          (distances[neighbour_index] != -1 && distances[neighbour_index] <= distance)) {
+        continue;
+      }
+
+      const int direction = (i + 4) % 8;
+      if (terrain.get_transition(neighbour_x8, neighbour_y8, direction) !=
+          PathFindingTerrain::Transition::FREE) {
+        continue;
+      }
+
+      if (distances[neighbour_index] == -1) {
+        reached_nodes.push_back(neighbour_index);
+      }
+      distances[neighbour_index] = distance;
+      open_list.push_back({ distance, neighbour_index });
+      std::push_heap(open_list.begin(), open_list.end());
+    }
+  }
+}
+
+/**
+ * \brief Returns the distance from a node to the target.
+ * \param x8 X coordinate of the node (divided by 8).
+ * \param y8 Y coordinate of the node (divided by 8).
+ * \return The distance, or -1 if the target cannot be reached from there.
+ */
+int FlowField::get_distance(int x8, int y8) const {
+
+  if (x8 < 0 || x8 >= width8 || y8 < 0 || y8 >= height8) {
+    return -1;
+  }
+  return distances[y8 * width8 + x8];
+}
+
+/**
+ * \brief Follows the field from the position of an entity.
+ *
+ * The first step is also checked against dynamic obstacles, so that the
+ * entity goes around them.
+ * Later steps are checked again when the entity gets there.
+ *
+ * \param source An entity aligned on the map grid, on the layer of the
+ * field.
+ * \param max_steps Maximum length of the path.
+ * \return A path toward the target (see PathMovement), or an empty string
+ * if the field does not lead to the target from there.
+ */
+std::string FlowField::compute_path(MapEntity& source, int max_steps) const {
+
+  if (!built || source.get_layer() != layer) {
+    return "";
+  }
+
+  Point location = source.get_bounding_box().get_xy();
+  std::string path;
+  while (static_cast<int>(path.size()) < max_steps) {
+
+    const int x8 = location.x / 8;
+    const int y8 = location.y / 8;
+    const int distance = get_distance(x8, y8);
+    if (distance <= 0) {
+      // Not reachable, or arrived.
+      break;
+    }
+
+    // Take the step that leads to the shortest remaining distance.
+    int best_direction = -1;
+    int best_distance = 0;
+    for (int i = 0; i < 8; ++i) {
+      const Point& offset = PathFindingTerrain::neighbour_offsets[i];
+      const int neighbour_distance = get_distance(x8 + offset.x / 8, y8 + offset.y / 8);
+      if (neighbour_distance == -1 || neighbour_distance >= distance) {
+        continue;
+      }
+
+      const int total_distance = neighbour_distance + ((i & 1) ? 11 : 8);
+      if ((best_direction == -1 || total_distance < best_distance) &&
+          (!path.empty() || is_step_valid(source, location, i))) {
+        best_direction = i;
+        best_distance = total_distance;
+      }
+    }
+
+    if (best_direction == -1) {
+      break;
+    }
+    path += static_cast<char>('0' + best_direction);
+    location += PathFindingTerrain::neighbour_offsets[best_direction];
+  }
+  return path;
+}
+
+/**
+ * \brief Returns whether an entity can take a step now.
+ * \param source The entity.
+ * \param location Node where the entity is.
+ * \param direction Direction of the step (0 to 7).
+ * \return \c true if there is no obstacle for this step.
+ */
+bool FlowField::is_step_valid(
+    MapEntity& source, const Point& location, int direction) const {
+
+  Rectangle collision_box = PathFindingTerrain::transition_boxes[direction];
+  collision_box.add_xy(location);
+  return !map.test_collision_with_obstacles(layer, collision_box, source);
+}
+
+/**
+ * \brief Compares two entries of the priority queue.
+ *
+ * The closest node is the greatest one, as required by std::push_heap().
+ *
+ * \param other The other entry.
+ */
+bool FlowField::OpenNode::operator<(const OpenNode& other) const {
+  return distance > other.distance;
+}
+
+}
+
@@ -15,34 +15,18 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/movements/PathFinding.h"
+#include "solarus/movements/PathFindingTerrain.h"
+#include "solarus/entities/MapEntities.h"
 #include "solarus/entities/MapEntity.h"
 #include "solarus/lowlevel/Geometry.h"
+#include "solarus/lowlevel/Profiler.h"
 #include "solarus/Map.h"
 #include "solarus/lowlevel/Debug.h"
+#include <algorithm>
 
 namespace Solarus {
 
-const Point PathFinding::neighbours_locations[] = {
-  {  8,  0 },
-  {  8, -8 },
-  {  0, -8 },
-  { -8, -8 },
-  { -8,  0 },
-  { -8,  8 },
-  {  0,  8 },
-  {  8,  8 }
-};
-
-const Rectangle PathFinding::transition_collision_boxes[] = {
-  Rectangle(16,  0,  8, 16 ),
-  Rectangle( 0, -8, 24, 24 ),
-  Rectangle( 0, -8, 16,  8 ),
-  Rectangle(-8, -8, 24, 24 ),
-  Rectangle(-8,  0,  8, 16 ),
-  Rectangle(-8,  0, 24, 24 ),
-  Rectangle( 0, 16, 16,  8 ),
-  Rectangle( 0,  0, 24, 24 )
-};
+std::vector<std::unique_ptr<PathFinding::SearchData>> PathFinding::free_search_data;
 
 /**
  * \brief Constructor.
@@ -57,7 +41,8 @@ PathFinding::PathFinding(
     MapEntity& target_entity):
   map(map),
   source_entity(source_entity),
-  target_entity(target_entity) {
+  target_entity(target_entity),
+  terrain(map.get_entities().get_path_finding_terrain(source_entity.get_layer())) {
 
   Debug::check_assertion(source_entity.is_aligned_to_grid(),
       "The source must be aligned on the map grid");
@@ -70,10 +55,6 @@ PathFinding::PathFinding(
  */
 std::string PathFinding::compute_path() {
 
-  //std::cout << "will compute a path from " << source_entity.get_top_left_x() << ","
-  //  << source_entity.get_top_left_y() << " to " << target_entity.get_top_left_x() << ","
-  //  << target_entity.get_top_left_y() << std::endl;
-
   Point source = source_entity.get_bounding_box().get_xy();
   Point target = target_entity.get_bounding_box().get_xy();
 
@@ -81,192 +62,208 @@ std::string PathFinding::compute_path() {
   target.x += -target.x % 8;
   target.y += 4;
   target.y += -target.y % 8;
-  const int target_index = get_square_index(target);
 
   Debug::check_assertion(target.x % 8 == 0 && target.y % 8 == 0,
       "Could not snap the target to the map grid");
 
   const int total_mdistance = Geometry::get_manhattan_distance(source, target);
   if (total_mdistance > 200 || target_entity.get_layer() != source_entity.get_layer()) {
-    //std::cout << "too far, not computing a path\n";
     return ""; // too far to compute a path
   }
 
-  std::string path = "";
+  const int width8 = map.get_width8();
+  const int height8 = map.get_height8();
+  if (source.x < 0 || source.x >= width8 * 8 ||
+      source.y < 0 || source.y >= height8 * 8) {
+    return "";
+  }
+  const int source_index = (source.y / 8) * width8 + source.x / 8;
+  const int target_index = (target.y / 8) * width8 + target.x / 8;
+
+  std::unique_ptr<SearchData> data = acquire_search_data();
+  std::vector<Node>& nodes = data->nodes;
+  std::vector<OpenNode>& open_list = data->open_list;
+  if (nodes.size() < static_cast<size_t>(width8 * height8)) {
+    nodes.resize(width8 * height8, Node());
+  }
+  if (++data->generation == 0) {
+    // All generation numbers were used: start again from a clean state.
+    std::fill(nodes.begin(), nodes.end(), Node());
+    data->generation = 1;
+  }
+  const uint32_t generation = data->generation;
+  uint32_t order = 0;
 
-  Node starting_node;
-  const int index = get_square_index(source);
-  starting_node.location = source;
-  starting_node.index = index;
+  Node& starting_node = nodes[source_index];
+  starting_node.generation = generation;
   starting_node.previous_cost = 0;
-  starting_node.heuristic = total_mdistance;
-  starting_node.total_cost = total_mdistance;
-  starting_node.direction = ' ';
   starting_node.parent_index = -1;
+  starting_node.direction = ' ';
+  starting_node.closed = false;
+  open_list.push_back({ total_mdistance, order++, source_index });
 
-  open_list[index] = starting_node;
-  open_list_indices.push_front(index);
-
-  bool finished = false;
-  while (!finished) {
+  std::string path;
+  while (!open_list.empty()) {
 
     // pick the node with the lowest total cost in the open list
-    const int index = open_list_indices.front();
-    Node* current_node = &open_list[index];
-    open_list_indices.pop_front();
-    closed_list[index] = *current_node;
-    open_list.erase(index);
-    current_node = &closed_list[index];
-
-    //std::cout << System::now() << " picking the lowest cost node in the open list ("
-    //  << (open_list_indices.size() + 1) << " elements): "
-    //  << current_node->location << ", index = " << current_node->index
-    //  << ", cost = " << current_node->previous_cost << " + " << current_node->heuristic << "\n";
+    const OpenNode open_node = open_list.front();
+    std::pop_heap(open_list.begin(), open_list.end());
+    open_list.pop_back();
+
+    const int index = open_node.index;
+    Node& current_node = nodes[index];
+    if (current_node.closed) {
+      // Outdated entry: this node was reached later with a better cost.
+      continue;
+    }
+    current_node.closed = true;
 
     if (index == target_index) {
-      //std::cout << "target node was added to the closed list\n";
-      finished = true;
-      path = rebuild_path(current_node);
-      //std::cout << "rebuild done\n";
+      path = rebuild_path(*data, index);
+      break;
     }
-    else {
-      // look at the accessible nodes from it
-      //std::cout << System::now() << " looking for accessible states\n";
-      for (int i = 0; i < 8; i++) {
-
-        Node new_node;
-        const int immediate_cost = (i & 1) ? 11 : 8;
-        new_node.previous_cost = current_node->previous_cost + immediate_cost;
-        new_node.location = current_node->location;
-        new_node.location += neighbours_locations[i];
-        new_node.index = get_square_index(new_node.location);
-        //std::cout << "  node in direction " << i << ": index = " << new_node.index << std::endl;
-
-        const bool in_closed_list = (closed_list.find(new_node.index) != closed_list.end());
-        if (!in_closed_list && Geometry::get_manhattan_distance(new_node.location, target) < 200
-            && is_node_transition_valid(*current_node, i)) {
-          //std::cout << "  node in direction " << i << " is not in the closed list\n";
-          // not in the closed list: look in the open list
-
-          const bool in_open_list = open_list.find(new_node.index) != open_list.end();
-
-          if (!in_open_list) {
-            // not in the open list: add it
-            new_node.heuristic = Geometry::get_manhattan_distance(new_node.location, target);
-            new_node.total_cost = new_node.previous_cost + new_node.heuristic;
-            new_node.parent_index = index;
-            new_node.direction = '0' + i;
-            open_list[new_node.index] = new_node;
-            add_index_sorted(&open_list[new_node.index]);
-            //std::cout << "  node in direction " << i << " is not in the open list, adding it with cost "
-            //  << new_node.previous_cost << " (" << current_node->previous_cost << " + "
-            //  << immediate_cost << ") + " << new_node.heuristic << " and parent " << new_node.parent_index << "\n";
-          }
-          else {
-            //std::cout << "  node in direction " << i << " is already in the open list\n";
-            Node* existing_node = &open_list[new_node.index];
-            // already in the open list: see if the current path is better
-            if (new_node.previous_cost < existing_node->previous_cost) {
-              existing_node->previous_cost = new_node.previous_cost;
-              existing_node->total_cost = existing_node->previous_cost + existing_node->heuristic;
-              existing_node->parent_index = index;
-              open_list_indices.sort();
-            }
-          }
-        }
-        else {
-          //std::cout << "skipping node in direction " << i << ": already in closed list = "
-          //  << in_closed_list << ", too far from target = "
-          //  << (get_manhattan_distance(new_node.location, target) >= 200) << ", invalid transition = "
-          //  << (!is_node_transition_valid(*current_node, i)) << std::endl;
-        }
+
+    // look at the accessible nodes from it
+    const Point location((index % width8) * 8, (index / width8) * 8);
+    for (int i = 0; i < 8; i++) {
+
+      const Point new_location = location + PathFindingTerrain::neighbour_offsets[i];
+      if (new_location.x < 0 || new_location.x >= width8 * 8 ||
+          new_location.y < 0 || new_location.y >= height8 * 8) {
+        // Outside the map: the transition would be invalid anyway.
+        continue;
+      }
+
+      const int new_index = (new_location.y / 8) * width8 + new_location.x / 8;
+      Node& new_node = nodes[new_index];
+      const bool visited = new_node.generation == generation;
+      if (visited && new_node.closed) {
+        continue;
       }
-      if (open_list_indices.empty()) {
-        finished = true;
+
+      const int immediate_cost = (i & 1) ? 11 : 8;
+      const int previous_cost = current_node.previous_cost + immediate_cost;
+      if (visited && previous_cost >= new_node.previous_cost) {
+        // Already in the open list with a better path.
+        continue;
+      }
+
+      const int heuristic = Geometry::get_manhattan_distance(new_location, target);
+      if (heuristic >= 200 || !is_node_transition_valid(location, i)) {
+        continue;
       }
+
+      new_node.generation = generation;
+      new_node.previous_cost = previous_cost;
+      new_node.parent_index = index;
+      new_node.direction = '0' + i;
+      new_node.closed = false;
+      open_list.push_back({ previous_cost + heuristic, order++, new_index });
+      std::push_heap(open_list.begin(), open_list.end());
     }
   }
 
-  //std::cout << "path found: " << path << ", open nodes: " << open_list.size() << ", closed nodes: " << closed_list.size() << std::endl;
+  open_list.clear();
+  release_search_data(std::move(data));
   return path;
 }
 
 /**
- * \brief Returns the index of the 8*8 square in the map
- * corresponding to the specified location.
- * \param location location of a node on the map
- * \return index of the square corresponding to the top-left part of the location
+ * \brief Compares two entries of the open list.
+ *
+ * The entry with the highest priority is the greatest one, as required by
+ * std::push_heap(): the lowest total cost, and the last added one for equal
+ * costs.
+ *
+ * \param other the other entry
  */
-int PathFinding::get_square_index(const Point& location) const {
+bool PathFinding::OpenNode::operator<(const OpenNode& other) const {
 
-  const int x8 = location.x / 8;
-  const int y8 = location.y / 8;
-  return y8 * map.get_width8() + x8;
+  if (total_cost != other.total_cost) {
+    return total_cost > other.total_cost;
+  }
+  return order < other.order;
 }
 
 /**
- * \brief Compares two nodes according to their total estimated cost.
- * \param other the other node
+ * \brief Builds the string representation of the path found by the algorithm.
+ * \param data The nodes of the search.
+ * \param final_index Index of the final node of the path.
+ * \return The path.
  */
-bool PathFinding::Node::operator<(const Node& other) const {
-  return total_cost < other.total_cost;
+std::string PathFinding::rebuild_path(
+    const SearchData& data, int final_index) const {
+
+  std::string path;
+  int index = final_index;
+  while (data.nodes[index].direction != ' ') {
+    path += data.nodes[index].direction;
+    index = data.nodes[index].parent_index;
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
 }
 
 /**
- * \brief Adds the index of a node to the sorted list of indices of the open
- * list, making sure that the list remains sorted.
- * \param node The node.
+ * \brief Returns whether a transition between two nodes is valid, i.e.
+ * whether there is no collision with the map.
+ *
+ * The part of the test that only depends on tiles comes from the
+ * PathFindingTerrain cache.
+ *
+ * \param location location of the first node
+ * \param direction the direction to take (0 to 7)
+ * \return true if there is no collision for this transition
  */
-void PathFinding::add_index_sorted(Node* node) {
-
-  bool inserted = false;
-  for (auto it = open_list_indices.begin();
-      it != open_list_indices.end() && !inserted;
-      ++it) {
-    const int index = *it;
-    const Node* current_node = &open_list[index];
-    if (current_node->total_cost >= node->total_cost) {
-      open_list_indices.insert(it, node->index);
-      inserted = true;
-    }
+bool PathFinding::is_node_transition_valid(
+    const Point& location, int direction) const {
+
+  const Layer layer = source_entity.get_layer();
+  Rectangle collision_box = PathFindingTerrain::transition_boxes[direction];
+  collision_box.add_xy(location);
+
+  if (map.get_entities().overlaps_ground_modifiers(layer, collision_box)) {
+    // Entities may change the ground: nothing can be assumed from the tiles.
+    return !map.test_collision_with_obstacles(layer, collision_box, source_entity);
   }
 
-  if (!inserted) {
-    open_list_indices.push_back(node->index);
+  switch (terrain.get_transition(location.x / 8, location.y / 8, direction)) {
+
+  case PathFindingTerrain::Transition::BLOCKED:
+    return false;
+
+  case PathFindingTerrain::Transition::GROUND_DEPENDENT:
+    return !map.test_collision_with_obstacles(layer, collision_box, source_entity);
+
+  case PathFindingTerrain::Transition::FREE:
+    break;
   }
+
+  Profiler::ScopedPhase phase(Profiler::Phase::COLLISION);
+  return !map.test_collision_with_entities(layer, collision_box, source_entity);
 }
 
 /**
- * \brief Builds the string representation of the path found by the algorithm.
- * \param closed_list The closed list of A*.
- * \return final_node The final node of the path.
+ * \brief Returns arrays to perform a search.
+ * \return Search data from a previous search if possible.
  */
-std::string PathFinding::rebuild_path(const Node* final_node) {
-
-  const Node* current_node = final_node;
-  std::string path = "";
-  while (current_node->direction != ' ') {
-    path = current_node->direction + path;
-    current_node = &closed_list[current_node->parent_index];
-    //std::cout << "current_node: " << current_node->index << ", path = " << path << std::endl;
+std::unique_ptr<PathFinding::SearchData> PathFinding::acquire_search_data() {
+
+  if (free_search_data.empty()) {
+    return std::unique_ptr<SearchData>(new SearchData());
   }
-  return path;
+
+  std::unique_ptr<SearchData> data = std::move(free_search_data.back());
+  free_search_data.pop_back();
+  return data;
 }
 
 /**
- * \brief Returns whether a transition between two nodes is valid, i.e.
- * whether there is no collision with the map.
- * \param initial_node the first node
- * \param direction the direction to take (0 to 7)
- * \return true if there is no collision for this transition
+ * \brief Gives back arrays at the end of a search.
+ * \param data The search data to reuse in later searches.
  */
-bool PathFinding::is_node_transition_valid(
-    const Node& initial_node, int direction) const {
-
-  Rectangle collision_box = transition_collision_boxes[direction];
-  collision_box.add_xy(initial_node.location);
-
-  return !map.test_collision_with_obstacles(source_entity.get_layer(), collision_box, source_entity);
+void PathFinding::release_search_data(std::unique_ptr<SearchData> data) {
+  free_search_data.push_back(std::move(data));
 }
 
 }
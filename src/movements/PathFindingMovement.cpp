@@ -15,9 +15,12 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/movements/PathFindingMovement.h"
+#include "solarus/movements/FlowField.h"
 #include "solarus/movements/PathFinding.h"
 #include "solarus/lua/LuaContext.h"
+#include "solarus/entities/MapEntities.h"
 #include "solarus/entities/MapEntity.h"
+#include "solarus/Map.h"
 #include "solarus/lowlevel/Random.h"
 #include "solarus/lowlevel/System.h"
 #include "solarus/lowlevel/Debug.h"
@@ -31,7 +34,8 @@ namespace Solarus {
 PathFindingMovement::PathFindingMovement(int speed):
   PathMovement("", speed, false, false, true),
   target(),
-  next_recomputation_date(0) {
+  next_recomputation_date(0),
+  flow_field_enabled(false) {
 
 }
 
@@ -44,6 +48,27 @@ void PathFindingMovement::set_target(const MapEntityPtr& target) {
   next_recomputation_date = System::now() + 100;
 }
 
+/**
+ * \brief Returns whether this movement follows the flow field toward its
+ * target.
+ * \return \c true if the flow field is used, \c false if a path is
+ * computed with A* for this entity only.
+ */
+bool PathFindingMovement::is_flow_field_enabled() const {
+  return flow_field_enabled;
+}
+
+/**
+ * \brief Sets whether this movement follows the flow field toward its
+ * target.
+ * \param flow_field_enabled \c true to use the flow field shared by all
+ * entities chasing the same target, \c false to compute a path with A*
+ * for this entity only.
+ */
+void PathFindingMovement::set_flow_field_enabled(bool flow_field_enabled) {
+  this->flow_field_enabled = flow_field_enabled;
+}
+
 /**
  * \brief Updates the position.
  */
@@ -80,8 +105,25 @@ void PathFindingMovement::update() {
 void PathFindingMovement::recompute_movement() {
 
   if (target != nullptr) {
+
+    std::string path;
+    FlowField* flow_field = nullptr;
+    if (flow_field_enabled) {
+      flow_field = get_entity()->get_map().get_entities().get_flow_field(*target);
+    }
+    if (flow_field != nullptr) {
+      // Only a few steps: following the field again is cheap.
+      flow_field->update();
+      path = flow_field->compute_path(*get_entity(), 4);
+      if (!path.empty()) {
+        next_recomputation_date = System::now();
+        set_path(path);
+        return;
+      }
+    }
+
     PathFinding path_finding(get_entity()->get_map(), *get_entity(), *target);
-    std::string path = path_finding.compute_path();
+    path = path_finding.compute_path();
 
     uint32_t min_delay;
     if (path.size() == 0) {
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/movements/PathFindingTerrain.h"
+#include "solarus/entities/GroundBits.h"
+#include "solarus/lowlevel/Debug.h"
+#include <algorithm>
+
+namespace Solarus {
+
+/**
+ * \brief Location of each neighbour node relative to a node.
+ */
+const Point PathFindingTerrain::neighbour_offsets[] = {
+  {  8,  0 },
+  {  8, -8 },
+  {  0, -8 },
+  { -8, -8 },
+  { -8,  0 },
+  { -8,  8 },
+  {  0,  8 },
+  {  8,  8 }
+};
+
+/**
+ * \brief Area that must be free of obstacles to go from a node to each
+ * neighbour node, relative to the location of the node.
+ */
+const Rectangle PathFindingTerrain::transition_boxes[] = {
+  Rectangle(16,  0,  8, 16 ),
+  Rectangle( 0, -8, 24, 24 ),
+  Rectangle( 0, -8, 16,  8 ),
+  Rectangle(-8, -8, 24, 24 ),
+  Rectangle(-8,  0,  8, 16 ),
+  Rectangle(-8,  0, 24, 24 ),
+  Rectangle( 0, 16, 16,  8 ),
+  Rectangle( 0,  0, 24, 24 )
+};
+
+/**
+ * \brief Creates a cache where no node is computed yet.
+ * \param ground_bits Wall bits of the tiles of the layer.
+ * \param width8 Number of 8x8 squares on a row of the map.
+ * \param height8 Number of 8x8 squares on a column of the map.
+ */
+PathFindingTerrain::PathFindingTerrain(
+    const GroundBits& ground_bits,
+    int width8,
+    int height8
+):
+  ground_bits(ground_bits),
+  width8(width8),
+  height8(height8),
+  nodes(width8 * height8, 0),
+  version(0) {
+
+}
+
+/**
+ * \brief Returns what the tiles say about a transition.
+ * \param x8 X coordinate of the node (divided by 8).
+ * \param y8 Y coordinate of the node (divided by 8).
+ * \param direction Direction of the transition (0 to 7).
+ * \return The static state of this transition.
+ */
+PathFindingTerrain::Transition PathFindingTerrain::get_transition(
+    int x8, int y8, int direction) {
+
+  if (x8 < 0 || x8 >= width8 || y8 < 0 || y8 >= height8) {
+    return Transition::BLOCKED;
+  }
+
+  uint32_t& node = nodes[y8 * width8 + x8];
+  if (node == 0) {
+    node = compute_node(x8, y8);
+  }
+
+  if (node & (1 << direction)) {
+    return Transition::BLOCKED;
+  }
+  if (node & (1 << (direction + 8))) {
+    return Transition::GROUND_DEPENDENT;
+  }
+  return Transition::FREE;
+}
+
+/**
+ * \brief Forgets the cached nodes whose transitions may involve a square.
+ *
+ * Call this function when the tile ground of a square changes.
+ *
+ * \param x8 X coordinate of the square (divided by 8).
+ * \param y8 Y coordinate of the square (divided by 8).
+ */
+void PathFindingTerrain::notify_ground_changed(int x8, int y8) {
+
+  // Transition boxes go from 8 pixels before a node to 24 pixels after it.
+  const int min_x8 = std::max(x8 - 2, 0);
+  const int max_x8 = std::min(x8 + 1, width8 - 1);
+  const int min_y8 = std::max(y8 - 2, 0);
+  const int max_y8 = std::min(y8 + 1, height8 - 1);
+
+  ++version;
+
+  for (int y = min_y8; y <= max_y8; ++y) {
+    for (int x = min_x8; x <= max_x8; ++x) {
+      nodes[y * width8 + x] = 0;
+    }
+  }
+}
+
+/**
+ * \brief Returns a number that changes whenever the ground changes.
+ *
+ * This allows users of the cache to know when their own data depending on
+ * the terrain is outdated.
+ *
+ * \return The current version of the terrain.
+ */
+uint32_t PathFindingTerrain::get_version() const {
+  return version;
+}
+
+/**
+ * \brief Tests the 8 transitions of a node against the tiles.
+ * \param x8 X coordinate of the node (divided by 8).
+ * \param y8 Y coordinate of the node (divided by 8).
+ * \return The value to store for this node.
+ */
+uint32_t PathFindingTerrain::compute_node(int x8, int y8) const {
+
+  const int width = width8 * 8;
+  const int height = height8 * 8;
+  const Point location(x8 * 8, y8 * 8);
+
+  uint32_t node = COMPUTED_BIT;
+  for (int direction = 0; direction < 8; ++direction) {
+
+    Rectangle box = transition_boxes[direction];
+    box.add_xy(location);
+
+    if (box.get_x() < 0 || box.get_x() + box.get_width() > width
+        || box.get_y() < 0 || box.get_y() + box.get_height() > height
+        || ground_bits.has_wall_on_border(box)) {
+      node |= 1 << direction;
+    }
+    else if (ground_bits.has_entity_dependent_ground_on_border(box)) {
+      node |= 1 << (direction + 8);
+    }
+  }
+  return node;
+}
+
+}
+